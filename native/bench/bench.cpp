@@ -0,0 +1,98 @@
+/*!
+ * @file bench.cpp
+ */
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <algorithm>
+#include "bench.h"
+
+/************************************************************
+ * Latency Statistics
+ ************************************************************/
+uint64_t LatencyStats::percentile(double p) {
+  if (_samples.empty()) {
+    return 0;
+  }
+  if (!_sorted) {
+    std::sort(_samples.begin(), _samples.end());
+    _sorted = true;
+  }
+  size_t idx = (size_t)(p / 100.0 * (double)(_samples.size() - 1) + 0.5);
+  return _samples[idx];
+}
+
+uint64_t LatencyStats::max(void) {
+  return percentile(100.0);
+}
+
+double LatencyStats::mean(void) const {
+  if (_samples.empty()) {
+    return 0.0;
+  }
+  double sum = 0.0;
+  for (uint64_t s : _samples) {
+    sum += (double)s;
+  }
+  return sum / (double)_samples.size();
+}
+
+void LatencyStats::printHeader(void) {
+  printf("  %-28s %9s %10s %10s %10s %10s %8s %8s\n", "call", "n", "mean[us]", "p50[us]", "p99[us]", "max[us]",
+         "malloc/n", "free/n");
+}
+
+void LatencyStats::print(const char* name) {
+  double n = count() ? (double)count() : 1.0;
+  printf("  %-28s %9zu %10.2f %10.2f %10.2f %10.2f %8.2f %8.2f\n", name, count(), mean() / 1000.0,
+         percentile(50) / 1000.0, percentile(99) / 1000.0, max() / 1000.0, _allocs / n, _frees / n);
+}
+
+
+/************************************************************
+ * Helpers
+ ************************************************************/
+static uint32_t s_Failed;                  // benchCheck() failures
+
+uint64_t benchNow(void) {
+  return simNanos64();
+}
+
+void benchSection(const char* title) {
+  printf("\n### %s\n", title);
+}
+
+const char* benchCheck(bool ok, const char* error) {
+  s_Failed += !ok;
+  return ok ? "" : error;
+}
+
+
+/************************************************************
+ * Run all Benchmarks
+ ************************************************************/
+int runBenchmarks(const BenchOptions& opt) {
+  simSetSerialOutput(opt.verbose);
+  printf("HelloESP32 native benchmark\n");
+  benchLoop(opt);
+  benchReconnect(opt);
+  benchCommands(opt);
+  benchTelemetry(opt);
+  benchTimers(opt);
+  benchOutbox(opt);
+  benchTasks(opt);
+  benchIrq(opt);
+  benchMcp(opt);
+  benchRoller(opt);
+  benchLoopStats(opt);
+  benchLog(opt);
+  benchOta(opt);
+  benchProbe(opt);
+  benchIdle(opt);
+  benchRx(opt);
+  benchQos(opt);
+  if (s_Failed) {
+    printf("\n!! %u checks failed\n", s_Failed);
+  }
+  fflush(stdout);
+  return s_Failed ? 1 : 0;
+}
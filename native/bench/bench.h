@@ -0,0 +1,100 @@
+/*!
+ * @file bench.h
+ */
+/************************************************************
+ * Native Benchmarks
+ ************************************************************
+ * Run with:  .pio/build/native/program --bench
+ * Timings are taken on the virtual clock (NativeSim.h), so
+ * time skipped by delay() counts as well.
+ * A failed check prints "!! ERROR" (benchCheck), the run then
+ * exits with 1.
+ ************************************************************/
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <NativeSim.h>
+#include <SimMcp23017.h>
+
+/************************************************************
+ * Options (set from the command line)
+ ************************************************************/
+struct BenchOptions {
+  uint32_t seconds    = 2;       // wall seconds per loop-rate run
+  uint32_t calls      = 20000;   // calls per latency measurement
+  uint32_t cmdRate    = 200;     // commands per second while loop() runs
+  bool     verbose    = false;   // keep Serial output
+};
+
+/************************************************************
+ * Latency Statistics
+ ************************************************************/
+class LatencyStats {
+  public:
+    void     reserve(size_t n)          { _samples.reserve(n); }
+    void     add(uint64_t ns)           { _samples.push_back(ns); }
+    void     addHeap(uint64_t allocs, uint64_t frees) { _allocs += allocs; _frees += frees; }
+    size_t   count(void) const          { return _samples.size(); }
+    uint64_t percentile(double p);
+    uint64_t max(void);
+    double   mean(void) const;
+    void     print(const char* name);
+    static void printHeader(void);
+
+  private:
+    std::vector<uint64_t> _samples;
+    bool                  _sorted = false;
+    uint64_t              _allocs = 0;
+    uint64_t              _frees = 0;
+};
+
+/************************************************************
+ * Helpers
+ ************************************************************/
+uint64_t benchNow(void);                                   // ns, virtual clock
+void     benchSection(const char* title);
+const char* benchCheck(bool ok, const char* error);       // "" or error (counted: --bench exits with 1)
+
+// measures one call: latency and heap traffic (allocs/frees)
+#define BENCH_CALL(stats, call)                                 \
+  do {                                                          \
+    uint64_t _a0 = simHeapAllocs();                             \
+    uint64_t _f0 = simHeapFrees();                              \
+    uint64_t _t0 = benchNow();                                  \
+    call;                                                       \
+    uint64_t _t1 = benchNow();                                  \
+    (stats).add(_t1 - _t0);                                     \
+    (stats).addHeap(simHeapAllocs() - _a0, simHeapFrees() - _f0); \
+  } while (0)
+
+/************************************************************
+ * Board (nativeMain.cpp)
+ ************************************************************/
+extern SimMcp23017 g_SimMcp[];                              // MCP_COUNT chips at MCP_ADDR
+
+/************************************************************
+ * Benchmarks
+ ************************************************************/
+int      runBenchmarks(const BenchOptions& opt);
+void     benchLoop(const BenchOptions& opt);
+void     benchReconnect(const BenchOptions& opt);
+void     benchCommands(const BenchOptions& opt);
+void     benchTelemetry(const BenchOptions& opt);
+void     benchTimers(const BenchOptions& opt);
+void     benchOutbox(const BenchOptions& opt);
+void     benchTasks(const BenchOptions& opt);
+void     benchIrq(const BenchOptions& opt);
+void     benchMcp(const BenchOptions& opt);
+void     benchRoller(const BenchOptions& opt);
+void     benchLoopStats(const BenchOptions& opt);
+void     benchLog(const BenchOptions& opt);
+void     benchOta(const BenchOptions& opt);
+void     benchProbe(const BenchOptions& opt);
+void     benchIdle(const BenchOptions& opt);
+void     benchRx(const BenchOptions& opt);
+void     benchQos(const BenchOptions& opt);
+
+#endif // _BENCH_H_
@@ -0,0 +1,83 @@
+/*!
+ * @file benchCommands.cpp
+ */
+/************************************************************
+ * Benchmark: Command Dispatch
+ * - perfect hash lookup vs. linear name scan (as done by
+ *   CommandParser) for 4 and 64 commands
+ * - table sizes (all const: flash on the ESP32)
+ ************************************************************/
+#include <Arduino.h>
+#include <commandRegistry.h>
+#include "bench.h"
+
+static void cmd_bench0(char* response)                          { response[0] = '\0'; }
+static void cmd_bench2(char* response, uint64_t a, uint64_t b)   { (void)a; (void)b; response[0] = '\0'; }
+
+#define BENCH_CMD8(p)                                                                       \
+  CMD(p "0", cmd_bench0), CMD(p "1", cmd_bench2), CMD(p "2", cmd_bench0), CMD(p "3", cmd_bench2), \
+  CMD(p "4", cmd_bench0), CMD(p "5", cmd_bench2), CMD(p "6", cmd_bench0), CMD(p "7", cmd_bench2)
+
+static constexpr CommandDef s_Defs4[] = {
+  CMD("hello", cmd_bench0), CMD("helloadd", cmd_bench2), CMD("helloecho", cmd_bench0), CMD("reset", cmd_bench0),
+};
+static constexpr CommandDef s_Defs64[] = {
+  BENCH_CMD8("rollerup"),   BENCH_CMD8("rollerdown"), BENCH_CMD8("rollerstop"), BENCH_CMD8("rollerpos"),
+  BENCH_CMD8("sensorread"), BENCH_CMD8("sensorcal"),  BENCH_CMD8("relayset"),   BENCH_CMD8("ledset"),
+};
+static constexpr CommandRegistry<countof(s_Defs4)>  s_Registry4(s_Defs4);
+static constexpr CommandRegistry<countof(s_Defs64)> s_Registry64(s_Defs64);
+static_assert(s_Registry4.valid() && s_Registry64.valid(), "benchmark tables");
+
+/************************************************************
+ * Linear scan over the names (reference)
+ ************************************************************/
+template <size_t N>
+static bool linearDispatch(const CommandDef (&defs)[N], char* line, char* response) {
+  char* args = line;
+  while (*args && (*args != ' ')) {
+    args++;
+  }
+  size_t len = (size_t)(args - line);
+  for (size_t i = 0; i < N; i++) {
+    if ((strncmp(defs[i].name, line, len) == 0) && !defs[i].name[len]) {
+      return defs[i].invoke(args, response);
+    }
+  }
+  return false;
+}
+
+/************************************************************
+ * ns per dispatch, averaged over all commands of the table
+ ************************************************************/
+template <size_t N, typename D>
+static double measure(const CommandDef (&defs)[N], uint32_t rounds, D dispatch) {
+  char     line[48];
+  char     response[CMD_RESPONSE_SIZE];
+  uint64_t total = 0;
+  for (uint32_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < N; i++) {
+      snprintf(line, sizeof(line), "%s%s", defs[i].name, defs[i].signature[0] ? " 40 2" : "");
+      uint64_t t0 = benchNow();
+      dispatch(line, response);
+      total += benchNow() - t0;
+    }
+  }
+  return (double)total / ((double)rounds * N);
+}
+
+template <size_t N>
+static void benchTable(const char* name, const CommandDef (&defs)[N], const CommandRegistry<N>& registry,
+                       uint32_t rounds) {
+  double hashed = measure(defs, rounds, [&](char* l, char* r) { registry.dispatch(l, r); });
+  double linear = measure(defs, rounds, [&](char* l, char* r) { linearDispatch(defs, l, r); });
+  printf("  %-14s %3zu cmds  perfect hash %7.1f ns  linear scan %7.1f ns  table %5zu B (const)\n",
+         name, N, hashed, linear, sizeof(defs) + sizeof(registry));
+}
+
+void benchCommands(const BenchOptions& opt) {
+  benchSection("command dispatch");
+  uint32_t rounds = opt.calls / 64 + 1;
+  benchTable("hello*", s_Defs4,  s_Registry4,  rounds * 16);
+  benchTable("roller/sensor", s_Defs64, s_Registry64, rounds);
+}
@@ -0,0 +1,122 @@
+/*!
+ * @file benchIdle.cpp
+ */
+/************************************************************
+ * Benchmark: Tickless Idle
+ * - loop() for opt.seconds with "probe SEQ" commands from a
+ *   second thread (a client on the broker) at
+ *   BENCH_IDLE_CMD_RATE, spinning vs. sleeping (g_IdleOn)
+ * - CPU time of the process (CLOCK_PROCESS_CPUTIME_ID) vs.
+ *   wall time: what the idle loop saves
+ * - round trip of the commands: what it costs (a command on
+ *   the MQTT socket must wake the sleep right away, far
+ *   below IDLE_LATENCY_MS)
+ * - idle % and wake-up reasons of the sleeping task(s)
+ * - single loop() vs. network task + loop() (dual-core)
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <time.h>
+#include <vector>
+#include "bench.h"
+
+#define BENCH_IDLE_CMD_RATE  20           // commands per second, a busy installation
+
+static const char* const s_WakeNames[IDLE_WAKE_COUNT] = {"timer", "bound", "socket", "irq", "queue"};
+
+static uint64_t cpuNanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void idleRun(const BenchOptions& opt, const char* name, bool idle) {
+  LocalBroker&          broker = LocalBroker::instance();
+  uint32_t              total = BENCH_IDLE_CMD_RATE * opt.seconds;
+  std::vector<uint64_t> sentAt(total);
+  std::mutex            lock;
+  LatencyStats          rtt;
+  std::atomic<bool>     done(false);
+  uint32_t              wakes0[IDLE_WAKE_COUNT], wakes1[IDLE_WAKE_COUNT];
+  for (uint8_t i = 0; i < IDLE_WAKE_COUNT; i++) {
+    wakes0[i] = g_IdleLoop.wakes(i) + g_IdleNet.wakes(i);
+  }
+  uint32_t busy0 = g_IdleLoop.busy() + g_IdleNet.busy();
+  int tap = broker.addTap(TOPIC_RESULT, [&](const BrokerMessage& m) {
+    uint64_t now = benchNow();
+    unsigned seq;
+    std::lock_guard<std::mutex> guard(lock);
+    if ((sscanf(m.payload.c_str(), "probe %u", &seq) == 1) && (seq < total)) {
+      rtt.add(now - sentAt[seq]);
+    }
+  });
+  g_IdleOn = idle && idleBegin();
+  g_IdleLoop.percent(micros());
+  g_IdleNet.percent(micros());
+  // the client: commands arrive while loop() sleeps
+  std::thread client([&]() {
+    char cmd[32];
+    for (uint32_t seq = 0; (seq < total) && !done; seq++) {
+      std::this_thread::sleep_for(std::chrono::microseconds(1000000 / BENCH_IDLE_CMD_RATE));
+      snprintf(cmd, sizeof(cmd), "probe %u", seq);
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        sentAt[seq] = benchNow();
+      }
+      broker.inject(TOPIC_CMD, cmd);
+    }
+  });
+  uint64_t t0 = benchNow(), c0 = cpuNanos(), passes = 0;
+  while (benchNow() - t0 < (uint64_t)opt.seconds * 1000000000ULL) {
+    loop();
+    passes++;
+  }
+  uint64_t wall = benchNow() - t0, cpu = cpuNanos() - c0;
+  uint32_t asleep[2] = {g_IdleLoop.percent(micros()), g_IdleNet.percent(micros())};
+  done = true;
+  client.join();
+  g_IdleOn = false;
+  // answers still on their way
+  for (uint64_t t1 = benchNow(); benchNow() - t1 < 100000000ULL;) {
+    loop();
+  }
+  broker.removeTap(tap);
+  for (uint8_t i = 0; i < IDLE_WAKE_COUNT; i++) {
+    wakes1[i] = g_IdleLoop.wakes(i) + g_IdleNet.wakes(i) - wakes0[i];
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  printf("  %s, %s: %.0f loop() passes/s, CPU %.1f %% of wall time, %zu/%u commands answered\n", name,
+         idle ? "idle wait" : "spinning", passes * 1e9 / wall, cpu * 100.0 / wall, rtt.count(), total);
+  if (idle) {
+    printf("  %-28s asleep: loop() %u %%, network task %u %%, busy passes %u, wakes:", "", asleep[0], asleep[1],
+           g_IdleLoop.busy() + g_IdleNet.busy() - busy0);
+    for (uint8_t i = 0; i < IDLE_WAKE_COUNT; i++) {
+      printf(" %s %u", s_WakeNames[i], wakes1[i]);
+    }
+    printf("\n");
+  }
+  LatencyStats::printHeader();
+  rtt.print("command round trip");
+  if (idle && (rtt.percentile(99) > IDLE_LATENCY_MS * 1000000ULL)) {
+    printf("  !! p99 above IDLE_LATENCY_MS (%u ms): the socket did not wake the sleep\n", (unsigned)IDLE_LATENCY_MS);
+  }
+}
+
+void benchIdle(const BenchOptions& opt) {
+  benchSection("tickless idle");
+  simSetRealDelay(true);
+  idleRun(opt, "single loop()", false);
+  idleRun(opt, "single loop()", true);
+  startNetTask();
+  idleRun(opt, "network task + loop()", false);
+  idleRun(opt, "network task + loop()", true);
+  stopNetTask();
+  simSetRealDelay(false);
+}
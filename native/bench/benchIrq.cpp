@@ -0,0 +1,161 @@
+/*!
+ * @file benchIrq.cpp
+ */
+/************************************************************
+ * Benchmark: IRQ Event Ring
+ * - INT_PIN driven with bouncing edges (simSetPin fires the
+ *   ISR), loop() runs every loopUs of virtual time:
+ *   - edges, events taken from the ring, overflows
+ *   - accepted edges (expected: one per transition) and
+ *     bounced events
+ *   - wake-ups the old g_IrqFlag would have seen (one per
+ *     loop() pass with an ISR call, no level, no time)
+ *   - latency ISR -> irqDrain (log2 histogram of g_Irq)
+ * - the IRQ state of the network task (g_IrqSnapshot) after
+ *   the runs: the same counters as g_Irq
+ * - snapshot under load: a writer thread publishes reports
+ *   whose counters are all equal while the bench reads them;
+ *   a report with different counters is torn
+ * - cost of the ISR: ring push vs. flag in a critical section
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <prototypes.h>
+#include <myHWconfig.h>
+#include <irqEvents.h>
+#include <atomic>
+#include <thread>
+#include "bench.h"
+
+#define BENCH_IRQ_SNAP_MS     300       // reader and writer, preempted in between
+
+struct IrqRun {
+  uint64_t    nextLoop;                  // us: next loop() pass
+  uint32_t    loopUs;
+  uint32_t    edges;                     // ISR calls
+  uint32_t    edgesSeen;                 // ISR calls at the last loop() pass
+  uint32_t    flagWakeups;               // loop() passes the old flag would have woken
+};
+
+// virtual time passes, loop() every run.loopUs
+static void runFor(IrqRun& run, uint64_t us) {
+  uint64_t end = simMicros64() + us;
+  while (simMicros64() < end) {
+    if (simMicros64() >= run.nextLoop) {
+      run.flagWakeups += (run.edges != run.edgesSeen);
+      run.edgesSeen = run.edges;
+      loop();
+      run.nextLoop = simMicros64() + run.loopUs;
+    }
+    uint64_t now = simMicros64();
+    simAdvanceMicros(((run.nextLoop < end) ? run.nextLoop : end) - now);
+  }
+}
+
+static void toggle(IrqRun& run) {
+  simSetPin(INT_PIN, !digitalRead(INT_PIN));
+  run.edges++;
+}
+
+/************************************************************
+ * transitions: press / release of a contact
+ * - each with `bounces` extra pairs of edges bounceUs apart,
+ *   then holdMs stable
+ ************************************************************/
+static void contact(const char* name, uint32_t transitions, uint32_t bounces, uint32_t bounceUs,
+                    uint32_t holdMs, uint32_t loopUs) {
+  IrqRun   run = {simMicros64(), loopUs, 0, 0, 0};
+  IrqState s0 = g_Irq;
+  uint32_t ov0 = g_IrqRing.overflows();
+  g_Irq.latency.reset();
+  for (uint32_t t = 0; t < transitions; t++) {
+    for (uint32_t b = 0; b < 2 * bounces + 1; b++) {
+      toggle(run);
+      runFor(run, bounceUs);
+    }
+    runFor(run, (uint64_t)holdMs * 1000);
+  }
+  runFor(run, IRQ_DEBOUNCE_US * 2);
+  printf("  %-28s edges %6u  events %6u  overflows %5u  accepted %3u/%3u  bounced %6u  old flag %4u"
+         "  latency p50 %5u us p99 %5u us max %5u us\n", name, run.edges, g_Irq.events - s0.events,
+         g_IrqRing.overflows() - ov0, g_Irq.accepted - s0.accepted, transitions, g_Irq.bounced - s0.bounced,
+         run.flagWakeups, g_Irq.latency.percentile(50), g_Irq.latency.percentile(99), g_Irq.latency.max());
+}
+
+static portMUX_TYPE s_Mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile boolean s_Flag;
+
+// the handler before the ring
+static void flagHandler(void) {
+  portENTER_CRITICAL(&s_Mux);
+  s_Flag = true;
+  portEXIT_CRITICAL(&s_Mux);
+}
+
+static void isrCost(const BenchOptions& opt) {
+  LatencyStats flag, ring, drain;
+  IrqEvent     ev;
+  flag.reserve(opt.calls);
+  ring.reserve(opt.calls);
+  drain.reserve(opt.calls);
+  for (uint32_t i = 0; i < opt.calls; i++) {
+    BENCH_CALL(flag, flagHandler());
+    BENCH_CALL(ring, irqHandler());
+    BENCH_CALL(drain, g_IrqRing.pop(ev));
+  }
+  LatencyStats::printHeader();
+  flag.print("ISR: flag + critical section");
+  ring.print("ISR: ring push");
+  drain.print("ring pop");
+}
+
+// reads while another thread publishes
+static void snapshotLoad(void) {
+  static SeqSnapshot<IrqReport> snap;
+  std::atomic<bool>             stop(false);
+  uint32_t                      reads = 0, torn = 0, seen = 0, last = 0;
+  std::thread writer([&]() {
+    IrqReport r = {};
+    for (uint32_t i = 1; !stop; i++) {
+      r.events = r.accepted = r.bounced = r.overflows = r.maxRate = i;
+      r.latency.add(i);
+      snap.publish(r);
+    }
+  });
+  for (IrqReport r = {}; !r.events;) {     // the writer is running
+    snap.read(r);
+  }
+  for (uint64_t t0 = benchNow(); benchNow() - t0 < BENCH_IRQ_SNAP_MS * 1000000ULL; reads++) {
+    IrqReport r;
+    snap.read(r);
+    torn += (r.accepted != r.events) || (r.bounced != r.events) || (r.overflows != r.events) ||
+            (r.maxRate != r.events) || (r.latency.count() != r.events);
+    seen += (r.events != last);
+    last = r.events;
+  }
+  stop = true;
+  writer.join();
+  printf("  snapshot under load: %u reads, %u new reports, %u torn%s\n", reads, seen, torn,
+         torn ? benchCheck(false, "  !! ERROR") : benchCheck(seen, "  !! ERROR: no report published"));
+}
+
+void benchIrq(const BenchOptions& opt) {
+  benchSection("IRQ event ring");
+  contact("clean, loop 1 ms",            40, 0,  100,  50,  1000);
+  contact("bouncing, loop 1 ms",         40, 5,  100,  50,  1000);
+  contact("bouncing, loop 20 ms",        40, 5,  100,  50, 20000);
+  contact("chatter 50 kHz, loop 5 ms",    4, 500, 10,  50,  5000);
+  printf("  ring %u events, debounce %u us; rate histogram %u windows, max %u events/s\n", IRQ_RING_SIZE,
+         IRQ_DEBOUNCE_US, g_Irq.rate.count(), g_Irq.maxRate);
+  IrqReport r;
+  g_IrqSnapshot.read(r);
+  bool same = (r.events == g_Irq.events) && (r.accepted == g_Irq.accepted) && (r.bounced == g_Irq.bounced) &&
+              (r.latency.count() == g_Irq.latency.count()) && (r.rate.count() == g_Irq.rate.count());
+  printf("  network task view (g_IrqSnapshot): events %u, accepted %u, bounced %u%s\n", r.events, r.accepted,
+         r.bounced, same ? ", as g_Irq" : benchCheck(false, "  !! ERROR: differs from g_Irq"));
+  snapshotLoad();
+
+  benchSection("IRQ event ring: operations");
+  isrCost(opt);
+}
@@ -0,0 +1,168 @@
+/*!
+ * @file benchLog.cpp
+ */
+/************************************************************
+ * Benchmark: Binary Log
+ * - cost of one log call: LOGI (ring) vs. the text path it
+ *   replaced (printf into a buffer, then Serial with the
+ *   115200 baud UART model, or mqttPub on TOPIC_LOG)
+ * - bytes per entry: frame vs. formatted text
+ * - burst of entries without a drain: entries dropped, the
+ *   drop count arrives as an entry of its own
+ * - format ids: every popped entry has to point back at the
+ *   format string of its call (g_LogAnchor + id)
+ * - TOPIC_LOG: loop() drains and publishes the batch, frames
+ *   and xor checked in the captured payloads
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <binLog.h>
+#include <string>
+#include "bench.h"
+
+#define BENCH_LOG_FMT       "bench: roller %u at %u %%, %s"
+#define BENCH_LOG_BURST     1000
+
+static const char s_BenchFmt[] = BENCH_LOG_FMT;
+
+static void logEntry(uint32_t i) {
+  g_Log.write(logProducer(), (LOG_CAT_MAIN << 4) | LOG_INFO, micros(), LOG_FMT_ID(s_BenchFmt),
+              i & 3, i % 101, "moving");
+}
+
+static void textEntry(char* buf, size_t size, uint32_t i) {
+  snprintf(buf, size, BENCH_LOG_FMT, i & 3, i % 101, "moving");
+}
+
+// the text paths before the binary log
+static void uartEntry(uint32_t i) {
+  char text[128];
+  textEntry(text, sizeof(text), i);
+  Serial.println(text);
+}
+
+static void mqttEntry(uint32_t i) {
+  char text[128];
+  textEntry(text, sizeof(text), i);
+  mqttPub(TOPIC_LOG, text, true);
+}
+
+// empty the rings, count the entries and those with the bench format
+static uint32_t drainRings(uint32_t& matched) {
+  uint8_t  entry[LOG_MAX_ENTRY];
+  uint32_t n = 0;
+  size_t   len;
+  matched = 0;
+  while ((len = g_Log.pop(entry)) != 0) {
+    int32_t id;
+    memcpy(&id, entry + 4, sizeof(id));
+    matched += (g_LogAnchor + id == s_BenchFmt);
+    n++;
+  }
+  return n;
+}
+
+// frames in a TOPIC_LOG payload, bad: sync or xor wrong
+static uint32_t countFrames(const std::string& p, uint32_t& bad) {
+  uint32_t frames = 0;
+  size_t   at = 0;
+  while (at + LOG_FRAME_EXTRA <= p.size()) {
+    uint8_t n = (uint8_t)p[at + 2], x = 0;
+    if (((uint8_t)p[at] != LOG_SYNC0) || ((uint8_t)p[at + 1] != LOG_SYNC1) ||
+        (at + n + LOG_FRAME_EXTRA > p.size())) {
+      bad++;
+      return frames;
+    }
+    for (size_t i = 0; i < n; i++) {
+      x ^= (uint8_t)p[at + 3 + i];
+    }
+    bad += (x != (uint8_t)p[at + 3 + n]);
+    frames++;
+    at += n + LOG_FRAME_EXTRA;
+  }
+  return frames;
+}
+
+static void callCost(const BenchOptions& opt) {
+  LatencyStats bin, drain, uart, mqtt;
+  char         text[128];
+  uint32_t     matched;
+  bin.reserve(opt.calls);
+  drain.reserve(opt.calls);
+  uart.reserve(opt.calls / 10);
+  mqtt.reserve(opt.calls);
+  for (uint32_t i = 0; i < opt.calls; i++) {
+    BENCH_CALL(bin, logEntry(i));
+    BENCH_CALL(drain, logDrain());
+    BENCH_CALL(mqtt, mqttEntry(i));
+  }
+  simSetUartModel(true);
+  for (uint32_t i = 0; i < opt.calls / 10; i++) {
+    BENCH_CALL(uart, uartEntry(i));
+  }
+  Serial.flush();
+  simSetUartModel(false);
+  jobLogFlush();
+  drainRings(matched);
+  LatencyStats::printHeader();
+  bin.print("LOGI (ring)");
+  drain.print("logDrain (1 entry)");
+  uart.print("printf + Serial (UART)");
+  mqtt.print("printf + mqttPub (dbgoutf)");
+
+  logEntry(7);
+  size_t entry = g_Log.pop((uint8_t*)text);
+  textEntry(text, sizeof(text), 7);
+  printf("  bytes per entry: frame %zu, text %zu (\"%s\" + newline)\n", entry + LOG_FRAME_EXTRA, strlen(text) + 1,
+         text);
+}
+
+void benchLog(const BenchOptions& opt) {
+  LocalBroker& broker = LocalBroker::instance();
+  uint32_t     matched;
+  benchSection("binary log");
+  callCost(opt);
+
+  // burst: the ring holds LOG_RING_SIZE bytes, nobody drains
+  logEntry(0);                             // drops of earlier runs reported first
+  drainRings(matched);
+  LogStats s0 = g_Log.stats();
+  for (uint32_t i = 0; i < BENCH_LOG_BURST; i++) {
+    logEntry(i);
+  }
+  LogStats s1 = g_Log.stats();
+  drainRings(matched);
+  logEntry(0);                             // reports the drops
+  uint32_t report = drainRings(matched);
+  printf("  burst of %u: kept %u, dropped %u (%u bytes/entry, ring %u bytes), drop report %s\n", BENCH_LOG_BURST,
+         s1.entries - s0.entries, s1.dropped - s0.dropped, (s1.bytes - s0.bytes) / (s1.entries - s0.entries), LOG_RING_SIZE,
+         (report == 2) ? "sent" : "MISSING");
+
+  // format ids
+  for (uint32_t i = 0; i < 100; i++) {
+    logEntry(i);
+  }
+  uint32_t n = drainRings(matched);
+  printf("  format ids: %u/%u entries point at their format string\n", matched, n);
+
+  // TOPIC_LOG
+  uint32_t    frames = 0, bad = 0, payloads = 0;
+  size_t      bytes = 0;
+  int tap = broker.addTap(TOPIC_LOG, [&](const BrokerMessage& m) {
+    payloads++;
+    bytes += m.payload.size();
+    frames += countFrames(m.payload, bad);
+  });
+  for (uint32_t i = 0; i < 500; i++) {
+    logEntry(i);
+    loop();
+  }
+  jobLogFlush();
+  loop();
+  broker.removeTap(tap);
+  printf("  TOPIC_LOG: %u payloads, %zu bytes, %u frames, %u bad\n", payloads, bytes, frames, bad);
+}
@@ -0,0 +1,196 @@
+/*!
+ * @file benchLoop.cpp
+ */
+/************************************************************
+ * Benchmark: setup(), time to ONLINE, loop() rate and
+ * per-call latencies of mqttPub, mqttCallback and cronjob
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <deque>
+#include "bench.h"
+
+#define BENCH_MAX_CRON_ALL  500           // every call hashes the sketch, keep it short
+#define BENCH_MAX_BOOT_MS   60000         // give up waiting for ONLINE
+#define BENCH_BATCH_5       "helloadd 1 2;helloadd 3 4;hello;helloecho \"roller;up\";helloadd 5 6;"
+#define BENCH_BATCH_20      "#ctrl-0001\n" BENCH_BATCH_5 BENCH_BATCH_5 BENCH_BATCH_5 BENCH_BATCH_5
+
+/************************************************************
+ * Run loop() for opt.seconds
+ * - cmdRate > 0: inject "hello" at that rate and measure the
+ *   round trip cmd -> result
+ ************************************************************/
+static void runLoopFor(const BenchOptions& opt, uint32_t cmdRate, const char* name) {
+  LocalBroker&         broker = LocalBroker::instance();
+  std::deque<uint64_t> pending;
+  LatencyStats         rtt;
+  int tap = broker.addTap(TOPIC_RESULT, [&](const BrokerMessage&) {
+    if (!pending.empty()) {
+      rtt.add(benchNow() - pending.front());
+      pending.pop_front();
+    }
+  });
+  uint64_t start = benchNow();
+  uint64_t end = start + (uint64_t)opt.seconds * 1000000000ULL;
+  uint64_t period = cmdRate ? 1000000000ULL / cmdRate : 0;
+  uint64_t nextCmd = start;
+  uint64_t iterations = 0;
+  uint64_t now = start;
+  while (now < end) {
+    if (period && (now >= nextCmd)) {
+      pending.push_back(now);
+      broker.inject(TOPIC_CMD, "hello");
+      nextCmd += period;
+    }
+    loop();
+    iterations++;
+    now = benchNow();
+  }
+  broker.removeTap(tap);
+  double secs = (double)(now - start) / 1e9;
+  printf("  %-28s %12.0f loops/s", name, (double)iterations / secs);
+  if (cmdRate) {
+    printf("   cmd->result: n=%zu p50=%.1fus p99=%.1fus max=%.1fus",
+           rtt.count(), rtt.percentile(50) / 1000.0, rtt.percentile(99) / 1000.0, rtt.max() / 1000.0);
+  }
+  printf("\n");
+}
+
+
+/************************************************************
+ * Call mqttCallback like PubSubClient does:
+ * topic and payload share one buffer
+ ************************************************************/
+static void benchCallback(const BenchOptions& opt, const char* name, const char* command) {
+  static char buf[1024];
+  size_t tl = strlen(TOPIC_CMD);
+  size_t pl = strlen(command);
+  LatencyStats stats;
+  stats.reserve(opt.calls);
+  for (uint32_t i = 0; i < opt.calls; i++) {
+    memcpy(buf, TOPIC_CMD, tl + 1);
+    memcpy(buf + tl + 1, command, pl);
+    BENCH_CALL(stats, mqttCallback(buf, (byte*)buf + tl + 1, (unsigned int)pl));
+  }
+  stats.print(name);
+}
+
+
+/************************************************************
+ * Command Burst
+ * - a controller burst of mixed commands through mqttCallback
+ * - throughput and worst-case callback latency
+ ************************************************************/
+static void benchCommandBurst(const BenchOptions& opt) {
+  static const char* commands[] = {"hello", "HelloAdd 40 2", "helloecho EchoTest", "HELLO", "helloadd 1 2"};
+  static char buf[1024];
+  const size_t nCommands = sizeof(commands) / sizeof(commands[0]);
+  size_t tl = strlen(TOPIC_CMD);
+  LatencyStats stats;
+  stats.reserve(opt.calls);
+  uint64_t busy = 0;
+  for (uint32_t i = 0; i < opt.calls; i++) {
+    const char* command = commands[i % nCommands];
+    size_t pl = strlen(command);
+    memcpy(buf, TOPIC_CMD, tl + 1);
+    memcpy(buf + tl + 1, command, pl);
+    uint64_t t0 = benchNow();
+    BENCH_CALL(stats, mqttCallback(buf, (byte*)buf + tl + 1, (unsigned int)pl));
+    busy += benchNow() - t0;
+  }
+  stats.print("mqttCallback burst");
+  printf("  %-28s %12.0f commands/s   p99.9 %.2f us   worst case %.2f us\n", "", opt.calls / (busy / 1e9),
+         stats.percentile(99.9) / 1000.0, stats.max() / 1000.0);
+}
+
+
+/************************************************************
+ * Publish a message of the given size
+ ************************************************************/
+static void benchPublish(const BenchOptions& opt, const char* name, const char* topic, size_t size) {
+  static char msg[1024];
+  memset(msg, 'x', sizeof(msg));
+  msg[size] = '\0';
+  LatencyStats stats;
+  stats.reserve(opt.calls);
+  for (uint32_t i = 0; i < opt.calls; i++) {
+    BENCH_CALL(stats, mqttPub(topic, msg, true));
+  }
+  stats.print(name);
+}
+
+
+/************************************************************
+ * Loop Benchmark
+ ************************************************************/
+void benchLoop(const BenchOptions& opt) {
+  LocalBroker& broker = LocalBroker::instance();
+  uint32_t     sketchRetained = 0;
+  int          sketchTap = broker.addTap(TOPIC_SKETCH, [&](const BrokerMessage& msg) {
+    sketchRetained += msg.retained ? 1 : 0;
+  });
+
+  benchSection("setup()");
+  uint32_t onlineAt = 0;
+  int      statusTap = broker.addTap(TOPIC_STATUS, [&](const BrokerMessage& msg) {
+    if (!onlineAt && (msg.payload == STATUS_MSG_ON)) {
+      onlineAt = millis();
+    }
+  });
+  uint32_t boot = millis();
+  uint64_t t0 = benchNow();
+  setup();
+  g_IdleOn = false;                        // loop() passes are timed here, benchIdle sleeps
+  printf("  setup() took %.1f ms (virtual clock, includes delay())\n", (benchNow() - t0) / 1e6);
+  // loop() brings up WiFi and MQTT, 1 ms of virtual time per pass
+  uint32_t passes = 0;
+  while (!onlineAt && (millis() - boot < BENCH_MAX_BOOT_MS)) {
+    loop();
+    simAdvanceMillis(1);
+    passes++;
+  }
+  broker.removeTap(statusTap);
+  printf("  ONLINE %u ms after boot, %u loop() passes (cold boot: scan + association + DHCP)\n",
+         onlineAt ? onlineAt - boot : 0, passes);
+
+  benchSection("loop() rate");
+  runLoopFor(opt, 0, "idle");
+  runLoopFor(opt, opt.cmdRate, "with commands");
+
+  benchSection("per-call latency");
+  LatencyStats::printHeader();
+  benchPublish(opt, "mqttPub log 17 bytes", TOPIC_LOG, 17);
+  benchPublish(opt, "mqttPub cpu 200 bytes", TOPIC_CPU, 200);
+  benchPublish(opt, "mqttPub sketch 1000 bytes", TOPIC_SKETCH, 1000);
+  benchCallback(opt, "mqttCallback hello", "hello");
+  benchCallback(opt, "mqttCallback helloadd", "HelloAdd 40 2");
+  benchCallback(opt, "mqttCallback helloecho", "helloecho EchoTest");
+  benchCommandBurst(opt);
+  benchCallback(opt, "mqttCallback batch x20", BENCH_BATCH_20);
+  {
+    LatencyStats stats;
+    stats.reserve(opt.calls);
+    for (uint32_t i = 0; i < opt.calls; i++) {
+      BENCH_CALL(stats, cronjob());
+    }
+    stats.print("cronjob (nothing due)");
+  }
+  {
+    LatencyStats stats;
+    uint32_t n = (opt.calls < BENCH_MAX_CRON_ALL) ? opt.calls : BENCH_MAX_CRON_ALL;
+    for (uint32_t i = 0; i < n; i++) {
+      simAdvanceMillis(61000);
+      BENCH_CALL(stats, cronjob());
+    }
+    stats.print("cronjob (all jobs due)");
+  }
+
+  // sketch state: retained once, re-sent only on change
+  std::string sketch;
+  broker.removeTap(sketchTap);
+  broker.retained(TOPIC_SKETCH, sketch);
+  printf("  sketch state: published (retained) %u time(s), %zu bytes on the broker\n", sketchRetained, sketch.size());
+}
@@ -0,0 +1,149 @@
+/*!
+ * @file benchLoopStats.cpp
+ */
+/************************************************************
+ * Benchmark: Loop Stage Statistics
+ * - loop() with commands for opt.seconds, then the metrics
+ *   document as it goes to TOPIC_METRICS
+ * - attribution: a timer job that spins 2 ms every 100 ms
+ *   has to show up under its own name (and in "cron"), the
+ *   other stages must stay fast
+ * - across two threads: one records like the application
+ *   core, the other closes BENCH_INTERVALS intervals and reads
+ *   each once settled(); every histogram must be whole (bucket
+ *   sum = count, p50 <= max) and no sample lost or counted
+ *   twice
+ * - cost of LOOP_STAGE() around an empty statement and of
+ *   the timer runner
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <loopStats.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "bench.h"
+
+#if LOOP_STATS
+
+#define BENCH_SLOW_JOB_US   2000
+#define BENCH_SLOW_JOB_MS   100
+#define BENCH_INTERVALS     500
+#define BENCH_PUBLISH_MS    1000         // wait for the metrics document
+
+static void slowJob(void) {
+  delayMicroseconds(BENCH_SLOW_JOB_US);
+}
+
+static void emptyJob(void) {
+}
+
+// loop() for opt.seconds with commands at opt.cmdRate, then publish the metrics
+static std::string runAndPublish(const BenchOptions& opt) {
+  LocalBroker& broker = LocalBroker::instance();
+  std::string  doc;
+  uint64_t     start = benchNow(), period = 1000000000ULL / opt.cmdRate, next = start;
+  g_LoopStats.newInterval(millis());
+  while (benchNow() - start < (uint64_t)opt.seconds * 1000000000ULL) {
+    if (benchNow() >= next) {
+      broker.inject(TOPIC_CMD, "hello");
+      next += period;
+    }
+    loop();
+  }
+  int tap = broker.addTap(TOPIC_METRICS, [&](const BrokerMessage& m) {
+    doc = m.payload;
+  });
+  jobLoopStats();
+  for (uint64_t t0 = benchNow(); doc.empty() && (benchNow() - t0 < BENCH_PUBLISH_MS * 1000000ULL);) {
+    loop();
+  }
+  broker.removeTap(tap);
+  return doc;
+}
+
+// one closed interval of a stage: whole? adds its samples to total
+static bool wholeInterval(const LoopStats& stats, size_t stage, uint64_t& total) {
+  const LogHistogram<LOOP_HIST_BUCKETS>* h = stats.stage(stage);
+  if (!h) {
+    return true;
+  }
+  TelemetryList b = h->buckets();
+  uint64_t      sum = 0;
+  for (size_t i = 0; i < b.count; i++) {
+    sum += b.values[i];
+  }
+  total += h->count();
+  return (sum == h->count()) && (h->percentile(50) <= h->max());
+}
+
+// application thread records, this one closes and reads the intervals
+static void crossCore(void) {
+  static LoopStats  stats;
+  std::atomic<bool> stop(false);
+  uint64_t          passes = 0, reported = 0, loops = 0;
+  uint32_t          torn = 0;
+  std::thread app([&]() {
+    for (uint32_t i = 0; !stop.load(std::memory_order_relaxed); i++) {
+      stats.add(LOOP_STAGE_CMD, i & 0xff);
+      stats.add(LOOP_STAGE_LOOP, i & 0xfff);
+      passes++;
+    }
+  });
+  for (uint32_t n = 0; n < BENCH_INTERVALS; n++) {
+    stats.newInterval(n);
+    while (!stats.settled()) {
+      std::this_thread::yield();
+    }
+    torn += !wholeInterval(stats, LOOP_STAGE_CMD, reported);
+    torn += !wholeInterval(stats, LOOP_STAGE_LOOP, loops);
+  }
+  stop = true;
+  app.join();
+  stats.newInterval(BENCH_INTERVALS);                // the thread is gone: read without settled()
+  torn += !wholeInterval(stats, LOOP_STAGE_CMD, reported);
+  torn += !wholeInterval(stats, LOOP_STAGE_LOOP, loops);
+  printf("  across two threads: %u intervals, %llu passes, reported cmd %llu loop %llu, torn %u%s\n",
+         BENCH_INTERVALS, (unsigned long long)passes, (unsigned long long)reported, (unsigned long long)loops,
+         torn, benchCheck(!torn && (reported == passes) && (loops == passes), "  !! ERROR"));
+}
+
+void benchLoopStats(const BenchOptions& opt) {
+  benchSection("loop stage statistics");
+  printf("  %s: %s\n", "commands", runAndPublish(opt).c_str());
+
+  int id = g_Timers.every(BENCH_SLOW_JOB_MS, slowJob);
+  g_LoopStats.nameJob(slowJob, "slow");
+  printf("  %s: %s\n", "2 ms job", runAndPublish(opt).c_str());
+  g_Timers.cancel(id);
+  crossCore();
+
+  benchSection("loop stage statistics: operations");
+  LatencyStats bare, stage, runner;
+  bare.reserve(opt.calls);
+  stage.reserve(opt.calls);
+  runner.reserve(opt.calls);
+  for (uint32_t i = 0; i < opt.calls; i++) {
+    BENCH_CALL(bare, emptyJob());
+    BENCH_CALL(stage, LOOP_STAGE(LOOP_STAGE_ROLLER, emptyJob()));
+    BENCH_CALL(runner, cronRunner(emptyJob));
+  }
+  LatencyStats::printHeader();
+  bare.print("empty call");
+  stage.print("LOOP_STAGE(empty call)");
+  runner.print("cronRunner(empty job)");
+  g_LoopStats.newInterval(millis());
+}
+
+#else
+
+void benchLoopStats(const BenchOptions& opt) {
+  benchSection("loop stage statistics");
+  printf("  compiled out (LOOP_STATS 0)\n");
+}
+
+#endif // LOOP_STATS
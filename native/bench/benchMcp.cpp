@@ -0,0 +1,169 @@
+/*!
+ * @file benchMcp.cpp
+ */
+/************************************************************
+ * Benchmark: MCP23017 Driver
+ * - firmware path: an input of the simulated expander
+ *   changes, INT_PIN -> ISR -> irqDrain -> mcpService; I2C
+ *   transactions, bytes and bus time per interrupt, inputs
+ *   seen by the driver
+ * - one interrupt read: burst (INTF..GPIOB in one transaction)
+ *   vs. one transaction per register
+ * - output updates: register shadows vs. writing OLATA/B
+ *   every time
+ * - 3 chips on one INT line: transactions per interrupt and
+ *   flags of the right chip
+ * - bus time comes from the mock bus at I2CSPEED (Wire.h
+ *   shim), it advances the virtual clock
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <prototypes.h>
+#include <myHWconfig.h>
+#include <irqEvents.h>
+#include <mcp23017.h>
+#include "bench.h"
+
+#define BENCH_MCP_SETTLE_MS  20          // loop() time after each input change
+#define BENCH_MCP_SPARE_PIN  33          // INT line of the multi-chip test (not INT_PIN)
+#define BENCH_MCP_CHIPS      3
+
+struct BusDelta {
+  SimI2cStats s0;
+  void   begin(void)                    { s0 = simI2cStats(); }
+  void   print(const char* name, uint32_t n) {
+    SimI2cStats s = simI2cStats();
+    printf("  %-34s n=%6u  transactions %5.2f  bytes %5.1f  bus %7.1f us   (per operation)\n", name, n,
+           (double)(s.transactions - s0.transactions) / n, (double)(s.bytes - s0.bytes) / n,
+           (double)(s.busNs - s0.busNs) / n / 1000.0);
+  }
+};
+
+// the input on the last pin of port B changes, INT_PIN -> firmware
+static void firmwarePath(uint32_t n) {
+  BusDelta bus;
+  uint16_t expect = g_Mcp[0].inputs();
+  uint32_t ok = 0, accepted = g_Irq.accepted;
+  bus.begin();
+  for (uint32_t i = 0; i < n; i++) {
+    uint8_t pin = 8 + i % 8;
+    expect ^= 1u << pin;
+    g_SimMcp[0].setInput(pin, (expect >> pin) & 1);
+    for (uint32_t t = 0; t < BENCH_MCP_SETTLE_MS; t++) {
+      loop();
+      simAdvanceMillis(1);
+    }
+    ok += (g_Mcp[0].inputs() == expect);
+  }
+  bus.print("INT_PIN -> mcpService (firmware)", n);
+  printf("  %-34s inputs seen %u/%u, accepted IRQ edges %u\n", "", ok, n, g_Irq.accepted - accepted);
+}
+
+static uint8_t readSingle(uint8_t reg) {
+  Wire.beginTransmission(MCP_ADDR);
+  Wire.write(reg);
+  Wire.endTransmission(false);
+  Wire.requestFrom((uint8_t)MCP_ADDR, (uint8_t)1, (uint8_t)1);
+  return (uint8_t)Wire.read();
+}
+
+// one interrupt: burst vs. six single register reads
+static void interruptRead(uint32_t n) {
+  LatencyStats burst, single;
+  BusDelta     bus;
+  McpInterrupt irq;
+  uint8_t      r[6];
+  burst.reserve(n);
+  single.reserve(n);
+  detachInterrupt(INT_PIN);                // no firmware reads in between
+  bus.begin();
+  for (uint32_t i = 0; i < n; i++) {
+    g_SimMcp[0].setInput(8, i & 1);
+    BENCH_CALL(burst, g_Mcp[0].readInterrupt(irq));
+  }
+  bus.print("burst INTF..GPIOB", n);
+  bus.begin();
+  for (uint32_t i = 0; i < n; i++) {
+    g_SimMcp[0].setInput(8, !(i & 1));
+    BENCH_CALL(single, for (uint8_t k = 0; k < 6; k++) { r[k] = readSingle(MCP_INTFA + k); });
+  }
+  bus.print("one transaction per register", n);
+  LatencyStats::printHeader();
+  burst.print("burst read (incl. bus time)");
+  single.print("single reads (incl. bus time)");
+  g_SimMcp[0].setInput(8, HIGH);
+  g_Mcp[0].readInterrupt(irq);
+  g_Irq.stable = digitalRead(INT_PIN);
+  attachInterrupt(INT_PIN, irqHandler, CHANGE);
+  (void)r;
+}
+
+// relay pattern on port A: 30% of the updates change one bit
+static void outputWrites(uint32_t n) {
+  BusDelta bus;
+  uint16_t v = 0;
+  uint32_t seed = 1;
+  bus.begin();
+  for (uint32_t i = 0; i < n; i++) {
+    seed = seed * 1103515245u + 12345u;
+    if ((seed >> 16) % 10 < 3) {
+      v ^= 1u << ((seed >> 8) % 8);
+    }
+    g_Mcp[0].write(0x00ff, v);
+  }
+  bus.print("write with shadows", n);
+  bool ok = (g_SimMcp[0].outputs() == (v & 0x00ff));
+  bus.begin();
+  for (uint32_t i = 0; i < n; i++) {
+    Wire.beginTransmission(MCP_ADDR);
+    Wire.write(MCP_OLATA);
+    Wire.write((uint8_t)v);
+    Wire.write((uint8_t)(v >> 8));
+    Wire.endTransmission();
+  }
+  bus.print("write OLATA/B every time", n);
+  printf("  %-34s outputs of the chip match the shadow: %s\n", "", ok ? "yes" : "NO");
+}
+
+// 3 chips, INT wired together; the input of one chip changes
+static void sharedInt(uint32_t n) {
+  static SimMcp23017 sims[BENCH_MCP_CHIPS];
+  static Mcp23017    chips[BENCH_MCP_CHIPS];
+  BusDelta           bus;
+  McpInterrupt       irq = {};
+  uint32_t           right = 0, wrong = 0, left = 0;
+  for (uint8_t c = 0; c < BENCH_MCP_CHIPS; c++) {
+    sims[c].attach(MCP_ADDR + 4 + c, BENCH_MCP_SPARE_PIN);
+    chips[c].begin(Wire, MCP_ADDR + 4 + c, MCP_INPUTS);
+  }
+  bus.begin();
+  for (uint32_t i = 0; i < n; i++) {
+    uint8_t chip = i % BENCH_MCP_CHIPS;
+    sims[chip].setInput(15, !(chips[chip].inputs() >> 15 & 1));
+    for (uint8_t c = 0; c < BENCH_MCP_CHIPS; c++) {
+      chips[c].readInterrupt(irq);
+      right += (c == chip) && irq.flags;
+      wrong += (c != chip) && irq.flags;
+    }
+    left += (simGetPin(BENCH_MCP_SPARE_PIN) == LOW);
+  }
+  bus.print("3 chips on one INT line", n);
+  printf("  %-34s flags on the right chip %u/%u, on others %u, INT still low %u\n", "", right, n, wrong, left);
+  for (uint8_t c = 0; c < BENCH_MCP_CHIPS; c++) {
+    simI2cAttach(MCP_ADDR + 4 + c, nullptr);
+  }
+}
+
+void benchMcp(const BenchOptions& opt) {
+  benchSection("MCP23017 driver");
+  printf("  I2C %u kHz, %u chip(s) at 0x%02x, debounce %u us\n", I2CSPEED / 1000, MCP_COUNT, MCP_ADDR,
+         IRQ_DEBOUNCE_US);
+  firmwarePath(200);
+  interruptRead(opt.calls / 10);
+  outputWrites(opt.calls / 10);
+  sharedInt(1000);
+  const McpStats& s = g_Mcp[0].stats();
+  printf("  driver: %u transactions, %u B out, %u B in, %u writes skipped, %u errors\n", s.transactions,
+         s.bytesOut, s.bytesIn, s.writesSkipped, s.errors);
+}
@@ -0,0 +1,511 @@
+/*!
+ * @file benchOta.cpp
+ */
+/************************************************************
+ * Benchmark: Delta OTA
+ * - sketch in app0 (simLoadSketch): the first bytes of this
+ *   program (real, compressible code; a shorter program is
+ *   repeated to fill it, noted); new image with the edits
+ *   of a typical release: bytes inserted, code behind it
+ *   moved (addresses in it changed), a block rewritten, data
+ *   appended
+ * - patches are built here by construction (same format as
+ *   tools/otadelta.py, heatshrink included) and streamed on
+ *   TOPIC_OTA through loop() over a link model (latency,
+ *   bandwidth): stop and wait (like espota) vs. a window of
+ *   chunks, full image vs. heatshrink vs. delta
+ * - the same delta made by tools/otadelta.py (python3; the
+ *   tool is found next to this source or in BENCH_OTA_TOOL),
+ *   so the device decoder is checked against the host side
+ * - per transfer: bytes on the wire, time and image bytes
+ *   per second (virtual clock, flash erase included), the
+ *   longest loop() pass, progress entries on TOPIC_LOG, boot
+ *   partition and MD5 of app1, reboot requested
+ * - a chunk sent twice (refused), a corrupt patch (MD5) and
+ *   a patch of another base: refused, app0 stays the boot
+ *   partition
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <MD5Builder.h>
+#include <esp_ota_ops.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <binLog.h>
+#include <otaDelta.h>
+#include <unistd.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "bench.h"
+
+#define BENCH_OTA_OLD       655360       // bytes of the running sketch
+#define BENCH_OTA_INSERT_AT 100000
+#define BENCH_OTA_INSERT    256
+#define BENCH_OTA_MOVED     300000       // bytes behind the insert with changed addresses
+#define BENCH_OTA_NEW_BLOCK 2048         // rewritten
+#define BENCH_OTA_APPEND    4096
+#define BENCH_OTA_MAX_MS    120000       // per transfer
+#define BENCH_OTA_HS_W      11           // heatshrink window (<= OTA_HS_WINDOW_MAX)
+#define BENCH_OTA_HS_L      4            // heatshrink lookahead
+// link host <-> broker <-> device
+#define BENCH_LINK_MS       20           // one way
+#define BENCH_LINK_KBPS     2000         // host -> device
+#define BENCH_LINK_IDLE_US  100          // virtual time of a loop() pass without flash work
+#define BENCH_LINK_RESEND   5000         // ms without an answer: send again from N
+
+typedef std::vector<uint8_t> Bytes;
+
+static uint32_t s_Rand = 0x2545f491;
+static uint32_t s_Restarts;
+
+static uint8_t rnd(void) {
+  s_Rand ^= s_Rand << 13;
+  s_Rand ^= s_Rand >> 17;
+  s_Rand ^= s_Rand << 5;
+  return (uint8_t)s_Rand;
+}
+
+static void onRestart(void) {
+  s_Restarts++;
+}
+
+static void md5(const Bytes& b, uint8_t* out) {
+  MD5Builder m;
+  m.begin();
+  for (size_t at = 0; at < b.size(); at += 4096) {
+    m.add(&b[at], (uint16_t)((b.size() - at < 4096) ? b.size() - at : 4096));
+  }
+  m.calculate();
+  m.getBytes(out);
+}
+
+static std::string md5Hex(const Bytes& b) {
+  uint8_t digest[16];
+  char    hex[33];
+  md5(b, digest);
+  for (int i = 0; i < 16; i++) {
+    snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  }
+  return hex;
+}
+
+/************************************************************
+ * Heatshrink encoder (greedy, hash chains)
+ ************************************************************/
+static Bytes shrink(const Bytes& in) {
+  const size_t         window = 1u << BENCH_OTA_HS_W, longest = 1u << BENCH_OTA_HS_L;
+  std::vector<int32_t> head(1 << 15, -1), prev(in.size(), -1);
+  Bytes                out;
+  uint32_t             acc = 0, bits = 0;
+  auto put = [&](uint32_t v, uint32_t n) {
+    acc = (acc << n) | v;
+    bits += n;
+    while (bits >= 8) {
+      bits -= 8;
+      out.push_back((uint8_t)(acc >> bits));
+    }
+    acc &= (1u << bits) - 1;
+  };
+  auto hash = [&](size_t i) { return ((in[i] << 7) ^ (in[i + 1] << 4) ^ in[i + 2]) & 0x7fff; };
+  for (size_t i = 0; i < in.size();) {
+    size_t best = 0, dist = 0;
+    if (i + 3 <= in.size()) {
+      int32_t j = head[hash(i)];
+      for (int tries = 8; (j >= 0) && (i - j <= window) && tries; tries--, j = prev[j]) {
+        size_t n = 0;
+        while ((n < longest) && (i + n < in.size()) && (in[j + n] == in[i + n])) {
+          n++;
+        }
+        if (n > best) {
+          best = n;
+          dist = i - j;
+        }
+      }
+    }
+    size_t step = (best >= 3) ? best : 1;
+    if (step > 1) {
+      put(0, 1);
+      put((uint32_t)(dist - 1), BENCH_OTA_HS_W);
+      put((uint32_t)(best - 1), BENCH_OTA_HS_L);
+    } else {
+      put(0x100 | in[i], 9);
+    }
+    for (size_t k = i; (k < i + step) && (k + 3 <= in.size()); k++) {
+      prev[k] = head[hash(k)];
+      head[hash(k)] = (int32_t)k;
+    }
+    i += step;
+  }
+  if (bits) {
+    out.push_back((uint8_t)(acc << (8 - bits)));
+  }
+  return out;
+}
+
+/************************************************************
+ * Patch Writer (by construction, see tools/otadelta.py)
+ ************************************************************/
+class PatchWriter {
+  public:
+    PatchWriter(const Bytes& base, const Bytes& image) : _base(base), _image(image) {}
+
+    // image[at..at+n] from base[from..], same / diff pairs
+    void copy(uint32_t from, uint32_t at, uint32_t n) {
+      int32_t seek = (int32_t)(from - _cursor);
+      _ops.push_back(OTA_OP_COPY);
+      varint(n);
+      varint(((uint32_t)seek << 1) ^ (uint32_t)(seek >> 31));
+      uint32_t k = 0;
+      while (k < n) {
+        uint32_t same = k;
+        while ((k < n) && !diff(from, at, k)) {
+          k++;
+        }
+        varint(k - same);
+        if (k == n) {
+          break;
+        }
+        uint32_t start = k;
+        while ((k < n) && (diff(from, at, k) || !sameRun(from, at, k, n))) {
+          k++;
+        }
+        varint(k - start);
+        for (uint32_t i = start; i < k; i++) {
+          _ops.push_back(diff(from, at, i));
+        }
+      }
+      _cursor = from + n;
+    }
+
+    void data(uint32_t at, uint32_t n) {
+      _ops.push_back(OTA_OP_DATA);
+      varint(n);
+      _ops.insert(_ops.end(), _image.begin() + at, _image.begin() + at + n);
+    }
+
+    // header + ops (+ END)
+    Bytes patch(uint8_t flags) {
+      Bytes p(OTA_DELTA_HEADER, 0), ops = _ops;
+      ops.push_back(OTA_OP_END);
+      memcpy(&p[0], OTA_DELTA_MAGIC, 4);
+      p[4] = OTA_DELTA_VERSION;
+      p[5] = flags;
+      p[6] = (flags & OTA_FLAG_HEATSHRINK) ? (BENCH_OTA_HS_W << 4 | BENCH_OTA_HS_L) : 0;
+      le32(p, 8, (uint32_t)_base.size());
+      le32(p, 12, (uint32_t)_image.size());
+      md5(_base, &p[16]);
+      md5(_image, &p[32]);
+      if (flags & OTA_FLAG_HEATSHRINK) {
+        ops = shrink(ops);
+      }
+      p.insert(p.end(), ops.begin(), ops.end());
+      return p;
+    }
+
+  private:
+    const Bytes& _base;
+    const Bytes& _image;
+    Bytes        _ops;
+    uint32_t     _cursor = 0;
+
+    uint8_t diff(uint32_t from, uint32_t at, uint32_t k) const {
+      return (uint8_t)(_image[at + k] - _base[from + k]);
+    }
+
+    // 4 equal bytes (or up to the end) end a diff run
+    bool sameRun(uint32_t from, uint32_t at, uint32_t k, uint32_t n) const {
+      for (uint32_t i = k; (i < k + 4) && (i < n); i++) {
+        if (diff(from, at, i)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    static void le32(Bytes& p, size_t at, uint32_t v) {
+      memcpy(&p[at], &v, sizeof(v));
+    }
+
+    void varint(uint32_t n) {
+      while (n >= 0x80) {
+        _ops.push_back((uint8_t)(n | 0x80));
+        n >>= 7;
+      }
+      _ops.push_back((uint8_t)n);
+    }
+};
+
+/************************************************************
+ * Images
+ ************************************************************/
+static void makeImages(Bytes& base, Bytes& image, PatchWriter& w) {
+  FILE*  f = fopen("/proc/self/exe", "rb");
+  size_t n = 0;
+  base.resize(BENCH_OTA_OLD);
+  if (f) {
+    n = fread(base.data(), 1, base.size(), f);
+    fclose(f);
+  }
+  if (n < base.size()) {
+    printf("  note: /proc/self/exe has %zu of %zu bytes, the base image is %s\n", n, base.size(),
+           n ? "padded with it repeated" : "random");
+    for (size_t i = n; i < base.size(); i++) {
+      base[i] = n ? base[i % n] : rnd();
+    }
+  }
+  base[0] = ESP_IMAGE_HEADER_MAGIC;
+  // inserted bytes, addresses behind them moved (every 8th word)
+  uint32_t moved = BENCH_OTA_INSERT_AT + BENCH_OTA_MOVED, block = moved + BENCH_OTA_NEW_BLOCK;
+  image.assign(base.begin(), base.begin() + BENCH_OTA_INSERT_AT);
+  for (uint32_t i = 0; i < BENCH_OTA_INSERT; i++) {
+    image.push_back(rnd());
+  }
+  for (uint32_t i = BENCH_OTA_INSERT_AT; i < moved; i++) {
+    image.push_back(base[i] + (((i & 31) == 0) ? 0x40 : 0) + (((i & 31) == 1) ? 1 : 0));
+  }
+  for (uint32_t i = 0; i < BENCH_OTA_NEW_BLOCK; i++) {
+    image.push_back(rnd());
+  }
+  image.insert(image.end(), base.begin() + block, base.end());
+  for (uint32_t i = 0; i < BENCH_OTA_APPEND; i++) {
+    image.push_back(rnd());
+  }
+
+  uint32_t at = 0;
+  w.copy(0, at, BENCH_OTA_INSERT_AT);
+  at += BENCH_OTA_INSERT_AT;
+  w.data(at, BENCH_OTA_INSERT);
+  at += BENCH_OTA_INSERT;
+  w.copy(BENCH_OTA_INSERT_AT, at, BENCH_OTA_MOVED);
+  at += BENCH_OTA_MOVED;
+  w.data(at, BENCH_OTA_NEW_BLOCK);
+  at += BENCH_OTA_NEW_BLOCK;
+  w.copy(block, at, BENCH_OTA_OLD - block);
+  at += BENCH_OTA_OLD - block;
+  w.data(at, BENCH_OTA_APPEND);
+}
+
+/************************************************************
+ * Transfer over the link model
+ * - host: as tools/otadelta.py send, at most `window` chunks
+ *   in flight (1: stop and wait)
+ ************************************************************/
+struct LinkMsg {
+  uint64_t    atUs;                        // arrives
+  std::string payload;
+};
+
+struct OtaRun {
+  std::string  answer;                     // last answer
+  uint32_t     chunks;
+  uint32_t     wire;                       // bytes host -> device
+  uint32_t     ms;                         // offset 0 -> done / error
+  uint32_t     timeouts;
+  uint32_t     progress;                   // "OTA: ..." entries on TOPIC_LOG
+  LatencyStats loop;                       // loop() passes while applying
+};
+
+// progress entries in a TOPIC_LOG payload (format string resolved in place)
+static uint32_t progressEntries(const std::string& p) {
+  uint32_t n = 0;
+  for (size_t at = 0; at + LOG_FRAME_EXTRA + LOG_HEADER <= p.size(); at += (uint8_t)p[at + 2] + LOG_FRAME_EXTRA) {
+    int32_t id;
+    memcpy(&id, p.data() + at + 3 + 4, sizeof(id));
+    n += !strncmp(g_LogAnchor + id, "OTA: ", 5);
+  }
+  return n;
+}
+
+static void transfer(const Bytes& patch, uint32_t window, OtaRun& run, uint32_t dupAt = 0) {
+  LocalBroker&        broker = LocalBroker::instance();
+  std::deque<LinkMsg> down, up;
+  uint64_t            linkFree = 0, start = simMicros64(), lastAnswer = start;
+  uint32_t            acked = 0, free = 1, offset = 0;
+  auto send = [&](uint32_t at) {
+    uint32_t    n = OTA_DELTA_CHUNK + (at ? 0 : OTA_DELTA_HEADER);
+    std::string msg((const char*)&at, sizeof(at));
+    n = (patch.size() - at < n) ? (uint32_t)(patch.size() - at) : n;
+    msg.append((const char*)&patch[at], n);
+    linkFree = std::max(linkFree, simMicros64()) + msg.size() * 8000ull / BENCH_LINK_KBPS;
+    down.push_back({linkFree + BENCH_LINK_MS * 1000ull, msg});
+    run.chunks++;
+    run.wire += (uint32_t)msg.size();
+    return n;
+  };
+  int tap = broker.addTap(TOPIC_OTA_ACK, [&](const BrokerMessage& m) {
+    up.push_back({simMicros64() + BENCH_LINK_MS * 1000ull, m.payload});
+  });
+  run.chunks = run.wire = run.timeouts = 0;
+  run.answer.clear();
+  while (run.answer.empty() || !run.answer.compare(0, 4, "ack ")) {
+    while ((offset < patch.size()) &&
+           (offset < acked + std::min(free, window) * OTA_DELTA_CHUNK + (acked ? 0 : OTA_DELTA_HEADER))) {
+      uint32_t n = send(offset);
+      if (dupAt && (offset > dupAt)) {
+        send(offset);                      // the previous chunk again: refused, answered at once
+        dupAt = 0;
+      }
+      offset += n;
+    }
+    while (!down.empty() && (down.front().atUs <= simMicros64())) {
+      broker.publish(TOPIC_OTA, (const uint8_t*)down.front().payload.data(), down.front().payload.size(), false);
+      down.pop_front();
+    }
+    BENCH_CALL(run.loop, loop());
+    uint64_t now = simMicros64();
+    while (!up.empty() && (up.front().atUs <= now)) {
+      unsigned n, f;
+      run.answer = up.front().payload;
+      up.pop_front();
+      lastAnswer = now;
+      if (sscanf(run.answer.c_str(), "ack %u %u", &n, &f) == 2) {
+        acked = n;
+        free = f;
+        offset = std::max(offset, acked);
+      }
+    }
+    if (now - lastAnswer > BENCH_LINK_RESEND * 1000ull) {
+      offset = acked;                      // go back to N
+      lastAnswer = now;
+      run.timeouts++;
+    }
+    if (now - start > BENCH_OTA_MAX_MS * 1000ull) {
+      run.answer = "timeout";
+    }
+    simAdvanceMicros(BENCH_LINK_IDLE_US);
+  }
+  run.ms = (uint32_t)((simMicros64() - start) / 1000);
+  broker.removeTap(tap);
+}
+
+static std::string partitionMD5(const esp_partition_t* part, size_t size) {
+  uint8_t    buf[4096];
+  MD5Builder m;
+  m.begin();
+  for (size_t at = 0; at < size; at += sizeof(buf)) {
+    size_t n = (size - at < sizeof(buf)) ? size - at : sizeof(buf);
+    esp_partition_read(part, at, buf, n);
+    m.add(buf, (uint16_t)n);
+  }
+  m.calculate();
+  return m.toString().c_str();
+}
+
+// transfer, check app1, wait for the reboot, back to app0
+static void update(const char* name, const Bytes& patch, const Bytes& image, uint32_t window, uint32_t dupAt = 0) {
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  LocalBroker&           broker = LocalBroker::instance();
+  OtaRun                 run;
+  run.progress = 0;
+  int tap = broker.addTap(TOPIC_LOG, [&](const BrokerMessage& m) { run.progress += progressEntries(m.payload); });
+  transfer(patch, window, run, dupAt);
+  const esp_partition_t* boot = esp_ota_get_boot_partition();
+  bool ok = !run.answer.compare(0, 5, "done ") && (boot != running) &&
+            (partitionMD5(boot, image.size()) == md5Hex(image));
+  uint32_t restarts = s_Restarts, start = millis();
+  while ((s_Restarts == restarts) && (millis() - start < BENCH_OTA_MAX_MS)) {
+    loop();
+  }
+  broker.removeTap(tap);
+  printf("  %-24s %7u %6u %8u %9.0f %6u %8.1f %8u  %s%s\n", name, (unsigned)patch.size(), run.chunks, run.ms,
+         image.size() * 1000.0 / (run.ms ? run.ms : 1), run.timeouts, run.loop.max() / 1e6, run.progress,
+         ok ? "ok" : run.answer.c_str(), (s_Restarts != restarts) ? "" : ", NO REBOOT");
+  esp_ota_set_boot_partition(running);     // the bench keeps running app0
+}
+
+/************************************************************
+ * Patch made by tools/otadelta.py
+ * - base and image to temporary files, "otadelta.py make"
+ * @return false if python3 or the tool is not there
+ ************************************************************/
+static std::string toolPath(void) {
+  const char* env = getenv("BENCH_OTA_TOOL");
+  std::string src = __FILE__;
+  if (env) {
+    return env;
+  }
+  size_t at = src.rfind("native/bench/");
+  return src.substr(0, (at == std::string::npos) ? 0 : at) + "tools/otadelta.py";
+}
+
+static bool writeFile(const std::string& path, const Bytes& data) {
+  FILE* f = fopen(path.c_str(), "wb");
+  bool  ok = f && (fwrite(data.data(), 1, data.size(), f) == data.size());
+  return (f && !fclose(f)) && ok;
+}
+
+static bool toolPatch(const Bytes& base, const Bytes& image, Bytes& patch) {
+  std::string tool = toolPath(), tmp = "/tmp/benchOta." + std::to_string(getpid());
+  std::string cmd = "python3 '" + tool + "' make " + tmp + ".base " + tmp + ".new -o " + tmp + ".delta >/dev/null";
+  bool        ok = false;
+  if (!access(tool.c_str(), R_OK) && writeFile(tmp + ".base", base) && writeFile(tmp + ".new", image) &&
+      !system(cmd.c_str())) {
+    FILE* f = fopen((tmp + ".delta").c_str(), "rb");
+    if (f) {
+      uint8_t buf[4096];
+      size_t  n;
+      patch.clear();
+      while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        patch.insert(patch.end(), buf, buf + n);
+      }
+      fclose(f);
+      ok = !patch.empty();
+    }
+  }
+  for (const char* ext : {".base", ".new", ".delta"}) {
+    remove((tmp + ext).c_str());
+  }
+  if (!ok) {
+    printf("  %-24s not run: %s (python3) failed\n", "delta otadelta.py", tool.c_str());
+  }
+  return ok;
+}
+
+// a patch the device has to refuse
+static void refused(const char* name, const Bytes& patch) {
+  OtaRun run;
+  transfer(patch, OTA_DELTA_WINDOW, run);
+  printf("  %s: \"%s\" after %u chunks, boot partition %s\n", name, run.answer.c_str(), run.chunks,
+         esp_ota_get_boot_partition()->label);
+}
+
+void benchOta(const BenchOptions& opt) {
+  Bytes       base, image, none;
+  PatchWriter delta(base, image), full(none, image);
+  benchSection("delta OTA");
+  makeImages(base, image, delta);
+  simLoadSketch(base.data(), base.size());
+  setupDeviceFacts();                      // MD5 of the new running sketch
+  simSetRestartHandler(onRestart);
+  full.data(0, (uint32_t)image.size());
+
+  Bytes raw = full.patch(OTA_FLAG_FULL), hs = full.patch(OTA_FLAG_FULL | OTA_FLAG_HEATSHRINK);
+  Bytes patch = delta.patch(0), hsPatch = delta.patch(OTA_FLAG_HEATSHRINK);
+  printf("  image %zu bytes, link %u ms one way, %u kbit/s, chunks of <= %u bytes, window %u\n", image.size(),
+         BENCH_LINK_MS, BENCH_LINK_KBPS, OTA_DELTA_CHUNK, OTA_DELTA_WINDOW);
+  printf("  %-24s %7s %6s %8s %9s %6s %8s %8s  %s\n", "transfer", "bytes", "chunks", "ms", "image B/s", "resend",
+         "loop[ms]", "progress", "result");
+  update("full, stop and wait", raw, image, 1);
+  update("full, window", raw, image, OTA_DELTA_WINDOW);
+  update("full heatshrink, window", hs, image, OTA_DELTA_WINDOW);
+  update("delta, window", patch, image, OTA_DELTA_WINDOW);
+  update("delta heatshrink, window", hsPatch, image, OTA_DELTA_WINDOW, (uint32_t)hsPatch.size() / 2);
+  printf("  chunk sent twice: %u refused (out of order)\n", g_OtaDelta.stats().repeats);
+  Bytes toolDelta;
+  if (toolPatch(base, image, toolDelta)) {
+    update("delta otadelta.py, window", toolDelta, image, OTA_DELTA_WINDOW);
+  }
+
+  // corrupt patch: a byte of the appended data
+  Bytes bad = patch;
+  bad[bad.size() - BENCH_OTA_APPEND / 2] ^= 0x40;
+  refused("corrupt patch", bad);
+  // patch of another base
+  Bytes other = patch;
+  other[16] ^= 0x01;
+  refused("other base", other);
+  simSetRestartHandler(nullptr);
+}
@@ -0,0 +1,208 @@
+/*!
+ * @file benchOutbox.cpp
+ */
+/************************************************************
+ * Benchmark: Offline Outbox
+ * - broker down for 2 and 10 min while the firmware produces
+ *   results (1/s), log lines (LOGI, 1/5 s) and its telemetry:
+ *   messages queued, replaced (keep latest), dropped, sent
+ *   after the reconnect, drain time and order of the results;
+ *   the log is not queued, g_LogBatch holds it (TOPIC_LOG
+ *   payloads after the reconnect)
+ * - under load: results at 100/s (above the OUTBOX_DRAIN_BURST
+ *   per T_OUTBOX_DRAIN of jobOutbox) through a short outage;
+ *   the queue must empty while they keep coming (what does
+ *   not fit the ring until ONLINE is dropped, as offline)
+ * - spill: 10 min of results into an 8 KB ring with and
+ *   without the flash partition (native/shim/esp_partition)
+ * - cost of push (keep all / keep latest) and front + pop
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <outbox.h>
+#include <outboxSpill.h>
+#include <binLog.h>
+#include "bench.h"
+
+#define BENCH_MAX_DRAIN_MS  120000
+#define BENCH_RESULT_MS     1000         // one command result per second while offline
+#define BENCH_LOG_MS        5000         // one log line every 5 seconds
+#define BENCH_LOAD_MS       10           // results under load: 100/s
+#define BENCH_LOAD_DOWN_MS  1000         // outage under load
+#define BENCH_LOAD_UP_MS    10000        // results after the reconnect
+
+struct OutageCount {
+  uint32_t results;
+  uint32_t logs;
+  uint32_t cpu;
+  uint32_t outOfOrder;
+  long     lastSeq;
+};
+
+static void outage(const char* name, uint32_t ms) {
+  LocalBroker& broker = LocalBroker::instance();
+  OutageCount  got = {0, 0, 0, 0, -1};
+  char         msg[32];
+  OutboxStats  s0 = g_Outbox.stats();
+  int tapResult = broker.addTap(TOPIC_RESULT, [&](const BrokerMessage& m) {
+    long seq = atol(m.payload.c_str() + 7);          // "result N"
+    got.outOfOrder += (seq <= got.lastSeq);
+    got.lastSeq = seq;
+    got.results++;
+  });
+  int tapLog = broker.addTap(TOPIC_LOG, [&](const BrokerMessage&) { got.logs++; });
+  int tapCpu = broker.addTap(TOPIC_CPU, [&](const BrokerMessage&) { got.cpu++; });
+
+  // offline
+  broker.setUp(false);
+  uint32_t start = millis(), results = 0, logs = 0;
+  while (millis() - start < ms) {
+    uint32_t t = millis() - start;
+    if (t >= results * BENCH_RESULT_MS) {
+      snprintf(msg, sizeof(msg), "result %u", results++);
+      mqttPub(TOPIC_RESULT, msg, true);
+    }
+    if (t >= logs * BENCH_LOG_MS) {
+      LOGI(MAIN, "bench: log %u", (unsigned)logs++);
+    }
+    loop();
+    simAdvanceMillis(1);
+  }
+  uint32_t depth = g_Outbox.depth();
+  size_t   bytes = g_Outbox.bytes();
+
+  // back online, drain
+  broker.setUp(true);
+  uint32_t back = millis(), online = 0, longest = 0;
+  while (!(online && g_Outbox.empty()) && (millis() - back < BENCH_MAX_DRAIN_MS)) {
+    uint32_t t0 = millis();
+    loop();
+    if (online) {
+      longest = (millis() - t0 > longest) ? millis() - t0 : longest;
+    } else if (g_Net.phase == NET_ONLINE) {
+      online = millis();
+    }
+    simAdvanceMillis(1);
+  }
+  jobLogFlush();
+  broker.removeTap(tapResult);
+  broker.removeTap(tapLog);
+  broker.removeTap(tapCpu);
+
+  const OutboxStats& s = g_Outbox.stats();
+  printf("  %-20s queued %4u (%5zu B)  replaced %3u  dropped %3u   results %3u/%3u  log %3u  cpu %u"
+         "  out of order %u\n", name, depth, bytes, s.replaced - s0.replaced, s.dropped - s0.dropped,
+         got.results, results, got.logs, got.cpu, got.outOfOrder);
+  printf("  %-20s drained %u messages in %u ms after ONLINE, longest loop() %u ms\n", "",
+         s.sent - s0.sent, millis() - online, longest);
+}
+
+// results faster than jobOutbox drains, through an outage
+static void underLoad(void) {
+  LocalBroker& broker = LocalBroker::instance();
+  OutageCount  got = {0, 0, 0, 0, -1};
+  char         msg[32];
+  int tapResult = broker.addTap(TOPIC_RESULT, [&](const BrokerMessage& m) {
+    long seq = atol(m.payload.c_str() + 7);          // "result N"
+    got.outOfOrder += (seq <= got.lastSeq);
+    got.lastSeq = seq;
+    got.results++;
+  });
+  OutboxStats  s0 = g_Outbox.stats();
+  broker.setUp(false);
+  uint32_t start = millis(), results = 0, online = 0, empty = 0, depth = 0;
+  while (millis() - start < BENCH_LOAD_DOWN_MS + BENCH_LOAD_UP_MS) {
+    uint32_t t = millis() - start;
+    if (t == BENCH_LOAD_DOWN_MS) {
+      broker.setUp(true);
+    }
+    if (t >= results * BENCH_LOAD_MS) {
+      snprintf(msg, sizeof(msg), "result %u", results++);
+      mqttPub(TOPIC_RESULT, msg, true);
+    }
+    loop();
+    if (!online && (g_Net.phase == NET_ONLINE) && (t >= BENCH_LOAD_DOWN_MS)) {
+      online = millis();
+      depth = g_Outbox.keepAll();
+    }
+    empty = (online && !empty && !g_Outbox.keepAll()) ? millis() : empty;
+    simAdvanceMillis(1);
+  }
+  for (uint32_t t = 0; (t < 1000) && (got.results < results); t++) {
+    loop();
+    simAdvanceMillis(1);
+  }
+  broker.removeTap(tapResult);
+  printf("  %-20s %u results/s, ONLINE %u ms after the broker, %u queued (dropped %u), queue empty %d ms later\n",
+         "under load", 1000 / BENCH_LOAD_MS, online - start - BENCH_LOAD_DOWN_MS, depth,
+         g_Outbox.stats().dropped - s0.dropped, empty ? (int)(empty - online) : -1);
+  printf("  %-20s results %u/%u, out of order %u%s\n", "", got.results, results, got.outOfOrder,
+         benchCheck(empty, "  !! ERROR: the queue did not empty"));
+}
+
+// 10 min of results (1/s, ~200 B) into a ring of OUTBOX_SIZE
+static void spill(const char* name, OutboxSpill* store) {
+  static Outbox<OUTBOX_SIZE> box;
+  char          msg[200];
+  OutboxMessage m;
+  box = Outbox<OUTBOX_SIZE>();
+  box.setSpill(store);
+  uint64_t t0 = simMicros64();
+  for (uint32_t i = 0; i < 600; i++) {
+    memset(msg, 'x', sizeof(msg));
+    int n = snprintf(msg, sizeof(msg), "result %u ", i);
+    msg[n] = 'x';
+    box.push(TOPIC_RESULT, msg, sizeof(msg), false, OUTBOX_KEEP_ALL);
+  }
+  uint32_t eraseMs = (uint32_t)((simMicros64() - t0) / 1000);
+  uint32_t depth = box.depth(), first = 0, sent = 0, outOfOrder = 0;
+  long     last = -1;
+  while (box.front(m)) {
+    long seq = atol(m.payload + 7);
+    first = sent ? first : (uint32_t)seq;
+    outOfOrder += (seq <= last);
+    last = seq;
+    box.pop();
+    sent++;
+  }
+  printf("  %-20s 600 results: kept %3u (spilled %3u, dropped %3u), oldest kept #%u, out of order %u,"
+         " erase %u ms\n", name, depth, box.stats().spilled, box.stats().dropped, first, outOfOrder, eraseMs);
+}
+
+static void operations(const BenchOptions& opt) {
+  static Outbox<OUTBOX_SIZE> box;
+  const char         msg[] = "{\"Heap Size\":349264,\"FreeHeap\":260632,\"Millis\":5220121}";
+  OutboxMessage      m;
+  LatencyStats       keepAll, keepLatest, drain;
+  uint32_t           n = opt.calls;
+  keepAll.reserve(n);
+  keepLatest.reserve(n);
+  drain.reserve(n);
+  for (uint32_t i = 0; i < n; i++) {
+    BENCH_CALL(keepAll, box.push(TOPIC_RESULT, msg, sizeof(msg) - 1, false, OUTBOX_KEEP_ALL));
+    BENCH_CALL(keepLatest, box.push(TOPIC_CPU, msg, sizeof(msg) - 1, false, OUTBOX_KEEP_LATEST));
+    BENCH_CALL(drain, if (box.front(m)) { box.pop(); });
+  }
+  LatencyStats::printHeader();
+  keepAll.print("push keep all (ring full)");
+  keepLatest.print("push keep latest");
+  drain.print("front + pop");
+}
+
+void benchOutbox(const BenchOptions& opt) {
+  static PartitionSpill flash;
+  benchSection("offline outbox");
+  outage("broker down 2 min", 120000);
+  outage("broker down 10 min", 600000);
+  underLoad();
+  spill("RAM only", nullptr);
+  flash.begin("outbox");
+  spill("RAM + flash 64 KB", &flash);
+
+  benchSection("offline outbox: operations");
+  operations(opt);
+}
@@ -0,0 +1,93 @@
+/*!
+ * @file benchProbe.cpp
+ */
+/************************************************************
+ * Benchmark: Command Latency Probe
+ * - "probe SEQ" on TOPIC_CMD at opt.cmdRate for opt.seconds,
+ *   the result on TOPIC_RESULT carries the cycle stamps of
+ *   the firmware (see cmdProbe.h)
+ * - round trip split as tools/cmdprobe.py does it: network
+ *   (round trip - pub: broker, the wait for mqtt.loop(), the
+ *   way out), queue (rx -> start), handler (start -> end),
+ *   format (end -> pub)
+ * - single loop() vs. network task + loop() (dual-core: the
+ *   command waits in g_CmdQueue, queue time shows it)
+ * - delay() sleeps for real here (as benchTasks)
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <mutex>
+#include <vector>
+#include "bench.h"
+
+struct ProbeStats {
+  LatencyStats rtt;
+  LatencyStats network;
+  LatencyStats queue;
+  LatencyStats handler;
+  LatencyStats format;
+  uint32_t     bad = 0;                    // result without stamps
+};
+
+static void probeRun(const BenchOptions& opt, const char* name) {
+  LocalBroker&          broker = LocalBroker::instance();
+  uint32_t              total = opt.cmdRate * opt.seconds;
+  std::vector<uint64_t> sentAt(total);
+  std::mutex            lock;
+  ProbeStats            s;
+  int tap = broker.addTap(TOPIC_RESULT, [&](const BrokerMessage& m) {
+    uint64_t now = benchNow();
+    unsigned seq, mhz, start, end, pub;
+    std::lock_guard<std::mutex> guard(lock);
+    if ((sscanf(m.payload.c_str(), "probe %u mhz=%u start=%u end=%u pub=%u", &seq, &mhz, &start, &end, &pub) != 5) ||
+        (seq >= total) || !mhz) {
+      s.bad++;
+      return;
+    }
+    uint64_t rtt = now - sentAt[seq], device = (uint64_t)pub * 1000 / mhz;
+    s.rtt.add(rtt);
+    s.network.add((rtt > device) ? rtt - device : 0);
+    s.queue.add((uint64_t)start * 1000 / mhz);
+    s.handler.add((uint64_t)(end - start) * 1000 / mhz);
+    s.format.add((uint64_t)(pub - end) * 1000 / mhz);
+  });
+  uint64_t t0 = benchNow(), period = 1000000000ULL / opt.cmdRate;
+  uint32_t sent = 0;
+  char     cmd[32];
+  while ((sent < total) || (benchNow() - t0 < (uint64_t)(opt.seconds + 1) * 1000000000ULL)) {
+    if ((sent < total) && (benchNow() - t0 >= sent * period)) {
+      snprintf(cmd, sizeof(cmd), "probe %u", sent);
+      sentAt[sent] = benchNow();
+      broker.inject(TOPIC_CMD, cmd);
+      sent++;
+    }
+    loop();
+    std::lock_guard<std::mutex> guard(lock);
+    if (s.rtt.count() + s.bad == total) {
+      break;
+    }
+  }
+  broker.removeTap(tap);
+  std::lock_guard<std::mutex> guard(lock);
+  printf("  %s: %zu/%u answered, %u without stamps\n", name, s.rtt.count(), total, s.bad);
+  LatencyStats::printHeader();
+  s.rtt.print("round trip");
+  s.network.print("  network (rtt - pub)");
+  s.queue.print("  queue (rx -> start)");
+  s.handler.print("  handler (start -> end)");
+  s.format.print("  format (end -> pub)");
+}
+
+void benchProbe(const BenchOptions& opt) {
+  benchSection("command latency probe");
+  simSetRealDelay(true);
+  probeRun(opt, "single loop()");
+  startNetTask();
+  probeRun(opt, "network task + loop()");
+  stopNetTask();
+  simSetRealDelay(false);
+}
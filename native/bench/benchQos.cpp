@@ -0,0 +1,220 @@
+/*!
+ * @file benchQos.cpp
+ */
+/************************************************************
+ * Benchmark: QoS 1 Publishing
+ * - BENCH_QOS_MESSAGES results of BENCH_QOS_PAYLOAD bytes on
+ *   TOPIC_RESULT over a link of BENCH_QOS_LINK_US round trip
+ *   (simSetLinkDelay): QoS 0 vs. QoS 1 with windows of 1 to
+ *   MQTT_QOS_SLOTS packets; the sender waits while
+ *   mqttQosRoom() says no (back-pressure)
+ * - throughput (until the last PUBACK), ack latency (send ->
+ *   PUBACK in the receive task), share of the time the
+ *   sender waited for room; QoS 0 does not wait for the link
+ * - burst: a sender that ignores the back-pressure, the
+ *   outbox takes what the window refused (mqttPub false)
+ * - broker restart with a window in flight on a slow link:
+ *   half of it reached the broker (PUBACK on its way), half
+ *   is still on the link and lost; all of it is sent again
+ *   after the reconnect (DUP), so the first half twice
+ * - delay() sleeps for real (the receive task runs on the
+ *   real clock)
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <mqttQos.h>
+#include <outbox.h>
+#include <mutex>
+#include <vector>
+#include "bench.h"
+
+#define BENCH_QOS_MESSAGES   1000
+#define BENCH_QOS_PAYLOAD    100           // a command result
+#define BENCH_QOS_LINK_US    2000          // WLAN to a broker in the LAN
+#define BENCH_QOS_BURST      48            // fits the outbox
+#define BENCH_QOS_SLOW_US    40000         // link of the restart check
+#define BENCH_QOS_TIMEOUT_S  20
+
+// host side: which results arrived at the broker, how often
+struct QosReceiver {
+  std::mutex            lock;
+  std::vector<uint32_t> copies;
+  int                   tap;
+
+  explicit QosReceiver(uint32_t total) : copies(total, 0) {
+    tap = LocalBroker::instance().addTap(TOPIC_RESULT, [this](const BrokerMessage& m) {
+      unsigned seq;
+      std::lock_guard<std::mutex> guard(lock);
+      if ((sscanf(m.payload.c_str(), "qos %u", &seq) == 1) && (seq < copies.size())) {
+        copies[seq]++;
+      }
+    });
+  }
+  ~QosReceiver(void) {
+    LocalBroker::instance().removeTap(tap);
+  }
+  void count(uint32_t& distinct, uint32_t& extra) {
+    std::lock_guard<std::mutex> guard(lock);
+    distinct = extra = 0;
+    for (uint32_t c : copies) {
+      distinct += (c > 0);
+      extra += (c > 1) ? c - 1 : 0;
+    }
+  }
+};
+
+static size_t result(char* buf, uint32_t seq) {
+  int n = snprintf(buf, BENCH_QOS_PAYLOAD + 1, "qos %u ", seq);
+  memset(buf + n, 'x', BENCH_QOS_PAYLOAD - n);
+  return BENCH_QOS_PAYLOAD;
+}
+
+static bool settled(void) {
+  return !g_QosWindow.inFlight() && g_Outbox.empty();
+}
+
+static void windowRun(uint32_t window, bool qos) {
+  char        msg[BENCH_QOS_PAYLOAD + 1];
+  QosReceiver rx(BENCH_QOS_MESSAGES);
+  uint32_t    sent = 0, distinct, extra;
+  uint64_t    waitNs = 0;
+  g_QosOn = qos;
+  g_QosWindow.limit(window);
+  g_QosStats.ackUs.reset();
+  MqttQosStats s0 = g_QosStats;
+  uint64_t     t0 = benchNow();
+  while (benchNow() - t0 < BENCH_QOS_TIMEOUT_S * 1000000000ULL) {
+    while ((sent < BENCH_QOS_MESSAGES) && mqttQosRoom(TOPIC_RESULT, BENCH_QOS_PAYLOAD)) {
+      mqttPub(TOPIC_RESULT, msg, result(msg, sent), true, false);
+      sent++;
+    }
+    bool     waiting = (sent < BENCH_QOS_MESSAGES);
+    uint64_t t1 = benchNow();
+    loop();
+    if ((sent == BENCH_QOS_MESSAGES) && settled()) {
+      rx.count(distinct, extra);
+      if (qos || (distinct == BENCH_QOS_MESSAGES)) {
+        break;
+      }
+    }
+    waitNs += waiting ? benchNow() - t1 : 0;
+  }
+  double s = (benchNow() - t0) / 1e9;
+  rx.count(distinct, extra);
+  if (!qos) {
+    printf("  %-10s %8.0f msg/s %10s %10s %10s %7u/%u %6.1f %%\n", "QoS 0", distinct / s, "-", "-", "-", distinct,
+           BENCH_QOS_MESSAGES, 0.0);
+    return;
+  }
+  const LogHistogram<QOS_HIST_BUCKETS>& h = g_QosStats.ackUs;
+  char name[16];
+  snprintf(name, sizeof(name), "window %u", window);
+  printf("  %-10s %8.0f msg/s %10u %10u %10u %7u/%u %6.1f %%%s\n", name, (g_QosStats.acked - s0.acked) / s,
+         h.percentile(50), h.percentile(99), h.max(), distinct, BENCH_QOS_MESSAGES, waitNs / 1e7 / s,
+         (g_QosStats.blocked != s0.blocked) ? "  !! window refused a packet" : "");
+}
+
+// a sender that does not ask for room
+static void burstRun(void) {
+  char        msg[BENCH_QOS_PAYLOAD + 1];
+  QosReceiver rx(BENCH_QOS_BURST);
+  uint32_t    handed = 0, distinct, extra;
+  g_QosOn = true;
+  g_QosWindow.limit(MQTT_QOS_WINDOW);
+  MqttQosStats  s0 = g_QosStats;
+  OutboxStats   o0 = g_Outbox.stats();
+  uint64_t      t0 = benchNow();
+  for (uint32_t seq = 0; seq < BENCH_QOS_BURST; seq++) {
+    handed += mqttPub(TOPIC_RESULT, msg, result(msg, seq), true, false);
+  }
+  uint32_t queued = g_Outbox.depth();
+  while (!settled() && (benchNow() - t0 < BENCH_QOS_TIMEOUT_S * 1000000000ULL)) {
+    loop();
+  }
+  double ms = (benchNow() - t0) / 1e6;
+  rx.count(distinct, extra);
+  printf("  burst of %u, window %u: %u sent at once, %u to the outbox (mqttPub false), %u blocked;\n"
+         "  all acknowledged after %.1f ms, %u/%u at the broker, %u twice, outbox dropped %u\n",
+         BENCH_QOS_BURST, (unsigned)MQTT_QOS_WINDOW, handed, queued, g_QosStats.blocked - s0.blocked, ms, distinct,
+         BENCH_QOS_BURST, extra, (unsigned)(g_Outbox.stats().dropped - o0.dropped));
+}
+
+// a window in flight on a slow link when the broker goes down
+static void restartRun(void) {
+  LocalBroker& broker = LocalBroker::instance();
+  char         msg[BENCH_QOS_PAYLOAD + 1];
+  uint32_t     window = MQTT_QOS_WINDOW, distinct, extra;
+  QosReceiver  rx(window);
+  g_QosOn = true;
+  g_QosWindow.limit(window);
+  simSetLinkDelay(BENCH_QOS_SLOW_US);
+  MqttQosStats s0 = g_QosStats;
+  // the first half reaches the broker, then it goes down
+  for (uint32_t seq = 0; seq < window; seq++) {
+    if (seq == window / 2) {
+      delayMicroseconds(BENCH_QOS_SLOW_US / 2 + 2000);
+    }
+    mqttPub(TOPIC_RESULT, msg, result(msg, seq), true, false);
+  }
+  uint32_t inFlight = g_QosWindow.inFlight();
+  uint32_t before;
+  rx.count(before, extra);
+  broker.setUp(false);
+  simSetRealDelay(false);
+  for (uint32_t t = 0; (g_Net.phase == NET_ONLINE) && (t < 1000); t++) {
+    loop();
+    simAdvanceMillis(1);
+  }
+  broker.setUp(true);
+  uint32_t up = millis();
+  while ((g_Net.phase != NET_ONLINE) && (millis() - up < 60000)) {
+    loop();
+    simAdvanceMillis(10);
+  }
+  uint32_t online = (g_Net.phase == NET_ONLINE) ? millis() - up : 0;
+  simSetRealDelay(true);
+  for (uint32_t t = 0; (t < 2000) && !settled(); t++) {
+    loop();
+    delay(1);
+  }
+  rx.count(distinct, extra);
+  printf("  %u in flight (link %u ms), %u at the broker when it went down, ONLINE again after %u ms\n", inFlight,
+         BENCH_QOS_SLOW_US / 1000, before, online);
+  printf("  retransmitted %u (DUP), acknowledged %u, %u/%u at the broker, %u twice, %u still in flight\n",
+         g_QosStats.retransmits - s0.retransmits, g_QosStats.acked - s0.acked, distinct, window, extra,
+         g_QosWindow.inFlight());
+  simSetLinkDelay(0);
+}
+
+void benchQos(const BenchOptions& opt) {
+  (void)opt;
+  simSetRealDelay(true);
+  startRxTask();
+
+  benchSection("QoS 1 publishing: throughput and ack latency");
+  printf("  %u results of %u bytes, link round trip %u us, sender waits for mqttQosRoom()\n", BENCH_QOS_MESSAGES,
+         BENCH_QOS_PAYLOAD, BENCH_QOS_LINK_US);
+  printf("  %-10s %14s %10s %10s %10s %9s %6s\n", "", "throughput", "ack p50 us", "ack p99 us", "ack max us",
+         "at broker", "waiting");
+  simSetLinkDelay(BENCH_QOS_LINK_US);
+  windowRun(0, false);
+  for (uint32_t window = 1; window <= MQTT_QOS_SLOTS; window *= 2) {
+    windowRun(window, true);
+  }
+
+  benchSection("QoS 1 publishing: back-pressure");
+  burstRun();
+  simSetLinkDelay(0);
+
+  benchSection("QoS 1 publishing: broker restart");
+  restartRun();
+
+  g_QosOn = false;
+  g_QosWindow.limit(MQTT_QOS_WINDOW);
+  stopRxTask();
+  simSetRealDelay(false);
+}
@@ -0,0 +1,110 @@
+/*!
+ * @file benchReconnect.cpp
+ */
+/************************************************************
+ * Benchmark: WiFi Fast Reconnect
+ * - reboot (as after OTA): WiFi and the MQTT session are
+ *   dropped, setupWIFI() runs again, loop() until ONLINE
+ * - cached BSSID + lease vs. access point moved to another
+ *   channel (fast attempt fails, scan + DHCP)
+ * - broker maintenance: broker down for 2 min, longest
+ *   loop() pass (virtual ms), connect attempts, DNS lookups
+ *   and time until ONLINE once the broker is back
+ * - backoff: spread of the reconnect attempts of 1000
+ *   devices (netBackoff) after the broker came back
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <WiFi.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include "bench.h"
+
+#define BENCH_MAX_RECONNECT_MS  60000
+#define BENCH_OUTAGE_MS         120000
+#define BENCH_FLEET             1000
+
+static void reboot(const char* name) {
+  LocalBroker& broker = LocalBroker::instance();
+  // drop WiFi, the MQTT session and g_Net, keep g_NetCache (RTC memory)
+  broker.setUp(false);
+  broker.setUp(true);
+  WiFi.disconnect();
+  memset(&g_Net, 0, sizeof(g_Net));
+  uint32_t start = millis();
+  setupWIFI();
+  while ((g_Net.phase != NET_ONLINE) && (millis() - start < BENCH_MAX_RECONNECT_MS)) {
+    loop();
+    simAdvanceMillis(1);
+  }
+  printf("  %-28s IP after %5u ms, ONLINE after %5u ms   fast hits %u misses %u\n", name, g_Net.connectMs,
+         millis() - start, g_Net.fastHits, g_Net.fastMisses);
+}
+
+// run loop() for ms of virtual time, returns the longest pass
+static uint32_t runFor(uint32_t ms) {
+  uint32_t end = millis() + ms;
+  uint32_t longest = 0;
+  while ((int32_t)(millis() - end) < 0) {
+    uint32_t t0 = millis();
+    loop();
+    longest = (millis() - t0 > longest) ? millis() - t0 : longest;
+    simAdvanceMillis(1);
+  }
+  return longest;
+}
+
+static void brokerOutage(void) {
+  LocalBroker& broker = LocalBroker::instance();
+  uint32_t     dns = g_Net.dnsLookups;
+  uint32_t     reconnects = g_Net.mqttReconnects;
+  broker.setUp(false);
+  uint32_t longest = runFor(BENCH_OUTAGE_MS);
+  uint32_t attempts = g_Net.attempts;
+  uint32_t back = millis();
+  broker.setUp(true);
+  while ((g_Net.mqttReconnects == reconnects) && (millis() - back < BENCH_MAX_RECONNECT_MS)) {
+    loop();
+    simAdvanceMillis(1);
+  }
+  printf("  %-28s longest loop() %u ms (TCP timeout %u ms), %u attempts, %u DNS lookups, ONLINE %u ms after\n",
+         "broker down 2 min", longest, broker.connectTimeMs(), attempts, g_Net.dnsLookups - dns, millis() - back);
+}
+
+// first attempt of each device after the broker came back,
+// all of them failed rounds 0..n at the same time before
+static void backoffSpread(void) {
+  static const uint8_t rounds[] = {0, 3, 6};
+  for (size_t r = 0; r < sizeof(rounds); r++) {
+    uint32_t lo = 0xffffffff, hi = 0, buckets[10] = {0};
+    uint32_t base = netBackoff(rounds[r], 1000, 60000, 0) * 2;
+    for (uint32_t i = 0; i < BENCH_FLEET; i++) {
+      uint32_t wait = netBackoff(rounds[r], 1000, 60000, (uint32_t)random(0x7fffffff));
+      lo = (wait < lo) ? wait : lo;
+      hi = (wait > hi) ? wait : hi;
+      buckets[(wait - base / 2) * 10 / (base / 2 + 1)]++;
+    }
+    printf("  backoff round %u: %5u..%5u ms, per 10%%:", rounds[r], lo, hi);
+    for (int b = 0; b < 10; b++) {
+      printf(" %3u", buckets[b]);
+    }
+    printf("\n");
+  }
+}
+
+void benchReconnect(const BenchOptions& opt) {
+  (void)opt;
+  benchSection("WiFi reconnect after reboot");
+  g_NetCache.magic = 0;
+  reboot("no cache (scan + DHCP)");
+  reboot("cached BSSID + lease");
+  simWifiSetChannel(11);
+  reboot("access point moved");
+  reboot("cached BSSID + lease");
+  simWifiSetChannel(6);
+
+  benchSection("MQTT reconnect");
+  brokerOutage();
+  backoffSpread();
+}
@@ -0,0 +1,246 @@
+/*!
+ * @file benchRoller.cpp
+ */
+/************************************************************
+ * Benchmark: Roller Shutter Engine
+ * - thousands of random moves through the commands and
+ *   loop(): single moves, grouped moves, reversals while
+ *   running, moves to the ends; loop() passes 0.5 .. 10 ms
+ *   apart (virtual time)
+ * - a physical model of the motors runs on the relay outputs
+ *   of the simulated MCP 23017 (g_SimMcp[0]) with the true
+ *   travel times: calibration exact, or off by up to +-2 %
+ * - reported: position error of the engine against the model
+ *   after each move, relay safety (both relays on, shortest
+ *   pause before a reversal), start skew of grouped moves
+ * - roller states on TOPIC_ROLLER (published by rollerLoop):
+ *   how many, and the last one after all stopped must say
+ *   "Busy":0
+ * - cost of tick() for NUM_ROLLERS and 16 rollers
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <roller.h>
+#include <telemetry.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "bench.h"
+
+#define BENCH_ROLLER_IDLE_MS  120000       // max. time until all rollers stopped
+#define BENCH_ROLLER_STATE_MS 2000         // > T_ROLLER_PUBLISH (main.cpp)
+
+static uint32_t s_Seed = 12345;
+
+static uint32_t rnd(uint32_t n) {
+  s_Seed = s_Seed * 1103515245u + 12345u;
+  return (s_Seed >> 8) % n;
+}
+
+struct RollerPlant {
+  double   pos[NUM_ROLLERS];               // 0 .. 1 between the end stops
+  double   upUs[NUM_ROLLERS];              // true travel times
+  double   downUs[NUM_ROLLERS];
+  uint64_t offAt[NUM_ROLLERS];             // us: motor stopped
+  int      lastDir[NUM_ROLLERS];           // direction before the stop
+  uint64_t onAt[NUM_ROLLERS];              // us: motor started
+  uint32_t relays;
+  uint32_t bothOn;                         // passes with up and down on
+  uint64_t minReversePause;                // us
+  uint64_t lastUs;
+};
+
+static int relayDir(uint32_t relays, int i) {
+  uint32_t bits = (relays >> (2 * i)) & 3;
+  return (bits == 1) ? -1 : (bits == 2) ? 1 : 0;
+}
+
+static void plantInit(RollerPlant& p, double calErr) {
+  for (int i = 0; i < NUM_ROLLERS; i++) {
+    double e = calErr * ((double)rnd(2001) / 1000.0 - 1.0);
+    p.pos[i] = std::min(1.0, std::max(0.0, g_Rollers.position(i) / (double)ROLLER_FULL));
+    p.upUs[i] = g_RollerUpMs[i] * 1000.0 * (1.0 + e);
+    p.downUs[i] = g_RollerDownMs[i] * 1000.0 * (1.0 + e);
+    p.offAt[i] = 0;
+    p.lastDir[i] = 0;
+    p.onAt[i] = 0;
+  }
+  p.relays = g_SimMcp[0].outputs() & 0xff;
+  p.bothOn = 0;
+  p.minReversePause = UINT64_MAX;
+  p.lastUs = simMicros64();
+}
+
+// motors run with the current relays until now
+static void plantRun(RollerPlant& p) {
+  uint64_t now = simMicros64();
+  double   dt = (double)(now - p.lastUs);
+  for (int i = 0; i < NUM_ROLLERS; i++) {
+    int dir = relayDir(p.relays, i);
+    p.pos[i] += (dir < 0) ? -dt / p.upUs[i] : (dir > 0) ? dt / p.downUs[i] : 0.0;
+    p.pos[i] = std::min(1.0, std::max(0.0, p.pos[i]));
+  }
+  p.lastUs = now;
+}
+
+// relays may have changed in loop()
+static void plantRelays(RollerPlant& p) {
+  uint32_t relays = g_SimMcp[0].outputs() & 0xff;
+  uint64_t now = simMicros64();
+  for (int i = 0; i < NUM_ROLLERS; i++) {
+    int was = relayDir(p.relays, i), dir = relayDir(relays, i);
+    p.bothOn += (((relays >> (2 * i)) & 3) == 3);
+    if (was && (dir != was)) {
+      p.offAt[i] = now;
+      p.lastDir[i] = was;
+    }
+    if (dir && (dir != was)) {
+      p.onAt[i] = now;
+      if (p.lastDir[i] && (dir != p.lastDir[i])) {
+        p.minReversePause = std::min(p.minReversePause, (was ? 0 : now - p.offAt[i]));
+      }
+    }
+  }
+  p.relays = relays;
+}
+
+static void step(RollerPlant& p) {
+  simAdvanceMicros(500 + rnd(9500));
+  plantRun(p);
+  loop();
+  plantRun(p);                             // the relays switched at the start of the pass
+  plantRelays(p);
+}
+
+static bool runUntilIdle(RollerPlant& p) {
+  uint64_t start = simMicros64();
+  while (g_Rollers.busy() && (simMicros64() - start < BENCH_ROLLER_IDLE_MS * 1000ULL)) {
+    step(p);
+  }
+  return !g_Rollers.busy();
+}
+
+static void command(const char* fmt, uint32_t a, uint32_t b) {
+  char cmd[48];
+  snprintf(cmd, sizeof(cmd), fmt, a, b);
+  runCommands(cmd);
+}
+
+static void moves(const char* name, uint32_t n, double calErr) {
+  RollerPlant         p;
+  std::vector<double> err;
+  std::vector<double> skew;
+  uint32_t            stuck = 0, states = 0;
+  std::string         lastState;
+  std::mutex          lock;
+  RollerStats         s0 = g_Rollers.stats();
+  int tap = LocalBroker::instance().addTap(TOPIC_ROLLER, [&](const BrokerMessage& msg) {
+    std::lock_guard<std::mutex> guard(lock);
+    states++;
+    lastState = msg.payload;
+  });
+  plantInit(p, calErr);
+  err.reserve(n * NUM_ROLLERS);
+  for (uint32_t m = 0; m < n; m++) {
+    uint32_t kind = rnd(100);
+    uint32_t percent = rnd(8) ? rnd(101) : 100 * rnd(2);
+    if (kind < 60) {
+      command("roller %u %u", rnd(NUM_ROLLERS), percent);
+    } else if (kind < 85) {
+      uint32_t mask = 1 + rnd((1u << NUM_ROLLERS) - 1), waiting = 0;
+      command("rollers %u %u", mask, percent);
+      for (int i = 0; i < NUM_ROLLERS; i++) {
+        waiting |= (uint32_t)(((g_Rollers.busy() >> i) & 1) && !g_Rollers.direction(i)) << i;
+      }
+      uint64_t first = UINT64_MAX, last = 0;
+      for (uint32_t started = 0; (started != waiting) && g_Rollers.busy(); ) {
+        step(p);
+        for (int i = 0; i < NUM_ROLLERS; i++) {
+          if (((waiting & ~started) >> i) & 1 && relayDir(p.relays, i)) {
+            started |= 1u << i;
+            first = std::min(first, p.onAt[i]);
+            last = std::max(last, p.onAt[i]);
+          }
+        }
+      }
+      if (last) {
+        skew.push_back((double)(last - first));
+      }
+    } else {
+      uint32_t r = rnd(NUM_ROLLERS);
+      command("roller %u %u", r, (g_Rollers.percent(r) < 50) ? 100 : 0);
+      for (uint32_t t = 1000 + rnd(9000); t > 0 && g_Rollers.busy(); t -= std::min(t, 5u)) {
+        step(p);
+      }
+      command("roller %u %u", r, percent);
+    }
+    stuck += !runUntilIdle(p);
+    for (int i = 0; i < NUM_ROLLERS; i++) {
+      err.push_back(std::abs(g_Rollers.position(i) / (double)ROLLER_FULL - p.pos[i]) * 100.0);
+    }
+  }
+  // the state after the last stop
+  for (uint32_t t = 0; t < BENCH_ROLLER_STATE_MS; t += 10) {
+    simAdvanceMillis(10);
+    loop();
+  }
+  LocalBroker::instance().removeTap(tap);
+  std::sort(err.begin(), err.end());
+  double mean = 0, maxSkew = 0;
+  for (double e : err) {
+    mean += e;
+  }
+  for (double s : skew) {
+    maxSkew = std::max(maxSkew, s);
+  }
+  const RollerStats& s = g_Rollers.stats();
+  printf("  %-22s moves %u: error mean %.3f%% p99 %.3f%% max %.3f%%  end syncs %u  reversals %u  stuck %u\n",
+         name, n, mean / err.size(), err[err.size() * 99 / 100], err.back(), s.endSyncs - s0.endSyncs,
+         s.reversals - s0.reversals, stuck);
+  printf("  %-22s both relays on %u, shortest pause before reversal %.0f ms (dead time %u ms),"
+         " group start skew max %.0f us (%zu groups)\n", "", p.bothOn,
+         (p.minReversePause == UINT64_MAX) ? 0.0 : p.minReversePause / 1000.0, ROLLER_DEAD_US / 1000,
+         maxSkew, skew.size());
+  printf("  %-22s roller states published %u, last %s\n", "", states,
+         TelemetryWriter::BINARY                                 ? "binary, not checked"
+         : (lastState.find("\"Busy\":0,") != std::string::npos) ? "all stopped"
+                                                                 : benchCheck(false, "!! ERROR: not all stopped"));
+}
+
+template <size_t N>
+static void tickCost(const char* name, uint32_t calls) {
+  static RollerBank<N> bank;
+  static uint32_t      up[N], down[N];
+  LatencyStats         lat;
+  uint32_t             now = 0;
+  for (size_t i = 0; i < N; i++) {
+    up[i] = 30000;
+    down[i] = 28000;
+  }
+  bank.begin(up, down, now);
+  lat.reserve(calls);
+  for (uint32_t c = 0; c < calls; c++) {
+    if (!bank.busy()) {
+      bank.moveGroup((1u << N) - 1, bank.percent(0) < 50 ? 100 : 0);
+    }
+    now += 1000;
+    BENCH_CALL(lat, bank.tick(now));
+  }
+  lat.print(name);
+}
+
+void benchRoller(const BenchOptions& opt) {
+  benchSection("roller engine");
+  moves("calibration exact", 2000, 0.0);
+  moves("calibration +-2%", 2000, 0.02);
+
+  benchSection("roller engine: operations");
+  LatencyStats::printHeader();
+  tickCost<NUM_ROLLERS>("tick(), 4 rollers", opt.calls);
+  tickCost<16>("tick(), 16 rollers", opt.calls);
+}
@@ -0,0 +1,254 @@
+/*!
+ * @file benchRx.cpp
+ */
+/************************************************************
+ * Benchmark: MQTT Receive Task
+ * - decoder: BENCH_RX_PACKETS packets (PUBLISH of 0..1500
+ *   bytes, every 50th larger than the buffer, PINGRESP in
+ *   between) fed in pieces of 1, 7, 536 and 1460 bytes and
+ *   at once: packets and payloads checked, cost per byte
+ * - firmware: "probe SEQ" at opt.cmdRate from a client
+ *   thread for opt.seconds while the network side carries a
+ *   job of BENCH_RX_SLOW_US every BENCH_RX_SLOW_MS (stand-in
+ *   for ArduinoOTA, reconnects, heavy timer jobs); mqtt.loop()
+ *   vs. receive task, single loop() vs. network task:
+ *   round trip and queue time (arrival -> start); SEQ holds
+ *   the run, answers of an earlier run are not counted, a
+ *   run with commands unanswered is reported as an error
+ * - keepalive: a minute of virtual time without commands,
+ *   PINGREQ sent / answered; broker restart: the lost socket
+ *   is seen, the task takes the new one
+ * - delay() sleeps for real here (as benchTasks)
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <mqttRx.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench.h"
+
+#define BENCH_RX_BUF        2048           // as MQTT_BUFSIZE
+#define BENCH_RX_PACKETS    2000
+#define BENCH_RX_SLOW_US    3000
+#define BENCH_RX_SLOW_MS    10
+#define BENCH_RX_KEEPALIVE  60000          // virtual ms
+#define BENCH_RX_RUN_TAG    1000000            // probe SEQ = run * BENCH_RX_RUN_TAG + seq
+#define BENCH_RX_LATE_S     2                  // wait for the answers still on their way
+
+static void appendPublish(std::string& out, const std::string& topic, size_t len, uint32_t seq) {
+  size_t remaining = 2 + topic.size() + len;
+  out += (char)0x30;
+  do {
+    uint8_t digit = remaining & 0x7f;
+    remaining >>= 7;
+    out += (char)(digit | (remaining ? 0x80 : 0));
+  } while (remaining);
+  out += (char)(topic.size() >> 8);
+  out += (char)(topic.size() & 0xff);
+  out += topic;
+  for (size_t i = 0; i < len; i++) {
+    out += (char)(seq + i);
+  }
+}
+
+static void decoderRun(const std::string& stream, size_t piece, uint32_t expect, uint32_t pings) {
+  static MqttRxDecoder<BENCH_RX_BUF> dec;
+  dec = MqttRxDecoder<BENCH_RX_BUF>();
+  uint32_t       good = 0, bad = 0, pingResp = 0, seq = 0;
+  const uint8_t* p = (const uint8_t*)stream.data();
+  size_t         left = stream.size();
+  uint64_t       t0 = benchNow();
+  while (left && !dec.error()) {
+    size_t n = (left < piece) ? left : piece;
+    left -= n;
+    while (n) {
+      size_t used = dec.feed(p, n);
+      p += used;
+      n -= used;
+      if (!dec.complete()) {
+        continue;
+      }
+      const char* topic;
+      size_t      tl, len;
+      uint8_t*    payload;
+      if (dec.publish(topic, tl, payload, len)) {
+        // the next packet of the stream that fits the buffer
+        while (seq % 50 == 49) {
+          seq++;
+        }
+        uint32_t ok = (len == (seq * 37) % 1500);
+        for (size_t i = 0; ok && (i < len); i++) {
+          ok = (payload[i] == (uint8_t)(seq + i));
+        }
+        good += ok;
+        bad += !ok;
+        seq++;
+      } else if (dec.type() == MQTT_PKT_PINGRESP) {
+        pingResp++;
+      }
+      dec.next();
+    }
+  }
+  uint64_t ns = benchNow() - t0;
+  printf("  pieces of %5zu bytes: %u/%u publishes ok, %u wrong, %u oversize skipped, %u/%u PINGRESP%s, %.2f ns/byte\n",
+         piece, good, expect, bad, dec.oversize(), pingResp, pings, dec.error() ? ", ERROR" : "",
+         (double)ns / stream.size());
+}
+
+static void decoderCheck(void) {
+  std::string stream;
+  std::string topic = TOPIC_CMD;
+  uint32_t    fits = 0, pings = 0;
+  for (uint32_t seq = 0; seq < BENCH_RX_PACKETS; seq++) {
+    if (seq % 50 == 49) {
+      appendPublish(stream, topic, BENCH_RX_BUF + 100, seq);
+    } else {
+      appendPublish(stream, topic, (seq * 37) % 1500, seq);
+      fits++;
+    }
+    if (seq % 10 == 0) {
+      stream.append("\xd0\x00", 2);
+      pings++;
+    }
+  }
+  printf("  %u packets, %zu bytes\n", BENCH_RX_PACKETS + pings, stream.size());
+  for (size_t piece : {(size_t)1, (size_t)7, (size_t)536, (size_t)1460, stream.size()}) {
+    decoderRun(stream, piece, fits, pings);
+  }
+}
+
+static void slowJob(void) {
+  delayMicroseconds(BENCH_RX_SLOW_US);
+}
+
+static void probeRun(const BenchOptions& opt, const char* name) {
+  static uint32_t       s_Run;
+  LocalBroker&          broker = LocalBroker::instance();
+  uint32_t              total = opt.cmdRate * opt.seconds;
+  uint32_t              run = ++s_Run;
+  std::vector<uint64_t> sentAt(total);
+  std::mutex            lock;
+  LatencyStats          rtt, queue;
+  std::atomic<bool>     done(false);
+  int tap = broker.addTap(TOPIC_RESULT, [&](const BrokerMessage& m) {
+    uint64_t now = benchNow();
+    unsigned tag, mhz, start, end, pub;
+    std::lock_guard<std::mutex> guard(lock);
+    if ((sscanf(m.payload.c_str(), "probe %u mhz=%u start=%u end=%u pub=%u", &tag, &mhz, &start, &end, &pub) != 5) ||
+        (tag / BENCH_RX_RUN_TAG != run) || !mhz) {
+      return;                              // not a probe of this run
+    }
+    uint32_t seq = tag % BENCH_RX_RUN_TAG;
+    if ((seq < total) && sentAt[seq]) {
+      rtt.add(now - sentAt[seq]);
+      queue.add((uint64_t)start * 1000 / mhz);
+      sentAt[seq] = 0;                     // counted once
+    }
+  });
+  std::thread client([&]() {
+    char cmd[32];
+    for (uint32_t seq = 0; (seq < total) && !done; seq++) {
+      std::this_thread::sleep_for(std::chrono::microseconds(1000000 / opt.cmdRate));
+      snprintf(cmd, sizeof(cmd), "probe %u", run * BENCH_RX_RUN_TAG + seq);
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        sentAt[seq] = benchNow();
+      }
+      broker.inject(TOPIC_CMD, cmd);
+    }
+  });
+  uint64_t t0 = benchNow();
+  while (benchNow() - t0 < (uint64_t)(opt.seconds + 1 + BENCH_RX_LATE_S) * 1000000000ULL) {
+    loop();
+    std::lock_guard<std::mutex> guard(lock);
+    if (rtt.count() == total) {
+      break;
+    }
+  }
+  done = true;
+  client.join();
+  broker.removeTap(tap);
+  std::lock_guard<std::mutex> guard(lock);
+  printf("  %s: %zu/%u answered\n", name, rtt.count(), total);
+  if (rtt.count() < total) {
+    printf("  %s: %zu commands unanswered after %u s\n", benchCheck(false, "!! ERROR"), total - rtt.count(),
+           opt.seconds + 1 + BENCH_RX_LATE_S);
+  }
+  LatencyStats::printHeader();
+  rtt.print("round trip");
+  queue.print("  queue (rx -> start)");
+}
+
+// a minute without commands, then a broker restart
+static void keepalive(void) {
+  LocalBroker& broker = LocalBroker::instance();
+  MqttRxStats  s0 = g_RxStats;
+  simSetRealDelay(false);
+  for (uint32_t t = 0; t < BENCH_RX_KEEPALIVE; t += 10) {
+    loop();
+    simAdvanceMillis(10);
+  }
+  printf("  %u s idle: %u PINGREQ, %u packets in, lost %u, %s\n", BENCH_RX_KEEPALIVE / 1000,
+         g_RxStats.pings - s0.pings, g_RxStats.packets - s0.packets, g_RxStats.lost - s0.lost,
+         (g_Net.phase == NET_ONLINE) ? "ONLINE" : "not ONLINE");
+  broker.setUp(false);
+  uint32_t down = millis(), seen = 0;
+  while (!seen && (millis() - down < 1000)) {
+    loop();
+    simAdvanceMillis(1);
+    seen = (g_Net.phase != NET_ONLINE) ? millis() - down : 0;
+  }
+  broker.setUp(true);
+  uint32_t up = millis();
+  while ((g_Net.phase != NET_ONLINE) && (millis() - up < 60000)) {
+    loop();
+    simAdvanceMillis(10);
+  }
+  uint32_t online = (g_Net.phase == NET_ONLINE) ? millis() - up : 0;
+  // the receive task runs on the real clock
+  std::atomic<uint32_t> answered(0);
+  int tap = broker.addTap(TOPIC_RESULT, [&](const BrokerMessage& m) {
+    answered += (m.payload == "world");
+  });
+  simSetRealDelay(true);
+  broker.inject(TOPIC_CMD, "hello");
+  for (uint32_t t = 0; (t < 1000) && !answered; t++) {
+    loop();
+    delay(1);
+  }
+  broker.removeTap(tap);
+  printf("  broker restart: lost seen after %u ms (receive task lost %u), ONLINE again after %u ms, command %s\n",
+         seen, g_RxStats.lost - s0.lost, online, answered ? "answered" : "NOT answered");
+}
+
+void benchRx(const BenchOptions& opt) {
+  benchSection("MQTT receive task: decoder");
+  decoderCheck();
+
+  benchSection("MQTT receive task: command round trip, network side busy");
+  printf("  network side: %u us job every %u ms\n", BENCH_RX_SLOW_US, BENCH_RX_SLOW_MS);
+  simSetRealDelay(true);
+  int id = g_Timers.every(BENCH_RX_SLOW_MS, slowJob);
+  probeRun(opt, "mqtt.loop(), single loop()");
+  startNetTask();
+  probeRun(opt, "mqtt.loop(), network task + loop()");
+  stopNetTask();
+  startRxTask();
+  probeRun(opt, "receive task, single loop()");
+  startNetTask();
+  probeRun(opt, "receive task, network task + loop()");
+  stopNetTask();
+  g_Timers.cancel(id);
+
+  benchSection("MQTT receive task: keepalive, broker restart");
+  keepalive();
+  stopRxTask();
+  simSetRealDelay(false);
+}
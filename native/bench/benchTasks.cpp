@@ -0,0 +1,166 @@
+/*!
+ * @file benchTasks.cpp
+ */
+/************************************************************
+ * Benchmark: Dual-Core Task Split
+ * - SPSC ring stress: one producer and one consumer thread,
+ *   variable length records, content and order checked
+ * - firmware: single loop() vs. network task (std::thread
+ *   stand-in, startNetTask) with the application in loop():
+ *   - command round trip cmd -> result at opt.cmdRate, every
+ *     command must be answered
+ *   - longest application pass while the network side
+ *     reconnects with a blocking 250 ms DNS lookup
+ * - delay() sleeps for real here, the virtual clock is
+ *   shared by both threads
+ * - needs setup() done (benchLoop)
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <prototypes.h>
+#include <mqttTopics.h>
+#include <taskSplit.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bench.h"
+
+#define BENCH_RING_SIZE     4096
+#define BENCH_RING_MAX_LEN  256
+#define BENCH_DNS_MS        250
+#define BENCH_RECONNECT_MS  5000
+
+static uint32_t recordLen(uint32_t seq) {
+  return 4 + (seq * 7919u) % (BENCH_RING_MAX_LEN - 4);
+}
+
+static void ringStress(uint32_t records) {
+  static SpscRing<BENCH_RING_SIZE> ring;
+  uint64_t errors = 0, bytes = 0;
+  uint64_t t0 = benchNow();
+  std::thread producer([records]() {
+    uint8_t buf[BENCH_RING_MAX_LEN];
+    for (uint32_t seq = 0; seq < records; seq++) {
+      uint32_t len = recordLen(seq);
+      memcpy(buf, &seq, sizeof(seq));
+      for (uint32_t i = 4; i < len; i++) {
+        buf[i] = (uint8_t)(seq + i);
+      }
+      while (!ring.push(buf, len)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  for (uint32_t seq = 0; seq < records; seq++) {
+    size_t   n;
+    uint8_t* p;
+    while (!(p = ring.peek(n))) {
+      std::this_thread::yield();
+    }
+    uint32_t got;
+    memcpy(&got, p, sizeof(got));
+    bool ok = (got == seq) && (n == recordLen(seq));
+    for (uint32_t i = 4; ok && (i < n); i++) {
+      ok = (p[i] == (uint8_t)(seq + i));
+    }
+    errors += !ok;
+    bytes += n;
+    ring.release();
+  }
+  producer.join();
+  double secs = (double)(benchNow() - t0) / 1e9;
+  printf("  SPSC ring %u B: %u records (4..%u B), %.1f M records/s, %.0f MB/s, producer full %u, errors %llu\n",
+         BENCH_RING_SIZE, records, BENCH_RING_MAX_LEN - 1, records / secs / 1e6, bytes / secs / 1e6,
+         ring.full(), (unsigned long long)errors);
+}
+
+// commands "#n;hello" at cmdRate, round trip via the tap on TOPIC_RESULT
+static void roundTrip(const BenchOptions& opt, const char* name) {
+  LocalBroker&          broker = LocalBroker::instance();
+  uint32_t              total = opt.cmdRate * opt.seconds;
+  std::vector<uint64_t> sentAt(total);
+  std::mutex            lock;
+  LatencyStats          rtt;
+  rtt.reserve(total);
+  int tap = broker.addTap(TOPIC_RESULT, [&](const BrokerMessage& m) {
+    size_t at = m.payload.find("\"id\":\"");
+    if (at != std::string::npos) {
+      uint32_t id = (uint32_t)atol(m.payload.c_str() + at + 6);
+      std::lock_guard<std::mutex> guard(lock);
+      if (id < total) {
+        rtt.add(benchNow() - sentAt[id]);
+      }
+    }
+  });
+  uint64_t start = benchNow(), period = 1000000000ULL / opt.cmdRate;
+  uint32_t sent = 0;
+  char     cmd[32];
+  while ((sent < total) || (benchNow() - start < (uint64_t)(opt.seconds + 1) * 1000000000ULL)) {
+    if ((sent < total) && (benchNow() - start >= sent * period)) {
+      sentAt[sent] = benchNow();
+      snprintf(cmd, sizeof(cmd), "#%u;hello", sent);
+      broker.inject(TOPIC_CMD, cmd);
+      sent++;
+    }
+    loop();
+    std::lock_guard<std::mutex> guard(lock);
+    if (rtt.count() == total) {
+      break;
+    }
+  }
+  broker.removeTap(tap);
+  std::lock_guard<std::mutex> guard(lock);
+  printf("  %-26s cmd->result: n=%zu/%u p50=%.1fus p99=%.1fus max=%.1fus%s\n", name, rtt.count(), total,
+         rtt.percentile(50) / 1000.0, rtt.percentile(99) / 1000.0, rtt.max() / 1000.0,
+         benchCheck(rtt.count() == total, "  !! ERROR: results missing"));
+}
+
+// longest loop() pass while the broker session is re-established
+static void reconnect(const char* name) {
+  LocalBroker& broker = LocalBroker::instance();
+  uint32_t     reconnects = g_Net.mqttReconnects;
+  uint64_t     longest = 0, passes = 0;
+  broker.setUp(false);
+  broker.setUp(true);
+  uint64_t start = benchNow();
+  while ((g_Net.mqttReconnects == reconnects) && (benchNow() - start < BENCH_RECONNECT_MS * 1000000ULL)) {
+    uint64_t t0 = benchNow();
+    loop();
+    longest = (benchNow() - t0 > longest) ? benchNow() - t0 : longest;
+    passes++;
+  }
+  double secs = (double)(benchNow() - start) / 1e9;
+  printf("  %-26s reconnect with %u ms DNS: longest loop() %.2f ms, %.0f loops/s, ONLINE after %.0f ms\n", name,
+         BENCH_DNS_MS, longest / 1e6, passes / secs, secs * 1000.0);
+}
+
+static void invalidateDns(void) {
+  for (int i = 0; i < NET_MAX_BROKERS; i++) {
+    g_Net.dns[i].valid = false;
+  }
+}
+
+void benchTasks(const BenchOptions& opt) {
+  benchSection("dual-core task split");
+  ringStress(opt.calls * 20);
+
+  simSetRealDelay(true);
+  simWifiSetDnsTime(BENCH_DNS_MS);
+  roundTrip(opt, "single loop()");
+  invalidateDns();
+  reconnect("single loop()");
+
+  startNetTask();
+  roundTrip(opt, "network task + loop()");
+  stopNetTask();
+  invalidateDns();
+  startNetTask();
+  reconnect("network task + loop()");
+  stopNetTask();
+  printf("  queues: %u commands, %u publishes passed, %u / %u dropped, publish queue full %u times\n",
+         g_TaskStats.cmdQueued, g_TaskStats.pubQueued, g_TaskStats.cmdDropped, g_TaskStats.pubDropped,
+         g_PubQueue.full());
+  simWifiSetDnsTime(20);
+  simSetRealDelay(false);
+}
@@ -0,0 +1,201 @@
+/*!
+ * @file benchTelemetry.cpp
+ */
+/************************************************************
+ * Benchmark: Telemetry Encoding
+ * - bytes and CPU time per document: String-built JSON (as
+ *   the firmware did before telemetry.h) vs. TelemetryEncoder
+ *   in JSON, CBOR and MessagePack
+ * - sketch state: the String reference queries ESP.* (incl.
+ *   getSketchMD5()) on every call, as the firmware did before
+ *   deviceFacts.h; it runs BENCH_MAX_LEGACY_SKETCH times only
+ * - worst case: every document as JSON with each number at
+ *   the maximum of its type (10 digit counters), the IP at
+ *   15 characters and the histograms full; must fit into
+ *   TELEMETRY_BUFSIZE (sendTelemetry drops a longer one)
+ * - --verbose dumps every document
+ ************************************************************/
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Version.h>
+#include <prototypes.h>
+#include <telemetryFields.h>
+#include <limits>
+#include "bench.h"
+
+#define BENCH_MAX_LEGACY_SKETCH  200     // every call hashes the sketch
+
+/************************************************************
+ * Reference: String concatenation
+ ************************************************************/
+static String legacyCPUState(void) {
+  String msgStr;
+  msgStr = "{";
+  msgStr.concat("\"Heap Size\":" + String(ESP.getHeapSize()) + ",");
+  msgStr.concat("\"FreeHeap\":" + String(ESP.getFreeHeap()) + ",");
+  msgStr.concat("\"Minimum Free Heap\":" + String(ESP.getMinFreeHeap()) + ",");
+  msgStr.concat("\"Max Free Heap\":" + String(ESP.getMaxAllocHeap()) + ",");
+  msgStr.concat("\"Chip Model\":\"" + String(ESP.getChipModel()) + "\",");
+  msgStr.concat("\"Chip Revision\":" + String(ESP.getChipRevision()) + ",");
+  msgStr.concat("\"Millis\":" + String(millis()) + ",");
+  msgStr.concat("\"Cycle Count\":" + String(ESP.getCycleCount()) + "");
+  msgStr.concat("}");
+  return msgStr;
+}
+
+static String legacyClientID(void) {
+  String myClientId;
+  uint8_t myMac[6];
+  WiFi.macAddress(myMac);
+  myClientId = ("esp32_");
+  for (int i=3; i<6; ++i) {
+    myClientId.concat(String(myMac[i], 16));
+    if (i < 5)
+      myClientId.concat('-');
+  }
+  return myClientId;
+}
+
+static String legacyNetworkState(void) {
+  String msgStr;
+  msgStr = '{';
+  msgStr.concat("\"IP-Address\":\"" + WiFi.localIP().toString() + "\",");
+  msgStr.concat("\"MQTT-ClientID\":\"" + legacyClientID() + "\"");
+  msgStr.concat("}");
+  return msgStr;
+}
+
+static String legacySketchState(void) {
+  String msgStr;
+  msgStr = '{';
+  msgStr.concat("\"Project version\":\"" + String(VERSION) + "\",");
+  msgStr.concat("\"Target\":\"" + String(TARGET) + "\",");
+  msgStr.concat("\"Build timestamp\":\"" + String(BUILD_TIMESTAMP)+ "\",");
+  msgStr.concat("\"Sdk Version\":\"" + String(ESP.getSdkVersion()) + "\",");
+  msgStr.concat("\"CpuFreq\":" + String(ESP.getCpuFreqMHz()) + ",");
+  msgStr.concat("\"SketchSize\":" + String(ESP.getSketchSize()) + ",");
+  msgStr.concat("\"Free SketchSpace\":" + String(ESP.getFreeSketchSpace()) + ",");
+  msgStr.concat("\"Sketch MD5\":\"" + String(ESP.getSketchMD5()) + "\",");
+  msgStr.concat("\"Flash ChipSize\":" + String(ESP.getFlashChipSize()) + ",");
+  msgStr.concat("\"Flash Chip Speed\":" + String(ESP.getFlashChipSpeed()));
+  msgStr.concat("}");
+  return msgStr;
+}
+
+static void dump(const BenchOptions& opt, const char* name, const char* data, size_t len, bool binary) {
+  if (!opt.verbose) {
+    return;
+  }
+  printf("  %s (%zu bytes): ", name, len);
+  for (size_t i = 0; i < len; i++) {
+    binary ? printf("%02x", (uint8_t)data[i]) : printf("%c", data[i]);
+  }
+  printf("\n");
+}
+
+/************************************************************
+ * One document in all encodings
+ ************************************************************/
+#define BENCH_TELEMETRY(opt, label, FIELDS)                                                   \
+  do {                                                                                        \
+    benchEncoding<TELEMETRY_JSON>(opt, label " json", [](TelemetryEncoder<TELEMETRY_JSON>& t) { \
+      TELEMETRY_WRITE(t, FIELDS);                                                             \
+    });                                                                                       \
+    benchEncoding<TELEMETRY_CBOR>(opt, label " cbor", [](TelemetryEncoder<TELEMETRY_CBOR>& t) { \
+      TELEMETRY_WRITE(t, FIELDS);                                                             \
+    });                                                                                       \
+    benchEncoding<TELEMETRY_MSGPACK>(opt, label " msgpack",                                   \
+                                     [](TelemetryEncoder<TELEMETRY_MSGPACK>& t) {             \
+      TELEMETRY_WRITE(t, FIELDS);                                                             \
+    });                                                                                       \
+  } while (0)
+
+template <int FORMAT, typename W>
+static void benchEncoding(const BenchOptions& opt, const char* label, W write) {
+  static char                 buf[TELEMETRY_BUFSIZE];
+  TelemetryEncoder<FORMAT>    tlm(buf, sizeof(buf));
+  LatencyStats                stats;
+  char                        name[40];
+  stats.reserve(opt.calls);
+  for (uint32_t i = 0; i < opt.calls; i++) {
+    BENCH_CALL(stats, write(tlm));
+  }
+  snprintf(name, sizeof(name), "%-16s %4zu B", label, tlm.length());
+  stats.print(name);
+  dump(opt, label, tlm.data(), tlm.length(), TelemetryEncoder<FORMAT>::BINARY);
+}
+
+static void benchLegacy(const BenchOptions& opt, const char* label, String (*build)(void)) {
+  LatencyStats stats;
+  String       doc;
+  char         name[40];
+  stats.reserve(opt.calls);
+  for (uint32_t i = 0; i < opt.calls; i++) {
+    BENCH_CALL(stats, doc = build());
+  }
+  snprintf(name, sizeof(name), "%-16s %4u B", label, doc.length());
+  stats.print(name);
+  dump(opt, label, doc.c_str(), doc.length(), false);
+}
+
+/************************************************************
+ * Worst Case (JSON)
+ * - the field lists with every value replaced by worst()
+ ************************************************************/
+static const uint32_t s_WorstList[64] = {
+#define BENCH_MAX8 UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX, UINT32_MAX
+  BENCH_MAX8, BENCH_MAX8, BENCH_MAX8, BENCH_MAX8, BENCH_MAX8, BENCH_MAX8, BENCH_MAX8, BENCH_MAX8
+#undef BENCH_MAX8
+};
+
+template <typename T>
+static typename std::enable_if<std::is_integral<T>::value, T>::type worst(T) {
+  return std::is_signed<T>::value ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+}
+static const char*   worst(const char* value)          { return value; }
+static IPAddress     worst(const IPAddress&)           { return IPAddress(255, 255, 255, 255); }
+static TelemetryList worst(const TelemetryList& list) {
+  return TelemetryList{s_WorstList, (list.count < 64) ? list.count : 64};
+}
+
+#define BENCH_WORST_FIELD(key, value)  _tlm.field(key, worst(value));
+#define BENCH_WORST(label, FIELDS)                                   \
+  do {                                                               \
+    static char                    buf[4 * TELEMETRY_BUFSIZE];        \
+    TelemetryEncoder<TELEMETRY_JSON> _tlm(buf, sizeof(buf));         \
+    _tlm.begin(0 FIELDS(TELEMETRY_COUNT));                           \
+    FIELDS(BENCH_WORST_FIELD)                                        \
+    _tlm.end();                                                      \
+    worstCase(opt, label, _tlm.data(), _tlm.length());               \
+  } while (0)
+
+static void worstCase(const BenchOptions& opt, const char* label, const char* data, size_t len) {
+  printf("  %-10s %4zu of %u B%s\n", label, len, (unsigned)TELEMETRY_BUFSIZE,
+         benchCheck(len && (len < TELEMETRY_BUFSIZE), "  !! ERROR: does not fit, sendTelemetry drops it"));
+  dump(opt, label, data, len, false);
+}
+
+void benchTelemetry(const BenchOptions& opt) {
+  benchSection("telemetry encoding");
+  LatencyStats::printHeader();
+  benchLegacy(opt, "cpu String", legacyCPUState);
+  BENCH_TELEMETRY(opt, "cpu", CPU_STATE_FIELDS);
+  benchLegacy(opt, "network String", legacyNetworkState);
+  BENCH_TELEMETRY(opt, "network", NETWORK_STATE_FIELDS);
+
+  BenchOptions legacy = opt;
+  legacy.calls = (opt.calls < BENCH_MAX_LEGACY_SKETCH) ? opt.calls : BENCH_MAX_LEGACY_SKETCH;
+  benchLegacy(legacy, "sketch String", legacySketchState);
+  BENCH_TELEMETRY(opt, "sketch", SKETCH_STATE_FIELDS);
+
+  benchSection("telemetry worst case (JSON)");
+  IrqReport irq = g_IrqReport;
+  g_IrqReport.latency.add(UINT32_MAX);     // all buckets in the list
+  g_IrqReport.rate.add(UINT32_MAX);
+  BENCH_WORST("cpu", CPU_STATE_FIELDS);
+  BENCH_WORST("network", NETWORK_STATE_FIELDS);
+  BENCH_WORST("irq", IRQ_STATE_FIELDS);
+  BENCH_WORST("roller", ROLLER_STATE_FIELDS);
+  BENCH_WORST("sketch", SKETCH_STATE_FIELDS);
+  g_IrqReport = irq;
+}
@@ -0,0 +1,146 @@
+/*!
+ * @file benchTimers.cpp
+ */
+/************************************************************
+ * Benchmark: Timer Wheel
+ * - drift: 1 h of 1s/10s/30s/60s jobs with a jittery loop
+ *   (0..20 ms per pass, a 3 s stall every 5 min), timer
+ *   wheel vs. the nested cronjob() checks it replaced
+ * - cost of every/after/cancel/run/nextDeadline with 200
+ *   jobs registered
+ ************************************************************/
+#include <Arduino.h>
+#include <timerWheel.h>
+#include "bench.h"
+
+#define BENCH_TIMER_JOBS     200
+#define BENCH_DRIFT_SECONDS  3600
+
+static const uint32_t s_Periods[4] = {1000, 10000, 30000, 60000};
+static uint32_t       s_Now;
+static uint32_t       s_Runs[4];
+static uint32_t       s_MaxLate[4];
+
+template <int I>
+static void driftJob(void) {
+  // lateness against the ideal grid k * period
+  uint32_t late = s_Now % s_Periods[I];
+  s_MaxLate[I] = (late > s_MaxLate[I]) ? late : s_MaxLate[I];
+  s_Runs[I]++;
+}
+
+static void resetDrift(void) {
+  memset(s_Runs, 0, sizeof(s_Runs));
+  memset(s_MaxLate, 0, sizeof(s_MaxLate));
+}
+
+// loop pass: 0..20 ms, every 5 minutes a 3 s stall (WiFi reconnect)
+static uint32_t nextPass(uint32_t& stall) {
+  if (s_Now >= stall) {
+    stall += 300000;
+    return 3000;
+  }
+  return (uint32_t)(rand() % 21);
+}
+
+static void printDrift(const char* name) {
+  printf("  %-20s", name);
+  for (int i = 0; i < 4; i++) {
+    printf("  %2us: %4u runs (%4u exp.) max late %5u ms", s_Periods[i] / 1000, s_Runs[i],
+           BENCH_DRIFT_SECONDS * 1000 / s_Periods[i], s_MaxLate[i]);
+    if (i == 1) {
+      printf("\n  %-20s", "");
+    }
+  }
+  printf("\n");
+}
+
+/************************************************************
+ * Reference: nested checks as cronjob() did before
+ ************************************************************/
+static void driftNested(void) {
+  uint32_t last1 = 0, last10 = 0, last30 = 0, last60 = 0;
+  uint32_t stall = 300000;
+  resetDrift();
+  srand(1);
+  for (s_Now = 0; s_Now < BENCH_DRIFT_SECONDS * 1000; s_Now += nextPass(stall)) {
+    if ((s_Now - last1) > 1000) {
+      last1 = s_Now;
+      driftJob<0>();
+      if ((s_Now - last10) > 10000) {
+        last10 = last1;
+        driftJob<1>();
+        if ((s_Now - last30) > 30000) {
+          last30 = last1;
+          driftJob<2>();
+          if ((s_Now - last60) > 60000) {
+            last60 = last1;
+            driftJob<3>();
+          }
+        }
+      }
+    }
+  }
+  printDrift("nested cronjob");
+}
+
+static void driftWheel(void) {
+  static TimerWheel<8> wheel;
+  uint32_t stall = 300000;
+  resetDrift();
+  srand(1);
+  wheel.begin(0);
+  wheel.every(s_Periods[0], driftJob<0>);
+  wheel.every(s_Periods[1], driftJob<1>);
+  wheel.every(s_Periods[2], driftJob<2>);
+  wheel.every(s_Periods[3], driftJob<3>);
+  for (s_Now = 0; s_Now < BENCH_DRIFT_SECONDS * 1000; s_Now += nextPass(stall)) {
+    wheel.run(s_Now);
+  }
+  printDrift("timer wheel");
+  printf("  %-20s  periods skipped during stalls: %u\n", "", wheel.missed());
+}
+
+/************************************************************
+ * Operation Cost
+ ************************************************************/
+static void nop(void) {
+}
+
+static void benchWheelOps(const BenchOptions& opt) {
+  static TimerWheel<BENCH_TIMER_JOBS> wheel;
+  static int   ids[BENCH_TIMER_JOBS];
+  LatencyStats add, cancel, run, next;
+  uint32_t     now = 0;
+  uint32_t     rounds = opt.calls / BENCH_TIMER_JOBS + 1;
+  srand(2);
+  wheel.begin(now);
+  for (uint32_t r = 0; r < rounds; r++) {
+    for (int i = 0; i < BENCH_TIMER_JOBS; i++) {
+      uint32_t delay = 1 + (uint32_t)(rand() % 600000);
+      BENCH_CALL(add, ids[i] = (i & 1) ? wheel.every(delay, nop) : wheel.after(delay, nop));
+    }
+    for (int i = 0; i < BENCH_TIMER_JOBS / 2; i++) {
+      now += 1 + (uint32_t)(rand() % 50);
+      BENCH_CALL(next, wheel.nextDeadline(now));
+      BENCH_CALL(run, wheel.run(now));
+    }
+    for (int i = 0; i < BENCH_TIMER_JOBS; i++) {
+      BENCH_CALL(cancel, wheel.cancel(ids[i]));
+    }
+  }
+  add.print("every/after");
+  cancel.print("cancel");
+  run.print("run (1..50 ms passed)");
+  next.print("nextDeadline");
+}
+
+void benchTimers(const BenchOptions& opt) {
+  benchSection("timer wheel: drift over 1 h");
+  driftNested();
+  driftWheel();
+
+  benchSection("timer wheel: operations (200 jobs)");
+  LatencyStats::printHeader();
+  benchWheelOps(opt);
+}
@@ -0,0 +1,191 @@
+/*!
+ * @file LocalBroker.cpp
+ */
+#include <LocalBroker.h>
+#include <NativeSim.h>
+#include <string.h>
+#include <algorithm>
+
+LocalBroker& LocalBroker::instance(void) {
+  static LocalBroker broker;
+  return broker;
+}
+
+
+/************************************************************
+ * Topic Matching
+ * - '+' matches exactly one level, '#' the remaining levels
+ ************************************************************/
+bool LocalBroker::topicMatches(const char* filter, const char* topic) {
+  while (*filter) {
+    if (*filter == '#') {
+      return true;
+    }
+    if (*filter == '+') {
+      while (*topic && (*topic != '/')) {
+        topic++;
+      }
+      filter++;
+      continue;
+    }
+    if (*filter != *topic) {
+      return false;
+    }
+    filter++;
+    topic++;
+  }
+  return *topic == '\0';
+}
+
+
+/************************************************************
+ * Availability
+ * - going down drops every session without publishing wills
+ ************************************************************/
+void LocalBroker::setUp(bool up) {
+  std::lock_guard<std::recursive_mutex> guard(_lock);
+  _up = up;
+  if (!up) {
+    for (auto& session : _sessions) {
+      session->connected = false;
+      session->inbox.clear();
+    }
+    _sessions.clear();
+  }
+}
+
+size_t LocalBroker::sessionCount(void) {
+  std::lock_guard<std::recursive_mutex> guard(_lock);
+  return _sessions.size();
+}
+
+
+/************************************************************
+ * Client Side
+ ************************************************************/
+std::shared_ptr<BrokerSession> LocalBroker::connect(const char* clientId, const char* willTopic,
+                                                    const char* willMessage, bool willRetain) {
+  std::lock_guard<std::recursive_mutex> guard(_lock);
+  if (!_up) {
+    return nullptr;
+  }
+  // take over an existing session with the same id
+  for (auto it = _sessions.begin(); it != _sessions.end(); ++it) {
+    if ((*it)->clientId == clientId) {
+      (*it)->connected = false;
+      _sessions.erase(it);
+      break;
+    }
+  }
+  auto session = std::make_shared<BrokerSession>();
+  session->clientId = clientId;
+  session->connected = true;
+  if (willTopic) {
+    session->hasWill = true;
+    session->will.topic = willTopic;
+    session->will.payload = willMessage ? willMessage : "";
+    session->will.retained = willRetain;
+  }
+  _sessions.push_back(session);
+  _connectCount++;
+  return session;
+}
+
+void LocalBroker::disconnect(const std::shared_ptr<BrokerSession>& session, bool graceful) {
+  std::lock_guard<std::recursive_mutex> guard(_lock);
+  auto it = std::find(_sessions.begin(), _sessions.end(), session);
+  if (it == _sessions.end()) {
+    return;
+  }
+  _sessions.erase(it);
+  session->connected = false;
+  if (!graceful && session->hasWill) {
+    publish(session->will.topic.c_str(), (const uint8_t*)session->will.payload.data(),
+            session->will.payload.size(), session->will.retained);
+  }
+}
+
+void LocalBroker::subscribe(const std::shared_ptr<BrokerSession>& session, const char* filter) {
+  std::lock_guard<std::recursive_mutex> guard(_lock);
+  session->subscriptions.push_back(filter);
+  for (auto& r : _retained) {
+    if (topicMatches(filter, r.first.c_str())) {
+      session->inbox.push_back(BrokerMessage{r.first, r.second, true});
+      simSocketData();
+    }
+  }
+}
+
+void LocalBroker::publish(const char* topic, const uint8_t* payload, size_t length, bool retained) {
+  std::lock_guard<std::recursive_mutex> guard(_lock);
+  if (!_up) {
+    return;
+  }
+  _publishCount++;
+  BrokerMessage msg{topic, std::string((const char*)payload, length), retained};
+  if (retained) {
+    if (length) {
+      _retained[msg.topic] = msg.payload;
+    } else {
+      _retained.erase(msg.topic);
+    }
+  }
+  for (auto& session : _sessions) {
+    for (auto& filter : session->subscriptions) {
+      if (topicMatches(filter.c_str(), topic)) {
+        session->inbox.push_back(BrokerMessage{msg.topic, msg.payload, false});
+        simSocketData();
+        break;
+      }
+    }
+  }
+  for (size_t i = 0; i < _taps.size(); i++) {
+    if (topicMatches(_taps[i].filter.c_str(), topic)) {
+      Tap fn = _taps[i].fn;
+      fn(msg);
+    }
+  }
+}
+
+bool LocalBroker::fetch(const std::shared_ptr<BrokerSession>& session, BrokerMessage& msg) {
+  std::lock_guard<std::recursive_mutex> guard(_lock);
+  if (!session->connected || session->inbox.empty()) {
+    return false;
+  }
+  msg = std::move(session->inbox.front());
+  session->inbox.pop_front();
+  return true;
+}
+
+
+/************************************************************
+ * Host Side
+ ************************************************************/
+int LocalBroker::addTap(const char* filter, Tap fn) {
+  std::lock_guard<std::recursive_mutex> guard(_lock);
+  int id = _nextTapId++;
+  _taps.push_back(TapEntry{id, filter, fn});
+  return id;
+}
+
+void LocalBroker::removeTap(int id) {
+  std::lock_guard<std::recursive_mutex> guard(_lock);
+  _taps.erase(std::remove_if(_taps.begin(), _taps.end(),
+                             [id](const TapEntry& t) { return t.id == id; }),
+              _taps.end());
+}
+
+void LocalBroker::inject(const char* topic, const char* payload, bool retained) {
+  SimHeapPause pause;
+  publish(topic, (const uint8_t*)payload, strlen(payload), retained);
+}
+
+bool LocalBroker::retained(const char* topic, std::string& payload) {
+  std::lock_guard<std::recursive_mutex> guard(_lock);
+  auto it = _retained.find(topic);
+  if (it == _retained.end()) {
+    return false;
+  }
+  payload = it->second;
+  return true;
+}
@@ -0,0 +1,93 @@
+/*!
+ * @file LocalBroker.h
+ */
+/************************************************************
+ * Native: in-process stand-in MQTT Broker
+ ************************************************************
+ * Routes publishes between the native PubSubClient and host
+ * side taps (benchmarks, simulated controller).
+ * - exact topics and the wildcards '+' and '#'
+ * - retained messages
+ * - last will, published on ungraceful disconnect
+ * - can be taken down to simulate broker maintenance; a
+ *   connect attempt then costs the configured TCP timeout
+ ************************************************************/
+#ifndef _LOCALBROKER_H_
+#define _LOCALBROKER_H_
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct BrokerMessage {
+  std::string topic;
+  std::string payload;
+  bool        retained;
+};
+
+struct BrokerSession {
+  std::string               clientId;
+  std::vector<std::string>  subscriptions;
+  std::deque<BrokerMessage> inbox;
+  bool                      hasWill = false;
+  BrokerMessage             will;
+  bool                      connected = false;
+};
+
+class LocalBroker {
+  public:
+    typedef std::function<void(const BrokerMessage&)> Tap;
+
+    static LocalBroker& instance(void);
+
+    // availability
+    void     setUp(bool up);
+    bool     isUp(void) const                  { return _up; }
+    void     setConnectTimeMs(uint32_t ms)     { _connectTimeMs = ms; }
+    uint32_t connectTimeMs(void) const         { return _connectTimeMs; }
+
+    // client side (used by the native PubSubClient)
+    std::shared_ptr<BrokerSession> connect(const char* clientId, const char* willTopic,
+                                           const char* willMessage, bool willRetain);
+    void     disconnect(const std::shared_ptr<BrokerSession>& session, bool graceful);
+    void     subscribe(const std::shared_ptr<BrokerSession>& session, const char* filter);
+    void     publish(const char* topic, const uint8_t* payload, size_t length, bool retained);
+    bool     fetch(const std::shared_ptr<BrokerSession>& session, BrokerMessage& msg);
+
+    // host side
+    int      addTap(const char* filter, Tap fn);
+    void     removeTap(int id);
+    void     inject(const char* topic, const char* payload, bool retained = false);
+    bool     retained(const char* topic, std::string& payload);
+
+    // statistics
+    uint64_t publishCount(void) const          { return _publishCount; }
+    uint64_t connectCount(void) const          { return _connectCount; }
+    size_t   sessionCount(void);
+
+    static bool topicMatches(const char* filter, const char* topic);
+
+  private:
+    struct TapEntry {
+      int         id;
+      std::string filter;
+      Tap         fn;
+    };
+
+    std::recursive_mutex                        _lock;
+    bool                                        _up = true;
+    uint32_t                                    _connectTimeMs = 3000;
+    std::vector<std::shared_ptr<BrokerSession>> _sessions;
+    std::vector<TapEntry>                       _taps;
+    std::map<std::string, std::string>          _retained;
+    int                                         _nextTapId = 1;
+    uint64_t                                    _publishCount = 0;
+    uint64_t                                    _connectCount = 0;
+};
+
+#endif // _LOCALBROKER_H_
@@ -0,0 +1,477 @@
+/*!
+ * @file fleet.cpp
+ */
+/************************************************************
+ * Fleet Load Generator
+ ************************************************************
+ * N virtual HelloESP32 nodes against the LocalBroker, all on
+ * one event loop (a sweep calls every node once, then the
+ * virtual clock moves FLEET_TICK_US on):
+ * - node i: prefix "fleet/nNNNN", its own PubSubClient and
+ *   TimerWheel, started at a random time within FLEET_BOOT_MS
+ * - MQTT session as connectMQTT(): LastWill OFFLINE on
+ *   status (retained), ONLINE (retained), subscribe to cmd;
+ *   connect and reconnect as netStep() / netStepMqtt(): TCP
+ *   round trip or T_MQTT_TCP_TIMEOUT, a lost connection
+ *   waits netLostWait(), failed rounds netRetryWait()
+ *   (netState.h)
+ * - timer jobs of setupTimers() that publish, on the periods
+ *   of settings.h: cpu, network, irq, metrics (LOOP_STATS),
+ *   the roller positions once after boot (rollerLoop) and
+ *   the retained sketch state; documents of TELEMETRY_WRITE
+ *   and writeLoopStats() with the values of the host
+ *   instance; offline they are dropped (the firmware queues
+ *   them in its outbox)
+ * - not modelled: the log batches on TOPIC_LOG (LOG_LEVEL,
+ *   jobLogFlush) and roller moves, the report says so
+ * - commands as mqttCallback(): the batch runs through the
+ *   command table of main.cpp (execCommands), the result is
+ *   published on result
+ * - the host instance (setup() / loop() of main.cpp) runs in
+ *   the same sweep
+ *
+ * Controller (host side): "#SEQ;helloadd SEQ 2" to a random
+ * node at cmdRate, the result is matched by its id and
+ * checked; the broker goes down for outageMs after a third
+ * of the run (all sessions dropped, as a restart does).
+ *
+ * Report: publishes per virtual and per wall second, command
+ * round trip percentiles (incl. the wait for the node's next
+ * pass, one sweep), the reconnect storm after the broker is
+ * back: connects per second, time until all nodes are
+ * ONLINE, attempts and failed attempts.
+ ************************************************************/
+#include <Arduino.h>
+#include <WiFi.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <PubSubClient.h>
+#include <prototypes.h>
+#include <settings.h>
+#include <mqttTopics.h>
+#include <telemetryFields.h>
+#include <commandBatch.h>
+#include <binLog.h>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "fleet.h"
+#include "bench/bench.h"
+
+#define FLEET_PREFIX        "fleet"
+#define FLEET_TICK_US       1000         // virtual time of one sweep (plus its real time)
+#define FLEET_BOOT_MS       5000         // nodes start within the first 5 s
+#define FLEET_TCP_RTT_MS    2
+#define FLEET_MAX_ONLINE_MS 600000       // give up waiting for the host instance / the storm
+
+enum FleetStage : uint8_t {
+  FLEET_WAIT = 0,                          // next attempt at nextAttempt
+  FLEET_TCP,                               // TCP connect pending
+  FLEET_ONLINE
+};
+
+struct FleetNode {
+  FleetNode(void) : mqtt(net) {}
+
+  char          prefix[24];
+  char          clientId[24];
+  char          status[40];
+  WiFiClient    net;
+  PubSubClient  mqtt;
+  TimerWheel<8> timers;
+  FleetStage    stage = FLEET_WAIT;
+  bool          reachable = false;         // broker up at the TCP connect
+  bool          sketchPending = true;
+  bool          rollerPending = true;      // positions at boot (g_RollerStatePending)
+  bool          lost = false;              // connection lost, not back yet
+  uint8_t       backoffRound = 0;
+  uint32_t      nextAttempt = 0;
+  uint32_t      tcpSince = 0;
+};
+
+struct FleetStats {
+  uint64_t publishes;                      // by the nodes
+  uint64_t bytes;
+  uint64_t attempts;                       // connect attempts
+  uint64_t failed;
+  uint64_t connects;
+  uint64_t lost;                           // connections lost
+};
+
+static std::vector<std::unique_ptr<FleetNode>> s_Nodes;
+static FleetNode*  s_Node;                 // node of the running timer job
+static FleetStats  s_Stats;
+static char        s_Doc[TELEMETRY_BUFSIZE];
+
+/************************************************************
+ * Node: publish (as mqttSend)
+ ************************************************************/
+static bool nodePub(FleetNode& n, const char* t, const char* msg, size_t len, bool retained) {
+  char topic[48];
+  snprintf(topic, sizeof(topic), "%s/%s", n.prefix, t);
+  if ((n.stage != FLEET_ONLINE) || !n.mqtt.beginPublish(topic, len, retained) ||
+      (n.mqtt.write((const uint8_t*)msg, len) != len) || !n.mqtt.endPublish()) {
+    return false;
+  }
+  s_Stats.publishes++;
+  s_Stats.bytes += len;
+  return true;
+}
+
+/************************************************************
+ * Node: timer jobs
+ ************************************************************/
+static void fleetCPUState(void) {
+  TelemetryWriter tlm(s_Doc, sizeof(s_Doc));
+  TELEMETRY_WRITE(tlm, CPU_STATE_FIELDS);
+  nodePub(*s_Node, T_CPU, tlm.data(), tlm.length(), false);
+}
+
+static void fleetNetworkState(void) {
+  TelemetryWriter tlm(s_Doc, sizeof(s_Doc));
+  TELEMETRY_WRITE(tlm, NETWORK_STATE_FIELDS);
+  nodePub(*s_Node, T_NETWORK, tlm.data(), tlm.length(), false);
+}
+
+static void fleetIrqState(void) {
+  TelemetryWriter tlm(s_Doc, sizeof(s_Doc));
+  TELEMETRY_WRITE(tlm, IRQ_STATE_FIELDS);
+  nodePub(*s_Node, T_IRQ, tlm.data(), tlm.length(), false);
+}
+
+static void fleetLoopStats(void) {
+  TelemetryWriter tlm(s_Doc, sizeof(s_Doc));
+  writeLoopStats(tlm);
+  nodePub(*s_Node, T_METRICS, tlm.data(), tlm.length(), false);
+}
+
+static void fleetRollerState(void) {
+  TelemetryWriter tlm(s_Doc, sizeof(s_Doc));
+  if (s_Node->rollerPending) {
+    TELEMETRY_WRITE(tlm, ROLLER_STATE_FIELDS);
+    s_Node->rollerPending = !nodePub(*s_Node, T_ROLLER, tlm.data(), tlm.length(), false);
+  }
+}
+
+static void fleetSketchState(void) {
+  if (s_Node->sketchPending &&
+      nodePub(*s_Node, T_SKETCH, g_DeviceFacts.sketchState, g_DeviceFacts.sketchStateLen, true)) {
+    s_Node->sketchPending = false;
+  }
+}
+
+/************************************************************
+ * Node: command received (as mqttCallback / runCommands)
+ ************************************************************/
+static void nodeCommand(FleetNode& n, uint8_t* payload, unsigned int length) {
+  static char cmd[MQTT_BUFSIZE];
+  static char result[CMD_BATCH_RESULT_SIZE];
+  length = (length < sizeof(cmd)) ? length : sizeof(cmd) - 1;
+  memcpy(cmd, payload, length);
+  cmd[length] = '\0';
+  execCommands(cmd, result);
+  nodePub(n, T_RESULT, result, strlen(result), false);
+}
+
+/************************************************************
+ * Node: connection (as netStep / netStepMqtt)
+ ************************************************************/
+static void nodeFailed(FleetNode& n, uint32_t now) {
+  s_Stats.failed++;
+  n.stage = FLEET_WAIT;
+  n.nextAttempt = now + netRetryWait(n.backoffRound, (uint32_t)random(0x7fffffff));
+}
+
+static void nodeStep(FleetNode& n, uint32_t now) {
+  LocalBroker& broker = LocalBroker::instance();
+  uint32_t     timeout = (broker.connectTimeMs() < T_MQTT_TCP_TIMEOUT) ? broker.connectTimeMs() : T_MQTT_TCP_TIMEOUT;
+  switch (n.stage) {
+    case FLEET_ONLINE:
+      s_Stats.lost++;
+      n.lost = true;
+      n.stage = FLEET_WAIT;
+      n.backoffRound = 0;
+      n.nextAttempt = now + netLostWait((uint32_t)random(0x7fffffff));
+      break;
+    case FLEET_WAIT:
+      if ((int32_t)(now - n.nextAttempt) < 0) {
+        return;
+      }
+      s_Stats.attempts++;
+      n.reachable = broker.isUp();
+      n.tcpSince = now;
+      n.stage = FLEET_TCP;
+      break;
+    case FLEET_TCP:
+      if (n.reachable && broker.isUp()) {
+        if (now - n.tcpSince < FLEET_TCP_RTT_MS) {
+          return;
+        }
+        n.net = WiFiClient(0);             // TCP up, CONNECT / CONNACK only
+        if (!n.mqtt.connect(n.clientId, nullptr, nullptr, n.status, 1, true, STATUS_MSG_OFF, true)) {
+          nodeFailed(n, now);
+          return;
+        }
+        n.stage = FLEET_ONLINE;
+        n.mqtt.publish(n.status, STATUS_MSG_ON, true);
+        snprintf(s_Doc, sizeof(s_Doc), "%s/%s", n.prefix, T_CMD);
+        n.mqtt.subscribe(s_Doc);
+        s_Stats.connects++;
+        s_Stats.publishes++;
+      } else if (n.reachable || (now - n.tcpSince >= timeout)) {
+        nodeFailed(n, now);
+      }
+      break;
+  }
+}
+
+// one pass of a node (as netLoop)
+static void nodeLoop(FleetNode& n, uint32_t now) {
+  if (!n.mqtt.loop() || (n.stage != FLEET_ONLINE)) {
+    nodeStep(n, now);
+  }
+  s_Node = &n;
+  n.timers.run(now);
+}
+
+static void fleetCreate(uint32_t count) {
+  uint32_t now = millis();
+  s_Nodes.clear();
+  for (uint32_t i = 0; i < count; i++) {
+    std::unique_ptr<FleetNode> node(new FleetNode());
+    FleetNode& n = *node;
+    uint32_t   boot = (uint32_t)random(FLEET_BOOT_MS);
+    snprintf(n.prefix, sizeof(n.prefix), FLEET_PREFIX "/n%04u", i);
+    snprintf(n.clientId, sizeof(n.clientId), "esp32_fleet_%04u", i);
+    snprintf(n.status, sizeof(n.status), "%s/%s", n.prefix, T_STATUS);
+    n.mqtt.setBufferSize(MQTT_BUFSIZE);
+    n.mqtt.setCallback([&n](char* topic, uint8_t* payload, unsigned int length) { nodeCommand(n, payload, length); });
+    n.nextAttempt = now + boot;
+    n.timers.begin(now);
+    n.timers.every(T_CPU_STATE, fleetCPUState, T_CPU_STATE + boot);
+    n.timers.every(T_NETWORK_STATE, fleetNetworkState, T_NETWORK_STATE + boot);
+    n.timers.every(T_IRQ_STATE, fleetIrqState, T_IRQ_STATE + boot);
+#if LOOP_STATS
+    n.timers.every(T_METRICS_STATE, fleetLoopStats, T_METRICS_STATE + boot);
+#endif
+    n.timers.every(T_ROLLER_PUBLISH, fleetRollerState, T_ROLLER_PUBLISH + boot);
+    n.timers.every(T_SKETCH_PUBLISH, fleetSketchState, T_SKETCH_PUBLISH + boot);
+    s_Nodes.push_back(std::move(node));
+  }
+}
+
+/************************************************************
+ * Controller
+ ************************************************************/
+struct FleetCommands {
+  std::unordered_map<uint32_t, uint64_t> pending;   // seq -> sent [ns]
+  LatencyStats rtt;
+  uint32_t     seq = 0;
+  uint32_t     sent = 0;
+  uint32_t     answered = 0;
+  uint32_t     wrong = 0;                  // unexpected result
+  uint32_t     offline = 0;                // target node not ONLINE
+  uint32_t     brokerDown = 0;             // not accepted by the broker
+};
+
+// sent: virtual time it was due [us], the wait for the sweep counts
+static void sendCommand(FleetCommands& c, uint64_t sent) {
+  LocalBroker& broker = LocalBroker::instance();
+  uint32_t     seq = ++c.seq;
+  FleetNode&   n = *s_Nodes[(uint32_t)random((long)s_Nodes.size())];
+  char         topic[48], payload[48];
+  snprintf(topic, sizeof(topic), "%s/%s", n.prefix, T_CMD);
+  snprintf(payload, sizeof(payload), "#%u;helloadd %u 2", seq, seq);
+  c.sent++;
+  if (!broker.isUp()) {
+    c.brokerDown++;
+    return;
+  }
+  if (n.stage != FLEET_ONLINE) {
+    c.offline++;
+    return;
+  }
+  c.pending[seq] = sent * 1000;
+  broker.inject(topic, payload);
+}
+
+static void onResult(FleetCommands& c, const BrokerMessage& m) {
+  const char* id = strstr(m.payload.c_str(), "\"id\":\"");
+  if (!id) {
+    return;
+  }
+  uint32_t seq = (uint32_t)strtoul(id + 6, nullptr, 10);
+  auto     it = c.pending.find(seq);
+  if (it == c.pending.end()) {
+    return;
+  }
+  char expected[48];
+  snprintf(expected, sizeof(expected), "The Answer is: %u", seq + 2);
+  c.rtt.add(simNanos64() - it->second);
+  c.pending.erase(it);
+  c.answered++;
+  c.wrong += strstr(m.payload.c_str(), expected) ? 0 : 1;
+}
+
+/************************************************************
+ * Reconnect Storm
+ ************************************************************/
+struct FleetStorm {
+  uint32_t              downAt = 0;        // virtual ms
+  uint32_t              upAt = 0;
+  uint32_t              allOnlineAt = 0;
+  FleetStats            atDown;            // s_Stats when the broker went down
+  FleetStats            atUp;              // ... and when it came back
+  std::vector<uint32_t> perSecond;         // connects after upAt
+  LatencyStats          online;            // ms from upAt until a node is back [ns]
+};
+
+static void printRow(const char* name, LatencyStats& s, double scale, const char* unit) {
+  printf("  %-30s n %7zu  p50 %9.2f  p99 %9.2f  p99.9 %9.2f  max %9.2f %s\n", name, s.count(),
+         s.percentile(50) / scale, s.percentile(99) / scale, s.percentile(99.9) / scale, s.max() / scale, unit);
+}
+
+/************************************************************
+ * Run
+ ************************************************************/
+int runFleet(const FleetOptions& opt) {
+  LocalBroker&  broker = LocalBroker::instance();
+  FleetCommands cmds;
+  FleetStorm    storm;
+  LatencyStats  sweep;
+  std::vector<uint32_t> pubPerSecond;
+  simSetSerialOutput(opt.verbose);
+  printf("HelloESP32 native fleet: %u nodes, %u s, %u commands/s, broker outage %u ms\n", opt.nodes, opt.seconds,
+         opt.cmdRate, opt.outageMs);
+
+  // host instance first: device facts, sketch state
+  setup();
+  g_IdleOn = false;                        // one thread serves all nodes, it must not sleep
+  for (uint32_t start = millis(); (g_Net.phase != NET_ONLINE) && (millis() - start < FLEET_MAX_ONLINE_MS);) {
+    loop();
+    simAdvanceMillis(1);
+  }
+  memset(&s_Stats, 0, sizeof(s_Stats));
+  fleetCreate(opt.nodes);
+  int tap = broker.addTap(FLEET_PREFIX "/+/" T_RESULT, [&](const BrokerMessage& m) { onResult(cmds, m); });
+
+  uint32_t start = millis(), lastSecond = 0;
+  uint32_t outageAt = opt.outageMs ? opt.seconds * 1000 / 3 : 0xffffffffu;
+  uint64_t nextCmd = simMicros64() + FLEET_BOOT_MS * 1000ull, cmdStep = opt.cmdRate ? 1000000 / opt.cmdRate : 0;
+  uint64_t pubs = 0, sweeps = 0;
+  auto     wall0 = std::chrono::steady_clock::now();
+  sweep.reserve((size_t)opt.seconds * 1000);
+  while (millis() - start < opt.seconds * 1000) {
+    uint32_t t = millis() - start;
+    // broker restart
+    if (broker.isUp() && !storm.downAt && (t >= outageAt)) {
+      storm.downAt = t;
+      storm.atDown = s_Stats;
+      broker.setUp(false);
+    } else if (!broker.isUp() && (t >= storm.downAt + opt.outageMs)) {
+      storm.upAt = t;
+      storm.atUp = s_Stats;
+      broker.setUp(true);
+    }
+    // commands
+    while (cmdStep && (simMicros64() >= nextCmd)) {
+      sendCommand(cmds, nextCmd);
+      nextCmd += cmdStep;
+    }
+    // sweep: the host instance, then every node
+    uint64_t t0 = benchNow();
+    loop();
+    uint32_t now = millis();
+    for (auto& node : s_Nodes) {
+      FleetStage was = node->stage;
+      nodeLoop(*node, now);
+      if (storm.upAt && node->lost && (was != FLEET_ONLINE) && (node->stage == FLEET_ONLINE)) {
+        uint32_t after = now - start - storm.upAt;
+        node->lost = false;
+        storm.online.add((uint64_t)after * 1000000);
+        if (storm.perSecond.size() <= after / 1000) {
+          storm.perSecond.resize(after / 1000 + 1);
+        }
+        storm.perSecond[after / 1000]++;
+        storm.allOnlineAt = after;
+      }
+    }
+    sweep.add(benchNow() - t0);
+    sweeps++;
+    // publishes per virtual second
+    if (t / 1000 != lastSecond) {
+      pubPerSecond.push_back((uint32_t)(s_Stats.publishes - pubs));
+      pubs = s_Stats.publishes;
+      lastSecond = t / 1000;
+    }
+    simAdvanceMicros(FLEET_TICK_US);
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall0).count();
+  broker.removeTap(tap);
+
+  // publish throughput
+  benchSection("publish throughput");
+  uint32_t peak = 0;
+  uint64_t steady = 0, steadyN = 0;
+  for (size_t i = 0; i < pubPerSecond.size(); i++) {
+    peak = (pubPerSecond[i] > peak) ? pubPerSecond[i] : peak;
+    // after the boot, before the outage
+    if ((i * 1000 >= FLEET_BOOT_MS) && (i * 1000 + 1000 <= outageAt)) {
+      steady += pubPerSecond[i];
+      steadyN++;
+    }
+  }
+  printf("  node publishes %llu (%llu bytes), broker publishes %llu\n", (unsigned long long)s_Stats.publishes,
+         (unsigned long long)s_Stats.bytes, (unsigned long long)broker.publishCount());
+  printf("  node publishes: status, cpu, network, irq, metrics, roller, sketch; not modelled: log batches, roller moves\n");
+  printf("  per virtual second: %.1f before the outage, peak %u   per wall second: %.0f (%.1f s wall for %u s)\n",
+         steadyN ? (double)steady / steadyN : 0.0, peak, s_Stats.publishes / wall, wall, opt.seconds);
+  printf("  sweep (host instance + %u nodes): mean %.1f us, p99 %.1f us, %.0f ns per node, %llu sweeps\n", opt.nodes,
+         sweep.mean() / 1000.0, sweep.percentile(99) / 1000.0, sweep.mean() / (opt.nodes ? opt.nodes : 1),
+         (unsigned long long)sweeps);
+
+  // commands
+  benchSection("command round trip");
+  printf("  sent %u, answered %u, wrong %u, lost %zu; not sent: target offline %u, broker down %u\n", cmds.sent,
+         cmds.answered, cmds.wrong, cmds.pending.size(), cmds.offline, cmds.brokerDown);
+  printRow("inject -> result (ms)", cmds.rtt, 1e6, "ms");
+
+  // reconnect storm
+  benchSection("reconnect storm");
+  if (!storm.upAt) {
+    printf("  no broker outage\n");
+  } else {
+    uint32_t back = 0, maxRate = 0;
+    size_t   retained = 0;
+    std::string status;
+    for (auto& node : s_Nodes) {
+      back += (node->stage == FLEET_ONLINE) ? 1 : 0;
+      retained += (broker.retained(node->status, status) && (status == STATUS_MSG_ON)) ? 1 : 0;
+    }
+    for (uint32_t n : storm.perSecond) {
+      maxRate = (n > maxRate) ? n : maxRate;
+    }
+    printf("  broker down at %u s for %u ms: %llu connections lost\n", storm.downAt / 1000, opt.outageMs,
+           (unsigned long long)(storm.atUp.lost - storm.atDown.lost));
+    printf("  back ONLINE %u/%u nodes, last after %u ms; retained ONLINE %zu; host instance after %u ms\n", back,
+           opt.nodes, storm.allOnlineAt, retained, g_Net.lastReconnectMs);
+    printf("  attempts %llu (%llu failed) while down, %llu (%llu failed) after; peak %u connects/s\n",
+           (unsigned long long)(storm.atUp.attempts - storm.atDown.attempts),
+           (unsigned long long)(storm.atUp.failed - storm.atDown.failed),
+           (unsigned long long)(s_Stats.attempts - storm.atUp.attempts),
+           (unsigned long long)(s_Stats.failed - storm.atUp.failed), maxRate);
+    printRow("broker up -> node ONLINE (ms)", storm.online, 1e6, "ms");
+    printf("  connects per second after the broker came back:");
+    for (size_t i = 0; i < storm.perSecond.size(); i++) {
+      printf("%s%u", (i % 20) ? " " : "\n   ", storm.perSecond[i]);
+    }
+    printf("\n");
+  }
+  s_Nodes.clear();
+  while (!g_Log.empty()) {
+    logDrain();
+  }
+  fflush(stdout);
+  return 0;
+}
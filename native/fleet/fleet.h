@@ -0,0 +1,31 @@
+/*!
+ * @file fleet.h
+ */
+/************************************************************
+ * Native Fleet Load Generator
+ ************************************************************
+ * Run with:  .pio/build/native/program --fleet 1000
+ * N virtual nodes on one event loop against the LocalBroker,
+ * each with the MQTT session of connectMQTT(), the telemetry
+ * jobs of setupTimers() and the command handling of
+ * mqttCallback() (see fleet.cpp).
+ ************************************************************/
+#ifndef _FLEET_H_
+#define _FLEET_H_
+
+#include <stdint.h>
+
+/************************************************************
+ * Options (set from the command line)
+ ************************************************************/
+struct FleetOptions {
+  uint32_t nodes      = 1000;    // virtual nodes
+  uint32_t seconds    = 120;     // virtual seconds of the run
+  uint32_t cmdRate    = 200;     // commands per second to the whole fleet
+  uint32_t outageMs   = 10000;   // broker down after a third of the run (0: no outage)
+  bool     verbose    = false;   // keep Serial output
+};
+
+int      runFleet(const FleetOptions& opt);
+
+#endif // _FLEET_H_
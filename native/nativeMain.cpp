@@ -0,0 +1,134 @@
+/*!
+ * @file nativeMain.cpp
+ */
+/************************************************************
+ * Native Entry Point
+ ************************************************************
+ * Runs setup() and loop() of src/main.cpp as a Linux
+ * process against the in-process LocalBroker.
+ * The board: MCP_COUNT simulated MCP 23017 on the I2C bus,
+ * their INT on INT_PIN (g_SimMcp).
+ *
+ *   program                    run the firmware forever
+ *   program --loops N          run N loop() iterations
+ *   program --dual-core        network task in its own thread
+ *                              (startNetTask), loop() runs the
+ *                              application only
+ *   program --rx-task          MQTT receive task (startRxTask)
+ *                              instead of mqtt.loop()
+ *   program --qos1             TOPIC_RESULT as QoS 1 (g_QosOn),
+ *                              implies --rx-task
+ *   program --bench [opts]     run the benchmarks
+ *     --seconds S              wall seconds per loop-rate run
+ *     --calls N                calls per latency measurement
+ *     --cmd-rate R             commands/s while loop() runs
+ *     --verbose                keep Serial output
+ *   program --fleet N [opts]   N virtual nodes against the
+ *                              broker (native/fleet)
+ *     --fleet-seconds S        virtual seconds of the run
+ *     --fleet-cmd-rate R       commands/s to the fleet
+ *     --outage MS              broker down after a third of
+ *                              the run (0: none)
+ *   --uart                     model the 115200 baud UART
+ *   --real-delay               delay() sleeps for real
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <prototypes.h>
+#include <taskSplit.h>
+#include <binLog.h>
+#include <myHWconfig.h>
+#include <SimMcp23017.h>
+#include "bench/bench.h"
+#include "fleet/fleet.h"
+
+SimMcp23017 g_SimMcp[MCP_COUNT];
+
+static void usage(const char* name) {
+  printf("usage: %s [--loops N] [--dual-core] [--rx-task] [--qos1] [--bench [--seconds S] [--calls N] [--cmd-rate R] [--verbose]]"
+         " [--fleet N [--fleet-seconds S] [--fleet-cmd-rate R] [--outage MS]] [--uart] [--real-delay]\n", name);
+}
+
+int main(int argc, char** argv) {
+  BenchOptions opt;
+  FleetOptions fleetOpt;
+  bool     bench = false;
+  bool     fleet = false;
+  bool     dualCore = false;
+  bool     rxTask = false;
+  uint64_t loops = 0;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool hasValue = (i + 1 < argc);
+    if (!strcmp(arg, "--bench")) {
+      bench = true;
+    } else if (!strcmp(arg, "--dual-core")) {
+      dualCore = true;
+    } else if (!strcmp(arg, "--rx-task")) {
+      rxTask = true;
+    } else if (!strcmp(arg, "--qos1")) {
+      rxTask = true;
+      g_QosOn = true;
+    } else if (!strcmp(arg, "--loops") && hasValue) {
+      loops = strtoull(argv[++i], nullptr, 10);
+    } else if (!strcmp(arg, "--seconds") && hasValue) {
+      opt.seconds = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(arg, "--calls") && hasValue) {
+      opt.calls = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(arg, "--cmd-rate") && hasValue) {
+      opt.cmdRate = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(arg, "--fleet") && hasValue) {
+      fleet = true;
+      fleetOpt.nodes = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(arg, "--fleet-seconds") && hasValue) {
+      fleetOpt.seconds = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(arg, "--fleet-cmd-rate") && hasValue) {
+      fleetOpt.cmdRate = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(arg, "--outage") && hasValue) {
+      fleetOpt.outageMs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(arg, "--verbose")) {
+      opt.verbose = true;
+      fleetOpt.verbose = true;
+    } else if (!strcmp(arg, "--uart")) {
+      simSetUartModel(true);
+    } else if (!strcmp(arg, "--real-delay")) {
+      simSetRealDelay(true);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  for (uint8_t i = 0; i < MCP_COUNT; i++) {
+    g_SimMcp[i].attach(MCP_ADDR + i, INT_PIN);
+  }
+  if (bench) {
+    return runBenchmarks(opt);
+  }
+  if (fleet) {
+    return runFleet(fleetOpt);
+  }
+
+  setup();
+  if (rxTask && !g_RxTask) {
+    startRxTask();
+  }
+  if (dualCore && !g_NetTask) {
+    startNetTask();
+  }
+  for (uint64_t i = 0; !loops || (i < loops); i++) {
+    loop();
+  }
+  if (g_NetTask) {
+    stopNetTask();
+  }
+  if (g_RxTask) {
+    stopRxTask();
+  }
+  // log entries the network task had not drained yet
+  while (!g_Log.empty()) {
+    logDrain();
+  }
+  Serial.flush();
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*!
+ * @file Arduino.h
+ */
+/************************************************************
+ * Native Shim: Arduino Core
+ ************************************************************
+ * Minimal stand-in for the Arduino-ESP32 core, so that
+ * src/main.cpp compiles and runs as a Linux process.
+ * - millis()/micros() run on a virtual clock: real time
+ *   plus everything skipped by delay() (see NativeSim.h)
+ * - GPIO calls are recorded, interrupts can be raised
+ *   from the host side
+ ************************************************************/
+#ifndef _NATIVE_ARDUINO_H_
+#define _NATIVE_ARDUINO_H_
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+/************************************************************
+ * Attributes / Constants
+ ************************************************************/
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+
+#define LOW               0x0
+#define HIGH              0x1
+#define INPUT             0x01
+#define OUTPUT            0x03
+#define INPUT_PULLUP      0x05
+#define RISING            0x01
+#define FALLING           0x02
+#define CHANGE            0x03
+
+#define digitalPinToInterrupt(p)  (p)
+
+/************************************************************
+ * Timing
+ ************************************************************/
+uint32_t millis(void);
+uint32_t micros(void);
+void     delay(uint32_t ms);
+void     delayMicroseconds(uint32_t us);
+void     yield(void);
+
+/************************************************************
+ * Random
+ ************************************************************/
+long     random(long howbig);
+long     random(long howsmall, long howbig);
+void     randomSeed(unsigned long seed);
+
+/************************************************************
+ * GPIO
+ ************************************************************/
+void     pinMode(uint8_t pin, uint8_t mode);
+void     digitalWrite(uint8_t pin, uint8_t val);
+int      digitalRead(uint8_t pin);
+void     attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void     detachInterrupt(uint8_t pin);
+
+/************************************************************
+ * FreeRTOS Spinlock
+ ************************************************************/
+typedef struct {
+  volatile int lock;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED  {0}
+#define portENTER_CRITICAL(mux)       nativeEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)        nativeExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)   nativeEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)    nativeExitCritical(mux)
+void     nativeEnterCritical(portMUX_TYPE* mux);
+void     nativeExitCritical(portMUX_TYPE* mux);
+
+/************************************************************
+ * FreeRTOS Tasks
+ * - a task is a std::thread, the core is ignored
+ * - vTaskDelay() sleeps for real (1 tick = 1 ms)
+ * - the thread running setup()/loop() is the loopTask
+ ************************************************************/
+typedef void*    TaskHandle_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void*);
+#define pdPASS               1
+#define pdFAIL               0
+#define portTICK_PERIOD_MS   1
+#define pdMS_TO_TICKS(ms)    ((TickType_t)(ms))
+BaseType_t   xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                                     UBaseType_t prio, TaskHandle_t* handle, BaseType_t core);
+void         vTaskDelete(TaskHandle_t task);
+void         vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+#include "WString.h"
+#include "Print.h"
+#include "IPAddress.h"
+#include "HardwareSerial.h"
+#include "Esp.h"
+
+#endif // _NATIVE_ARDUINO_H_
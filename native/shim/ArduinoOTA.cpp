@@ -0,0 +1,6 @@
+/*!
+ * @file ArduinoOTA.cpp
+ */
+#include <ArduinoOTA.h>
+
+ArduinoOTAClass ArduinoOTA;
@@ -0,0 +1,58 @@
+/*!
+ * @file ArduinoOTA.h
+ */
+/************************************************************
+ * Native Shim: ArduinoOTA
+ ************************************************************
+ * Stores the callbacks; handle() does nothing unless the
+ * host side starts a simulated update.
+ ************************************************************/
+#ifndef _NATIVE_ARDUINOOTA_H_
+#define _NATIVE_ARDUINOOTA_H_
+
+#include "Arduino.h"
+#include <functional>
+
+#define U_FLASH   0
+#define U_SPIFFS  100
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass {
+  public:
+    typedef std::function<void(void)>                      THandlerFunction;
+    typedef std::function<void(ota_error_t)>               THandlerFunction_Error;
+    typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+    ArduinoOTAClass& setPort(uint16_t port)                   { _port = port; return *this; }
+    ArduinoOTAClass& setHostname(const char* hostname)        { (void)hostname; return *this; }
+    ArduinoOTAClass& setPassword(const char* password)        { (void)password; return *this; }
+    ArduinoOTAClass& setPasswordHash(const char* hash)        { (void)hash; return *this; }
+    ArduinoOTAClass& onStart(THandlerFunction fn)             { _startCb = fn; return *this; }
+    ArduinoOTAClass& onEnd(THandlerFunction fn)               { _endCb = fn; return *this; }
+    ArduinoOTAClass& onProgress(THandlerFunction_Progress fn) { _progressCb = fn; return *this; }
+    ArduinoOTAClass& onError(THandlerFunction_Error fn)       { _errorCb = fn; return *this; }
+    void             begin(void)                              { _begun = true; }
+    void             end(void)                                { _begun = false; }
+    void             handle(void)                             {}
+    int              getCommand(void)                         { return _cmd; }
+
+  private:
+    uint16_t                  _port = 3232;
+    bool                      _begun = false;
+    int                       _cmd = U_FLASH;
+    THandlerFunction          _startCb;
+    THandlerFunction          _endCb;
+    THandlerFunction_Progress _progressCb;
+    THandlerFunction_Error    _errorCb;
+};
+
+extern ArduinoOTAClass ArduinoOTA;
+
+#endif // _NATIVE_ARDUINOOTA_H_
@@ -0,0 +1,26 @@
+/*!
+ * @file Client.h
+ */
+/************************************************************
+ * Native Shim: Client
+ ************************************************************/
+#ifndef _NATIVE_CLIENT_H_
+#define _NATIVE_CLIENT_H_
+
+#include "Print.h"
+#include "IPAddress.h"
+
+class Client : public Print {
+  public:
+    virtual int     connect(IPAddress ip, uint16_t port) = 0;
+    virtual int     connect(const char* host, uint16_t port) = 0;
+    virtual size_t  write(uint8_t c) override = 0;
+    virtual int     available(void) = 0;
+    virtual int     read(void) = 0;
+    virtual void    stop(void) = 0;
+    virtual uint8_t connected(void) = 0;
+    virtual int     fd(void) const                              { return -1; }   // socket, -1: none
+    using Print::write;
+};
+
+#endif // _NATIVE_CLIENT_H_
@@ -0,0 +1,20 @@
+/*!
+ * @file ESPmDNS.h
+ */
+/************************************************************
+ * Native Shim: mDNS (no-op)
+ ************************************************************/
+#ifndef _NATIVE_ESPMDNS_H_
+#define _NATIVE_ESPMDNS_H_
+
+#include "Arduino.h"
+
+class MDNSResponder {
+  public:
+    bool begin(const char* hostName)  { (void)hostName; return true; }
+    void end(void)                    {}
+};
+
+extern MDNSResponder MDNS;
+
+#endif // _NATIVE_ESPMDNS_H_
@@ -0,0 +1,39 @@
+/*!
+ * @file Esp.h
+ */
+/************************************************************
+ * Native Shim: ESP class
+ ************************************************************
+ * Plausible ESP32 values. getSketchMD5() hashes a simulated
+ * app partition on every call, like the original reads the
+ * whole partition from flash.
+ ************************************************************/
+#ifndef _NATIVE_ESP_H_
+#define _NATIVE_ESP_H_
+
+#include <stdint.h>
+#include "WString.h"
+
+class EspClass {
+  public:
+    uint32_t    getHeapSize(void);
+    uint32_t    getFreeHeap(void);
+    uint32_t    getMinFreeHeap(void);
+    uint32_t    getMaxAllocHeap(void);
+    const char* getChipModel(void);
+    uint8_t     getChipRevision(void);
+    uint32_t    getCycleCount(void);
+    const char* getSdkVersion(void);
+    uint32_t    getCpuFreqMHz(void);
+    uint32_t    getSketchSize(void);
+    uint32_t    getFreeSketchSpace(void);
+    String      getSketchMD5(void);
+    uint32_t    getFlashChipSize(void);
+    uint32_t    getFlashChipSpeed(void);
+    uint64_t    getEfuseMac(void);
+    void        restart(void);
+};
+
+extern EspClass ESP;
+
+#endif // _NATIVE_ESP_H_
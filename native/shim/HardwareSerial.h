@@ -0,0 +1,36 @@
+/*!
+ * @file HardwareSerial.h
+ */
+/************************************************************
+ * Native Shim: Serial
+ ************************************************************
+ * Writes to stdout. Optionally models the UART: a 128 byte
+ * TX-FIFO drained at the configured baudrate, writes block
+ * (busy wait) while the FIFO is full - as on the ESP32;
+ * availableForWrite() returns the free bytes of the FIFO.
+ ************************************************************/
+#ifndef _NATIVE_HARDWARESERIAL_H_
+#define _NATIVE_HARDWARESERIAL_H_
+
+#include "Print.h"
+
+class HardwareSerial : public Print {
+  public:
+    void   begin(unsigned long baud);
+    void   end(void) {}
+    void   flush(void);
+    int    available(void)  { return 0; }
+    int    read(void)       { return -1; }
+    int    availableForWrite(void);
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using  Print::write;
+    operator bool(void) const { return true; }
+
+  private:
+    unsigned long _baud = 115200;
+};
+
+extern HardwareSerial Serial;
+
+#endif // _NATIVE_HARDWARESERIAL_H_
@@ -0,0 +1,48 @@
+/*!
+ * @file IPAddress.h
+ */
+/************************************************************
+ * Native Shim: IPAddress (IPv4 only)
+ ************************************************************/
+#ifndef _NATIVE_IPADDRESS_H_
+#define _NATIVE_IPADDRESS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "Print.h"
+
+class IPAddress : public Printable {
+  public:
+    IPAddress(void) : _addr{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _addr{a, b, c, d} {}
+    IPAddress(uint32_t address) {
+      memcpy(_addr, &address, 4);
+    }
+
+    operator uint32_t(void) const {
+      uint32_t address;
+      memcpy(&address, _addr, 4);
+      return address;
+    }
+    bool     operator==(const IPAddress& rhs) const  { return memcmp(_addr, rhs._addr, 4) == 0; }
+    bool     operator!=(const IPAddress& rhs) const  { return !(*this == rhs); }
+    uint8_t  operator[](int index) const             { return _addr[index]; }
+    uint8_t& operator[](int index)                   { return _addr[index]; }
+
+    String toString(void) const {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _addr[0], _addr[1], _addr[2], _addr[3]);
+      return String(buf);
+    }
+    size_t printTo(Print& p) const override {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _addr[0], _addr[1], _addr[2], _addr[3]);
+      return p.print(buf);
+    }
+
+  private:
+    uint8_t _addr[4];
+};
+
+#endif // _NATIVE_IPADDRESS_H_
@@ -0,0 +1,35 @@
+/*!
+ * @file MD5Builder.h
+ */
+/************************************************************
+ * Native Shim: MD5Builder (RFC 1321)
+ ************************************************************
+ * The subset of the Arduino class used by src/: begin, add,
+ * calculate, getBytes / getChars / toString.
+ ************************************************************/
+#ifndef _NATIVE_MD5BUILDER_H_
+#define _NATIVE_MD5BUILDER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "WString.h"
+
+class MD5Builder {
+  public:
+    void   begin(void);
+    void   add(const uint8_t* data, size_t len);
+    void   calculate(void);
+    void   getBytes(uint8_t* output) const;      // 16 bytes
+    void   getChars(char* output) const;         // 33 chars: hex + '\0'
+    String toString(void) const;
+
+  private:
+    uint32_t _state[4];
+    uint64_t _bytes;
+    uint8_t  _block[64];
+    uint8_t  _digest[16];
+
+    void     transform(const uint8_t* block);
+};
+
+#endif // _NATIVE_MD5BUILDER_H_
@@ -0,0 +1,311 @@
+/*!
+ * @file NativeSim.cpp
+ */
+/************************************************************
+ * Native Shim: Arduino Core, Serial, ESP
+ ************************************************************/
+#include <Arduino.h>
+#include <NativeSim.h>
+#include <MD5Builder.h>
+#include <esp_ota_ops.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+/************************************************************
+ * Virtual Clock
+ ************************************************************/
+static const std::chrono::steady_clock::time_point s_Boot = std::chrono::steady_clock::now();
+static std::atomic<uint64_t> s_WarpUs(0);
+static bool                  s_RealDelay = false;
+
+uint64_t simNanos64(void) {
+  uint64_t real = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - s_Boot).count();
+  return real + s_WarpUs.load(std::memory_order_relaxed) * 1000;
+}
+
+uint64_t simMicros64(void) {
+  return simNanos64() / 1000;
+}
+
+void simAdvanceMillis(uint32_t ms)       { s_WarpUs += (uint64_t)ms * 1000; }
+void simAdvanceMicros(uint64_t us)       { s_WarpUs += us; }
+void simSetRealDelay(bool sleepForReal)  { s_RealDelay = sleepForReal; }
+
+uint32_t millis(void) {
+  return (uint32_t)(simMicros64() / 1000);
+}
+
+uint32_t micros(void) {
+  return (uint32_t)simMicros64();
+}
+
+void delay(uint32_t ms) {
+  if (s_RealDelay) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  } else {
+    simAdvanceMillis(ms);
+  }
+}
+
+void delayMicroseconds(uint32_t us) {
+  uint64_t until = simMicros64() + us;
+  while (simMicros64() < until) {
+  }
+}
+
+void yield(void) {
+  std::this_thread::yield();
+}
+
+
+/************************************************************
+ * Random
+ ************************************************************/
+long random(long howbig) {
+  return (howbig > 0) ? (long)(rand() % howbig) : 0;
+}
+
+long random(long howsmall, long howbig) {
+  return (howbig > howsmall) ? howsmall + random(howbig - howsmall) : howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+  srand((unsigned)seed);
+}
+
+
+/************************************************************
+ * Critical Sections
+ ************************************************************/
+void nativeEnterCritical(portMUX_TYPE* mux) {
+  while (__atomic_exchange_n(&mux->lock, 1, __ATOMIC_ACQUIRE)) {
+  }
+}
+
+void nativeExitCritical(portMUX_TYPE* mux) {
+  __atomic_store_n(&mux->lock, 0, __ATOMIC_RELEASE);
+}
+
+
+/************************************************************
+ * FreeRTOS Tasks
+ ************************************************************/
+struct SimTask {
+  const char* name;
+};
+
+static SimTask               s_LoopTask = {"loopTask"};
+static thread_local SimTask* s_CurrentTask = &s_LoopTask;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                                   UBaseType_t prio, TaskHandle_t* handle, BaseType_t core) {
+  (void)stackDepth;
+  (void)prio;
+  (void)core;
+  SimTask* task = new SimTask{name};
+  if (handle) {
+    *handle = task;
+  }
+  std::thread([fn, param, task]() {
+    s_CurrentTask = task;
+    fn(param);
+  }).detach();
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  // the thread ends when the task function returns (after vTaskDelete(nullptr))
+  (void)task;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return s_CurrentTask;
+}
+
+
+/************************************************************
+ * GPIO
+ ************************************************************/
+#define SIM_NUM_PINS 40
+
+static int   s_PinLevel[SIM_NUM_PINS];
+static void (*s_PinIsr[SIM_NUM_PINS])(void);
+static int   s_PinIsrMode[SIM_NUM_PINS];
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if ((pin < SIM_NUM_PINS) && (mode == INPUT_PULLUP)) {
+    s_PinLevel[pin] = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < SIM_NUM_PINS) {
+    s_PinLevel[pin] = val;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return (pin < SIM_NUM_PINS) ? s_PinLevel[pin] : LOW;
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+  if (pin < SIM_NUM_PINS) {
+    s_PinIsr[pin] = isr;
+    s_PinIsrMode[pin] = mode;
+  }
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < SIM_NUM_PINS) {
+    s_PinIsr[pin] = nullptr;
+  }
+}
+
+void simSetPin(uint8_t pin, int level) {
+  if (pin >= SIM_NUM_PINS) {
+    return;
+  }
+  int old = s_PinLevel[pin];
+  s_PinLevel[pin] = level;
+  if (!s_PinIsr[pin] || (old == level)) {
+    return;
+  }
+  int mode = s_PinIsrMode[pin];
+  if ((mode == CHANGE) || ((mode == FALLING) && (level == LOW)) || ((mode == RISING) && (level == HIGH))) {
+    s_PinIsr[pin]();
+  }
+}
+
+int simGetPin(uint8_t pin) {
+  return digitalRead(pin);
+}
+
+
+/************************************************************
+ * Serial
+ ************************************************************/
+HardwareSerial Serial;
+
+#define SIM_UART_FIFO 128
+
+static bool     s_SerialOutput = true;
+static bool     s_UartModel = false;
+static uint64_t s_UartIdleAt;         // simMicros64() when the TX-FIFO is empty
+
+void simSetSerialOutput(bool enable) { s_SerialOutput = enable; }
+void simSetUartModel(bool enable)    { s_UartModel = enable; }
+
+void HardwareSerial::begin(unsigned long baud) {
+  _baud = baud;
+}
+
+void HardwareSerial::flush(void) {
+  if (s_UartModel) {
+    while (simMicros64() < s_UartIdleAt) {
+    }
+  }
+  fflush(stdout);
+}
+
+int HardwareSerial::availableForWrite(void) {
+  if (!s_UartModel) {
+    return SIM_UART_FIFO;
+  }
+  uint64_t byteUs = 10000000ULL / _baud;
+  uint64_t now = simMicros64();
+  uint64_t queued = (s_UartIdleAt > now) ? (s_UartIdleAt - now + byteUs - 1) / byteUs : 0;
+  return (queued >= SIM_UART_FIFO) ? 0 : (int)(SIM_UART_FIFO - queued);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (s_UartModel) {
+    // 10 bit per byte (8N1); block while the FIFO has no room
+    uint64_t byteUs = 10000000ULL / _baud;
+    for (size_t i = 0; i < size; i++) {
+      uint64_t now = simMicros64();
+      if (s_UartIdleAt < now) {
+        s_UartIdleAt = now;
+      }
+      while (s_UartIdleAt > simMicros64() + SIM_UART_FIFO * byteUs) {
+      }
+      s_UartIdleAt += byteUs;
+    }
+  }
+  if (s_SerialOutput) {
+    fwrite(buffer, 1, size, stdout);
+  }
+  return size;
+}
+
+
+/************************************************************
+ * ESP
+ ************************************************************/
+EspClass ESP;
+
+#define SIM_HEAP_SIZE      349264
+
+// each thread (core) has its own cycle counter, not in step with the others
+// (as CCOUNT of the two ESP32 cores): a difference across threads is garbage
+static uint32_t simCycleOffset(void) {
+  static std::atomic<uint32_t> s_Threads(0);
+  static thread_local uint32_t s_Offset = s_Threads.fetch_add(1) * 0x9e3779b9u;
+  return s_Offset;
+}
+
+static void (*s_RestartHandler)(void);
+static uint32_t s_RestartCount;
+
+void     simSetRestartHandler(void (*handler)(void)) { s_RestartHandler = handler; }
+uint32_t simRestartCount(void)                       { return s_RestartCount; }
+
+uint32_t    EspClass::getHeapSize(void)        { return SIM_HEAP_SIZE; }
+uint32_t    EspClass::getFreeHeap(void)        { return 260632; }
+uint32_t    EspClass::getMinFreeHeap(void)     { return 253140; }
+uint32_t    EspClass::getMaxAllocHeap(void)    { return 113792; }
+const char* EspClass::getChipModel(void)       { return "ESP32-D0WDQ5"; }
+uint8_t     EspClass::getChipRevision(void)    { return 1; }
+uint32_t    EspClass::getCycleCount(void)      { return (uint32_t)(simNanos64() * 240 / 1000) + simCycleOffset(); }
+const char* EspClass::getSdkVersion(void)      { return "v4.4-native"; }
+uint32_t    EspClass::getCpuFreqMHz(void)      { return 240; }
+uint32_t    EspClass::getSketchSize(void)      { return simSketchSize(); }
+uint32_t    EspClass::getFreeSketchSpace(void) { return 1310720; }
+uint32_t    EspClass::getFlashChipSize(void)   { return 4194304; }
+uint32_t    EspClass::getFlashChipSpeed(void)  { return 40000000; }
+uint64_t    EspClass::getEfuseMac(void)        { return 0x0000A1B2C3D4E5F6ULL; }
+
+// reads and hashes the running partition, like the original
+String EspClass::getSketchMD5(void) {
+  const esp_partition_t* part = esp_ota_get_running_partition();
+  uint8_t    buf[4096];
+  MD5Builder md5;
+  md5.begin();
+  for (uint32_t at = 0; at < simSketchSize(); at += sizeof(buf)) {
+    uint32_t n = (simSketchSize() - at < sizeof(buf)) ? simSketchSize() - at : (uint32_t)sizeof(buf);
+    esp_partition_read(part, at, buf, n);
+    md5.add(buf, (uint16_t)n);
+  }
+  md5.calculate();
+  return md5.toString();
+}
+
+void EspClass::restart(void) {
+  s_RestartCount++;
+  if (s_RestartHandler) {
+    s_RestartHandler();
+    return;
+  }
+  Serial.println("### native: ESP.restart() - exiting");
+  Serial.flush();
+  exit(0);
+}
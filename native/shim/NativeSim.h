@@ -0,0 +1,123 @@
+/*!
+ * @file NativeSim.h
+ */
+/************************************************************
+ * Native Shim: Simulation Controls
+ ************************************************************
+ * Host side knobs of the native target. Used by the native
+ * main and the benchmarks, never by src/.
+ ************************************************************/
+#ifndef _NATIVE_SIM_H_
+#define _NATIVE_SIM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+
+struct BrokerSession;
+
+/************************************************************
+ * Virtual Clock
+ * - millis()/micros() = real time + warp
+ * - delay() adds to the warp instead of sleeping (default),
+ *   so setup() delays cost no wall time but stay visible
+ *   in millis()
+ ************************************************************/
+uint64_t simMicros64(void);
+uint64_t simNanos64(void);
+void     simAdvanceMillis(uint32_t ms);
+void     simAdvanceMicros(uint64_t us);
+void     simSetRealDelay(bool sleepForReal);
+
+/************************************************************
+ * Serial
+ ************************************************************/
+void     simSetSerialOutput(bool enable);      // false: discard Serial output
+void     simSetUartModel(bool enable);         // true: model 128 byte TX-FIFO at baudrate
+
+/************************************************************
+ * GPIO
+ ************************************************************/
+void     simSetPin(uint8_t pin, int level);    // drive input, fires attached ISR on matching edge
+int      simGetPin(uint8_t pin);               // last level written by firmware
+
+/************************************************************
+ * I2C (Wire.h)
+ * - a device gets the data bytes of each write (after the
+ *   address) and fills the bytes of each read
+ ************************************************************/
+class SimI2cDevice {
+  public:
+    virtual ~SimI2cDevice(void) {}
+    virtual void   i2cWrite(const uint8_t* data, size_t n) = 0;
+    virtual size_t i2cRead(uint8_t* data, size_t n) = 0;
+};
+
+struct SimI2cStats {
+  uint64_t transactions;                       // START .. STOP
+  uint64_t bytes;                              // incl. address bytes
+  uint64_t busNs;                              // time on the bus
+  uint64_t nacks;                              // no device at the address
+};
+
+void        simI2cAttach(uint8_t address, SimI2cDevice* device);   // nullptr: detach
+SimI2cStats simI2cStats(void);
+
+/************************************************************
+ * WiFi
+ ************************************************************/
+void     simWifiSetAvailable(bool available);  // access point in range
+void     simWifiSetScanTime(uint32_t ms);      // skipped by begin() with channel + BSSID
+void     simWifiSetAssociationTime(uint32_t ms);
+void     simWifiSetDhcpTime(uint32_t ms);      // skipped with a static IP (config())
+void     simWifiSetChannel(uint8_t channel);   // access point moved to another channel
+void     simWifiSetDnsTime(uint32_t ms);       // cost of one hostByName()
+
+/************************************************************
+ * Sockets (src/idleWait.h, src/mqttRx.h)
+ * - the LocalBroker calls simSocketData() for every message
+ *   it queues for a client: an MQTT socket became readable,
+ *   wakes idleWait() and simSocketWait()
+ * - simSocketWait(): until the generation (simSocketGen)
+ *   changes or us passed
+ * - simSocketAttach(): the broker session behind a socket of
+ *   tcpConnectStart(), read by mqttRxRecv() (PubSubClient)
+ * - simSetLinkDelay(): round trip of the link for the answers
+ *   to mqttRxSend() packets (PUBACK, PINGRESP), default 0
+ ************************************************************/
+void     simSocketData(void);
+uint32_t simSocketGen(void);
+void     simSocketWait(uint32_t gen, uint32_t us);
+void     simSocketAttach(int sock, const std::shared_ptr<BrokerSession>& session);
+void     simSetLinkDelay(uint32_t us);
+
+/************************************************************
+ * Heap (glibc malloc interposition, see nativeHeap.cpp)
+ * - counts every malloc/calloc/realloc/free of the process
+ * - SimHeapPause excludes the simulation itself (broker,
+ *   taps) on the current thread
+ ************************************************************/
+uint64_t simHeapAllocs(void);
+uint64_t simHeapFrees(void);
+
+class SimHeapPause {
+  public:
+    SimHeapPause(void);
+    ~SimHeapPause(void);
+};
+
+/************************************************************
+ * Sketch (app partitions: esp_partition.h, esp_ota_ops.h)
+ * - the running partition holds the sketch, getSketchSize()
+ *   and getSketchMD5() describe it
+ ************************************************************/
+void     simLoadSketch(const uint8_t* image, size_t size);   // replaces the running sketch
+uint32_t simSketchSize(void);
+
+/************************************************************
+ * Restart
+ ************************************************************/
+void     simSetRestartHandler(void (*handler)(void));
+uint32_t simRestartCount(void);
+
+#endif // _NATIVE_SIM_H_
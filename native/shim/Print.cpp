@@ -0,0 +1,45 @@
+/*!
+ * @file Print.cpp
+ */
+#include <Arduino.h>
+#include <stdarg.h>
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char    buf[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) {
+    return 0;
+  }
+  if ((size_t)len >= sizeof(buf)) {
+    len = sizeof(buf) - 1;
+  }
+  return write((const uint8_t*)buf, (size_t)len);
+}
+
+size_t Print::print(const String& s)                        { return write((const uint8_t*)s.c_str(), s.length()); }
+size_t Print::print(const char* str)                        { return write(str); }
+size_t Print::print(char c)                                 { return write((uint8_t)c); }
+size_t Print::print(unsigned char value, int base)          { return print(String(value, (unsigned char)base)); }
+size_t Print::print(int value, int base)                    { return print(String(value, (unsigned char)base)); }
+size_t Print::print(unsigned int value, int base)           { return print(String(value, (unsigned char)base)); }
+size_t Print::print(long value, int base)                   { return print(String(value, (unsigned char)base)); }
+size_t Print::print(unsigned long value, int base)          { return print(String(value, (unsigned char)base)); }
+size_t Print::print(long long value, int base)              { return print(String(value, (unsigned char)base)); }
+size_t Print::print(unsigned long long value, int base)     { return print(String(value, (unsigned char)base)); }
+size_t Print::print(double value, int digits)               { return print(String(value, (unsigned int)digits)); }
+size_t Print::print(const Printable& x)                     { return x.printTo(*this); }
+
+size_t Print::println(void) {
+  return write((const uint8_t*)"\r\n", 2);
+}
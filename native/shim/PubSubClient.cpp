@@ -0,0 +1,343 @@
+/*!
+ * @file PubSubClient.cpp
+ */
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <LocalBroker.h>
+#include <NativeSim.h>
+
+/************************************************************
+ * Construction
+ ************************************************************/
+PubSubClient::PubSubClient(void)
+  : _client(nullptr), _domain(nullptr), _port(0), _buffer(nullptr), _bufferSize(0),
+    _keepAlive(MQTT_KEEPALIVE), _socketTimeout(MQTT_SOCKET_TIMEOUT), _state(MQTT_DISCONNECTED),
+    _streamTopicLen(0), _streamLen(0), _streamExpected(0), _streamRetained(false), _streaming(false) {
+  setBufferSize(MQTT_MAX_PACKET_SIZE);
+}
+
+PubSubClient::PubSubClient(Client& client) : PubSubClient() {
+  setClient(client);
+}
+
+PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client) : PubSubClient() {
+  setServer(addr, port);
+  setClient(client);
+}
+
+PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client) : PubSubClient() {
+  setServer(domain, port);
+  setClient(client);
+}
+
+PubSubClient::~PubSubClient(void) {
+  free(_buffer);
+}
+
+PubSubClient& PubSubClient::setServer(IPAddress ip, uint16_t port) {
+  _ip = ip;
+  _port = port;
+  _domain = nullptr;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+  _domain = domain;
+  _port = port;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  _callback = callback;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setClient(Client& client) {
+  _client = &client;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setKeepAlive(uint16_t keepAlive) {
+  _keepAlive = keepAlive;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t timeout) {
+  _socketTimeout = timeout;
+  return *this;
+}
+
+boolean PubSubClient::setBufferSize(uint16_t size) {
+  if (size == 0) {
+    return false;
+  }
+  uint8_t* newBuffer = (uint8_t*)realloc(_buffer, size);
+  if (!newBuffer) {
+    return false;
+  }
+  _buffer = newBuffer;
+  _bufferSize = size;
+  return true;
+}
+
+
+/************************************************************
+ * Connection
+ ************************************************************/
+boolean PubSubClient::connect(const char* id) {
+  return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr, true);
+}
+
+boolean PubSubClient::connect(const char* id, const char* user, const char* pass) {
+  return connect(id, user, pass, nullptr, 0, false, nullptr, true);
+}
+
+boolean PubSubClient::connect(const char* id, const char* willTopic, uint8_t willQos, boolean willRetain,
+                              const char* willMessage) {
+  return connect(id, nullptr, nullptr, willTopic, willQos, willRetain, willMessage, true);
+}
+
+boolean PubSubClient::connect(const char* id, const char* user, const char* pass, const char* willTopic,
+                              uint8_t willQos, boolean willRetain, const char* willMessage) {
+  return connect(id, user, pass, willTopic, willQos, willRetain, willMessage, true);
+}
+
+boolean PubSubClient::connect(const char* id, const char* user, const char* pass, const char* willTopic,
+                              uint8_t willQos, boolean willRetain, const char* willMessage, boolean cleanSession) {
+  (void)user;
+  (void)pass;
+  (void)willQos;
+  (void)cleanSession;
+  if (connected()) {
+    return true;
+  }
+  if (WiFi.status() != WL_CONNECTED) {
+    _state = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  // like PubSubClient: a client that is connected already is
+  // used as is (no DNS, no TCP connect)
+  bool tcpUp = _client && _client->connected();
+  // WiFiClient::connect(domain) resolves on every attempt
+  if (_domain && !tcpUp) {
+    IPAddress resolved;
+    if (!WiFi.hostByName(_domain, resolved)) {
+      _state = MQTT_CONNECT_FAILED;
+      return false;
+    }
+  }
+  SimHeapPause pause;
+  LocalBroker& broker = LocalBroker::instance();
+  if (!broker.isUp()) {
+    // blocking TCP connect runs into its timeout
+    if (!tcpUp) {
+      delay(broker.connectTimeMs());
+    } else {
+      _client->stop();
+    }
+    _state = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  _session = broker.connect(id, willTopic, willMessage, willRetain);
+  if (!_session) {
+    _state = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  if (_client) {
+    _client->connect(_ip, _port);
+    simSocketAttach(_client->fd(), _session);   // receive task (src/mqttRx.h)
+  }
+  _state = MQTT_CONNECTED;
+  return true;
+}
+
+void PubSubClient::disconnect(void) {
+  if (_session) {
+    SimHeapPause pause;
+    LocalBroker::instance().disconnect(_session, true);
+    _session.reset();
+  }
+  if (_client) {
+    _client->stop();
+  }
+  _state = MQTT_DISCONNECTED;
+}
+
+boolean PubSubClient::connected(void) {
+  if (_session && !_session->connected) {
+    SimHeapPause pause;
+    _session.reset();
+    if (_client) {
+      _client->stop();
+    }
+    _state = MQTT_CONNECTION_LOST;
+  }
+  return _session != nullptr;
+}
+
+
+/************************************************************
+ * Publish
+ ************************************************************/
+boolean PubSubClient::publish(const char* topic, const char* payload) {
+  return publish(topic, (const uint8_t*)payload, payload ? (unsigned int)strlen(payload) : 0, false);
+}
+
+boolean PubSubClient::publish(const char* topic, const char* payload, boolean retained) {
+  return publish(topic, (const uint8_t*)payload, payload ? (unsigned int)strlen(payload) : 0, retained);
+}
+
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength) {
+  return publish(topic, payload, plength, false);
+}
+
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+  if (!connected()) {
+    return false;
+  }
+  size_t topicLen = strnlen(topic, _bufferSize);
+  if (_bufferSize < MQTT_MAX_HEADER_SIZE + 2 + topicLen + plength) {
+    return false;
+  }
+  // serialise into the client buffer like the original
+  uint8_t* pos = _buffer + MQTT_MAX_HEADER_SIZE;
+  *pos++ = (uint8_t)(topicLen >> 8);
+  *pos++ = (uint8_t)(topicLen & 0xff);
+  memcpy(pos, topic, topicLen);
+  pos += topicLen;
+  memcpy(pos, payload, plength);
+  SimHeapPause pause;
+  LocalBroker::instance().publish(topic, pos, plength, retained);
+  return true;
+}
+
+boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, boolean retained) {
+  if (!connected()) {
+    return false;
+  }
+  size_t topicLen = strnlen(topic, _bufferSize);
+  if (_bufferSize < MQTT_MAX_HEADER_SIZE + 2 + topicLen + 1) {
+    return false;
+  }
+  uint8_t* pos = _buffer + MQTT_MAX_HEADER_SIZE;
+  *pos++ = (uint8_t)(topicLen >> 8);
+  *pos++ = (uint8_t)(topicLen & 0xff);
+  memcpy(pos, topic, topicLen);
+  pos[topicLen] = '\0';
+  _streamTopicLen = (uint16_t)topicLen;
+  _streamLen = 0;
+  _streamExpected = plength;
+  _streamRetained = retained;
+  _streaming = true;
+  return true;
+}
+
+size_t PubSubClient::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t PubSubClient::write(const uint8_t* buffer, size_t size) {
+  if (!_streaming) {
+    return 0;
+  }
+  // the original streams to the socket; here the payload is
+  // collected behind the topic and bounded by the buffer size
+  size_t offset = MQTT_MAX_HEADER_SIZE + 2 + _streamTopicLen + 1 + _streamLen;
+  size_t room = (_bufferSize > offset) ? _bufferSize - offset : 0;
+  size_t n = (size < room) ? size : room;
+  memcpy(_buffer + offset, buffer, n);
+  _streamLen += n;
+  return n;
+}
+
+int PubSubClient::endPublish(void) {
+  if (!_streaming) {
+    return 0;
+  }
+  _streaming = false;
+  if ((_streamLen != _streamExpected) || !connected()) {
+    return 0;
+  }
+  const char*  topic = (const char*)_buffer + MQTT_MAX_HEADER_SIZE + 2;
+  SimHeapPause pause;
+  LocalBroker::instance().publish(topic, (const uint8_t*)topic + _streamTopicLen + 1, _streamLen, _streamRetained);
+  return 1;
+}
+
+
+/************************************************************
+ * Subscribe
+ ************************************************************/
+boolean PubSubClient::subscribe(const char* topic) {
+  return subscribe(topic, 0);
+}
+
+boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
+  (void)qos;
+  if (!connected()) {
+    return false;
+  }
+  SimHeapPause pause;
+  LocalBroker::instance().subscribe(_session, topic);
+  return true;
+}
+
+boolean PubSubClient::unsubscribe(const char* topic) {
+  (void)topic;
+  return connected();
+}
+
+
+/************************************************************
+ * Loop
+ * - one message per call, laid out as received PUBLISH:
+ *   [hdr][len 1..4][topic-len 2][topic][payload]
+ * - the topic is moved one byte to the front and terminated,
+ *   the payload follows the terminator (as in the original)
+ ************************************************************/
+boolean PubSubClient::loop(void) {
+  if (!connected()) {
+    return false;
+  }
+  size_t  tl;
+  size_t  pl;
+  uint8_t llen = 0;
+  {
+    SimHeapPause  pause;
+    BrokerMessage msg;
+    if (!LocalBroker::instance().fetch(_session, msg)) {
+      return true;
+    }
+    tl = msg.topic.size();
+    pl = msg.payload.size();
+    size_t  remaining = 2 + tl + pl;
+    uint8_t lenBytes[4];
+    size_t  x = remaining;
+    do {
+      uint8_t digit = x & 0x7f;
+      x >>= 7;
+      if (x) {
+        digit |= 0x80;
+      }
+      lenBytes[llen++] = digit;
+    } while (x && (llen < 4));
+    if (1 + llen + remaining > _bufferSize) {
+      // too large for the buffer: dropped, like the original
+      return true;
+    }
+    _buffer[0] = (uint8_t)(0x30 | (msg.retained ? 1 : 0));
+    memcpy(_buffer + 1, lenBytes, llen);
+    _buffer[llen + 1] = (uint8_t)(tl >> 8);
+    _buffer[llen + 2] = (uint8_t)(tl & 0xff);
+    memcpy(_buffer + llen + 3, msg.topic.data(), tl);
+    memcpy(_buffer + llen + 3 + tl, msg.payload.data(), pl);
+  }
+  if (_callback) {
+    char* topic = (char*)_buffer + llen + 2;
+    memmove(_buffer + llen + 2, _buffer + llen + 3, tl);
+    _buffer[llen + 2 + tl] = 0;
+    uint8_t* payload = _buffer + llen + 3 + tl;
+    _callback(topic, payload, (unsigned int)pl);
+  }
+  return true;
+}
@@ -0,0 +1,112 @@
+/*!
+ * @file PubSubClient.h
+ */
+/************************************************************
+ * Native Shim: PubSubClient 2.8
+ ************************************************************
+ * API compatible stand-in which talks to the in-process
+ * LocalBroker instead of a socket. Buffer handling mirrors
+ * the original:
+ * - publish() copies topic and payload into the client
+ *   buffer and fails when they do not fit
+ * - loop() fetches at most one message, lays it out in the
+ *   buffer like a received PUBLISH packet and passes
+ *   pointers into that buffer to the callback
+ * - connect() resolves the domain every time and blocks for
+ *   the TCP timeout while the broker is down, unless the
+ *   client is connected already (src/tcpConnect.h)
+ ************************************************************/
+#ifndef _NATIVE_PUBSUBCLIENT_H_
+#define _NATIVE_PUBSUBCLIENT_H_
+
+#include "Arduino.h"
+#include "Client.h"
+#include <functional>
+#include <memory>
+
+#define MQTT_VERSION_3_1_1           4
+#define MQTT_MAX_PACKET_SIZE         256
+#define MQTT_KEEPALIVE               15
+#define MQTT_SOCKET_TIMEOUT          15
+#define MQTT_MAX_HEADER_SIZE         5
+
+#define MQTT_CONNECTION_TIMEOUT      -4
+#define MQTT_CONNECTION_LOST         -3
+#define MQTT_CONNECT_FAILED          -2
+#define MQTT_DISCONNECTED            -1
+#define MQTT_CONNECTED                0
+
+#define MQTTQOS0                     (0 << 1)
+#define MQTTQOS1                     (1 << 1)
+
+#define MQTT_CALLBACK_SIGNATURE      std::function<void(char*, uint8_t*, unsigned int)> callback
+
+struct BrokerSession;
+
+class PubSubClient : public Print {
+  public:
+    PubSubClient(void);
+    PubSubClient(Client& client);
+    PubSubClient(IPAddress addr, uint16_t port, Client& client);
+    PubSubClient(const char* domain, uint16_t port, Client& client);
+    ~PubSubClient(void);
+
+    PubSubClient& setServer(IPAddress ip, uint16_t port);
+    PubSubClient& setServer(const char* domain, uint16_t port);
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+    PubSubClient& setClient(Client& client);
+    PubSubClient& setKeepAlive(uint16_t keepAlive);
+    PubSubClient& setSocketTimeout(uint16_t timeout);
+
+    boolean  setBufferSize(uint16_t size);
+    uint16_t getBufferSize(void)                       { return _bufferSize; }
+
+    boolean  connect(const char* id);
+    boolean  connect(const char* id, const char* user, const char* pass);
+    boolean  connect(const char* id, const char* willTopic, uint8_t willQos, boolean willRetain, const char* willMessage);
+    boolean  connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos,
+                     boolean willRetain, const char* willMessage);
+    boolean  connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos,
+                     boolean willRetain, const char* willMessage, boolean cleanSession);
+    void     disconnect(void);
+
+    boolean  publish(const char* topic, const char* payload);
+    boolean  publish(const char* topic, const char* payload, boolean retained);
+    boolean  publish(const char* topic, const uint8_t* payload, unsigned int plength);
+    boolean  publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained);
+
+    boolean  beginPublish(const char* topic, unsigned int plength, boolean retained);
+    int      endPublish(void);
+    size_t   write(uint8_t c) override;
+    size_t   write(const uint8_t* buffer, size_t size) override;
+    using    Print::write;
+
+    boolean  subscribe(const char* topic);
+    boolean  subscribe(const char* topic, uint8_t qos);
+    boolean  unsubscribe(const char* topic);
+
+    boolean  loop(void);
+    boolean  connected(void);
+    int      state(void)                               { return _state; }
+
+  private:
+    std::function<void(char*, uint8_t*, unsigned int)> _callback;
+    std::shared_ptr<BrokerSession> _session;
+    Client*     _client;
+    const char* _domain;
+    IPAddress   _ip;
+    uint16_t    _port;
+    uint8_t*    _buffer;
+    uint16_t    _bufferSize;
+    uint16_t    _keepAlive;
+    uint16_t    _socketTimeout;
+    int         _state;
+    // streamed publish (beginPublish / write / endPublish)
+    uint16_t    _streamTopicLen;
+    uint32_t    _streamLen;
+    uint32_t    _streamExpected;
+    bool        _streamRetained;
+    bool        _streaming;
+};
+
+#endif // _NATIVE_PUBSUBCLIENT_H_
@@ -0,0 +1,122 @@
+/*!
+ * @file SimMcp23017.cpp
+ */
+/************************************************************
+ * Native Shim: MCP23017 Model (SimMcp23017.h)
+ ************************************************************/
+#include <Arduino.h>
+#include <SimMcp23017.h>
+
+#define SIM_MCP_MAX   8                    // chips on one bus
+
+#define R_IODIRA      0x00
+#define R_IPOLA       0x02
+#define R_GPINTENA    0x04
+#define R_IOCON       0x0A
+#define R_IOCONB      0x0B
+#define R_INTFA       0x0E
+#define R_INTFB       0x0F
+#define R_INTCAPA     0x10
+#define R_INTCAPB     0x11
+#define R_GPIOA       0x12
+#define R_GPIOB       0x13
+#define R_OLATA       0x14
+
+static SimMcp23017* s_Chips[SIM_MCP_MAX];
+static uint64_t     s_LowPins;             // INT lines pulled low by a chip
+
+void SimMcp23017::attach(uint8_t address, uint8_t intPin) {
+  memset(_reg, 0, sizeof(_reg));
+  _reg[R_IODIRA] = _reg[R_IODIRA + 1] = 0xff;
+  _ptr = 0;
+  _intPin = intPin;
+  _intf = _intcap = 0;
+  for (int i = 0; i < SIM_MCP_MAX; i++) {
+    if (!s_Chips[i] || (s_Chips[i] == this)) {
+      s_Chips[i] = this;
+      break;
+    }
+  }
+  simI2cAttach(address, this);
+  updateInt();
+}
+
+uint16_t SimMcp23017::gpio(void) const {
+  uint16_t iodir = reg16(R_IODIRA);
+  return ((_pins ^ reg16(R_IPOLA)) & iodir) | (reg16(R_OLATA) & ~iodir);
+}
+
+uint16_t SimMcp23017::outputs(void) const {
+  return reg16(R_OLATA) & ~reg16(R_IODIRA);
+}
+
+void SimMcp23017::setInput(uint8_t pin, int level) {
+  uint16_t bit = 1u << pin;
+  uint16_t old = gpio();
+  _pins = level ? (_pins | bit) : (_pins & ~bit);
+  if ((old ^ gpio()) & bit & reg16(R_IODIRA) & reg16(R_GPINTENA)) {
+    if (!_intf) {
+      _intcap = gpio();                    // port at the time of the interrupt
+    }
+    _intf |= bit;
+    updateInt();
+  }
+}
+
+uint8_t SimMcp23017::readReg(uint8_t reg) {
+  uint8_t hi = reg & 1;
+  switch (reg) {
+    case R_INTFA: case R_INTFB:
+      return (uint8_t)(_intf >> (8 * hi));
+    case R_INTCAPA: case R_INTCAPB:
+    case R_GPIOA: case R_GPIOB: {
+      uint8_t v = (uint8_t)(((reg <= R_INTCAPB) ? _intcap : gpio()) >> (8 * hi));
+      _intf &= hi ? 0x00ff : 0xff00;       // read clears the interrupt of the port
+      updateInt();
+      return v;
+    }
+    default:
+      return _reg[reg];
+  }
+}
+
+void SimMcp23017::i2cWrite(const uint8_t* data, size_t n) {
+  if (!n) {
+    return;
+  }
+  _ptr = data[0] % SIM_MCP_REGS;
+  for (size_t i = 1; i < n; i++) {
+    uint8_t reg = _ptr;
+    if ((reg == R_GPIOA) || (reg == R_GPIOB)) {
+      reg += R_OLATA - R_GPIOA;
+    }
+    if ((reg == R_IOCON) || (reg == R_IOCONB)) {
+      _reg[R_IOCON] = _reg[R_IOCONB] = data[i];
+    } else if ((reg < R_INTFA) || (reg >= R_OLATA)) {
+      _reg[reg] = data[i];                 // INTF, INTCAP are read only
+    }
+    _ptr = (_ptr + 1) % SIM_MCP_REGS;
+  }
+}
+
+size_t SimMcp23017::i2cRead(uint8_t* data, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    data[i] = readReg(_ptr);
+    _ptr = (_ptr + 1) % SIM_MCP_REGS;
+  }
+  return n;
+}
+
+// open drain: the line is low while any chip on it has an interrupt
+// (the pin is only driven when that changes)
+void SimMcp23017::updateInt(void) {
+  bool     low = false;
+  uint64_t bit = 1ULL << _intPin;
+  for (int i = 0; i < SIM_MCP_MAX; i++) {
+    low |= s_Chips[i] && (s_Chips[i]->_intPin == _intPin) && s_Chips[i]->interrupt();
+  }
+  if (low != !!(s_LowPins & bit)) {
+    s_LowPins = low ? (s_LowPins | bit) : (s_LowPins & ~bit);
+    simSetPin(_intPin, low ? LOW : HIGH);
+  }
+}
@@ -0,0 +1,52 @@
+/*!
+ * @file SimMcp23017.h
+ */
+/************************************************************
+ * Native Shim: MCP23017 Model (I2C device)
+ ************************************************************
+ * Register file of an MCP23017 with IOCON.BANK = 0:
+ * - sequential access (SEQOP = 0): the address pointer
+ *   increments after every byte, wraps after OLATB
+ * - GPIO reads the pins (inputs) and OLAT (outputs), a write
+ *   to GPIO writes OLAT
+ * - interrupt on change (INTCON = 0) of inputs with GPINTEN:
+ *   the first change captures INTCAP and sets INTF; reading
+ *   INTCAP or GPIO of a port clears INTF of that port
+ * - INT is open drain (IOCON.ODR, MIRROR): all chips attached
+ *   to the same pin drive it low together (simSetPin, fires
+ *   the ISR of the firmware)
+ * - pins without an external level float high (pull-ups)
+ ************************************************************/
+#ifndef _NATIVE_SIMMCP23017_H_
+#define _NATIVE_SIMMCP23017_H_
+
+#include <stdint.h>
+#include <NativeSim.h>
+
+#define SIM_MCP_REGS  0x16
+
+class SimMcp23017 : public SimI2cDevice {
+  public:
+    void     attach(uint8_t address, uint8_t intPin);   // power-on reset, on the bus
+    void     setInput(uint8_t pin, int level);           // external level of pin 0..15
+    uint16_t outputs(void) const;                        // levels of the output pins
+    bool     interrupt(void) const          { return _intf != 0; }
+
+    void     i2cWrite(const uint8_t* data, size_t n) override;
+    size_t   i2cRead(uint8_t* data, size_t n) override;
+
+  private:
+    uint8_t  _reg[SIM_MCP_REGS];
+    uint8_t  _ptr = 0;
+    uint8_t  _intPin = 0;
+    uint16_t _pins = 0xffff;               // external levels
+    uint16_t _intf = 0;
+    uint16_t _intcap = 0;
+
+    uint16_t reg16(uint8_t regA) const     { return _reg[regA] | (_reg[regA + 1] << 8); }
+    uint16_t gpio(void) const;
+    uint8_t  readReg(uint8_t reg);
+    void     updateInt(void);
+};
+
+#endif // _NATIVE_SIMMCP23017_H_
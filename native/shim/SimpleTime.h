@@ -0,0 +1,12 @@
+/*!
+ * @file SimpleTime.h
+ */
+/************************************************************
+ * Native Shim: SimpleTime (nothing of it is used in src/)
+ ************************************************************/
+#ifndef _NATIVE_SIMPLETIME_H_
+#define _NATIVE_SIMPLETIME_H_
+
+#include "Arduino.h"
+
+#endif // _NATIVE_SIMPLETIME_H_
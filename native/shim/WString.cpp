@@ -0,0 +1,233 @@
+/*!
+ * @file WString.cpp
+ */
+#include <Arduino.h>
+#include <ctype.h>
+
+/************************************************************
+ * Number Formatting
+ ************************************************************/
+static void formatUnsigned(char* buf, unsigned long long value, unsigned char base) {
+  char tmp[66];
+  int  pos = 0;
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    unsigned digit = value % base;
+    tmp[pos++] = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+    value /= base;
+  } while (value);
+  for (int i = 0; i < pos; i++) {
+    buf[i] = tmp[pos - 1 - i];
+  }
+  buf[pos] = '\0';
+}
+
+static void formatSigned(char* buf, long long value, unsigned char base) {
+  if ((value < 0) && (base == 10)) {
+    buf[0] = '-';
+    formatUnsigned(buf + 1, (unsigned long long)(-(value + 1)) + 1, base);
+  } else {
+    formatUnsigned(buf, (unsigned long long)value, base);
+  }
+}
+
+
+/************************************************************
+ * Constructors
+ ************************************************************/
+String::String(const char* cstr) : _buf(nullptr), _len(0), _cap(0) {
+  concat(cstr ? cstr : "");
+}
+
+String::String(const String& str) : _buf(nullptr), _len(0), _cap(0) {
+  concat(str.c_str(), str._len);
+}
+
+String::String(String&& rval) : _buf(rval._buf), _len(rval._len), _cap(rval._cap) {
+  rval._buf = nullptr;
+  rval._len = 0;
+  rval._cap = 0;
+}
+
+String::String(char c) : _buf(nullptr), _len(0), _cap(0) {
+  concat(c);
+}
+
+String::String(unsigned char value, unsigned char base) : String((unsigned long long)value, base) {}
+String::String(int value, unsigned char base) : String((long long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long long)value, base) {}
+String::String(long value, unsigned char base) : String((long long)value, base) {}
+String::String(unsigned long value, unsigned char base) : String((unsigned long long)value, base) {}
+
+String::String(long long value, unsigned char base) : _buf(nullptr), _len(0), _cap(0) {
+  char tmp[67];
+  formatSigned(tmp, value, base);
+  concat(tmp);
+}
+
+String::String(unsigned long long value, unsigned char base) : _buf(nullptr), _len(0), _cap(0) {
+  char tmp[66];
+  formatUnsigned(tmp, value, base);
+  concat(tmp);
+}
+
+String::String(double value, unsigned int decimalPlaces) : _buf(nullptr), _len(0), _cap(0) {
+  char tmp[48];
+  snprintf(tmp, sizeof(tmp), "%.*f", (int)decimalPlaces, value);
+  concat(tmp);
+}
+
+String::~String(void) {
+  free(_buf);
+}
+
+
+/************************************************************
+ * Assignment
+ ************************************************************/
+String& String::operator=(const String& rhs) {
+  if (this != &rhs) {
+    _len = 0;
+    concat(rhs.c_str(), rhs._len);
+  }
+  return *this;
+}
+
+String& String::operator=(String&& rval) {
+  if (this != &rval) {
+    free(_buf);
+    _buf = rval._buf;
+    _len = rval._len;
+    _cap = rval._cap;
+    rval._buf = nullptr;
+    rval._len = 0;
+    rval._cap = 0;
+  }
+  return *this;
+}
+
+String& String::operator=(const char* cstr) {
+  _len = 0;
+  concat(cstr ? cstr : "");
+  return *this;
+}
+
+String& String::operator=(char c) {
+  _len = 0;
+  concat(c);
+  return *this;
+}
+
+
+/************************************************************
+ * Concatenation
+ ************************************************************/
+bool String::reserve(unsigned int size) {
+  if (_buf && (_cap >= size)) {
+    return true;
+  }
+  char* newBuf = (char*)realloc(_buf, size + 1);
+  if (!newBuf) {
+    return false;
+  }
+  _buf = newBuf;
+  _cap = size;
+  return true;
+}
+
+bool String::concat(const char* cstr, unsigned int length) {
+  if (!reserve(_len + length)) {
+    return false;
+  }
+  memmove(_buf + _len, cstr, length);
+  _len += length;
+  _buf[_len] = '\0';
+  return true;
+}
+
+bool String::concat(const String& str)       { return concat(str.c_str(), str._len); }
+bool String::concat(const char* cstr)        { return concat(cstr, (unsigned int)strlen(cstr)); }
+bool String::concat(char c)                  { return concat(&c, 1); }
+bool String::concat(unsigned char num)       { return concat(String(num)); }
+bool String::concat(int num)                 { return concat(String(num)); }
+bool String::concat(unsigned int num)        { return concat(String(num)); }
+bool String::concat(long num)                { return concat(String(num)); }
+bool String::concat(unsigned long num)       { return concat(String(num)); }
+bool String::concat(long long num)           { return concat(String(num)); }
+bool String::concat(unsigned long long num)  { return concat(String(num)); }
+bool String::concat(double num)              { return concat(String(num)); }
+
+
+/************************************************************
+ * Access / Conversion
+ ************************************************************/
+char String::operator[](unsigned int index) const {
+  return (index < _len) ? _buf[index] : '\0';
+}
+
+bool String::equals(const char* cstr) const {
+  return strcmp(c_str(), cstr ? cstr : "") == 0;
+}
+
+void String::toLowerCase(void) {
+  for (unsigned int i = 0; i < _len; i++) {
+    _buf[i] = (char)tolower((unsigned char)_buf[i]);
+  }
+}
+
+void String::toUpperCase(void) {
+  for (unsigned int i = 0; i < _len; i++) {
+    _buf[i] = (char)toupper((unsigned char)_buf[i]);
+  }
+}
+
+void String::toCharArray(char* buf, unsigned int bufsize, unsigned int index) const {
+  if (!bufsize || !buf) {
+    return;
+  }
+  if (index >= _len) {
+    buf[0] = '\0';
+    return;
+  }
+  unsigned int n = _len - index;
+  if (n > bufsize - 1) {
+    n = bufsize - 1;
+  }
+  memcpy(buf, _buf + index, n);
+  buf[n] = '\0';
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  for (unsigned int i = from; i < _len; i++) {
+    if (_buf[i] == c) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  String out;
+  if (to > _len) {
+    to = _len;
+  }
+  if (from < to) {
+    out.concat(_buf + from, to - from);
+  }
+  return out;
+}
+
+long String::toInt(void) const {
+  return strtol(c_str(), nullptr, 10);
+}
+
+
+/************************************************************
+ * Operators
+ ************************************************************/
+String operator+(const String& lhs, const String& rhs) { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String& lhs, const char* rhs)   { String s(lhs); s.concat(rhs); return s; }
+String operator+(const char* lhs, const String& rhs)   { String s(lhs); s.concat(rhs); return s; }
+String operator+(const String& lhs, char rhs)          { String s(lhs); s.concat(rhs); return s; }
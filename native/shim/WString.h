@@ -0,0 +1,82 @@
+/*!
+ * @file WString.h
+ */
+/************************************************************
+ * Native Shim: Arduino String
+ ************************************************************
+ * Heap backed String with the subset of the Arduino API
+ * used in this project. Like the original every
+ * concatenation may (re)allocate.
+ ************************************************************/
+#ifndef _NATIVE_WSTRING_H_
+#define _NATIVE_WSTRING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+class String {
+  public:
+    String(const char* cstr = "");
+    String(const String& str);
+    String(String&& rval);
+    explicit String(char c);
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(long long value, unsigned char base = 10);
+    explicit String(unsigned long long value, unsigned char base = 10);
+    explicit String(double value, unsigned int decimalPlaces = 2);
+    ~String(void);
+
+    String& operator=(const String& rhs);
+    String& operator=(String&& rval);
+    String& operator=(const char* cstr);
+    String& operator=(char c);
+
+    bool concat(const String& str);
+    bool concat(const char* cstr);
+    bool concat(const char* cstr, unsigned int length);
+    bool concat(char c);
+    bool concat(unsigned char num);
+    bool concat(int num);
+    bool concat(unsigned int num);
+    bool concat(long num);
+    bool concat(unsigned long num);
+    bool concat(long long num);
+    bool concat(unsigned long long num);
+    bool concat(double num);
+
+    String& operator+=(const String& rhs)   { concat(rhs);  return *this; }
+    String& operator+=(const char* cstr)    { concat(cstr); return *this; }
+    String& operator+=(char c)              { concat(c);    return *this; }
+
+    unsigned int length(void) const         { return _len; }
+    const char*  c_str(void) const          { return _buf ? _buf : ""; }
+    char         operator[](unsigned int index) const;
+    bool         equals(const char* cstr) const;
+    bool         operator==(const char* cstr) const { return equals(cstr); }
+    bool         operator==(const String& rhs) const { return equals(rhs.c_str()); }
+
+    void         toLowerCase(void);
+    void         toUpperCase(void);
+    void         toCharArray(char* buf, unsigned int bufsize, unsigned int index = 0) const;
+    int          indexOf(char c, unsigned int from = 0) const;
+    String       substring(unsigned int from, unsigned int to) const;
+    long         toInt(void) const;
+
+  private:
+    bool         reserve(unsigned int size);
+
+    char*        _buf;
+    unsigned int _len;
+    unsigned int _cap;
+};
+
+String operator+(const String& lhs, const String& rhs);
+String operator+(const String& lhs, const char* rhs);
+String operator+(const char* lhs, const String& rhs);
+String operator+(const String& lhs, char rhs);
+
+#endif // _NATIVE_WSTRING_H_
@@ -0,0 +1,113 @@
+/*!
+ * @file WiFi.cpp
+ */
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include <NativeSim.h>
+
+WiFiClass     WiFi;
+MDNSResponder MDNS;
+
+static bool     s_ApAvailable = true;
+static uint32_t s_ScanTimeMs = 1000;
+static uint32_t s_AssocTimeMs = 150;
+static uint32_t s_DhcpTimeMs = 350;
+static uint8_t  s_Channel = 6;
+static uint32_t s_DnsTimeMs = 20;
+static uint8_t  s_Mac[6]   = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+static uint8_t  s_Bssid[6] = {0x02, 0x11, 0x22, 0x33, 0x44, 0x55};
+
+void simWifiSetAvailable(bool available)     { s_ApAvailable = available; }
+void simWifiSetScanTime(uint32_t ms)         { s_ScanTimeMs = ms; }
+void simWifiSetAssociationTime(uint32_t ms)  { s_AssocTimeMs = ms; }
+void simWifiSetDhcpTime(uint32_t ms)         { s_DhcpTimeMs = ms; }
+void simWifiSetChannel(uint8_t channel)      { s_Channel = channel; }
+void simWifiSetDnsTime(uint32_t ms)          { s_DnsTimeMs = ms; }
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase, int32_t channel,
+                             const uint8_t* bssid, bool connect) {
+  (void)ssid;
+  (void)passphrase;
+  // channel + BSSID given: no scan, a wrong one never connects
+  _direct = (channel > 0) && bssid;
+  _wrongAp = (channel > 0) && (channel != s_Channel);
+  _wrongAp = _wrongAp || (bssid && memcmp(bssid, s_Bssid, sizeof(s_Bssid)));
+  _begun = connect;
+  _beginAt = millis();
+  return status();
+}
+
+bool WiFiClass::config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2) {
+  (void)gateway;
+  (void)subnet;
+  (void)dns1;
+  (void)dns2;
+  _staticIP = localIP;                   // 0.0.0.0: DHCP
+  return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff, bool eraseap) {
+  (void)wifioff;
+  (void)eraseap;
+  _begun = false;
+  return true;
+}
+
+bool WiFiClass::reconnect(void) {
+  _begun = true;
+  _beginAt = millis();
+  return true;
+}
+
+wl_status_t WiFiClass::status(void) {
+  if (!_begun) {
+    return WL_DISCONNECTED;
+  }
+  if (!s_ApAvailable || _wrongAp) {
+    return WL_NO_SSID_AVAIL;
+  }
+  uint32_t connectTime = s_AssocTimeMs;
+  connectTime += _direct ? 0 : s_ScanTimeMs;
+  connectTime += ((uint32_t)_staticIP) ? 0 : s_DhcpTimeMs;
+  if (millis() - _beginAt < connectTime) {
+    return WL_DISCONNECTED;
+  }
+  return WL_CONNECTED;
+}
+
+IPAddress WiFiClass::localIP(void) {
+  if (status() != WL_CONNECTED) {
+    return IPAddress();
+  }
+  return ((uint32_t)_staticIP) ? _staticIP : IPAddress(192, 168, 1, 42);
+}
+
+IPAddress WiFiClass::gatewayIP(void)          { return IPAddress(192, 168, 1, 1); }
+IPAddress WiFiClass::subnetMask(void)         { return IPAddress(255, 255, 255, 0); }
+IPAddress WiFiClass::dnsIP(uint8_t dnsNo)     { (void)dnsNo; return IPAddress(192, 168, 1, 1); }
+uint8_t*  WiFiClass::BSSID(void)              { return s_Bssid; }
+int32_t   WiFiClass::channel(void)            { return s_Channel; }
+int8_t    WiFiClass::RSSI(void)               { return -61; }
+String    WiFiClass::SSID(void)               { return String("native"); }
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+  memcpy(mac, s_Mac, 6);
+  return mac;
+}
+
+String WiFiClass::macAddress(void) {
+  char buf[18];
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X",
+           s_Mac[0], s_Mac[1], s_Mac[2], s_Mac[3], s_Mac[4], s_Mac[5]);
+  return String(buf);
+}
+
+int WiFiClass::hostByName(const char* hostname, IPAddress& result) {
+  (void)hostname;
+  if (status() != WL_CONNECTED) {
+    return 0;
+  }
+  delay(s_DnsTimeMs);
+  result = IPAddress(127, 0, 0, 1);
+  return 1;
+}
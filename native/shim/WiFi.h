@@ -0,0 +1,75 @@
+/*!
+ * @file WiFi.h
+ */
+/************************************************************
+ * Native Shim: WiFi (station mode)
+ ************************************************************
+ * begin() starts a simulated association which completes
+ * after scan + association + DHCP time of millis(), when the
+ * access point is available (see NativeSim.h):
+ * - begin() with channel and BSSID skips the scan, a wrong
+ *   channel or BSSID never connects
+ * - config() with a static IP skips DHCP
+ ************************************************************/
+#ifndef _NATIVE_WIFI_H_
+#define _NATIVE_WIFI_H_
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+#include "WiFiUdp.h"
+
+typedef enum {
+  WL_IDLE_STATUS     = 0,
+  WL_NO_SSID_AVAIL   = 1,
+  WL_SCAN_COMPLETED  = 2,
+  WL_CONNECTED       = 3,
+  WL_CONNECT_FAILED  = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED    = 6
+} wl_status_t;
+
+typedef enum {
+  WIFI_OFF    = 0,
+  WIFI_STA    = 1,
+  WIFI_AP     = 2,
+  WIFI_AP_STA = 3
+} wifi_mode_t;
+
+class WiFiClass {
+  public:
+    bool        mode(wifi_mode_t m)           { _mode = m; return true; }
+    wl_status_t begin(const char* ssid, const char* passphrase = nullptr, int32_t channel = 0,
+                      const uint8_t* bssid = nullptr, bool connect = true);
+    bool        config(IPAddress localIP, IPAddress gateway, IPAddress subnet,
+                       IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+    bool        disconnect(bool wifioff = false, bool eraseap = false);
+    bool        reconnect(void);
+    bool        setAutoReconnect(bool autoReconnect) { _autoReconnect = autoReconnect; return true; }
+    wl_status_t status(void);
+
+    IPAddress   localIP(void);
+    IPAddress   gatewayIP(void);
+    IPAddress   subnetMask(void);
+    IPAddress   dnsIP(uint8_t dnsNo = 0);
+    uint8_t*    macAddress(uint8_t* mac);
+    String      macAddress(void);
+    uint8_t*    BSSID(void);
+    int32_t     channel(void);
+    int8_t      RSSI(void);
+    String      SSID(void);
+
+    int         hostByName(const char* hostname, IPAddress& result);
+
+  private:
+    wifi_mode_t _mode = WIFI_OFF;
+    bool        _begun = false;
+    bool        _autoReconnect = true;
+    uint32_t    _beginAt = 0;
+    bool        _direct = false;
+    bool        _wrongAp = false;
+    IPAddress   _staticIP;
+};
+
+extern WiFiClass WiFi;
+
+#endif // _NATIVE_WIFI_H_
@@ -0,0 +1,38 @@
+/*!
+ * @file WiFiClient.h
+ */
+/************************************************************
+ * Native Shim: WiFiClient
+ ************************************************************
+ * Transport placeholder: the native PubSubClient talks to
+ * the in-process LocalBroker directly, so this client only
+ * tracks its connection state and the socket handle of
+ * tcpConnectStart() (idleWait, mqttRxRecv).
+ ************************************************************/
+#ifndef _NATIVE_WIFICLIENT_H_
+#define _NATIVE_WIFICLIENT_H_
+
+#include "Arduino.h"
+#include "Client.h"
+
+class WiFiClient : public Client {
+  public:
+    WiFiClient(void)                                           {}
+    WiFiClient(int fd) : _connected(fd >= 0), _fd(fd)          {}   // socket connected elsewhere (tcpConnect.h)
+    int     connect(IPAddress ip, uint16_t port) override       { (void)ip; (void)port; _connected = true; return 1; }
+    int     connect(const char* host, uint16_t port) override  { (void)host; (void)port; _connected = true; return 1; }
+    size_t  write(uint8_t c) override                          { (void)c; return 1; }
+    size_t  write(const uint8_t* buf, size_t size) override    { (void)buf; return size; }
+    int     available(void) override                           { return 0; }
+    int     read(void) override                                { return -1; }
+    void    stop(void) override                                { _connected = false; }
+    uint8_t connected(void) override                           { return _connected; }
+    int     fd(void) const override                            { return _connected ? _fd : -1; }
+    using Print::write;
+
+  private:
+    bool    _connected = false;
+    int     _fd = -1;                                          // connect(): no socket (fleet nodes)
+};
+
+#endif // _NATIVE_WIFICLIENT_H_
@@ -0,0 +1,18 @@
+/*!
+ * @file WiFiUdp.h
+ */
+/************************************************************
+ * Native Shim: WiFiUDP (unused placeholder)
+ ************************************************************/
+#ifndef _NATIVE_WIFIUDP_H_
+#define _NATIVE_WIFIUDP_H_
+
+#include "Arduino.h"
+
+class WiFiUDP {
+  public:
+    uint8_t begin(uint16_t port)  { (void)port; return 1; }
+    void    stop(void)            {}
+};
+
+#endif // _NATIVE_WIFIUDP_H_
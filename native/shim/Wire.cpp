@@ -0,0 +1,109 @@
+/*!
+ * @file Wire.cpp
+ */
+/************************************************************
+ * Native Shim: I2C Bus (Wire.h)
+ ************************************************************/
+#include <Wire.h>
+#include <string.h>
+#include <NativeSim.h>
+
+#define SIM_I2C_ADDRESSES  128
+
+TwoWire Wire;
+
+static SimI2cDevice* s_Devices[SIM_I2C_ADDRESSES];
+static SimI2cStats   s_Stats;
+static uint64_t      s_BusPs;              // bus time not yet added to the virtual clock (ps)
+
+void simI2cAttach(uint8_t address, SimI2cDevice* device) {
+  if (address < SIM_I2C_ADDRESSES) {
+    s_Devices[address] = device;
+  }
+}
+
+SimI2cStats simI2cStats(void) {
+  return s_Stats;
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+  setClock(frequency ? frequency : 100000);
+  return true;
+}
+
+void TwoWire::setClock(uint32_t frequency) {
+  _frequency = frequency;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  _address = address;
+  _txLen = 0;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t n) {
+  n = (n < I2C_BUFFER_LENGTH - _txLen) ? n : I2C_BUFFER_LENGTH - _txLen;
+  memcpy(_tx + _txLen, data, n);
+  _txLen += n;
+  return n;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  SimI2cDevice* dev = (_address < SIM_I2C_ADDRESSES) ? s_Devices[_address] : nullptr;
+  _clocks += 1 + 9 * (1 + (dev ? _txLen : 0));  // (repeated) START, address, data
+  _open = true;
+  if (dev) {
+    dev->i2cWrite(_tx, _txLen);
+    s_Stats.bytes += 1 + _txLen;
+  } else {
+    s_Stats.nacks++;
+  }
+  if (sendStop || !dev) {
+    finish();
+  }
+  return dev ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t n, uint8_t sendStop) {
+  SimI2cDevice* dev = (address < SIM_I2C_ADDRESSES) ? s_Devices[address] : nullptr;
+  n = (n < I2C_BUFFER_LENGTH) ? n : I2C_BUFFER_LENGTH;
+  _rxLen = _rxPos = 0;
+  _clocks += 1 + 9 * (1 + (dev ? n : 0));
+  _open = true;
+  if (dev) {
+    _rxLen = dev->i2cRead(_rx, n);
+    s_Stats.bytes += 1 + _rxLen;
+  } else {
+    s_Stats.nacks++;
+  }
+  if (sendStop) {
+    finish();
+  }
+  return (uint8_t)_rxLen;
+}
+
+int TwoWire::available(void) {
+  return (int)(_rxLen - _rxPos);
+}
+
+int TwoWire::read(void) {
+  return (_rxPos < _rxLen) ? _rx[_rxPos++] : -1;
+}
+
+// STOP: the transaction is on the bus
+void TwoWire::finish(void) {
+  if (!_open) {
+    return;
+  }
+  uint64_t ps = (uint64_t)(_clocks + 1) * 1000000000000ULL / _frequency;
+  s_Stats.transactions++;
+  s_Stats.busNs += ps / 1000;
+  s_BusPs += ps;
+  simAdvanceMicros(s_BusPs / 1000000);
+  s_BusPs %= 1000000;
+  _clocks = 0;
+  _open = false;
+}
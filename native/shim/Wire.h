@@ -0,0 +1,49 @@
+/*!
+ * @file Wire.h
+ */
+/************************************************************
+ * Native Shim: I2C Bus (TwoWire, subset)
+ ************************************************************
+ * Devices are C++ models attached with simI2cAttach() (see
+ * NativeSim.h). Every transaction (START .. STOP, a repeated
+ * start does not end it) advances the virtual clock by its
+ * time on the bus at the clock given to begin(): 9 clocks per
+ * byte incl. the address, one per START / Sr / STOP.
+ ************************************************************/
+#ifndef _NATIVE_WIRE_H_
+#define _NATIVE_WIRE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define I2C_BUFFER_LENGTH  128
+
+class TwoWire {
+  public:
+    bool    begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    void    setClock(uint32_t frequency);
+    void    beginTransmission(uint8_t address);
+    size_t  write(uint8_t data);
+    size_t  write(const uint8_t* data, size_t n);
+    uint8_t endTransmission(bool sendStop = true);        // 0: ok, 2: address NACK
+    uint8_t requestFrom(uint8_t address, uint8_t n, uint8_t sendStop = 1);
+    int     available(void);
+    int     read(void);
+
+  private:
+    uint32_t _frequency = 100000;
+    uint8_t  _address = 0;
+    uint8_t  _tx[I2C_BUFFER_LENGTH];
+    size_t   _txLen = 0;
+    uint8_t  _rx[I2C_BUFFER_LENGTH];
+    size_t   _rxLen = 0;
+    size_t   _rxPos = 0;
+    bool     _open = false;                // repeated start pending
+    uint32_t _clocks = 0;                  // clocks of the open transaction
+
+    void    finish(void);
+};
+
+extern TwoWire Wire;
+
+#endif // _NATIVE_WIRE_H_
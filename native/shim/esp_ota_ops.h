@@ -0,0 +1,26 @@
+/*!
+ * @file esp_ota_ops.h
+ */
+/************************************************************
+ * Native Shim: ESP-IDF OTA API (subset)
+ ************************************************************
+ * Boots from "app0" (esp_partition.h); the next update
+ * partition is the other one. set_boot_partition() checks the
+ * image magic like the bootloader would, the partition that
+ * runs does not change until the process restarts.
+ * Implemented in esp_partition.cpp.
+ ************************************************************/
+#ifndef _NATIVE_ESP_OTA_OPS_H_
+#define _NATIVE_ESP_OTA_OPS_H_
+
+#include "esp_partition.h"
+
+#define ESP_ERR_OTA_VALIDATE_FAILED   0x1503
+#define ESP_IMAGE_HEADER_MAGIC        0xE9
+
+const esp_partition_t* esp_ota_get_running_partition(void);
+const esp_partition_t* esp_ota_get_boot_partition(void);
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+esp_err_t              esp_ota_set_boot_partition(const esp_partition_t* partition);
+
+#endif // _NATIVE_ESP_OTA_OPS_H_
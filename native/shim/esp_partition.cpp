@@ -0,0 +1,141 @@
+/*!
+ * @file esp_partition.cpp
+ */
+/************************************************************
+ * Native Shim: ESP-IDF Partition API (esp_partition.h)
+ ************************************************************/
+#include <esp_partition.h>
+#include <esp_ota_ops.h>
+#include <string.h>
+#include <NativeSim.h>
+
+#define SIM_FLASH_SECTOR     4096
+#define SIM_FLASH_ERASE_MS   45                // typical 4 KB sector erase of an ESP32 flash
+#define SIM_APP_SIZE         0x140000
+#define SIM_OUTBOX_SIZE      0x10000
+#define SIM_SKETCH_SIZE      790608            // default sketch in app0
+
+static const esp_partition_t s_Partitions[] = {
+  {ESP_PARTITION_TYPE_APP,  ESP_PARTITION_SUBTYPE_APP_OTA_0,  0x010000, SIM_APP_SIZE,    "app0",   false},
+  {ESP_PARTITION_TYPE_APP,  ESP_PARTITION_SUBTYPE_APP_OTA_1,  0x150000, SIM_APP_SIZE,    "app1",   false},
+  {ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x99,    0x3f0000, SIM_OUTBOX_SIZE, "outbox", false},
+};
+static const esp_partition_t* const s_Running = &s_Partitions[0];
+static const esp_partition_t*       s_Boot = &s_Partitions[0];
+static uint32_t s_SketchSize = SIM_SKETCH_SIZE;
+static bool     s_Erased;                  // flash starts erased (0xff)
+static uint8_t s_App0[SIM_APP_SIZE];
+static uint8_t s_App1[SIM_APP_SIZE];
+static uint8_t s_Outbox[SIM_OUTBOX_SIZE];
+static uint8_t* const s_Flash[] = {s_App0, s_App1, s_Outbox};
+
+// the default sketch in the running partition
+static void flashInit(void) {
+  memset(s_App0, 0xff, sizeof(s_App0));
+  memset(s_App1, 0xff, sizeof(s_App1));
+  memset(s_Outbox, 0xff, sizeof(s_Outbox));
+  for (uint32_t i = 0; i < s_SketchSize; i++) {
+    s_App0[i] = (uint8_t)(i * 31);
+  }
+  s_App0[0] = ESP_IMAGE_HEADER_MAGIC;
+  s_Erased = true;
+}
+
+// flash of a partition, nullptr if out of range
+static uint8_t* flashAt(const esp_partition_t* part, size_t offset, size_t size) {
+  size_t i = (size_t)(part - s_Partitions);
+  if (!s_Erased) {
+    flashInit();
+  }
+  if ((part < s_Partitions) || (i >= sizeof(s_Partitions) / sizeof(s_Partitions[0])) ||
+      (offset > part->size) || (size > part->size - offset)) {
+    return nullptr;
+  }
+  return s_Flash[i] + offset;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+  for (const esp_partition_t& part : s_Partitions) {
+    if ((type == part.type) && ((subtype == ESP_PARTITION_SUBTYPE_ANY) || (subtype == part.subtype)) &&
+        (!label || !strcmp(label, part.label))) {
+      return &part;
+    }
+  }
+  return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* part, size_t src_offset, void* dst, size_t size) {
+  uint8_t* flash = flashAt(part, src_offset, size);
+  if (!flash) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(dst, flash, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* part, size_t dst_offset, const void* src, size_t size) {
+  uint8_t* flash = flashAt(part, dst_offset, size);
+  if (!flash) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  for (size_t i = 0; i < size; i++) {
+    flash[i] &= ((const uint8_t*)src)[i];
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t offset, size_t size) {
+  uint8_t* flash = flashAt(part, offset, size);
+  if (!flash || (offset % SIM_FLASH_SECTOR) || (size % SIM_FLASH_SECTOR)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  memset(flash, 0xff, size);
+  simAdvanceMillis(SIM_FLASH_ERASE_MS * (uint32_t)(size / SIM_FLASH_SECTOR));
+  return ESP_OK;
+}
+
+
+/************************************************************
+ * OTA (esp_ota_ops.h)
+ ************************************************************/
+const esp_partition_t* esp_ota_get_running_partition(void) {
+  return s_Running;
+}
+
+const esp_partition_t* esp_ota_get_boot_partition(void) {
+  return s_Boot;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+  return ((start_from ? start_from : s_Running) == &s_Partitions[0]) ? &s_Partitions[1] : &s_Partitions[0];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+  uint8_t* flash = flashAt(partition, 0, 1);
+  if (!flash || (partition->type != ESP_PARTITION_TYPE_APP)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (*flash != ESP_IMAGE_HEADER_MAGIC) {
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+  }
+  s_Boot = partition;
+  return ESP_OK;
+}
+
+
+/************************************************************
+ * Sketch (NativeSim.h)
+ ************************************************************/
+void simLoadSketch(const uint8_t* image, size_t size) {
+  uint8_t* flash = flashAt(s_Running, 0, size);
+  if (flash) {
+    memset(s_App0, 0xff, sizeof(s_App0));
+    memcpy(flash, image, size);
+    s_SketchSize = (uint32_t)size;
+  }
+}
+
+uint32_t simSketchSize(void) {
+  return s_SketchSize;
+}
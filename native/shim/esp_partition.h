@@ -0,0 +1,51 @@
+/*!
+ * @file esp_partition.h
+ */
+/************************************************************
+ * Native Shim: ESP-IDF Partition API (subset)
+ ************************************************************
+ * The default 4 MB layout in RAM: app partitions "app0"
+ * (ota_0, running) and "app1" (ota_1), plus the data
+ * partition "outbox" (64 KB). NOR flash semantics: write only
+ * clears bits, erase sets a sector to 0xff and costs
+ * SIM_FLASH_ERASE_MS of virtual time.
+ ************************************************************/
+#ifndef _NATIVE_ESP_PARTITION_H_
+#define _NATIVE_ESP_PARTITION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_FAIL               -1
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_SIZE    0x104
+
+typedef enum {
+  ESP_PARTITION_TYPE_APP  = 0x00,
+  ESP_PARTITION_TYPE_DATA = 0x01
+} esp_partition_type_t;
+
+typedef enum {
+  ESP_PARTITION_SUBTYPE_APP_OTA_0 = 0x10,
+  ESP_PARTITION_SUBTYPE_APP_OTA_1 = 0x11,
+  ESP_PARTITION_SUBTYPE_ANY       = 0xff
+} esp_partition_subtype_t;
+
+typedef struct {
+  esp_partition_type_t    type;
+  esp_partition_subtype_t subtype;
+  uint32_t                address;
+  uint32_t                size;
+  char                    label[17];
+  bool                    encrypted;
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label);
+esp_err_t esp_partition_read(const esp_partition_t* part, size_t src_offset, void* dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t* part, size_t dst_offset, const void* src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t offset, size_t size);
+
+#endif // _NATIVE_ESP_PARTITION_H_
@@ -0,0 +1,94 @@
+/*!
+ * @file idleWait.cpp
+ */
+/************************************************************
+ * Native Shim: Tickless Idle (src/idleWait.h)
+ ************************************************************
+ * One condition variable for all doorbells:
+ * - idleWake() sets the event bits and notifies
+ * - simSocketData() (LocalBroker) counts a message queued
+ *   for a client; a wait with a read socket takes one, like
+ *   one PUBLISH that makes the socket readable
+ * - simSocketWait() (native/shim/mqttRx.cpp) sleeps until
+ *   the next simSocketData() (generation count)
+ * - a pending TCP connect (writeSock) is not signalled, the
+ *   wait is cut to SIM_IDLE_TCP_POLL_US instead
+ * - the timeout runs on the real clock (the virtual clock
+ *   follows it)
+ * - light sleep is not supported
+ ************************************************************/
+#include <idleWait.h>
+#include <NativeSim.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#define SIM_IDLE_TCP_POLL_US  1000
+
+static std::mutex              s_Lock;
+static std::condition_variable s_Bell;
+static uint32_t                s_Pending;
+static uint32_t                s_SocketData;
+static uint32_t                s_SocketGen;
+
+void simSocketData(void) {
+  std::lock_guard<std::mutex> guard(s_Lock);
+  s_SocketData++;
+  s_SocketGen++;
+  s_Bell.notify_all();
+}
+
+uint32_t simSocketGen(void) {
+  std::lock_guard<std::mutex> guard(s_Lock);
+  return s_SocketGen;
+}
+
+void simSocketWait(uint32_t gen, uint32_t us) {
+  std::unique_lock<std::mutex> lock(s_Lock);
+  s_Bell.wait_for(lock, std::chrono::microseconds(us), [&]() { return s_SocketGen != gen; });
+}
+
+// forget what arrived while nobody waited
+bool idleBegin(void) {
+  std::lock_guard<std::mutex> guard(s_Lock);
+  s_Pending = 0;
+  s_SocketData = 0;
+  return true;
+}
+
+bool idleLightSleep(void) {
+  return false;
+}
+
+void idleWake(uint32_t events) {
+  std::lock_guard<std::mutex> guard(s_Lock);
+  s_Pending |= events;
+  s_Bell.notify_all();
+}
+
+void idleWakeFromISR(uint32_t events) {
+  idleWake(events);
+}
+
+uint8_t idleWait(uint32_t events, int readSock, int writeSock, uint32_t us) {
+  std::unique_lock<std::mutex> lock(s_Lock);
+  if ((writeSock >= 0) && (us > SIM_IDLE_TCP_POLL_US)) {
+    us = SIM_IDLE_TCP_POLL_US;
+  }
+  bool ready = s_Bell.wait_for(lock, std::chrono::microseconds(us), [&]() {
+    return (s_Pending & events) || ((readSock >= 0) && s_SocketData);
+  });
+  uint32_t got = s_Pending & events;
+  s_Pending &= ~events;
+  if (got & IDLE_EV_IRQ) {
+    return IDLE_WAKE_IRQ;
+  }
+  if (got) {
+    return IDLE_WAKE_QUEUE;
+  }
+  if (ready) {
+    s_SocketData--;
+    return IDLE_WAKE_SOCKET;
+  }
+  return IDLE_WAKE_TIMER;
+}
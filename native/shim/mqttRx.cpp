@@ -0,0 +1,218 @@
+/*!
+ * @file mqttRx.cpp
+ */
+/************************************************************
+ * Native Shim: MQTT Receive Socket (src/mqttRx.h)
+ ************************************************************
+ * The messages the LocalBroker queued for the session of a
+ * socket (simSocketAttach, PubSubClient::connect) come out
+ * as MQTT bytes:
+ * - one PUBLISH packet per message, QoS 0
+ * - at most SIM_RX_SEGMENT bytes per call, so larger packets
+ *   arrive in pieces as over TCP
+ * - mqttRxSend: PINGREQ is answered with PINGRESP, PUBLISH
+ *   (QoS 1, mqttQos.h) goes to the broker and is answered
+ *   with PUBACK, other packets are dropped
+ * - the link: a packet of mqttRxSend reaches the broker half
+ *   of simSetLinkDelay() us later, its answer is readable
+ *   after the other half (real clock); mqttRxRecv() moves
+ *   them along
+ * - the session gone or disconnected: closed (-1), what was
+ *   still on the link is lost
+ ************************************************************/
+#include <mqttRx.h>
+#include <NativeSim.h>
+#include <LocalBroker.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#define SIM_RX_SOCKETS   4                 // as native/shim/tcpConnect.cpp
+#define SIM_RX_SEGMENT   1460              // TCP MSS
+
+struct SimRxPacket {
+  uint64_t    at;                          // realNanos() at the other end of the link
+  std::string bytes;
+};
+
+struct SimRxSocket {
+  std::weak_ptr<BrokerSession> session;
+  std::string                  pending;    // bytes not read yet
+  std::deque<SimRxPacket>      sent;       // mqttRxSend -> broker
+  std::deque<SimRxPacket>      answers;    // broker -> pending
+};
+
+static std::mutex  s_Lock;
+static SimRxSocket s_Sockets[SIM_RX_SOCKETS];
+static uint32_t    s_LinkDelayUs;
+
+static uint64_t realNanos(void) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void simSetLinkDelay(uint32_t us) {
+  std::lock_guard<std::mutex> guard(s_Lock);
+  s_LinkDelayUs = us;
+}
+
+void simSocketAttach(int sock, const std::shared_ptr<BrokerSession>& session) {
+  if ((sock < 0) || (sock >= SIM_RX_SOCKETS)) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(s_Lock);
+  s_Sockets[sock].session = session;
+  s_Sockets[sock].pending.clear();
+  s_Sockets[sock].sent.clear();
+  s_Sockets[sock].answers.clear();
+}
+
+static void encodePublish(std::string& out, const BrokerMessage& msg) {
+  size_t tl = msg.topic.size();
+  size_t remaining = 2 + tl + msg.payload.size();
+  out += (char)(0x30 | (msg.retained ? 1 : 0));
+  do {
+    uint8_t digit = remaining & 0x7f;
+    remaining >>= 7;
+    out += (char)(digit | (remaining ? 0x80 : 0));
+  } while (remaining);
+  out += (char)(tl >> 8);
+  out += (char)(tl & 0xff);
+  out += msg.topic;
+  out += msg.payload;
+}
+
+// a PUBLISH for the broker, packet id 0 if QoS 0
+static bool decodePublish(const std::string& packet, std::string& topic, std::string& payload, uint16_t& id) {
+  const uint8_t* buf = (const uint8_t*)packet.data();
+  size_t         n = packet.size();
+  size_t         at = 1, remaining = 0;
+  for (uint8_t shift = 0; (at < n) && (shift < 28); shift += 7) {
+    remaining |= (size_t)(buf[at] & 0x7f) << shift;
+    if (!(buf[at++] & 0x80)) {
+      break;
+    }
+  }
+  if ((at + remaining != n) || (remaining < 2)) {
+    return false;
+  }
+  size_t tl = ((size_t)buf[at] << 8) | buf[at + 1];
+  bool   qos = (buf[0] & 0x06) != 0;
+  at += 2;
+  if (at + tl + (qos ? 2 : 0) > n) {
+    return false;
+  }
+  topic.assign((const char*)buf + at, tl);
+  at += tl;
+  id = qos ? (uint16_t)((buf[at] << 8) | buf[at + 1]) : 0;
+  at += qos ? 2 : 0;
+  payload.assign((const char*)buf + at, n - at);
+  return true;
+}
+
+// the broker gets a packet of mqttRxSend, returns the answer (may be empty)
+static std::string brokerReceive(const std::string& packet) {
+  std::string topic, payload;
+  uint16_t    id = 0;
+  switch ((uint8_t)packet[0] >> 4) {
+    case MQTT_PKT_PINGREQ:
+      return std::string("\xd0\x00", 2);
+    case MQTT_PKT_PUBLISH:
+      if (!decodePublish(packet, topic, payload, id)) {
+        return std::string();
+      }
+      LocalBroker::instance().publish(topic.c_str(), (const uint8_t*)payload.data(), payload.size(), packet[0] & 0x01);
+      if (id) {
+        return std::string{(char)(MQTT_PKT_PUBACK << 4), 2, (char)(id >> 8), (char)(id & 0xff)};
+      }
+      return std::string();
+    default:
+      return std::string();
+  }
+}
+
+int mqttRxRecv(int sock, uint8_t* buf, size_t n, uint32_t waitMs) {
+  if ((sock < 0) || (sock >= SIM_RX_SOCKETS)) {
+    return -1;
+  }
+  SimHeapPause pause;
+  LocalBroker& broker = LocalBroker::instance();
+  SimRxSocket& s = s_Sockets[sock];
+  uint32_t     gen = simSocketGen();
+  for (int round = 0; round < 2; round++) {
+    std::deque<SimRxPacket> arrived;
+    uint64_t                now = realNanos();
+    uint64_t                half;
+    uint64_t                waitNs = (uint64_t)waitMs * 1000000;
+    {
+      std::lock_guard<std::mutex> guard(s_Lock);
+      half = (uint64_t)s_LinkDelayUs * 500;
+      while (!s.sent.empty() && (s.sent.front().at <= now)) {
+        arrived.push_back(std::move(s.sent.front()));
+        s.sent.pop_front();
+      }
+    }
+    // outside the lock: the broker runs its taps
+    for (SimRxPacket& p : arrived) {
+      p.bytes = brokerReceive(p.bytes);
+    }
+    {
+      std::lock_guard<std::mutex>    guard(s_Lock);
+      std::shared_ptr<BrokerSession> session = s.session.lock();
+      BrokerMessage                  msg;
+      if (!session || !session->connected) {
+        s.sent.clear();
+        s.answers.clear();
+        return -1;
+      }
+      for (SimRxPacket& p : arrived) {
+        if (!p.bytes.empty()) {
+          s.answers.push_back({p.at + half, std::move(p.bytes)});
+        }
+      }
+      while (!s.answers.empty() && (s.answers.front().at <= now)) {
+        s.pending += s.answers.front().bytes;
+        s.answers.pop_front();
+      }
+      // wake up when the next packet is through the link
+      for (const std::deque<SimRxPacket>* link : {&s.sent, &s.answers}) {
+        if (!link->empty() && (link->front().at < now + waitNs)) {
+          waitNs = (link->front().at > now) ? link->front().at - now : 0;
+        }
+      }
+      while ((s.pending.size() < SIM_RX_SEGMENT) && broker.fetch(session, msg)) {
+        encodePublish(s.pending, msg);
+      }
+      size_t k = (s.pending.size() < n) ? s.pending.size() : n;
+      k = (k < SIM_RX_SEGMENT) ? k : SIM_RX_SEGMENT;
+      if (k) {
+        memcpy(buf, s.pending.data(), k);
+        s.pending.erase(0, k);
+        return (int)k;
+      }
+    }
+    if (!round) {
+      simSocketWait(gen, (uint32_t)((waitNs + 999) / 1000));
+    }
+  }
+  return 0;
+}
+
+boolean mqttRxSend(int sock, const uint8_t* buf, size_t n) {
+  if ((sock < 0) || (sock >= SIM_RX_SOCKETS) || !n) {
+    return false;
+  }
+  {
+    SimHeapPause                   pause;
+    std::lock_guard<std::mutex>    guard(s_Lock);
+    SimRxSocket&                   s = s_Sockets[sock];
+    std::shared_ptr<BrokerSession> session = s.session.lock();
+    if (!session || !session->connected) {
+      return false;
+    }
+    s.sent.push_back({realNanos() + (uint64_t)s_LinkDelayUs * 500, std::string((const char*)buf, n)});
+  }
+  simSocketData();
+  return true;
+}
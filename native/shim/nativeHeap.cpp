@@ -0,0 +1,66 @@
+/*!
+ * @file nativeHeap.cpp
+ */
+/************************************************************
+ * Native Shim: Heap Counter
+ ************************************************************
+ * Replaces malloc & co. of glibc (symbol interposition) to
+ * count heap traffic. operator new/delete end up here too.
+ ************************************************************/
+#include <NativeSim.h>
+#include <stddef.h>
+
+extern "C" {
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t n, size_t size);
+  void* __libc_realloc(void* ptr, size_t size);
+  void  __libc_free(void* ptr);
+}
+
+static uint64_t     s_Allocs;
+static uint64_t     s_Frees;
+static __thread int s_Paused;
+
+static inline void countAlloc(void) {
+  if (!s_Paused) {
+    __atomic_fetch_add(&s_Allocs, 1, __ATOMIC_RELAXED);
+  }
+}
+
+static inline void countFree(void) {
+  if (!s_Paused) {
+    __atomic_fetch_add(&s_Frees, 1, __ATOMIC_RELAXED);
+  }
+}
+
+extern "C" void* malloc(size_t size) {
+  countAlloc();
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+  countAlloc();
+  return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+  if (ptr && !size) {
+    countFree();
+  } else {
+    countAlloc();
+  }
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr) {
+  if (ptr) {
+    countFree();
+  }
+  __libc_free(ptr);
+}
+
+uint64_t simHeapAllocs(void) { return __atomic_load_n(&s_Allocs, __ATOMIC_RELAXED); }
+uint64_t simHeapFrees(void)  { return __atomic_load_n(&s_Frees, __ATOMIC_RELAXED); }
+
+SimHeapPause::SimHeapPause(void)  { s_Paused++; }
+SimHeapPause::~SimHeapPause(void) { s_Paused--; }
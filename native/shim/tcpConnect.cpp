@@ -0,0 +1,63 @@
+/*!
+ * @file tcpConnect.cpp
+ */
+/************************************************************
+ * Native Shim: Non-blocking TCP Connect (src/tcpConnect.h)
+ ************************************************************
+ * A connect attempt is pending for one round trip when the
+ * LocalBroker is up at tcpConnectStart(), else for its TCP
+ * timeout (setConnectTimeMs), then fails. The "socket" is
+ * only a handle for WiFiClient(sock).
+ ************************************************************/
+#include <tcpConnect.h>
+#include <WiFi.h>
+#include <LocalBroker.h>
+
+#define SIM_TCP_SOCKETS   4
+#define SIM_TCP_RTT_MS    2
+
+static bool     s_Used[SIM_TCP_SOCKETS];
+static uint32_t s_StartedAt[SIM_TCP_SOCKETS];
+static bool     s_Reachable[SIM_TCP_SOCKETS];
+
+int tcpConnectStart(IPAddress ip, uint16_t port) {
+  (void)ip;
+  (void)port;
+  if (WiFi.status() != WL_CONNECTED) {
+    return TCP_FAILED;
+  }
+  for (int sock = 0; sock < SIM_TCP_SOCKETS; sock++) {
+    if (!s_Used[sock]) {
+      s_Used[sock] = true;
+      s_StartedAt[sock] = millis();
+      s_Reachable[sock] = LocalBroker::instance().isUp();
+      return sock;
+    }
+  }
+  return TCP_FAILED;
+}
+
+int tcpConnectPoll(int sock) {
+  if ((sock < 0) || (sock >= SIM_TCP_SOCKETS) || !s_Used[sock]) {
+    return TCP_FAILED;
+  }
+  LocalBroker& broker = LocalBroker::instance();
+  uint32_t     elapsed = millis() - s_StartedAt[sock];
+  if (WiFi.status() != WL_CONNECTED) {
+    return TCP_FAILED;
+  }
+  if (s_Reachable[sock] && broker.isUp()) {
+    if (elapsed < SIM_TCP_RTT_MS) {
+      return TCP_PENDING;
+    }
+    s_Used[sock] = false;                // owned by WiFiClient now
+    return TCP_CONNECTED;
+  }
+  return (!s_Reachable[sock] && (elapsed < broker.connectTimeMs())) ? TCP_PENDING : TCP_FAILED;
+}
+
+void tcpConnectAbort(int sock) {
+  if ((sock >= 0) && (sock < SIM_TCP_SOCKETS)) {
+    s_Used[sock] = false;
+  }
+}
@@ -0,0 +1,286 @@
+/*!
+ * @file binLog.h
+ */
+/************************************************************
+ * Binary Log (deferred formatting)
+ ************************************************************
+ * A log call stores the format string id and the raw
+ * arguments, the text is made on the host:
+ *
+ *   LOGE(NET, "MQTT CONNECT to %s FAILED [%lu]", name, n);
+ *     -> entry in a lock-free ring (no printf, no String)
+ *   logDrain() (network side, every pass)
+ *     -> frames to the UART, only as much as the TX FIFO
+ *        takes (never blocks)
+ *     -> appended to the batch, jobLogFlush() publishes it
+ *        on TOPIC_LOG once per T_LOG_FLUSH (offline: kept,
+ *        not in the outbox)
+ *   tools/logdecode.py firmware.elf < capture
+ *     -> text
+ *
+ * - levels per category at compile time (LOG_LEVEL_<CAT>,
+ *   debugOptions.h): a call above the level is not compiled
+ * - format id: offset of the format string from g_LogAnchor,
+ *   both are in the read-only data of the image, so the
+ *   decoder finds the text in the ELF (also with PIE)
+ * - entry: us (micros), format id, category << 4 | level,
+ *   arguments with a type tag each: int32, int64, double or
+ *   string (copied, max. LOG_MAX_STR bytes); the decoder
+ *   formats them with the printf format of the string
+ * - one SPSC ring per producer task: loop() and, with
+ *   DUAL_CORE, the network task (logProducer()); the
+ *   consumer takes the older entry of both rings
+ * - full ring: the entry is dropped and counted, the count
+ *   goes out as an entry of its own once there is room again
+ * - frame: LOG_SYNC0 LOG_SYNC1 len entry xor, so the decoder
+ *   resyncs after noise and passes other text through
+ ************************************************************/
+#ifndef _BINLOG_H_
+#define _BINLOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+#include "debugOptions.h"
+#include "spscRing.h"
+
+#ifndef LOG_RING_SIZE
+  #define LOG_RING_SIZE     4096           // bytes per producer task
+#endif
+#define LOG_PRODUCERS       2              // loop(), network task
+#define LOG_MAX_ENTRY       200            // bytes of one entry (arguments are cut)
+#define LOG_MAX_STR         64             // bytes of one string argument
+#define LOG_HEADER          9              // us, format id, category / level
+#define LOG_SYNC0           0xA5
+#define LOG_SYNC1           0x5A
+#define LOG_FRAME_EXTRA     4              // sync, len, xor
+
+// argument tags
+#define LOG_ARG_I32         1
+#define LOG_ARG_I64         2
+#define LOG_ARG_F64         3
+#define LOG_ARG_STR         4
+
+// categories (4 bit)
+#define LOG_CAT_MAIN        0
+#define LOG_CAT_SETUP       1
+#define LOG_CAT_NET         2              // WiFi / MQTT connection
+#define LOG_CAT_MQTT        3              // messages, commands
+#define LOG_CAT_IRQ         4              // INT_PIN, MCP 23017, rollers
+#define LOG_CAT_PARSER      5
+
+extern const char g_LogAnchor[];           // format ids are relative to this
+
+#define LOG_FMT_ID(fmt)     ((int32_t)((uintptr_t)(fmt) - (uintptr_t)g_LogAnchor))
+
+#define LOG(level, cat, fmt, ...)                                              \
+  do {                                                                         \
+    if ((level) <= LOG_LEVEL_##cat) {                                          \
+      g_Log.write(logProducer(), (LOG_CAT_##cat << 4) | (level), micros(),     \
+                  LOG_FMT_ID(fmt), ##__VA_ARGS__);                             \
+    }                                                                          \
+  } while (0)
+
+#define LOGE(cat, fmt, ...) LOG(LOG_ERROR, cat, fmt, ##__VA_ARGS__)
+#define LOGI(cat, fmt, ...) LOG(LOG_INFO,  cat, fmt, ##__VA_ARGS__)
+#define LOGD(cat, fmt, ...) LOG(LOG_DEBUG, cat, fmt, ##__VA_ARGS__)
+
+// string argument with a length (need not be terminated)
+struct LogStr {
+  const char* s;
+  size_t      len;
+};
+
+struct LogStats {
+  uint32_t    entries;                     // written
+  uint32_t    dropped;                     // ring full
+  uint32_t    bytes;                       // entry bytes written
+};
+
+/************************************************************
+ * Argument encoders: tag + data, cut at end
+ ************************************************************/
+inline uint8_t* logPutStr(uint8_t* p, const uint8_t* end, const char* s, size_t n) {
+  if (end - p < 2) {
+    return p;
+  }
+  n = (n > LOG_MAX_STR) ? LOG_MAX_STR : n;
+  n = ((size_t)(end - p - 2) < n) ? (size_t)(end - p - 2) : n;
+  *p++ = LOG_ARG_STR;
+  *p++ = (uint8_t)n;
+  memcpy(p, s, n);
+  return p + n;
+}
+
+// terminated string: copied while its length is taken
+inline uint8_t* logPut(uint8_t* p, const uint8_t* end, const char* s) {
+  size_t n = 0, max = (size_t)(end - p);
+  if (!s) {
+    return logPutStr(p, end, "(null)", 6);
+  }
+  if (max < 2) {
+    return p;
+  }
+  max = (max - 2 < LOG_MAX_STR) ? max - 2 : LOG_MAX_STR;
+  while ((n < max) && s[n]) {
+    p[2 + n] = (uint8_t)s[n];
+    n++;
+  }
+  p[0] = LOG_ARG_STR;
+  p[1] = (uint8_t)n;
+  return p + 2 + n;
+}
+
+inline uint8_t* logPut(uint8_t* p, const uint8_t* end, char* s) {
+  return logPut(p, end, (const char*)s);
+}
+
+inline uint8_t* logPut(uint8_t* p, const uint8_t* end, LogStr s) {
+  return logPutStr(p, end, s.s, s.len);
+}
+
+template <typename T>
+inline uint8_t* logPut(uint8_t* p, const uint8_t* end, T v) {
+  static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                "log argument: integer, double, string or pointer");
+  uint8_t tag;
+  uint8_t data[8];
+  size_t  n;
+  if constexpr (std::is_floating_point<T>::value) {
+    double d = v;
+    tag = LOG_ARG_F64;
+    n = sizeof(d);
+    memcpy(data, &d, n);
+  } else if constexpr (std::is_pointer<T>::value) {
+    uint64_t u = (uintptr_t)v;
+    tag = LOG_ARG_I64;
+    n = sizeof(u);
+    memcpy(data, &u, n);
+  } else if constexpr (sizeof(T) > 4) {
+    int64_t i = (int64_t)v;
+    tag = LOG_ARG_I64;
+    n = sizeof(i);
+    memcpy(data, &i, n);
+  } else {
+    int32_t i = (int32_t)v;
+    tag = LOG_ARG_I32;
+    n = sizeof(i);
+    memcpy(data, &i, n);
+  }
+  if ((size_t)(end - p) < 1 + n) {
+    return p;
+  }
+  *p = tag;
+  memcpy(p + 1, data, n);
+  return p + 1 + n;
+}
+
+template <size_t SIZE>
+class BinLog {
+  public:
+    /************************************************************
+     * Producer: write one entry
+     * @param[in] producer  ring (logProducer())
+     * @param[in] catLevel  category << 4 | level
+     * @param[in] us        micros()
+     * @param[in] fmt       format id (LOG_FMT_ID)
+     * @param[in] args      arguments of the format
+     ************************************************************/
+    template <typename... A>
+    void write(size_t producer, uint8_t catLevel, uint32_t us, int32_t fmt, A... args) {
+      uint8_t        entry[LOG_MAX_ENTRY];
+      const uint8_t* end = entry + sizeof(entry);
+      uint8_t*       p = header(entry, catLevel, us, fmt);
+      ((p = logPut(p, end, args)), ...);
+      (void)end;
+      if (_dropped[producer] != _reported[producer]) {
+        uint8_t  lost[LOG_HEADER + 5];
+        uint8_t* q = header(lost, (LOG_CAT_MAIN << 4) | LOG_ERROR, us, LOG_FMT_ID(LOG_DROPPED_FMT));
+        q = logPut(q, lost + sizeof(lost), _dropped[producer] - _reported[producer]);
+        if (!_ring[producer].push(lost, (size_t)(q - lost))) {
+          _dropped[producer]++;
+          return;
+        }
+        _reported[producer] = _dropped[producer];
+      }
+      if (!_ring[producer].push(entry, (size_t)(p - entry))) {
+        _dropped[producer]++;
+        return;
+      }
+      _entries[producer]++;
+      _bytes[producer] += (uint32_t)(p - entry);
+    }
+
+    /************************************************************
+     * Consumer: take the oldest entry of all rings
+     * @param[out] entry LOG_MAX_ENTRY bytes
+     * @return length, 0 if all rings are empty
+     ************************************************************/
+    size_t pop(uint8_t* entry) {
+      size_t   n = 0, best = LOG_PRODUCERS;
+      uint8_t* p = nullptr;
+      uint32_t bestUs = 0, us;
+      for (size_t i = 0; i < LOG_PRODUCERS; i++) {
+        size_t   len;
+        uint8_t* q = _ring[i].peek(len);
+        if (q) {
+          memcpy(&us, q, sizeof(us));
+          if ((best == LOG_PRODUCERS) || ((int32_t)(us - bestUs) < 0)) {
+            best = i;
+            bestUs = us;
+            p = q;
+            n = len;
+          }
+        }
+      }
+      if (best == LOG_PRODUCERS) {
+        return 0;
+      }
+      memcpy(entry, p, n);
+      _ring[best].release();
+      return n;
+    }
+
+    bool empty(void) const {
+      for (size_t i = 0; i < LOG_PRODUCERS; i++) {
+        if (!_ring[i].empty()) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // counters of all producers
+    LogStats stats(void) const {
+      LogStats s = {};
+      for (size_t i = 0; i < LOG_PRODUCERS; i++) {
+        s.entries += _entries[i];
+        s.dropped += _dropped[i];
+        s.bytes += _bytes[i];
+      }
+      return s;
+    }
+
+  private:
+    static constexpr const char* LOG_DROPPED_FMT = "log: %u entries dropped";
+
+    SpscRing<SIZE> _ring[LOG_PRODUCERS];
+    // producer side
+    uint32_t       _entries[LOG_PRODUCERS] = {};
+    uint32_t       _dropped[LOG_PRODUCERS] = {};
+    uint32_t       _reported[LOG_PRODUCERS] = {};
+    uint32_t       _bytes[LOG_PRODUCERS] = {};
+
+    static uint8_t* header(uint8_t* p, uint8_t catLevel, uint32_t us, int32_t fmt) {
+      memcpy(p, &us, sizeof(us));
+      memcpy(p + 4, &fmt, sizeof(fmt));
+      p[8] = catLevel;
+      return p + LOG_HEADER;
+    }
+};
+
+extern BinLog<LOG_RING_SIZE> g_Log;
+size_t logProducer(void);                  // ring of the calling task (main.cpp)
+
+#endif // _BINLOG_H_
@@ -0,0 +1,96 @@
+/*!
+ * @file cmdProbe.h
+ */
+/************************************************************
+ * Command Latency Probe
+ ************************************************************
+ * Command "probe SEQ" is answered with the cycles at the
+ * stations of its own way through the firmware, relative to
+ * its arrival:
+ *
+ *   rx     mqttCallback() got the message (network side)
+ *   start  runCommands() starts the batch (application side;
+ *          dual-core: after g_CmdQueue)
+ *   end    the batch is done
+ *   pub    the result is formatted, handed to mqttPub() (the
+ *          10 digits of pub are written last, in place)
+ *
+ *   result: "probe SEQ mhz=240 start=C end=C pub=CCCCCCCCCC"
+ *
+ * The host (tools/cmdprobe.py, native bench) splits its round
+ * trip: queue = start, handler = end - start, format =
+ * pub - end, network = round trip - pub (broker, wire, the
+ * wait for mqtt.loop() and the way out through mqttPub).
+ * - rx is micros() (esp_timer, one clock for both cores):
+ *   the cycle counters of the two cores are not in step, so
+ *   rx -> start is measured in us and given in cycles
+ *   (resolution 1 us); start, end, pub are cycles of the
+ *   application core
+ * - cycles of the stamp clock (idleWait.h): with
+ *   IDLE_LIGHT_SLEEP the CPU clock is scaled, the stamps are
+ *   us and mhz=1
+ * - 32 bit cycles: a probe must be answered within 2^32
+ *   cycles (17.8 s at 240 MHz)
+ * - sent in a batch, a probe only returns "probe SEQ"
+ ************************************************************/
+#ifndef _CMDPROBE_H_
+#define _CMDPROBE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+struct CmdProbe {
+  uint32_t rx;                             // micros(): message arrived (any core)
+  uint32_t start;                          // cycles: batch started
+  uint32_t queue;                          // cycles: rx -> start (from micros())
+  uint32_t seq;                            // SEQ of the probe
+  bool     pending;                        // a probe ran in this batch
+};
+
+#define CMD_PROBE_PUB_DIGITS  10
+
+/************************************************************
+ * Batch starts (application core)
+ * @param[in,out] p probe of the batch, rx set
+ * @param[in] now micros()
+ * @param[in] cycles cycle counter
+ * @param[in] mhz CPU clock (cycles per us)
+ ************************************************************/
+inline void cmdProbeStart(CmdProbe& p, uint32_t now, uint32_t cycles, uint32_t mhz) {
+  p.queue = (now - p.rx) * mhz;
+  p.start = cycles;
+  p.pending = false;
+}
+
+/************************************************************
+ * Format the Probe Result (pub: zeros, see cmdProbeStamp)
+ * @param[out] out result buffer
+ * @param[in] size size of out
+ * @param[in] p probe of the batch
+ * @param[in] end cycles: batch done
+ * @param[in] mhz CPU clock (cycles per us)
+ * @return length of the result, 0 if it did not fit
+ ************************************************************/
+inline size_t cmdProbeResult(char* out, size_t size, const CmdProbe& p, uint32_t end, uint32_t mhz) {
+  int n = snprintf(out, size, "probe %lu mhz=%lu start=%lu end=%lu pub=%0*lu", (unsigned long)p.seq,
+                   (unsigned long)mhz, (unsigned long)p.queue, (unsigned long)(p.queue + end - p.start),
+                   CMD_PROBE_PUB_DIGITS, 0ul);
+  return ((n > 0) && ((size_t)n < size)) ? (size_t)n : 0;
+}
+
+/************************************************************
+ * Write pub into a formatted Probe Result
+ * @param[in,out] out result of cmdProbeResult
+ * @param[in] len its length
+ * @param[in] p probe of the batch
+ * @param[in] pub cycles: now
+ ************************************************************/
+inline void cmdProbeStamp(char* out, size_t len, const CmdProbe& p, uint32_t pub) {
+  uint32_t v = p.queue + pub - p.start;
+  for (size_t i = 0; i < CMD_PROBE_PUB_DIGITS; i++) {
+    out[len - 1 - i] = (char)('0' + v % 10);
+    v /= 10;
+  }
+}
+
+#endif // _CMDPROBE_H_
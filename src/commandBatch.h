@@ -0,0 +1,232 @@
+/*!
+ * @file commandBatch.h
+ */
+/************************************************************
+ * Command Batches
+ ************************************************************
+ * One MQTT message may carry several commands, separated by
+ * newline or ';' (outside of "quoted text"):
+ *
+ *   #42;helloadd 40 2;helloecho "a;b";hello
+ *
+ * - an optional first segment "#ID" is a correlation id,
+ *   echoed back as is (not lowered)
+ * - commands are executed in order, an error does not stop
+ *   the batch
+ * - a single command without id is answered as before, with
+ *   its plain response
+ * - everything else gets one JSON result document:
+ *
+ *   {"id":"42","results":[{"cmd":"helloadd 40 2","ok":true,
+ *    "result":"The Answer is: 42"},...],"n":3,"failed":0}
+ *
+ *   "truncated":true is added if not all results fit into
+ *   the buffer (n and failed still count all commands)
+ * - parsing is done in place, nothing is allocated
+ ************************************************************/
+#ifndef _COMMANDBATCH_H_
+#define _COMMANDBATCH_H_
+
+#include <ctype.h>
+#include "commandRegistry.h"
+
+#ifndef CMD_BATCH_RESULT_SIZE
+  #define CMD_BATCH_RESULT_SIZE  1536      // max length of a batch result document (incl. '\0'), must fit into the MQTT buffer
+#endif
+
+#define CMD_BATCH_ID_SIZE        40        // max length of a correlation id
+#define CMD_BATCH_TAIL           64        // reserved for the closing fields of the document
+
+/************************************************************
+ * Cut the next non-empty segment of cur (in place)
+ * - separators: '\n', ';' (not inside quotes)
+ * - blanks and '\r' around the segment are removed
+ * - returns nullptr if there is none
+ ************************************************************/
+inline char* cmdNextSegment(char*& cur) {
+  while (*cur) {
+    while ((*cur == ' ') || (*cur == '\r') || (*cur == '\n') || (*cur == ';')) {
+      cur++;
+    }
+    if (!*cur) {
+      break;
+    }
+    char* segment = cur;
+    bool  quoted = false;
+    while (*cur && (quoted || ((*cur != '\n') && (*cur != ';')))) {
+      if (*cur == '"') {
+        quoted = !quoted;
+      }
+      cur++;
+    }
+    char* end = cur;
+    if (*cur) {
+      *cur++ = '\0';
+    }
+    while ((end > segment) && ((end[-1] == ' ') || (end[-1] == '\r'))) {
+      *--end = '\0';
+    }
+    if (*segment) {
+      return segment;
+    }
+  }
+  return nullptr;
+}
+
+/************************************************************
+ * JSON Result Writer
+ * - writes into a fixed buffer, never overflows
+ * - an entry that does not fit is rolled back as a whole
+ ************************************************************/
+class CmdJsonWriter {
+  public:
+    CmdJsonWriter(char* buf, size_t size)
+      : _buf(buf), _size(size), _limit(size), _len(0), _mark(0), _overflow(false) {
+      _buf[0] = '\0';
+    }
+
+    void raw(const char* s) {
+      while (*s) {
+        put(*s++);
+      }
+    }
+
+    void str(const char* s) {
+      put('"');
+      for (; *s; s++) {
+        uint8_t c = (uint8_t)*s;
+        if ((c == '"') || (c == '\\')) {
+          put('\\');
+          put((char)c);
+        } else if (c < 0x20) {
+          static const char hex[] = "0123456789abcdef";
+          raw("\\u00");
+          put(hex[c >> 4]);
+          put(hex[c & 0x0f]);
+        } else {
+          put((char)c);
+        }
+      }
+      put('"');
+    }
+
+    void number(uint32_t n) {
+      char tmp[12];
+      snprintf(tmp, sizeof(tmp), "%lu", (unsigned long)n);
+      raw(tmp);
+    }
+
+    // entries: mark() before, commit() after; false if rolled back
+    void mark(void)  { _mark = _len; _overflow = false; }
+    bool commit(void) {
+      if (_overflow) {
+        _len = _mark;
+        _buf[_len] = '\0';
+      }
+      return !_overflow;
+    }
+
+    // the closing fields may use the reserved tail
+    void reserve(size_t tail)  { _limit = (_size > tail) ? _size - tail : 0; }
+    void release(void)         { _limit = _size; _overflow = false; }
+    size_t length(void) const  { return _len; }
+
+  private:
+    void put(char c) {
+      if (_len + 1 < _limit) {
+        _buf[_len++] = c;
+        _buf[_len] = '\0';
+      } else {
+        _overflow = true;
+      }
+    }
+
+    char*  _buf;
+    size_t _size;
+    size_t _limit;
+    size_t _len;
+    size_t _mark;
+    bool   _overflow;
+};
+
+/************************************************************
+ * Execute all commands of msg
+ * - msg is modified (split, lowered, tokenized in place)
+ * - out: CMD_BATCH_RESULT_SIZE bytes, receives the plain
+ *   response or the JSON result document
+ * - returns the number of commands executed
+ ************************************************************/
+template <size_t N>
+size_t cmdRunBatch(const CommandRegistry<N>& registry, char* msg, char* out) {
+  char        response[CMD_RESPONSE_SIZE];
+  char*       cur = msg;
+  char*       segment = cmdNextSegment(cur);
+  const char* id = nullptr;
+  if (segment && (segment[0] == '#')) {
+    id = segment + 1;
+    if (strlen(id) >= CMD_BATCH_ID_SIZE) {
+      segment[CMD_BATCH_ID_SIZE] = '\0';
+    }
+    segment = cmdNextSegment(cur);
+  }
+  char* next = segment ? cmdNextSegment(cur) : nullptr;
+
+  // single command: plain response
+  if (!id && !next) {
+    if (!segment) {
+      snprintf(out, CMD_RESPONSE_SIZE, "parse error: unknown command");
+      return 0;
+    }
+    for (char* c = segment; *c; c++) {
+      *c = tolower(*c);
+    }
+    registry.dispatch(segment, out);
+    return 1;
+  }
+
+  // batch: JSON document
+  CmdJsonWriter json(out, CMD_BATCH_RESULT_SIZE);
+  uint32_t      count = 0;
+  uint32_t      failed = 0;
+  bool          truncated = false;
+  json.reserve(CMD_BATCH_TAIL);
+  json.raw("{");
+  if (id) {
+    json.raw("\"id\":");
+    json.str(id);
+    json.raw(",");
+  }
+  json.raw("\"results\":[");
+  for (; segment; segment = next, next = segment ? cmdNextSegment(cur) : nullptr) {
+    for (char* c = segment; *c; c++) {
+      *c = tolower(*c);
+    }
+    // once an entry did not fit, the rest is executed but not listed
+    if (!truncated) {
+      json.mark();
+      json.raw(count ? ",{\"cmd\":" : "{\"cmd\":");
+      json.str(segment);                   // before dispatch: tokenizing cuts the line
+    }
+    bool ok = registry.dispatch(segment, response);
+    if (!truncated) {
+      json.raw(ok ? ",\"ok\":true,\"result\":" : ",\"ok\":false,\"result\":");
+      json.str(response);
+      json.raw("}");
+      truncated = !json.commit();
+    }
+    count++;
+    failed += ok ? 0 : 1;
+  }
+  json.release();
+  json.raw("],\"n\":");
+  json.number(count);
+  json.raw(",\"failed\":");
+  json.number(failed);
+  if (truncated) {
+    json.raw(",\"truncated\":true");
+  }
+  json.raw("}");
+  return count;
+}
+
+#endif // _COMMANDBATCH_H_
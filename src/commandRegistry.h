@@ -0,0 +1,357 @@
+/*!
+ * @file commandRegistry.h
+ */
+/************************************************************
+ * Command Registry
+ ************************************************************
+ * Commands are defined at compile time in one constant
+ * table (lives in flash, no RAM per command):
+ *
+ *   void cmd_helloadd(char* response, uint64_t sum1, uint64_t sum2);
+ *   constexpr CommandDef g_CommandDefs[] = {
+ *     CMD("helloadd", cmd_helloadd),
+ *   };
+ *   constexpr CommandRegistry<countof(g_CommandDefs)> g_Commands(g_CommandDefs);
+ *   static_assert(g_Commands.valid(), "command names must be unique, lower case");
+ *
+ * - the argument signature ("uu", "s", ...) is derived from
+ *   the parameter types of the handler:
+ *     u: uint64_t  i: int64_t  d: double  s: const char*
+ * - per signature a parser is generated (cmdInvoke), nothing
+ *   is interpreted at runtime
+ * - names are looked up through a perfect hash, built at
+ *   compile time: one hash and one string compare per
+ *   command, regardless of the number of commands
+ * - the command line is tokenized in place; string arguments
+ *   point into it (plain words or "quoted text")
+ ************************************************************/
+#ifndef _COMMANDREGISTRY_H_
+#define _COMMANDREGISTRY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tuple>
+#include <utility>
+
+#ifndef CMD_RESPONSE_SIZE
+  #define CMD_RESPONSE_SIZE  64            // max length of a command response (incl. '\0')
+#endif
+
+#define CMD(name, fn)  CommandDef{name, CmdSignature<decltype(&fn)>::value, &cmdInvoke<&fn>}
+
+typedef bool (*CmdInvoker)(char* args, char* response);
+
+struct CommandDef {
+  const char* name;                        // lower case, no blanks
+  const char* signature;                   // argument types, e.g. "uu"
+  CmdInvoker  invoke;
+};
+
+template <typename T, size_t N>
+constexpr size_t countof(const T (&)[N]) {
+  return N;
+}
+
+
+/************************************************************
+ * Argument Types
+ ************************************************************/
+template <typename T> struct CmdArg;
+
+// skip blanks, cut the next token (in place), false if none
+inline bool cmdNextToken(char*& cur, char*& token) {
+  while (*cur == ' ') {
+    cur++;
+  }
+  if (!*cur) {
+    return false;
+  }
+  if (*cur == '"') {
+    token = ++cur;
+    while (*cur && (*cur != '"')) {
+      cur++;
+    }
+    if (!*cur) {
+      return false;
+    }
+  } else {
+    token = cur;
+    while (*cur && (*cur != ' ')) {
+      cur++;
+    }
+  }
+  if (*cur) {
+    *cur++ = '\0';
+  }
+  return true;
+}
+
+template <> struct CmdArg<uint64_t> {
+  static constexpr char sig = 'u';
+  static bool parse(char*& cur, uint64_t& out) {
+    char* token;
+    if (!cmdNextToken(cur, token) || !*token) {
+      return false;
+    }
+    out = 0;
+    for (; *token; token++) {
+      if ((*token < '0') || (*token > '9')) {
+        return false;
+      }
+      out = out * 10 + (uint64_t)(*token - '0');
+    }
+    return true;
+  }
+};
+
+template <> struct CmdArg<int64_t> {
+  static constexpr char sig = 'i';
+  static bool parse(char*& cur, int64_t& out) {
+    char* token;
+    if (!cmdNextToken(cur, token)) {
+      return false;
+    }
+    bool negative = (*token == '-');
+    if ((*token == '-') || (*token == '+')) {
+      token++;
+    }
+    if (!*token) {
+      return false;
+    }
+    uint64_t value = 0;
+    for (; *token; token++) {
+      if ((*token < '0') || (*token > '9')) {
+        return false;
+      }
+      value = value * 10 + (uint64_t)(*token - '0');
+    }
+    out = negative ? -(int64_t)value : (int64_t)value;
+    return true;
+  }
+};
+
+template <> struct CmdArg<double> {
+  static constexpr char sig = 'd';
+  static bool parse(char*& cur, double& out) {
+    char* token;
+    char* end;
+    if (!cmdNextToken(cur, token)) {
+      return false;
+    }
+    out = strtod(token, &end);
+    return (end != token) && !*end;
+  }
+};
+
+template <> struct CmdArg<const char*> {
+  static constexpr char sig = 's';
+  static bool parse(char*& cur, const char*& out) {
+    char* token;
+    if (!cmdNextToken(cur, token)) {
+      return false;
+    }
+    out = token;
+    return true;
+  }
+};
+
+
+/************************************************************
+ * Signature & Invoker, generated from the handler type
+ * - handler: void fn(char* response, ARGS...)
+ ************************************************************/
+template <typename F> struct CmdSignature;
+
+template <typename... A> struct CmdSignature<void (*)(char*, A...)> {
+  static constexpr char   value[] = {CmdArg<A>::sig..., '\0'};
+  static constexpr size_t arity = sizeof...(A);
+};
+
+template <auto Fn, typename... A, size_t... I>
+bool cmdInvokeImpl(char* args, char* response, void (*)(char*, A...), std::index_sequence<I...>) {
+  std::tuple<A...> values;
+  if (!(CmdArg<A>::parse(args, std::get<I>(values)) && ...)) {
+    snprintf(response, CMD_RESPONSE_SIZE, "parse error: invalid or missing argument");
+    return false;
+  }
+  while (*args == ' ') {
+    args++;
+  }
+  if (*args) {
+    snprintf(response, CMD_RESPONSE_SIZE, "parse error: too many arguments");
+    return false;
+  }
+  response[0] = '\0';
+  Fn(response, std::get<I>(values)...);
+  return true;
+}
+
+template <auto Fn>
+bool cmdInvoke(char* args, char* response) {
+  return cmdInvokeImpl<Fn>(args, response, Fn, std::make_index_sequence<CmdSignature<decltype(Fn)>::arity>());
+}
+
+
+/************************************************************
+ * Perfect Hash (hash and displace)
+ * - FNV-1a of the name selects a bucket; every bucket has its
+ *   own displacement (searched at compile time) that moves
+ *   its names into free slots
+ * - table size: power of two >= 2 * number of commands,
+ *   one bucket per two slots
+ ************************************************************/
+constexpr uint32_t cmdHash(const char* name, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (uint8_t)name[i]) * 16777619u;
+  }
+  return h ^ (h >> 15);
+}
+
+constexpr uint32_t cmdSlotHash(uint32_t h, uint8_t displacement) {
+  uint32_t x = h ^ (displacement * 0x9e3779b1u);
+  x ^= x >> 16;
+  x *= 0x85ebca6bu;
+  return x ^ (x >> 13);
+}
+
+constexpr size_t cmdStrLen(const char* s) {
+  size_t n = 0;
+  while (s[n]) {
+    n++;
+  }
+  return n;
+}
+
+constexpr size_t cmdTableSize(size_t n) {
+  size_t size = 4;
+  while (size < 2 * n) {
+    size <<= 1;
+  }
+  return size;
+}
+
+template <size_t N>
+class CommandRegistry {
+  public:
+    static constexpr size_t TABLE_SIZE = cmdTableSize(N);
+    static constexpr size_t BUCKETS = TABLE_SIZE / 2;
+    static_assert(N < 255, "too many commands");
+
+    constexpr CommandRegistry(const CommandDef (&defs)[N]) : _defs(defs), _ok(true), _displacement{}, _slots{} {
+      uint32_t hashes[N] = {};
+      size_t   fill[BUCKETS] = {};
+      bool     used[TABLE_SIZE] = {};
+      for (size_t i = 0; i < N; i++) {
+        hashes[i] = cmdHash(defs[i].name, cmdStrLen(defs[i].name));
+        fill[hashes[i] & (BUCKETS - 1)]++;
+      }
+      // largest buckets first, they are the hardest to place
+      for (size_t size = N; _ok && (size > 0); size--) {
+        for (size_t b = 0; _ok && (b < BUCKETS); b++) {
+          if (fill[b] == size) {
+            _ok = place(hashes, b, used);
+          }
+        }
+      }
+    }
+
+    /************************************************************
+     * Table check, use with static_assert
+     * - perfect hash found (names are unique)
+     * - names are lower case without blanks (input is lowered)
+     ************************************************************/
+    constexpr bool valid(void) const {
+      if (!_ok) {
+        return false;
+      }
+      for (size_t i = 0; i < N; i++) {
+        for (const char* c = _defs[i].name; *c; c++) {
+          if (((*c >= 'A') && (*c <= 'Z')) || (*c == ' ')) {
+            return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    /************************************************************
+     * Find Command by name (len characters of name are used)
+     ************************************************************/
+    const CommandDef* find(const char* name, size_t len) const {
+      uint32_t h = cmdHash(name, len);
+      uint8_t  displacement = _displacement[h & (BUCKETS - 1)];
+      if (!displacement) {
+        return nullptr;
+      }
+      uint8_t slot = _slots[cmdSlotHash(h, displacement) & (TABLE_SIZE - 1)];
+      if (!slot) {
+        return nullptr;
+      }
+      const CommandDef* def = &_defs[slot - 1];
+      return ((strncmp(def->name, name, len) == 0) && !def->name[len]) ? def : nullptr;
+    }
+
+    /************************************************************
+     * Execute Command line "name arg1 arg2 ..."
+     * - line is modified (tokenized in place)
+     * - response: CMD_RESPONSE_SIZE bytes
+     * - returns false on unknown command or parse error
+     ************************************************************/
+    bool dispatch(char* line, char* response) const {
+      while (*line == ' ') {
+        line++;
+      }
+      char* args = line;
+      while (*args && (*args != ' ')) {
+        args++;
+      }
+      const CommandDef* def = find(line, (size_t)(args - line));
+      if (!def) {
+        snprintf(response, CMD_RESPONSE_SIZE, "parse error: unknown command");
+        return false;
+      }
+      return def->invoke(args, response);
+    }
+
+    size_t            count(void) const            { return N; }
+    const CommandDef& operator[](size_t i) const   { return _defs[i]; }
+
+  private:
+    // find a displacement that moves all names of bucket b into free slots
+    constexpr bool place(const uint32_t (&hashes)[N], size_t b, bool (&used)[TABLE_SIZE]) {
+      for (uint32_t d = 1; d < 256; d++) {
+        bool taken[TABLE_SIZE] = {};
+        bool ok = true;
+        for (size_t i = 0; ok && (i < N); i++) {
+          if ((hashes[i] & (BUCKETS - 1)) == b) {
+            size_t slot = cmdSlotHash(hashes[i], (uint8_t)d) & (TABLE_SIZE - 1);
+            ok = !used[slot] && !taken[slot];
+            taken[slot] = true;
+          }
+        }
+        if (ok) {
+          _displacement[b] = (uint8_t)d;
+          for (size_t i = 0; i < N; i++) {
+            if ((hashes[i] & (BUCKETS - 1)) == b) {
+              size_t slot = cmdSlotHash(hashes[i], (uint8_t)d) & (TABLE_SIZE - 1);
+              used[slot] = true;
+              _slots[slot] = (uint8_t)(i + 1);
+            }
+          }
+          return true;
+        }
+      }
+      return false;
+    }
+
+    const CommandDef* _defs;
+    bool              _ok;
+    uint8_t           _displacement[BUCKETS];
+    uint8_t           _slots[TABLE_SIZE];
+};
+
+#endif // _COMMANDREGISTRY_H_
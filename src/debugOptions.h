@@ -11,30 +11,35 @@
 
 
 /************************************************************
- * Serial Debugging Config
+ * Log Levels per Category (see binLog.h)
+ * - calls above the level of their category are not compiled
+ * - entries go to the UART and to TOPIC_LOG in binary form,
+ *   tools/logdecode.py turns them into text
  ************************************************************/ 
-#define DEBUG                 1  // Debug main 
-#define DEBUG_ERROR           1  // Error Messages
-#define DEBUG_HEARTBEAT       0  // Debug Heartbeat
-#define DEBUG_IRQ             0  // Debug IRQ
-#define DEBUG_MQTT            0  // Debug MQTT Callback
-#define DEBUG_MONITOR         0  // Debug Wifi & MQTT Monitoring
-#define DEBUG_SETUP           1  // Debug Setup 
-#define DEBUG_PARSER          1  // Debug Command Parser
+#define LOG_NONE              0
+#define LOG_ERROR             1
+#define LOG_INFO              2
+#define LOG_DEBUG             3
+
+#define LOG_LEVEL_MAIN        LOG_INFO   // Main
+#define LOG_LEVEL_SETUP       LOG_INFO   // Setup
+#define LOG_LEVEL_NET         LOG_ERROR  // Wifi & MQTT Monitoring (LOG_INFO: state changes)
+#define LOG_LEVEL_MQTT        LOG_INFO   // MQTT Messages and Commands
+#define LOG_LEVEL_IRQ         LOG_ERROR  // IRQ, MCP 23017, Rollers (LOG_DEBUG: every edge)
+#define LOG_LEVEL_PARSER      LOG_INFO   // Command Parser
+#ifndef LOG_UART
+  #define LOG_UART            1          // 0: log entries only to TOPIC_LOG
+#endif
 
 
 /************************************************************
- * Debugging Macros use Macro "DBG...." instead of "Serial"
+ * Loop Statistics: cycle histograms per loop() stage and
+ * timer job on TOPIC_METRICS (see loopStats.h), 0: compiled
+ * out
  ************************************************************/ 
-#define DEBUG_STATE       (DEBUG_HEARTBEAT || DEBUG_IRQ || DEBUG_STATE_CHANGE)
-
-#define DBG               if(DEBUG)Serial 
-#define DBG_ERROR         if(DEBUG_ERROR)Serial 
-#define DBG_HEARTBEAT     if(DEBUG_HEARTBEAT)Serial 
-#define DBG_IRQ           if(DEBUG_IRQ)Serial 
-#define DBG_MQTT          if(DEBUG_MQTT)Serial 
-#define DBG_MONITOR       if(DEBUG_MONITOR)Serial 
-#define DBG_SETUP         if(DEBUG_SETUP)Serial 
-#define DBG_PARSER        if(DEBUG_PARSER)Serial 
+#ifndef LOOP_STATS
+  #define LOOP_STATS          1  // Loop Stage Histograms
+#endif
+
 
 #endif  // _DEBUGOPTIONS_H_
\ No newline at end of file
@@ -0,0 +1,40 @@
+/*!
+ * @file deviceFacts.h
+ */
+/************************************************************
+ * Device Facts
+ ************************************************************
+ * Values that do not change until the next reboot, read
+ * once in setup() (setupDeviceFacts):
+ * - MQTT ClientID (from the MAC)
+ * - sketch MD5 (hashes the whole app partition, slow),
+ *   sketch size, flash, SDK version
+ * - the sketch state document, rendered once; it is
+ *   published retained and only re-sent when a value
+ *   changes (CPU frequency is checked once a minute)
+ ************************************************************/
+#ifndef _DEVICEFACTS_H_
+#define _DEVICEFACTS_H_
+
+#include "telemetry.h"
+
+#define DEVICE_CLIENTID_SIZE  24           // "esp32_xx-xx-xx"
+
+struct DeviceFacts {
+  char        clientId[DEVICE_CLIENTID_SIZE];
+  char        sketchMD5[33];
+  const char* sdkVersion;
+  uint32_t    cpuFreqMHz;                  // may be changed at runtime (setCpuFrequencyMhz)
+  uint32_t    sketchSize;
+  uint32_t    freeSketchSpace;
+  uint32_t    flashChipSize;
+  uint32_t    flashChipSpeed;
+  // pre-rendered sketch state document
+  char        sketchState[TELEMETRY_BUFSIZE];
+  size_t      sketchStateLen;
+  boolean     sketchStatePending;          // not yet published (retained) since the last change
+};
+
+extern DeviceFacts g_DeviceFacts;
+
+#endif // _DEVICEFACTS_H_
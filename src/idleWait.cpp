@@ -0,0 +1,176 @@
+/*!
+ * @file idleWait.cpp
+ */
+/************************************************************
+ * Tickless Idle (ESP32, VFS select / eventfd)
+ * - the native target uses native/shim/idleWait.cpp
+ ************************************************************/
+#ifdef ARDUINO_ARCH_ESP32
+
+#include <idleWait.h>
+#include <atomic>
+#include <sys/select.h>
+#include <esp_vfs_eventfd.h>
+#include <esp_pm.h>
+#include <esp_wifi.h>
+#include <freertos/timers.h>
+
+#define IDLE_DOORBELLS   2                 // 0: application, 1: network task
+
+static int                   s_Doorbell[IDLE_DOORBELLS] = {-1, -1};
+static std::atomic<uint32_t> s_Pending(0);
+
+// doorbells of the tasks that sleep on events
+static void idleRing(uint32_t events) {
+  uint64_t one = 1;
+  if ((events & IDLE_EV_APP) && (s_Doorbell[0] >= 0)) {
+    write(s_Doorbell[0], &one, sizeof(one));
+  }
+  if ((events & IDLE_EV_NET) && (s_Doorbell[1] >= 0)) {
+    write(s_Doorbell[1], &one, sizeof(one));
+  }
+}
+
+// timer daemon task, on behalf of idleWakeFromISR
+static void idleRingDeferred(void* param, uint32_t events) {
+  (void)param;
+  idleRing(events);
+}
+
+
+/************************************************************
+ * Create the Doorbells
+ * - one eventfd per task that sleeps
+ * @return false if eventfd is not available
+ ************************************************************/
+bool idleBegin(void) {
+  esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+  esp_err_t err = esp_vfs_eventfd_register(&config);
+  if ((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE)) {
+    return false;
+  }
+  for (size_t i = 0; i < IDLE_DOORBELLS; i++) {
+    if (s_Doorbell[i] < 0) {
+      s_Doorbell[i] = eventfd(0, 0);
+    }
+    if (s_Doorbell[i] < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+/************************************************************
+ * Automatic Light Sleep
+ * - CPU down to 80 MHz and light sleep while all tasks wait,
+ *   WiFi modem sleep (wakes for every DTIM beacon)
+ * - needs CONFIG_PM_ENABLE and tickless FreeRTOS in the SDK
+ *   configuration
+ * - the cycle counter is no clock then: IDLE_LIGHT_SLEEP
+ *   switches the stamps to esp_timer (STAMP_NOW, idleWait.h)
+ * @return false if not supported
+ ************************************************************/
+bool idleLightSleep(void) {
+#if CONFIG_PM_ENABLE
+  esp_pm_config_esp32_t pm = {};
+  pm.max_freq_mhz = (int)getCpuFrequencyMhz();
+  pm.min_freq_mhz = 80;
+  pm.light_sleep_enable = true;
+  if (esp_pm_configure(&pm) != ESP_OK) {
+    return false;
+  }
+  return esp_wifi_set_ps(WIFI_PS_MIN_MODEM) == ESP_OK;
+#else
+  return false;
+#endif
+}
+
+
+/************************************************************
+ * Wake the Tasks sleeping on events
+ * @param[in] events IDLE_EV_...
+ ************************************************************/
+void idleWake(uint32_t events) {
+  s_Pending.fetch_or(events, std::memory_order_release);
+  idleRing(events);
+}
+
+
+/************************************************************
+ * Wake from an ISR
+ * - write() of the VFS is not IRAM safe, the timer daemon
+ *   task rings the doorbell; if its queue is full the event
+ *   is seen after IDLE_LATENCY_MS at the latest
+ * @param[in] events IDLE_EV_...
+ ************************************************************/
+void IRAM_ATTR idleWakeFromISR(uint32_t events) {
+  BaseType_t woken = pdFALSE;
+  s_Pending.fetch_or(events, std::memory_order_release);
+  xTimerPendFunctionCallFromISR(idleRingDeferred, nullptr, events, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+
+/************************************************************
+ * Sleep until an Event, Socket or the Timeout
+ * - an event already pending: select() only polls, which
+ *   also empties its doorbell
+ * - a doorbell without event (rung for one taken by the
+ *   previous call) counts as IDLE_WAKE_QUEUE
+ * @param[in] events IDLE_EV_... to wake for
+ * @param[in] readSock wake if readable (-1: none)
+ * @param[in] writeSock wake if writable (-1: none)
+ * @param[in] us timeout
+ * @return IdleWake (IDLE_WAKE_TIMER on timeout)
+ ************************************************************/
+uint8_t idleWait(uint32_t events, int readSock, int writeSock, uint32_t us) {
+  fd_set rfds, wfds;
+  int    maxFd = -1;
+  FD_ZERO(&rfds);
+  FD_ZERO(&wfds);
+  for (size_t i = 0; i < IDLE_DOORBELLS; i++) {
+    if ((events & (i ? IDLE_EV_NET : IDLE_EV_APP)) && (s_Doorbell[i] >= 0)) {
+      FD_SET(s_Doorbell[i], &rfds);
+      maxFd = (s_Doorbell[i] > maxFd) ? s_Doorbell[i] : maxFd;
+    }
+  }
+  if (readSock >= 0) {
+    FD_SET(readSock, &rfds);
+    maxFd = (readSock > maxFd) ? readSock : maxFd;
+  }
+  if (writeSock >= 0) {
+    FD_SET(writeSock, &wfds);
+    maxFd = (writeSock > maxFd) ? writeSock : maxFd;
+  }
+  if (s_Pending.load(std::memory_order_acquire) & events) {
+    us = 0;
+  }
+  struct timeval tv = {(time_t)(us / 1000000), (suseconds_t)(us % 1000000)};
+  int  res = select(maxFd + 1, &rfds, &wfds, nullptr, &tv);
+  bool rung = false;
+  // empty the doorbells before taking the events (a new one rings again)
+  for (size_t i = 0; (res > 0) && (i < IDLE_DOORBELLS); i++) {
+    uint64_t v;
+    if ((s_Doorbell[i] >= 0) && FD_ISSET(s_Doorbell[i], &rfds)) {
+      read(s_Doorbell[i], &v, sizeof(v));
+      rung = true;
+    }
+  }
+  uint32_t got = s_Pending.fetch_and(~events, std::memory_order_acq_rel) & events;
+  if (got & IDLE_EV_IRQ) {
+    return IDLE_WAKE_IRQ;
+  }
+  if (got) {
+    return IDLE_WAKE_QUEUE;
+  }
+  if ((res > 0) && (((readSock >= 0) && FD_ISSET(readSock, &rfds)) ||
+                    ((writeSock >= 0) && FD_ISSET(writeSock, &wfds)))) {
+    return IDLE_WAKE_SOCKET;
+  }
+  return rung ? IDLE_WAKE_QUEUE : IDLE_WAKE_TIMER;
+}
+
+#endif // ARDUINO_ARCH_ESP32
@@ -0,0 +1,154 @@
+/*!
+ * @file idleWait.h
+ */
+/************************************************************
+ * Tickless Idle
+ ************************************************************
+ * Instead of spinning, loop() (and the network task) sleep
+ * after each pass until the next thing is due:
+ *
+ *   budget = min(next timer job, roller start / stop, end of
+ *                the IRQ debounce, next MQTT attempt, ...)
+ *            0 while work is pending (queues, log, delta OTA)
+ *   idleWait(events, readSock, writeSock, budget)
+ *     returns early on
+ *     - data on the MQTT socket (readSock)
+ *     - the TCP connect to the broker done (writeSock)
+ *     - idleWake(): INT_PIN (irqHandler), a record in
+ *       g_CmdQueue / g_PubQueue (dual-core) or in
+ *       g_RxNetQueue (receive task, mqttRx.h)
+ *
+ * - a sleep never exceeds IDLE_LATENCY_MS: the bound for all
+ *   that has no wake source (ArduinoOTA invitation on UDP,
+ *   WiFi association, MQTT keepalive); a command on the MQTT
+ *   socket wakes right away
+ * - IDLE_LIGHT_SLEEP 1: automatic light sleep between the
+ *   passes plus WiFi modem sleep (esp_pm); the AP's DTIM
+ *   period adds to the command latency then, and the stamp
+ *   clock counts us instead of cycles (see below)
+ * - events: one bit per source (IDLE_EV_...), the sources of
+ *   the application and of the network task each ring their
+ *   own doorbell, so in dual-core each task only wakes for
+ *   its own
+ * - statistics per sleeping task (IdleStats): idle % since
+ *   the last report and the wake-up reasons, published with
+ *   the CPU state
+ * - ESP32: select() over the sockets and one eventfd per
+ *   task, written by idleWake() (from the ISR through the
+ *   timer daemon task), see idleWait.cpp
+ * - native: condition variable, rung by idleWake() and the
+ *   LocalBroker (native/shim/idleWait.cpp)
+ ************************************************************/
+#ifndef _IDLEWAIT_H_
+#define _IDLEWAIT_H_
+
+#include <Arduino.h>
+
+#ifndef IDLE_WAIT
+  #define IDLE_WAIT           1            // 0: loop() spins as before
+#endif
+#ifndef IDLE_LIGHT_SLEEP
+  #define IDLE_LIGHT_SLEEP    0            // 1: automatic light sleep and WiFi modem sleep
+#endif
+#ifndef IDLE_LATENCY_MS
+  #define IDLE_LATENCY_MS     50           // longest sleep of a pass
+#endif
+#define IDLE_NONE             0xffffffffu  // budget: nothing due
+
+/************************************************************
+ * Stamp Clock
+ * - IRQ events and debounce (irqEvents.h), loop stage
+ *   statistics (loopStats.h), command probe (cmdProbe.h):
+ *   the cycle counter of the core, STAMP_PER_US(mhz) = mhz
+ * - IDLE_LIGHT_SLEEP 1: esp_pm scales the CPU clock between
+ *   80 MHz and the maximum and light sleep stops the
+ *   counter, so a cycle is no fixed time; the stamps are us
+ *   of esp_timer then (IRAM safe, the same on both cores),
+ *   STAMP_PER_US(mhz) = 1
+ ************************************************************/
+#if IDLE_LIGHT_SLEEP
+  #ifdef ARDUINO_ARCH_ESP32
+    #include <esp_timer.h>
+    #define STAMP_NOW()         ((uint32_t)esp_timer_get_time())
+  #else
+    #define STAMP_NOW()         micros()
+  #endif
+  #define STAMP_PER_US(mhz)     1u
+#else
+  #ifdef ARDUINO_ARCH_ESP32
+    #include <hal/cpu_hal.h>
+    #define STAMP_NOW()         cpu_hal_get_cycle_count()
+  #else
+    #define STAMP_NOW()         ESP.getCycleCount()
+  #endif
+  #define STAMP_PER_US(mhz)     (mhz)
+#endif
+
+// events (idleWake), the task that sleeps on them
+#define IDLE_EV_IRQ           0x01         // INT_PIN edge (application)
+#define IDLE_EV_CMD           0x02         // record in g_CmdQueue (application)
+#define IDLE_EV_PUB           0x04         // record in g_PubQueue (network task)
+#define IDLE_EV_RX            0x08         // record in g_RxNetQueue (network task)
+#define IDLE_EV_APP           (IDLE_EV_IRQ | IDLE_EV_CMD)
+#define IDLE_EV_NET           (IDLE_EV_PUB | IDLE_EV_RX)
+
+enum IdleWake : uint8_t {
+  IDLE_WAKE_TIMER,                         // the budget ran out (something is due)
+  IDLE_WAKE_BOUND,                         // IDLE_LATENCY_MS passed
+  IDLE_WAKE_SOCKET,                        // MQTT socket readable, TCP connect done
+  IDLE_WAKE_IRQ,                           // IDLE_EV_IRQ
+  IDLE_WAKE_QUEUE,                         // IDLE_EV_CMD, IDLE_EV_PUB, IDLE_EV_RX
+  IDLE_WAKE_COUNT
+};
+
+/************************************************************
+ * Statistics of one sleeping task
+ * - add() / busyPass() by the task itself, percent() by the
+ *   reporter (32 bit values, no lock)
+ ************************************************************/
+class IdleStats {
+  public:
+    void add(uint8_t reason, uint32_t sleptUs) {
+      _wakes[reason]++;
+      _sleptUs += sleptUs;
+    }
+
+    // a pass without sleep: work was pending
+    void busyPass(void)                  { _busy++; }
+
+    // % of the time since the last call spent asleep
+    uint32_t percent(uint32_t nowUs) {
+      uint32_t slept = _sleptUs - _reportSlept;
+      uint32_t span = nowUs - _reportAt;
+      _reportSlept = _sleptUs;
+      _reportAt = nowUs;
+      return span ? (uint32_t)((uint64_t)slept * 100 / span) : 0;
+    }
+
+    uint32_t wakes(uint8_t reason) const { return _wakes[reason]; }
+    uint32_t busy(void) const            { return _busy; }
+
+  private:
+    volatile uint32_t _wakes[IDLE_WAKE_COUNT] = {};
+    volatile uint32_t _busy = 0;
+    volatile uint32_t _sleptUs = 0;        // free running
+    uint32_t          _reportSlept = 0;
+    uint32_t          _reportAt = 0;
+};
+
+/************************************************************
+ * Platform (idleWait.cpp, native/shim/idleWait.cpp)
+ ************************************************************/
+bool    idleBegin(void);                                   // doorbells, false: loop() spins
+bool    idleLightSleep(void);                              // IDLE_LIGHT_SLEEP, false: not supported
+void    idleWake(uint32_t events);                         // any task
+void    idleWakeFromISR(uint32_t events);                  // ISR (IRAM)
+uint8_t idleWait(uint32_t events, int readSock, int writeSock, uint32_t us);   // IdleWake
+
+extern boolean   g_IdleOn;                 // false: no sleep (IDLE_WAIT 0, benchmarks)
+extern IdleStats g_IdleLoop;               // loop() (dual-core: application)
+extern IdleStats g_IdleNet;                // network task (dual-core)
+extern uint32_t  g_IdlePercent[2];         // CPU_STATE_FIELDS (sendCPUState)
+extern uint32_t  g_IdleWakes[IDLE_WAKE_COUNT];
+
+#endif // _IDLEWAIT_H_
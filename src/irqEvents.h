@@ -0,0 +1,142 @@
+/*!
+ * @file irqEvents.h
+ */
+/************************************************************
+ * IRQ Event Ring
+ ************************************************************
+ * The ISR of INT_PIN (MCP23017) only stores a timestamped
+ * event, the work is done later by irqDrain() from loop():
+ *
+ *   irqHandler (ISR):  g_IrqRing.push(cycles, level)
+ *   irqDrain (loop):   pop -> statistics -> debounce
+ *                      -> irqEdge(level, cycles of the edge)
+ *
+ * - wait-free single producer (ISR) / single consumer ring,
+ *   no critical section; a full ring counts an overflow
+ *   and drops the new event
+ * - every edge is kept (CHANGE), with the cycle count and
+ *   the pin level read in the ISR
+ * - debounce: an edge is accepted once the pin was quiet for
+ *   IRQ_DEBOUNCE_US; irqEdge() gets the time of the first
+ *   edge of the burst, the other events count as bounced
+ * - the level of a burst is the level of its last event; if
+ *   the ring overflowed meanwhile (last edge maybe lost) the
+ *   pin is read again
+ * - statistics (published on TOPIC_IRQ):
+ *   - latency ISR -> irqDrain in us, log2 histogram
+ *   - events per second (1 s windows with events), log2
+ *     histogram and maximum
+ * - g_Irq belongs to irqDrain() (application); after a pass
+ *   with events it publishes the statistics as an IrqReport
+ *   to g_IrqSnapshot (seqSnapshot.h), sendIrqState() on the
+ *   network task reads that copy
+ ************************************************************/
+#ifndef _IRQEVENTS_H_
+#define _IRQEVENTS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "idleWait.h"
+#include "logHistogram.h"
+#include "seqSnapshot.h"
+
+#ifndef IRQ_RING_SIZE
+  #define IRQ_RING_SIZE     64             // events (power of 2)
+#endif
+#ifndef IRQ_DEBOUNCE_US
+  #define IRQ_DEBOUNCE_US   5000           // quiet time until an edge is accepted
+#endif
+#define IRQ_HIST_BUCKETS    16             // latency up to 32 ms, rate up to 32768/s
+
+// ISR helpers: no flash access; cycles of the stamp clock (idleWait.h, us with IDLE_LIGHT_SLEEP)
+#define IRQ_CYCLES()           STAMP_NOW()
+#ifdef ARDUINO_ARCH_ESP32
+  #include <soc/gpio_struct.h>
+  #define IRQ_PIN_LEVEL(pin)   (((pin) < 32) ? ((GPIO.in >> (pin)) & 1) : ((GPIO.in1.data >> ((pin) - 32)) & 1))
+#else
+  #define IRQ_PIN_LEVEL(pin)   digitalRead(pin)
+#endif
+
+struct IrqEvent {
+  uint32_t    cycles;                      // cycle count in the ISR
+  uint32_t    level;                       // pin level in the ISR
+};
+
+template <size_t N>
+class IrqRing {
+  static_assert(N && !(N & (N - 1)), "ring size must be a power of 2");
+
+  public:
+    // producer (ISR): wait-free
+    __attribute__((always_inline)) inline bool push(uint32_t cycles, uint32_t level) {
+      uint32_t tail = _tail.load(std::memory_order_relaxed);
+      if (tail - _head.load(std::memory_order_acquire) >= N) {
+        _overflows.store(_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+      }
+      _ev[tail & (N - 1)] = IrqEvent{cycles, level};
+      _tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    // consumer (loop)
+    bool pop(IrqEvent& ev) {
+      uint32_t head = _head.load(std::memory_order_relaxed);
+      if (head == _tail.load(std::memory_order_acquire)) {
+        return false;
+      }
+      ev = _ev[head & (N - 1)];
+      _head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    uint32_t overflows(void) const      { return _overflows.load(std::memory_order_relaxed); }
+    bool     empty(void) const          { return _head.load(std::memory_order_relaxed) ==
+                                                 _tail.load(std::memory_order_acquire); }
+
+  private:
+    IrqEvent              _ev[N];
+    std::atomic<uint32_t> _head{0};        // free running, written by the consumer
+    std::atomic<uint32_t> _tail{0};        // free running, written by the ISR
+    std::atomic<uint32_t> _overflows{0};   // written by the ISR
+};
+
+struct IrqState {
+  // debounce
+  uint8_t     stable;                      // accepted level of INT_PIN
+  uint8_t     pendingLevel;                // level of the last event of the burst
+  bool        pending;                     // burst in progress (not quiet for IRQ_DEBOUNCE_US)
+  uint32_t    burst;                       // events of the burst
+  uint32_t    edgeAt;                      // cycles: first edge of the burst
+  uint32_t    lastAt;                      // cycles: last event of the burst
+  uint32_t    overflowsSeen;               // g_IrqRing.overflows() at the last accepted burst
+  // rate window
+  uint32_t    windowAt;                    // cycles: start of the current 1 s window
+  uint32_t    windowEvents;
+  // statistics
+  uint32_t    events;                      // popped from the ring
+  uint32_t    accepted;                    // edges passed to irqEdge()
+  uint32_t    bounced;                     // events dropped by the debounce
+  uint32_t    maxRate;                     // events in the busiest 1 s window
+  LogHistogram<IRQ_HIST_BUCKETS> latency;  // us from the ISR to irqDrain()
+  LogHistogram<IRQ_HIST_BUCKETS> rate;     // events per 1 s window
+};
+
+// statistics of g_Irq for other tasks (IRQ_STATE_FIELDS)
+struct IrqReport {
+  uint32_t    events;
+  uint32_t    accepted;
+  uint32_t    bounced;
+  uint32_t    overflows;                   // g_IrqRing.overflows()
+  uint32_t    maxRate;
+  LogHistogram<IRQ_HIST_BUCKETS> latency;
+  LogHistogram<IRQ_HIST_BUCKETS> rate;
+};
+
+extern IrqRing<IRQ_RING_SIZE>  g_IrqRing;
+extern IrqState                g_Irq;
+extern SeqSnapshot<IrqReport>  g_IrqSnapshot;   // written by irqDrain()
+extern IrqReport               g_IrqReport;     // IRQ_STATE_FIELDS, filled by sendIrqState()
+
+#endif // _IRQEVENTS_H_
@@ -0,0 +1,79 @@
+/*!
+ * @file logHistogram.h
+ */
+/************************************************************
+ * Log2 Histogram
+ ************************************************************
+ * Fixed memory histogram for latencies and rates:
+ *
+ *   bucket 0:  v == 0
+ *   bucket i:  2^(i-1) <= v < 2^i
+ *   last:      everything above
+ *
+ * - add() is a count leading zeros and an increment
+ * - percentile() returns the upper bound of the bucket that
+ *   holds the p-th value (at most max()), so p50/p99 are
+ *   exact to a factor of 2
+ * - buckets() feeds a telemetry field (TelemetryList), the
+ *   trailing empty buckets are cut
+ ************************************************************/
+#ifndef _LOGHISTOGRAM_H_
+#define _LOGHISTOGRAM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "telemetry.h"
+
+template <size_t BUCKETS>
+class LogHistogram {
+  static_assert((BUCKETS >= 2) && (BUCKETS <= 33), "1..32 bit buckets");
+
+  public:
+    void add(uint32_t v) {
+      size_t b = v ? 32 - __builtin_clz(v) : 0;
+      _buckets[(b < BUCKETS) ? b : BUCKETS - 1]++;
+      _count++;
+      _max = (v > _max) ? v : _max;
+    }
+
+    uint32_t percentile(uint32_t p) const {
+      if (!_count) {
+        return 0;
+      }
+      uint64_t rank = ((uint64_t)_count * p + 99) / 100;
+      uint64_t seen = 0;
+      for (size_t b = 0; b < BUCKETS - 1; b++) {
+        seen += _buckets[b];
+        if (seen >= rank) {
+          uint32_t upper = b ? (uint32_t)((1ULL << b) - 1) : 0;
+          return (upper < _max) ? upper : _max;
+        }
+      }
+      return _max;
+    }
+
+    TelemetryList buckets(void) const {
+      size_t n = BUCKETS;
+      while (n && !_buckets[n - 1]) {
+        n--;
+      }
+      return TelemetryList{_buckets, n};
+    }
+
+    void reset(void) {
+      memset(_buckets, 0, sizeof(_buckets));
+      _count = 0;
+      _max = 0;
+    }
+
+    uint32_t count(void) const          { return _count; }
+    uint32_t max(void) const            { return _max; }
+
+  private:
+    uint32_t _buckets[BUCKETS] = {};
+    uint32_t _count = 0;
+    uint32_t _max = 0;
+};
+
+#endif // _LOGHISTOGRAM_H_
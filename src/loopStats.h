@@ -0,0 +1,178 @@
+/*!
+ * @file loopStats.h
+ */
+/************************************************************
+ * Loop Stage Statistics
+ ************************************************************
+ * Cycle count durations of every stage of loop() and of
+ * every timer job, one log2 histogram each:
+ *
+ *   LOOP_STAGE(LOOP_STAGE_MQTT, alive = mqtt.loop());
+ *   g_Timers.runner(cronRunner);     // timer jobs
+ *   g_LoopStats.nameJob(jobCPUState, "cpu");
+ *
+ * - add() is a count leading zeros and three stores, no heap;
+ *   timer jobs are found by their callback in a table of
+ *   LOOP_STATS_JOBS entries, jobs without a name share the
+ *   last one ("other")
+ * - the histograms cover one publish interval: two per
+ *   stage, by the parity of the epoch; newInterval() bumps
+ *   the epoch, every stage clears the other one on its next
+ *   add() and goes on there, the closed interval stays as it
+ *   is for the report (stage(), job())
+ * - DUAL_CORE: each histogram is written by one core only;
+ *   the network task reports the closed interval once the
+ *   application left it (settled(): its LOOP_STAGE_LOOP,
+ *   the last stage of its pass, is in the new epoch), so it
+ *   never reads a histogram that is still written
+ * - p50/p99/max are reported in us (see LogHistogram for the
+ *   precision of the percentiles)
+ * - cycles of the stamp clock (idleWait.h): us with
+ *   IDLE_LIGHT_SLEEP, where the CPU clock is scaled
+ * - LOOP_STATS 0 (debugOptions.h): LOOP_STAGE() is just the
+ *   call, nothing of this is compiled
+ ************************************************************/
+#ifndef _LOOPSTATS_H_
+#define _LOOPSTATS_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include "debugOptions.h"
+#include "idleWait.h"
+#include "logHistogram.h"
+#include "timerWheel.h"
+
+#if LOOP_STATS
+
+#define LOOP_HIST_BUCKETS   26             // cycles up to 2^25 (140 ms at 240 MHz, 33 s in us)
+#ifndef LOOP_STATS_JOBS
+  #define LOOP_STATS_JOBS   12             // timer jobs with their own histogram
+#endif
+
+enum LoopStage {
+  LOOP_STAGE_LOOP,                         // loop() as a whole (dual-core: the application)
+  LOOP_STAGE_MQTT,                         // mqtt.loop()
+  LOOP_STAGE_NET,                          // netStep(): WiFi / MQTT state machine
+  LOOP_STAGE_OTA,                          // ArduinoOTA.handle(), otaDeltaStep()
+  LOOP_STAGE_PUB,                          // taskPubDrain()
+  LOOP_STAGE_CRON,                         // cronjob(): all timer jobs due
+  LOOP_STAGE_LOG,                          // logDrain()
+  LOOP_STAGE_CMD,                          // taskCmdDrain()
+  LOOP_STAGE_IRQ,                          // irqDrain()
+  LOOP_STAGE_ROLLER,                       // rollerLoop()
+  LOOP_STAGE_COUNT
+};
+
+#define LOOP_CYCLES()       STAMP_NOW()
+
+#define LOOP_STAGE(stage, call)                                \
+  do {                                                         \
+    uint32_t _c0 = LOOP_CYCLES();                              \
+    call;                                                      \
+    g_LoopStats.add(stage, LOOP_CYCLES() - _c0);               \
+  } while (0)
+
+class LoopStats {
+  public:
+    struct Stage {
+      LogHistogram<LOOP_HIST_BUCKETS> cycles[2];   // by the parity of the epoch
+      std::atomic<uint32_t>           epoch[2];    // interval of the values in cycles[]
+    };
+
+    LoopStats() {
+      for (size_t j = 0; j < LOOP_STATS_JOBS; j++) {
+        _jobFn[j] = nullptr;
+        _jobName[j] = nullptr;
+      }
+      _jobName[LOOP_STATS_JOBS - 1] = "other";
+    }
+
+    // hot path: one stage took `cycles`
+    void add(size_t stage, uint32_t cycles) {
+      record(_stages[stage], cycles);
+    }
+
+    // timer job `fn` took `cycles`
+    void addJob(TimerCallback fn, uint32_t cycles) {
+      size_t j = 0;
+      while ((j < LOOP_STATS_JOBS - 1) && (_jobFn[j] != fn)) {
+        j++;
+      }
+      record(_jobs[j], cycles);
+    }
+
+    /************************************************************
+     * Give a timer job its own histogram
+     * @param[in] fn   callback passed to every() / after()
+     * @param[in] name key in the metrics document (static)
+     * @return false if the table is full (counted as "other")
+     ************************************************************/
+    bool nameJob(TimerCallback fn, const char* name) {
+      for (size_t j = 0; j < LOOP_STATS_JOBS - 1; j++) {
+        if (!_jobFn[j] || (_jobFn[j] == fn)) {
+          _jobFn[j] = fn;
+          _jobName[j] = name;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // close the interval and start a new one (reporting side)
+    void newInterval(uint32_t nowMs) {
+      _closedMs = nowMs - _intervalAt;
+      _intervalAt = nowMs;
+      _epoch.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // the application pass (LOOP_STAGE_LOOP) left the closed interval
+    bool settled(void) const {
+      uint32_t epoch = _epoch.load(std::memory_order_relaxed);
+      return _stages[LOOP_STAGE_LOOP].epoch[epoch & 1].load(std::memory_order_acquire) == epoch;
+    }
+
+    // histogram of the closed interval, nullptr if it had none
+    const LogHistogram<LOOP_HIST_BUCKETS>* stage(size_t stage) const {
+      return closed(_stages[stage]);
+    }
+    const LogHistogram<LOOP_HIST_BUCKETS>* job(size_t j) const {
+      return closed(_jobs[j]);
+    }
+    const char* jobName(size_t j) const     { return _jobName[j]; }
+    uint32_t    closedMs(void) const        { return _closedMs; }
+
+  private:
+    Stage                 _stages[LOOP_STAGE_COUNT] = {};
+    Stage                 _jobs[LOOP_STATS_JOBS] = {};
+    TimerCallback         _jobFn[LOOP_STATS_JOBS];
+    const char*           _jobName[LOOP_STATS_JOBS];
+    std::atomic<uint32_t> _epoch{0};
+    uint32_t              _intervalAt = 0;  // millis() of the last newInterval()
+    uint32_t              _closedMs = 0;    // length of the closed interval
+
+    void record(Stage& s, uint32_t cycles) {
+      uint32_t epoch = _epoch.load(std::memory_order_relaxed);
+      size_t   i = epoch & 1;
+      if (s.epoch[i].load(std::memory_order_relaxed) != epoch) {
+        s.cycles[i].reset();
+        s.epoch[i].store(epoch, std::memory_order_release);
+      }
+      s.cycles[i].add(cycles);
+    }
+
+    const LogHistogram<LOOP_HIST_BUCKETS>* closed(const Stage& s) const {
+      uint32_t epoch = _epoch.load(std::memory_order_relaxed) - 1;
+      size_t   i = epoch & 1;
+      return ((s.epoch[i].load(std::memory_order_acquire) == epoch) && s.cycles[i].count()) ? &s.cycles[i] : nullptr;
+    }
+};
+
+extern LoopStats g_LoopStats;
+
+#else
+
+#define LOOP_STAGE(stage, call)  call
+
+#endif // LOOP_STATS
+
+#endif // _LOOPSTATS_H_
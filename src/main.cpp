@@ -28,13 +28,37 @@
 #include <PubSubClient.h>        // MQTT  
 #include <ESPmDNS.h>             // for OTA-Update
 #include <ArduinoOTA.h>          // for OTA-Update
-#include <CommandParser.h>       // To Parse MQTT Commands
+#include <Wire.h>                // I2C
 #include <SimpleTime.h>          // Time Conversions 
 // Own Project Files
 #include <prototypes.h>          // Prototypes 
+#include <settings.h>            // Buffers and Timings (shared with the native fleet)
 #include <myHWconfig.h>          // Hardware Wireing
 #include <Version.h>             // Automatic Version Incrementing (triggered by Upload to Production)
 #include <debugOptions.h>        // Debugging [my be improved]
+#include <mqttTopics.h>          // MQTT Topics (MQTT_PREFIX joined at compile time)
+#include <commandRegistry.h>     // To Parse MQTT Commands (compile-time command table)
+#include <commandBatch.h>        // Command batches on the cmd topic (aggregated result)
+#include <telemetryFields.h>     // Telemetry documents (JSON / CBOR / MessagePack)
+#include <netState.h>            // WiFi / MQTT state machine
+#include <tcpConnect.h>          // Non-blocking TCP connect to the broker
+#include <deviceFacts.h>         // Device facts, read once at boot
+#include <timerWheel.h>          // Timer Jobs (periodic and one-shot)
+#include <outbox.h>              // Offline Outbox (store and forward)
+#ifdef OUTBOX_SPILL_PARTITION
+  #include <outboxSpill.h>       // Outbox spill to a flash partition
+#endif
+#include <taskSplit.h>           // Dual-core: network task, SPSC queues
+#include <irqEvents.h>           // IRQ event ring, debounce, statistics
+#include <mcp23017.h>            // MCP 23017 I/O expanders (I2C)
+#include <roller.h>              // Roller shutter engine
+#include <loopStats.h>           // Loop stage histograms (LOOP_STATS, debugOptions.h)
+#include <binLog.h>              // Binary log (LOG_LEVEL_..., debugOptions.h)
+#include <otaDelta.h>            // Delta OTA (patch of tools/otadelta.py on TOPIC_OTA)
+#include <cmdProbe.h>            // Command latency probe (cycle stamps in the result)
+#include <idleWait.h>            // Tickless idle (IDLE_WAIT, IDLE_LIGHT_SLEEP)
+#include <mqttRx.h>              // MQTT receive task (MQTT_RX_TASK)
+#include <mqttQos.h>             // QoS 1 publishing (MQTT_QOS1)
 
 
 /************************************************************
@@ -60,9 +84,8 @@
 
 /************************************************************
  * MQTT-Settings
+ * - Topics and MQTT_PREFIX: see mqttTopics.h
  ************************************************************/ 
-// Prefix for MQTT Topics should be defined in plattformio.ini
-// e.g.: build_flags = '-DMQTT_PREFIX="homectrl/tisch"'
 #ifndef  MQTT_SERVER    
   #define MQTT_SERVER "mqtt.example.de"
 #endif
@@ -75,23 +98,11 @@
 #ifndef  MQTT_PASS
   #define MQTT_PASS ""
 #endif
-#ifndef MQTT_PREFIX
-  #define MQTT_PREFIX "esp32/default"
-#endif
+// optional Failover-Brokers, tried in this order after MQTT_SERVER (same port, user and password)
+// e.g.: build_flags = '-DMQTT_SERVER_2="mqtt2.example.de"'
+//   MQTT_SERVER_2, MQTT_SERVER_3
 
-// MQTT-Connection Settings
-#define MQTT_BUFSIZE   2048                       // MQTT-Buffersize (may be augmented, when Scan returns many BLE-Devices
-// Topic used to subscribe, MQTT_PREFIX will be added
-#define T_CMD          "cmd"                      // Topic for Commands (subscribe) (MQTT_PREFIX will be added)
-// Topics used to publish, MQTT_PREFIX will be added
-#define T_CPU          "cpu"                      // Topic for CPU Status
-#define T_LOG          "log"                      // Topic for Logging
-#define T_NETWORK      "network"                  // Topic for Network Status 
-#define T_RESULT       "result"                   // Topic for Commands Responses
-#define T_SKETCH       "sketch"                   // Topic for Sketch Status 
-#define T_STATUS       "status"                   // Topic for Online-Status 'ONLINE/OFFLINE' (published at birth and lastwill) (MQTT_PREFIX will be added)
-#define STATUS_MSG_ON  "ONLINE"                   // Online Message
-#define STATUS_MSG_OFF "OFFLINE"                  // Last Will Message
+// MQTT-Connection Settings (MQTT_BUFSIZE, log batch, outbox drain): see settings.h
 
 /************************************************************
  * Debug LED
@@ -99,21 +110,14 @@
 #define DBG_LED 2
 
 /************************************************************
- * Timings
+ * Timings: T_... see settings.h
  ************************************************************/ 
-#define T_HEARTBEAT_1S         1000  // cron every 1 second
-#define T_HEARTBEAT_10S       10000  // cron every 10 seconds
-#define T_HEARTBEAT_30S       30000  // cron every 30 seconds
-#define T_HEARTBEAT_60S       60000  // cron every 60 seconds
-#define T_STATE_LONG          60000  // Print detailed Status every 1 minute
-#define T_STATE_SHORT          1000  // Print Status every 1 second
-#define T_MQTT_RECONNECT       5000  // How often check MQTT: 5 seconds
-#define T_NET_MONITORING      10000  // How often check Wifi: 10 seconds 
-#define T_WIFI_MAX_TRIES         10  // Howoften retry to reconnect Wifi: 10 (repeated later)
-#define T_REBOOT_TIMEOUT       5000  // ms until Reboot is triggered when g_rebootActive = true
 
-// Roller
-#define NUM_ROLLERS               4   // No of Rollers to be configured 
+// Roller (NUM_ROLLERS: see roller.h)
+// - relays: MCP port A, roller i: up = bit 2*i, down = bit 2*i+1 (chip i/4)
+// - buttons: MCP port B, roller i: up = bit 8+2*i, down = bit 8+2*i+1 (chip i/4), active low
+#define ROLLER_UP_MS   {30000, 30000, 30000, 30000}   // calibrated travel time 100% -> 0% per roller
+#define ROLLER_DOWN_MS {28000, 28000, 28000, 28000}   // calibrated travel time 0% -> 100% per roller
 
 
 /************************************************************
@@ -123,684 +127,2518 @@
 WiFiClient myWiFiClient;
 // MQTT Client
 PubSubClient mqtt(MQTT_SERVER, MQTT_PORT, myWiFiClient);
-// IRQ Handling
-portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
-// CommandParser
-typedef CommandParser<> MyCommandParser;
-MyCommandParser parser;
-// Command Handler Prototypes
-void cmd_hello(MyCommandParser::Argument *args, char *response);
-void cmd_helloadd(MyCommandParser::Argument *args, char *response);
-void cmd_helloecho(MyCommandParser::Argument *args, char *response);
-void cmd_reset(MyCommandParser::Argument *args, char *response);
+// MQTT Brokers, in the order they are tried
+const char* const g_MqttServers[] = {
+  MQTT_SERVER,
+#ifdef MQTT_SERVER_2
+  MQTT_SERVER_2,
+#endif
+#ifdef MQTT_SERVER_3
+  MQTT_SERVER_3,
+#endif
+};
+static_assert(countof(g_MqttServers) <= NET_MAX_BROKERS, "too many MQTT servers");
+// Outbox policy per topic (topics not listed: OUTBOX_KEEP_ALL)
+const OutboxRule g_OutboxRules[] = {
+  {TOPIC_CPU,     OUTBOX_KEEP_LATEST},
+  {TOPIC_NETWORK, OUTBOX_KEEP_LATEST},
+  {TOPIC_IRQ,     OUTBOX_KEEP_LATEST},
+  {TOPIC_ROLLER,  OUTBOX_KEEP_LATEST},
+  {TOPIC_METRICS, OUTBOX_KEEP_LATEST},
+  {TOPIC_SKETCH,  OUTBOX_NONE},              // retried by jobSketchState()
+  {TOPIC_RESULT,  OUTBOX_KEEP_ALL},
+  {TOPIC_LOG,     OUTBOX_NONE},              // held in g_LogBatch (jobLogFlush), never ahead of a result
+  {TOPIC_OTA_ACK, OUTBOX_NONE},              // the host sends the chunk again
+};
+// Topics published with QoS 1 (MQTT_QOS1, see mqttQos.h)
+const char* const g_Qos1Topics[] = {
+  TOPIC_RESULT,
+};
+// Command Handler Prototypes (Command Table: see g_CommandDefs)
+void cmd_hello(char *response);
+void cmd_helloadd(char *response, uint64_t sum1, uint64_t sum2);
+void cmd_helloecho(char *response, const char *str);
+void cmd_probe(char *response, uint64_t seq);
+void cmd_reset(char *response);
+void cmd_roller(char *response, uint64_t id, uint64_t percent);
+void cmd_rollers(char *response, uint64_t mask, uint64_t percent);
+void cmd_rollerstop(char *response, uint64_t mask);
 
 /************************************************************
  * Global Vars
  ************************************************************/ 
 boolean     g_Firstrun; 
-// Monitoring
-uint32_t    g_LastHeartbeat_1s; 
-uint32_t    g_LastHeartbeat_10s;
-uint32_t    g_LastHeartbeat_30s;
-uint32_t    g_LastHeartbeat_60s;
-uint32_t    g_LastMqttReconnectAttempt;
-uint32_t    g_LastStateLong;
-uint32_t    g_LastStateShort;
-uint32_t    g_LastNetMonitoring;
-uint32_t    g_LastRollerMonitoring;
+// Timer Jobs
+TimerWheel<TIMER_JOBS> g_Timers;
 uint8_t     g_LedState;
 // MQTT
-uint32_t    g_MqttReconnectCount;
+char        g_TelemetryBuf[TELEMETRY_BUFSIZE];   // send...State() of the network side (not sendRollerState)
+Outbox<OUTBOX_SIZE> g_Outbox;              // messages published while offline
+#ifdef OUTBOX_SPILL_PARTITION
+PartitionSpill g_OutboxSpill;              // evicted outbox messages (flash)
+#endif
+// Device
+DeviceFacts g_DeviceFacts;                     // read once in setupDeviceFacts()
 // Wifi
-boolean     g_wificonnected;
+NetState    g_Net;                         // WiFi / MQTT state machine (see netState.h)
+RTC_DATA_ATTR NetCache g_NetCache;         // last BSSID, channel and lease (survives reboot)
 const char* g_wifissid = WIFI_SSID;
 const char* g_wifipass = WIFI_PSK;
 const char* g_otahash = OTA_HASH;
+OtaDelta    g_OtaDelta;                    // delta OTA, network side (see otaDelta.h)
+uint32_t    g_OtaStartMs;                  // millis() of the ArduinoOTA start
+uint32_t    g_OtaTotal;                    // image bytes of the ArduinoOTA update
+uint32_t    g_OtaProgressMs;               // millis() of the last progress entry
 // IRQ
-volatile boolean g_IrqFlag;
-boolean     g_LastIRQ;
+IrqRing<IRQ_RING_SIZE> g_IrqRing;          // irqHandler -> irqDrain (see irqEvents.h)
+IrqState    g_Irq;                         // debounce and statistics
+SeqSnapshot<IrqReport> g_IrqSnapshot;      // statistics of g_Irq for the network task
+IrqReport   g_IrqReport;                   // IRQ_STATE_FIELDS (sendIrqState)
+Mcp23017    g_Mcp[MCP_COUNT];              // I/O expanders (see myHWconfig.h)
+// Roller
+static_assert(NUM_ROLLERS <= 4 * MCP_COUNT, "two relays per roller on port A");
+const uint32_t g_RollerUpMs[NUM_ROLLERS] = ROLLER_UP_MS;
+const uint32_t g_RollerDownMs[NUM_ROLLERS] = ROLLER_DOWN_MS;
+RollerBank<NUM_ROLLERS> g_Rollers;         // positions, relays (see roller.h)
+uint32_t    g_RollerRelays;                // relay bits on the MCP outputs
+uint32_t    g_RollerBusy;                  // g_Rollers.busy() of the last pass
+boolean     g_RollerStatePending;          // positions changed, not published yet
+uint32_t    g_RollerPublishedAt;           // millis() of the last roller state
+uint32_t    g_RollerPercent[NUM_ROLLERS];  // positions for ROLLER_STATE_FIELDS
+// Log
+const char  g_LogAnchor[] = "binlog";      // format ids are offsets from here (see binLog.h)
+BinLog<LOG_RING_SIZE> g_Log;               // entries of loop() and the network task
+uint8_t     g_LogBatch[LOG_BATCH_SIZE];    // frames for the next TOPIC_LOG publish
+size_t      g_LogBatchLen;
+uint32_t    g_LogBatchDropped;             // frames dropped: batch full while offline
+boolean     g_LogWaiting;                  // a frame waits for room in the UART (logDrain)
+#if LOOP_STATS
+// Loop Statistics
+LoopStats   g_LoopStats;                   // cycle histograms per stage and timer job (see loopStats.h)
+#endif
 // Reboot Timer
-boolean     g_rebootActive;                // if true trigger reeboot 5s after g_reboot_triggered
-uint32_t    g_rebootTriggered;             // millis() when reboot was started
+int         g_rebootJob;                   // Timer Job of a pending reboot (TIMER_NONE: none)
+std::atomic<bool> g_rebootRequest;         // command "reset" received (scheduled by netLoop)
+// Task Split (see taskSplit.h)
+SpscRing<CMD_QUEUE_SIZE> g_CmdQueue;       // mqttCallback / rxTask -> appLoop
+CmdProbe    g_Probe;                       // stations of the running batch (see cmdProbe.h)
+SpscRing<PUB_QUEUE_SIZE> g_PubQueue;       // mqttPub (application) -> netLoop
+TaskSplitStats g_TaskStats;
+TaskHandle_t volatile g_NetTask;           // network task (nullptr: single loop())
+volatile boolean g_NetTaskStop;            // ask the network task to end (stopNetTask)
+// Idle (see idleWait.h)
+boolean     g_IdleOn;                      // loop() and the network task sleep between passes
+IdleStats   g_IdleLoop;                    // loop() (dual-core: application)
+IdleStats   g_IdleNet;                     // network task (dual-core)
+uint32_t    g_IdlePercent[2];              // for CPU_STATE_FIELDS: loop(), network task
+uint32_t    g_IdleWakes[IDLE_WAKE_COUNT];  // for CPU_STATE_FIELDS: both tasks
+// MQTT Receive Task (see mqttRx.h)
+TaskHandle_t volatile g_RxTask;            // nullptr: mqtt.loop() reads the socket
+volatile boolean g_RxTaskStop;             // ask the receive task to end (stopRxTask)
+MqttRxGate  g_RxGate;                      // socket handover network side <-> rxTask
+MqttRxDecoder<MQTT_BUFSIZE> g_RxDecoder;   // packet being received (rxTask only)
+SpscRing<RX_NET_QUEUE_SIZE> g_RxNetQueue;  // rxTask -> mqttRxLoop (TOPIC_OTA)
+MqttRxStats g_RxStats;
+std::atomic<uint32_t> g_RxLastIn;          // millis() of the last inbound bytes
+std::atomic<bool> g_RxLost;                // socket closed or protocol error (rxTask)
+uint32_t    g_RxPingAt;                    // millis() of the PINGREQ without answer, 0: none
+// QoS 1 Publishing (see mqttQos.h)
+boolean     g_QosOn;                       // g_Qos1Topics as QoS 1 while the receive task runs
+MqttQosWindow<MQTT_QOS_SLOTS, MQTT_QOS_BUFFER> g_QosWindow;   // packets in flight
+MqttQosStats g_QosStats;
 boolean     g_lastDebug;
 
 
 /************************************************************
  * IRQ Handler
- * - called whenever GPIO goes low
+ * - called on every edge of INT_PIN
+ * - only queues cycle count and pin level, irqDrain() does
+ *   the rest (a full ring counts an overflow)
+ * - wakes the idle loop (IDLE_EV_IRQ)
  ************************************************************/ 
 void IRAM_ATTR irqHandler(void){
-  portENTER_CRITICAL(&mux);
-  g_IrqFlag = true;
-  portEXIT_CRITICAL(&mux);    
+  g_IrqRing.push(IRQ_CYCLES(), IRQ_PIN_LEVEL(INT_PIN));
+  idleWakeFromISR(IDLE_EV_IRQ);
 }
 
 
 /************************************************************
- * Command "hello"
- * - Return: `world` 
+ * IRQ Drain
+ * - from appLoop(): takes all events of g_IrqRing
+ * - latency ISR -> here and events per second into the
+ *   histograms of g_Irq, a copy for the network task after a
+ *   pass that changed them (irqReport)
+ * - debounce: an edge is accepted after IRQ_DEBOUNCE_US
+ *   without a further event, then irqEdge() is called with
+ *   the cycle count of the first edge of the burst
+ * - cycle counts are per core: the ISR is attached by setup()
+ *   on the core of loop(), which also runs appLoop()
+ * - cycles of the stamp clock: us with IDLE_LIGHT_SLEEP (see
+ *   idleWait.h)
  ************************************************************/ 
-void cmd_hello(MyCommandParser::Argument *args, char *response) {  
-  String msgStr;  
-  msgStr = "world";  
-  msgStr.toCharArray(response, MyCommandParser::MAX_RESPONSE_SIZE);
+void irqDrain(void) {
+  IrqEvent ev;
+  uint32_t cyclesPerUs = STAMP_PER_US(g_DeviceFacts.cpuFreqMHz);
+  boolean  changed = false;
+  while (g_IrqRing.pop(ev)) {
+    changed = true;
+    g_Irq.events++;
+    g_Irq.latency.add((IRQ_CYCLES() - ev.cycles) / cyclesPerUs);
+    if (ev.cycles - g_Irq.windowAt >= cyclesPerUs * 1000000u) {
+      if (g_Irq.windowEvents) {
+        g_Irq.rate.add(g_Irq.windowEvents);
+        g_Irq.maxRate = (g_Irq.windowEvents > g_Irq.maxRate) ? g_Irq.windowEvents : g_Irq.maxRate;
+      }
+      g_Irq.windowAt = ev.cycles;
+      g_Irq.windowEvents = 0;
+    }
+    g_Irq.windowEvents++;
+    if (!g_Irq.pending) {
+      g_Irq.pending = true;
+      g_Irq.burst = 0;
+      g_Irq.edgeAt = ev.cycles;
+    }
+    g_Irq.burst++;
+    g_Irq.pendingLevel = (uint8_t)ev.level;
+    g_Irq.lastAt = ev.cycles;
+  }
+  if (g_Irq.pending && (IRQ_CYCLES() - g_Irq.lastAt >= IRQ_DEBOUNCE_US * cyclesPerUs)) {
+    uint8_t level = g_Irq.pendingLevel;
+    if (g_IrqRing.overflows() != g_Irq.overflowsSeen) {
+      g_Irq.overflowsSeen = g_IrqRing.overflows();
+      level = digitalRead(INT_PIN);        // the last edge may be lost
+    }
+    g_Irq.pending = false;
+    changed = true;
+    if (level == g_Irq.stable) {
+      g_Irq.bounced += g_Irq.burst;        // back at the old level: glitch
+    } else {
+      g_Irq.stable = level;
+      g_Irq.accepted++;
+      g_Irq.bounced += g_Irq.burst - 1;
+      irqEdge(level, g_Irq.edgeAt);
+    }
+  }
+  if (changed) {
+    irqReport();
+  }
 }
 
 
 /************************************************************
- * Command "helloadd SUM1 SUM2"
- * - Return: `The Answer is: [SUM1+SUM2]` 
+ * Publish the IRQ Statistics to the other Tasks
+ * - a copy in g_IrqSnapshot: jobIrqState() runs on the
+ *   network task, g_Irq is written here only
  ************************************************************/ 
-void cmd_helloadd(MyCommandParser::Argument *args, char *response) {  
-  uint32_t sum1;
-  uint32_t sum2;
-  String msgStr;  
-  sum1 = (uint32_t) args[0].asUInt64;
-  sum2 = (uint32_t) args[1].asUInt64;
-  msgStr = "The Answer is: ";  
-  msgStr.concat(sum1 + sum2);
-  msgStr.toCharArray(response, MyCommandParser::MAX_RESPONSE_SIZE);
+void irqReport(void) {
+  static IrqReport r;
+  r.events = g_Irq.events;
+  r.accepted = g_Irq.accepted;
+  r.bounced = g_Irq.bounced;
+  r.overflows = g_IrqRing.overflows();
+  r.maxRate = g_Irq.maxRate;
+  r.latency = g_Irq.latency;
+  r.rate = g_Irq.rate;
+  g_IrqSnapshot.publish(r);
 }
 
+
 /************************************************************
- * Command "helloecho STRING"
- * - Return: `[STRING]` 
+ * IRQ Edge (debounced)
+ * - INT_PIN changed to level, first edge at cycles
+ * - low: an MCP 23017 has an interrupt
+ ************************************************************
+ * @param[in] level  new level of INT_PIN
+ * @param[in] cycles cycle count of the first edge
  ************************************************************/ 
-void cmd_helloecho(MyCommandParser::Argument *args, char *response) {      
-  String msgStr;  
-  msgStr = String(args[0].asString);  
-  msgStr.toCharArray(response, MyCommandParser::MAX_RESPONSE_SIZE);
+void irqEdge(uint8_t level, uint32_t cycles) {
+  LOGD(IRQ, "IRQ: INT_PIN %s (%u us ago)", level ? "HIGH" : "LOW",
+       (unsigned)((IRQ_CYCLES() - cycles) / STAMP_PER_US(g_DeviceFacts.cpuFreqMHz)));
+  if (level == LOW) {
+    mcpService();
+  }
 }
 
 
 /************************************************************
- * Command "reset"
- * - Reboot ESP32
+ * MCP Service
+ * - one burst read (INTF, INTCAP, GPIO) per chip, which also
+ *   releases its INT; again while INT_PIN stays low (a chip
+ *   got a new change meanwhile)
+ * - the rising edge of INT_PIN caused by the reads is not a
+ *   new interrupt: the level read now becomes the stable one
  ************************************************************/ 
-void cmd_reset(MyCommandParser::Argument *args, char *response) {
-  String msgStr;  
-  msgStr = "Rebooting in 5 seconds ... [please standby]: ";
-  g_rebootActive = true;
-  g_rebootTriggered = millis();
-  msgStr.toCharArray(response, MyCommandParser::MAX_RESPONSE_SIZE);    
+void mcpService(void) {
+  McpInterrupt irq;
+  for (uint8_t pass = 0; pass < MCP_SERVICE_PASSES; pass++) {
+    for (uint8_t i = 0; i < MCP_COUNT; i++) {
+      uint16_t last = g_Mcp[i].inputs();
+      if (g_Mcp[i].present() && g_Mcp[i].readInterrupt(irq)) {
+        uint16_t changed = (irq.flags | (irq.gpio ^ last)) & MCP_INPUTS;
+        if (changed) {
+          mcpInputs(i, changed, irq.gpio & MCP_INPUTS);
+        }
+      }
+    }
+    if (digitalRead(INT_PIN) == HIGH) {
+      break;
+    }
+  }
+  g_Irq.stable = digitalRead(INT_PIN);
 }
 
 
 /************************************************************
- * Compose ClientID
- * - clientId = "esp32_"+ MAC 
+ * MCP Inputs changed
+ * - APP Handler: inputs of an MCP 23017
+ ************************************************************
+ * @param[in] chip    index in g_Mcp
+ * @param[in] changed inputs that changed (or toggled and
+ *                    returned) since the last read
+ * @param[in] inputs  levels of the inputs now
  ************************************************************/ 
-String composeClientID(void) {
-  String myClientId;
-  uint8_t myMac[6];
-  WiFi.macAddress(myMac);  
-  myClientId = ("esp32_");  
-  for (int i=3; i<6; ++i) {
-    myClientId.concat(String(myMac[i], 16));    
-    if (i < 5)
-      myClientId.concat('-');
-  }  
-  return myClientId;
+void mcpInputs(uint8_t chip, uint16_t changed, uint16_t inputs) {
+  LOGD(IRQ, "MCP %u: changed 0x%04x inputs 0x%04x", chip, changed, inputs);
+  uint16_t pressed = changed & ~inputs;    // buttons are active low
+  for (uint8_t k = 0; k < 4; k++) {
+    uint8_t roller = chip * 4 + k;
+    uint8_t buttons = (pressed >> (8 + 2 * k)) & 0x03;
+    if ((roller < NUM_ROLLERS) && buttons) {
+      rollerButton(roller, buttons);
+    }
+  }
 }
 
 
 /************************************************************
- * Debug Print String
- * - to Serial Console 
- * - MQTT-Message to TOPIC_LOG
- * @param[in] mes Message to be send
+ * Roller Button pressed
+ * - stops a roller that is moving (or about to)
+ * - else up: move to 0%, down: move to 100%
+ ************************************************************
+ * @param[in] roller  index of the roller
+ * @param[in] buttons bit 0: up, bit 1: down
  ************************************************************/ 
-void dbgout(String msg){  
-  mqttPub (T_LOG, msg, false);
+void rollerButton(uint8_t roller, uint8_t buttons) {
+  if (g_Rollers.busy() & (1u << roller)) {
+    g_Rollers.stop(roller);
+  } else {
+    g_Rollers.moveTo(roller, (buttons & 0x01) ? 0 : 100);
+  }
 }
 
 
 /************************************************************
- * Monitor Connections
- * - Check Wifi (and reconnect)
- * - Check MQTT (and reconnect)
- * TODO: reconnect on wifi error without rebooting!
- ************************************************************/ 
-void monitorConnections(void) {  
-  // Monitor WIFI- and MQTT-Connection   
-  if (millis() - g_LastNetMonitoring > T_NET_MONITORING) {    
-    // Monitor WIFI-Connection   
-    g_LastNetMonitoring = millis();
-    DBG_MONITOR.print("!!! WiFi localIP: ");
-    DBG_MONITOR.println(WiFi.localIP());    
-    if ((WiFi.status() != WL_CONNECTED) || (WiFi.localIP()[0] == 0)) {      
-      DBG_ERROR.println("WiFi CONNECTION LOST");
-      DBG_ERROR.println("reconnecting ...");
-      WiFi.disconnect();
-      WiFi.reconnect();
-      if (WiFi.status() != WL_CONNECTED) {      
-        DBG_ERROR.println("WiFi RECONNECTION FAILED, TRYING AGAIN LATER");  
-        DBG_MONITOR.println("Not Monitoring MQTT because WiFi OFFLINE");     
-        g_wificonnected = false;
-      } else {        
-        DBG_ERROR.println("WiFi CONNECTION RESTORED");
-        g_wificonnected = true;
-      }
-    } else {        
-        DBG_MONITOR.println("Monitoring WiFi... ONLINE");
-        g_wificonnected = true;
-    }
-    // Monitor MQTT-Connection
-    if (g_wificonnected){
-      DBG_MONITOR.print("!!! MQTT: ");      
-      if (!mqtt.connected()) {        
-        if (millis() - g_LastMqttReconnectAttempt > T_MQTT_RECONNECT) {
-          g_LastMqttReconnectAttempt = millis();
-          g_MqttReconnectCount++;
-          DBG_ERROR.print("MQTT Connection lost! - Error:");
-          DBG_ERROR.println("mqtt.state()");
-          DBG_ERROR.print(" - trying to reconnect [");
-          DBG_ERROR.print(g_MqttReconnectCount);
-          DBG_ERROR.println("]... ");      
-          // Attempt to reconnect
-          String myClientID;
-          myClientID = composeClientID();
-          if (mqtt.connect(myClientID.c_str(), MQTT_USER, MQTT_PASS, MQTT_PREFIX "/" T_STATUS, 1, true, STATUS_MSG_OFF, true))  { 
-            // connected: publish Status ONLINE
-            mqtt.publish(MQTT_PREFIX "/" T_STATUS, STATUS_MSG_ON, true);
-            // resubscribe
-            mqtt.subscribe(MQTT_PREFIX "/" T_CMD);          
-            g_LastMqttReconnectAttempt = 0;
-            g_MqttReconnectCount = 0;
-            DBG_ERROR.println("MQTT SUCCESSFULLY RECONNECTED");
-          } else {
-            DBG_ERROR.println("MQTT RECONNECTION FAILED");
-          } 
-        } 
-      } else {
-        DBG_MONITOR.println("... ONLINE");             
-      }
+ * Roller Loop
+ * - from appLoop(): advance all rollers
+ * - relays: one write per MCP whose outputs change (the
+ *   shadows skip the others); retried on the next pass
+ *   after a bus error
+ * - positions are published when a roller starts or stops,
+ *   at most every T_ROLLER_PUBLISH; here on the application
+ *   side, where tick() changes g_Rollers (mqttPub queues to
+ *   the network task in dual-core), retried if not handed
+ ************************************************************/ 
+void rollerLoop(void) {
+  uint32_t relays = g_Rollers.tick(micros());
+  if (relays != g_RollerRelays) {
+    boolean ok = true;
+    for (uint8_t i = 0; i < MCP_COUNT; i++) {
+      ok &= g_Mcp[i].write(0x00ff, (uint16_t)((relays >> (8 * i)) & 0xff));
+    }
+    if (ok) {
+      g_RollerRelays = relays;
+    } else {
+      LOGE(IRQ, "Roller: relay write failed");
     }
-  } 
+  }
+  if (g_Rollers.busy() != g_RollerBusy) {
+    g_RollerBusy = g_Rollers.busy();
+    g_RollerStatePending = true;
+  }
+  if (g_RollerStatePending && (millis() - g_RollerPublishedAt >= T_ROLLER_PUBLISH)) {
+    g_RollerPublishedAt = millis();
+    g_RollerStatePending = !sendRollerState(true);
+  }
 }
 
 
 /************************************************************
- * MQTT Message Received
- * - Callback function started when MQTT Message received
- * - convert Payload to lower case
- * - 
- * @param[in] topic Topic received
- * @param[in] topic Message received
- * @param[in] length Length of the Message received
+ * Command "hello"
+ * - Return: `world` 
  ************************************************************/ 
-void mqttCallback(char* topic, byte* payload, unsigned int length) {  
-  String msg;  
-  char* myBuf = (char*)malloc(length + 1);    
-  char response[MyCommandParser::MAX_RESPONSE_SIZE];
-  // copy Buffer to String
-  //   payload[length] = '\0';  // ensure that buffer is null-terminated
-  //   msg = String((char*)payload);
-  // Copy payload to new buffer and add '0x00' to the end
-  for (int i=0; i<length; i++) {
-    myBuf [i] = payload [i] ;
-  }
-  myBuf[length] = '\0';
-  // Convert Buffer to String
-  msg = String((char*)myBuf);    
-  // convert String to Lower-Case
-  msg.toLowerCase();
-  // Echo String
-  dbgout("received MQTT-Message: \"" + msg + "\"");
-  // Parse Command    
-  msg.toCharArray(myBuf, msg.length() + 1);    
-  parser.processCommand(myBuf, response);            
-  // Publish Result;
-  mqttPub (T_RESULT, String(response), false);
-  // free(msgBuf);
-  free(myBuf);
+void cmd_hello(char *response) {  
+  snprintf(response, CMD_RESPONSE_SIZE, "world");
 }
 
 
 /************************************************************
- * Publish & Print Message
- * - to Serial Console
- *   - if mqttOnly is false
- * - Publish MQTT-Message to topic MQTT_PREFIX/TOPIC_LOG
- *   - MQTT_PREFIX is added by this function
- * @param[in] topic MQTT-SubTopic (MQTT_PREFIX will be added)
- * @param[in] msg Message to be send
- * @param[in] mqttOnly if false, then also Serial Output is generated
+ * Command "helloadd SUM1 SUM2"
+ * - Return: `The Answer is: [SUM1+SUM2]` 
  ************************************************************/ 
-void mqttPub(String subtopic, String msg, boolean mqttOnly){  
-  String myTopic;
-  // Serial
-  if (!mqttOnly) {
-    DBG.println(msg);    
-  }  
-  // MQTT Topic
-  myTopic = MQTT_PREFIX;
-  myTopic.concat("/" + subtopic);
-  char* topicBuf = (char*)malloc(myTopic.length() + 1);  // allocate memory
-  myTopic.toCharArray(topicBuf, myTopic.length() + 1);  
-  // MQTT Message
-  char* msgBuf = (char*)malloc(msg.length() + 1);  // allocate memory
-  msg.toCharArray(msgBuf, msg.length() + 1);  
-  if (mqtt.connected()) {
-    mqtt.publish(topicBuf, msgBuf);
-  } else {
-    DBG_ERROR.println("ERROR: MQTT-Connection lost");
-  }
-  free(msgBuf);
-  free(topicBuf);
+void cmd_helloadd(char *response, uint64_t sum1, uint64_t sum2) {  
+  snprintf(response, CMD_RESPONSE_SIZE, "The Answer is: %lu", (unsigned long)((uint32_t)sum1 + (uint32_t)sum2));
 }
 
-
 /************************************************************
- * cronjob
- * - execute things periodicaly
- * 
+ * Command "helloecho STRING"
+ * - Return: `[STRING]` 
  ************************************************************/ 
-void cronjob(void) {
-  // once a second
-  if ((millis() - g_LastHeartbeat_1s) > T_HEARTBEAT_1S) {
-    g_LastHeartbeat_1s = millis();    
-    oncePerSecond();  
-    if ((millis() - g_LastHeartbeat_10s) > T_HEARTBEAT_10S) {
-      g_LastHeartbeat_10s = g_LastHeartbeat_1s;    
-      oncePerTenSeconds();
-      if ((millis() - g_LastHeartbeat_30s) > T_HEARTBEAT_30S) {
-        g_LastHeartbeat_30s = g_LastHeartbeat_1s;    
-        oncePerThirtySeconds();
-        if ((millis() - g_LastHeartbeat_60s) > T_HEARTBEAT_60S) {
-          g_LastHeartbeat_60s = g_LastHeartbeat_1s;    
-          oncePerMinute();
-        }
-      }
-    }
-  }
+void cmd_helloecho(char *response, const char *str) {      
+  snprintf(response, CMD_RESPONSE_SIZE, "%s", str);
 }
 
 
 /************************************************************
- * Once per Second
- * - execute things once every second
+ * Command "probe SEQ"
+ * - latency probe: runCommands() replaces the result with
+ *   the cycle stamps of this message (see cmdProbe.h)
+ * - Return: `probe [SEQ] mhz=[MHZ] start=[C] end=[C] pub=[C]`
  ************************************************************/ 
-void oncePerSecond(void) {
-  // Insert here Actions, which should occure every Second
+void cmd_probe(char *response, uint64_t seq) {
+  g_Probe.seq = (uint32_t)seq;
+  g_Probe.pending = true;
+  snprintf(response, CMD_RESPONSE_SIZE, "probe %lu", (unsigned long)seq);
 }
 
 
 /************************************************************
- * Once per 10 Seconds
- * - execute things once every 10 seconds
+ * Command "reset"
+ * - Reboot ESP32
  ************************************************************/ 
-void oncePerTenSeconds(void) {
-  // Insert here Actions, which should occure every 10 Seconds
-  sendCPUState(true);
+void cmd_reset(char *response) {
+  g_rebootRequest = true;          // the Timer Jobs belong to the network side
+  snprintf(response, CMD_RESPONSE_SIZE, "Rebooting in 5 seconds ... [please standby]: ");
 }
 
+
 /************************************************************
- * Once per 30 Seconds
- * - execute things once every 30 seconds
+ * Command "roller ID PERCENT"
+ * - move roller ID (0..NUM_ROLLERS-1) to PERCENT (0: open,
+ *   100: closed)
+ * - Return: `roller [ID]: [NOW]% -> [PERCENT]%` 
  ************************************************************/ 
-void oncePerThirtySeconds(void) {
-  // Insert here Actions, which should occure every 10 Seconds
-  sendNetworkState(true);
+void cmd_roller(char *response, uint64_t id, uint64_t percent) {
+  if ((id >= NUM_ROLLERS) || (percent > 100)) {
+    snprintf(response, CMD_RESPONSE_SIZE, "roller: ID 0..%u, PERCENT 0..100", NUM_ROLLERS - 1);
+    return;
+  }
+  g_Rollers.moveTo((size_t)id, (uint32_t)percent);
+  snprintf(response, CMD_RESPONSE_SIZE, "roller %u: %u%% -> %u%%", (unsigned)id,
+           (unsigned)g_Rollers.percent((size_t)id), (unsigned)percent);
 }
 
+
 /************************************************************
- * Once per 60 Seconds
- * - execute things once every minute
+ * Command "rollers MASK PERCENT"
+ * - move the rollers of MASK (bit i: roller i) to PERCENT,
+ *   they start together
+ * - Return: `rollers [MASK] -> [PERCENT]%` 
  ************************************************************/ 
-void oncePerMinute(void) {
-  // Insert here Actions, which should occure every 10 Seconds
-  sendSketchState(true);
+void cmd_rollers(char *response, uint64_t mask, uint64_t percent) {
+  mask &= (1u << NUM_ROLLERS) - 1;
+  if (!mask || (percent > 100)) {
+    snprintf(response, CMD_RESPONSE_SIZE, "rollers: MASK 1..%u, PERCENT 0..100", (1u << NUM_ROLLERS) - 1);
+    return;
+  }
+  g_Rollers.moveGroup((uint32_t)mask, (uint32_t)percent);
+  snprintf(response, CMD_RESPONSE_SIZE, "rollers 0x%x -> %u%%", (unsigned)mask, (unsigned)percent);
 }
 
+
 /************************************************************
- * Reset Handler
- * - Reboot ESP32 if 
- *   - g_rebootActive 
- *   - g_rebootTriggered was T_REBOOT_TIMEOUT ms ago (default 5000)
+ * Command "rollerstop MASK"
+ * - stop the rollers of MASK (bit i: roller i)
+ * - Return: `stopped [MASK]` 
  ************************************************************/ 
-void resetHandler() {  
-  if (g_rebootActive) {
-    if (millis() - g_rebootTriggered > T_REBOOT_TIMEOUT) {
-      g_rebootActive = false;       
-      delay(1000);      
-      ESP.restart();    
+void cmd_rollerstop(char *response, uint64_t mask) {
+  for (size_t i = 0; i < NUM_ROLLERS; i++) {
+    if (mask & (1u << i)) {
+      g_Rollers.stop(i);
     }
   }
+  snprintf(response, CMD_RESPONSE_SIZE, "stopped 0x%x", (unsigned)(mask & ((1u << NUM_ROLLERS) - 1)));
 }
 
 
 /************************************************************
- * Send CPU State
- * this will send Status of CPU as JSON Message:
- ************************************************************
- * {"Heap Size":349264,"FreeHeap":260632,"Minimum Free Heap":253140,
- *  "Max Free Heap":113792,"Chip Model":"ESP32-D0WDQ5",
- *  "Chip Revision":1,"Millis":5220121,"Cycle Count":3019255534
- * }
- ************************************************************
- * @param[in] mqttOnly if false, then also Serial Output is generated
+ * Command Table
+ * - "command", Callback-Function 
+ * - Params are taken from the parameter types of the handler
+ *   u: uint64_t, i: int64_t, d: double, s: const char*
+ * - names must be lower case (commands are lowered)
  ************************************************************/ 
-void sendCPUState(boolean mqttOnly) {    
-  String msgStr;
-  msgStr = "{";    
-  msgStr.concat("\"Heap Size\":" + String(ESP.getHeapSize()) + ",");
-  msgStr.concat("\"FreeHeap\":" + String(ESP.getFreeHeap()) + ",");
-  msgStr.concat("\"Minimum Free Heap\":" + String(ESP.getMinFreeHeap()) + ",");
-  msgStr.concat("\"Max Free Heap\":" + String(ESP.getMaxAllocHeap()) + ",");
-  msgStr.concat("\"Chip Model\":\"" + String(ESP.getChipModel()) + "\",");
-  msgStr.concat("\"Chip Revision\":" + String(ESP.getChipRevision()) + ",");
-  msgStr.concat("\"Millis\":" + String(millis()) + ",");
-  msgStr.concat("\"Cycle Count\":" + String(ESP.getCycleCount()) + "");
-  msgStr.concat("}");
-  mqttPub(T_CPU, msgStr, mqttOnly);  
-}
+constexpr CommandDef g_CommandDefs[] = {
+  CMD("hello",     cmd_hello),                  // hello
+  CMD("helloadd",  cmd_helloadd),               // helloadd [SUM1] [SUM2]
+  CMD("helloecho", cmd_helloecho),              // helloecho [STRING]
+  CMD("probe",     cmd_probe),                  // probe [SEQ]
+  CMD("reset",     cmd_reset),                  // reset
+  CMD("roller",    cmd_roller),                 // roller [ID] [PERCENT]
+  CMD("rollers",   cmd_rollers),                // rollers [MASK] [PERCENT]
+  CMD("rollerstop", cmd_rollerstop),            // rollerstop [MASK]
+};
+constexpr CommandRegistry<countof(g_CommandDefs)> g_Commands(g_CommandDefs);
+static_assert(g_Commands.valid(), "command names must be unique and lower case");
 
 
 /************************************************************
- * Send Network State
- * this will send State of Network  as JSON Message:
- ************************************************************
- * {"IP-Address":"192.168.1.42",
- *  "MQTT-ClientID":"esp32_00_00_00"  
- * }
- ************************************************************
- * @param[in] mqttOnly if false, then also Serial Output is generated
+ * Compose ClientID
+ * - clientId = "esp32_" + last 3 bytes of the MAC (hex)
+ * - done once in setupDeviceFacts(), use g_DeviceFacts.clientId
+ * @param[out] clientId buffer for the ClientID
+ * @param[in] size size of clientId
  ************************************************************/ 
-void sendNetworkState(boolean mqttOnly) {    
-  String msgStr;  
-  msgStr = '{';  
-  msgStr.concat("\"IP-Address\":\"" + WiFi.localIP().toString() + "\",");
-  msgStr.concat("\"MQTT-ClientID\":\"" + composeClientID() + "\"");     
-  msgStr.concat("}");    
-  mqttPub(T_NETWORK, msgStr, mqttOnly);
+void composeClientID(char* clientId, size_t size) {
+  uint8_t myMac[6];
+  WiFi.macAddress(myMac);  
+  snprintf(clientId, size, "esp32_%x-%x-%x", myMac[3], myMac[4], myMac[5]);
 }
 
 
 /************************************************************
- * Send Sketch State
- * this will send Status of Sketch as JSON Message:
- ************************************************************
- * {"Compiletime":"1.11.2022, 20:9:4",
- *  "Sdk Version":"v3.3.5-1-g85c43024c","CpuFreq":240,
- *  "SketchSize":790608,"Free SketchSpace":1310720,
- *  "Sketch MD5":"fc84355a94fd722e55310621cf3645da",
- *  "Flash ChipSize":4194304,"Flash Chip Speed":40000000
- * }
- ************************************************************
- * @param[in] mqttOnly if false, then also Serial Output is generated
+ * Log Producer (see binLog.h)
+ * - ring of the calling task: the network task (dual-core)
+ *   has its own, everything else writes to ring 0
  ************************************************************/ 
-void sendSketchState(boolean mqttOnly) {    
-  String msgStr;    
-  msgStr = '{';
-  msgStr.concat("\"Project version\":\"" + String(VERSION) + "\",");
-  msgStr.concat("\"Target\":\"" + String(TARGET) + "\",");
-  msgStr.concat("\"Build timestamp\":\"" + String(BUILD_TIMESTAMP)+ "\",");  
-  msgStr.concat("\"Sdk Version\":\"" + String(ESP.getSdkVersion()) + "\",");     
-  msgStr.concat("\"CpuFreq\":" + String(ESP.getCpuFreqMHz()) + ",");
-  msgStr.concat("\"SketchSize\":" + String(ESP.getSketchSize()) + ",");
-  msgStr.concat("\"Free SketchSpace\":" + String(ESP.getFreeSketchSpace()) + ",");
-  msgStr.concat("\"Sketch MD5\":\"" + String(ESP.getSketchMD5()) + "\",");
-  msgStr.concat("\"Flash ChipSize\":" + String(ESP.getFlashChipSize()) + ",");
-  msgStr.concat("\"Flash Chip Speed\":" + String(ESP.getFlashChipSpeed()));  
-  msgStr.concat("}");  
-  mqttPub(T_SKETCH, msgStr, true);  
+size_t logProducer(void) {
+  return (g_NetTask && (xTaskGetCurrentTaskHandle() == g_NetTask)) ? 1 : 0;
 }
-                  
+
 
 /************************************************************
- * Init Global Vars
+ * Log Drain (network side, every pass)
+ * - frames the entries of g_Log, oldest first
+ * - UART (LOG_UART): only as many bytes as the TX FIFO takes,
+ *   the rest of a frame goes out in the next pass
+ * - every frame is added to g_LogBatch for jobLogFlush(); a
+ *   full batch is published right away, while offline the
+ *   frame is dropped (counted) and the batch kept
+ * @return true if a frame waits for room in the UART
  ************************************************************/ 
-void setupGlobalVars(void){
-  DBG_SETUP.print("- Global Vars ... ");    
-  g_Firstrun = true;
-  g_LastHeartbeat_1s = millis();       
-  g_LastHeartbeat_10s = millis();       
-  g_LastHeartbeat_30s = millis();       
-  g_LastHeartbeat_60s = millis();       
-  g_LastMqttReconnectAttempt = millis();     
-  g_LastNetMonitoring = millis();          // Timer for Monitoring Network 
-  g_LedState = 0;    
-  g_MqttReconnectCount = 0;  
-  g_wificonnected = false;
-  g_IrqFlag = false;
-  g_LastIRQ = true;  
-  g_rebootActive = false;                  // if true trigger reeboot 5s after g_reboot_triggered
-  g_rebootTriggered = millis();            // millis() when reboot was started  
-  DBG_SETUP.println("done.");
-  delay(DEBUG_SETUP_DELAY);  
+boolean logDrain(void) {
+  static uint8_t frame[LOG_MAX_ENTRY + LOG_FRAME_EXTRA];
+  static size_t  frameLen = 0;
+#if LOG_UART
+  static size_t  frameAt = 0;
+#endif
+  for (;;) {
+#if LOG_UART
+    if (frameAt < frameLen) {
+      int room = Serial.availableForWrite();
+      if (room <= 0) {
+        return true;
+      }
+      size_t n = ((size_t)room < frameLen - frameAt) ? (size_t)room : frameLen - frameAt;
+      Serial.write(frame + frameAt, n);
+      frameAt += n;
+      continue;
+    }
+#endif
+    size_t  n = g_Log.pop(frame + 3);
+    uint8_t x = 0;
+    if (!n) {
+      return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+      x ^= frame[3 + i];
+    }
+    frame[0] = LOG_SYNC0;
+    frame[1] = LOG_SYNC1;
+    frame[2] = (uint8_t)n;
+    frame[3 + n] = x;
+    frameLen = n + LOG_FRAME_EXTRA;
+#if LOG_UART
+    frameAt = 0;
+#endif
+    if (g_LogBatchLen + frameLen > sizeof(g_LogBatch)) {
+      jobLogFlush();
+    }
+    if (g_LogBatchLen + frameLen > sizeof(g_LogBatch)) {
+      g_LogBatchDropped++;
+      continue;
+    }
+    memcpy(g_LogBatch + g_LogBatchLen, frame, frameLen);
+    g_LogBatchLen += frameLen;
+  }
 }
 
 
 /************************************************************
- * Init GPIO-Ports
- ************************************************************/ 
-void setupGPIO(void) {  
-  DBG_SETUP.print("- Init GPIO-Port... ");  
-  pinMode(DBG_LED, OUTPUT);
-  pinMode(INT_PIN, INPUT_PULLUP);
-  DBG_SETUP.println("done.");
-  delay(DEBUG_SETUP_DELAY);  
+ * Monitor Connections
+ * - Timer Job, every T_NET_MONITORING
+ * - loop() only steps the state machine while not ONLINE,
+ *   this catches a lost WiFi while the MQTT session still
+ *   looks alive
+ ************************************************************/
+void monitorConnections(void) {
+  IPAddress ip = WiFi.localIP();
+  LOGI(NET, "!!! WiFi localIP: %u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  netStep();
+  LOGI(NET, "Monitoring WiFi & MQTT... %s", (g_Net.phase == NET_ONLINE) ? "ONLINE" : "OFFLINE");
 }
 
 
 /************************************************************
- * Init IRQ
- * IRQ is triggered from MCP 23017
- ************************************************************/ 
-void setupIRQ(void) {  
-  DBG_SETUP.print("- Init IRQ... ");    
-  attachInterrupt(INT_PIN, irqHandler, FALLING);
-  DBG_SETUP.println("done.");  
-  delay(DEBUG_SETUP_DELAY);
+ * Enter Network Phase
+ * - leaving NET_ONLINE takes the socket from the receive
+ *   task first (PubSubClient reads CONNACK of the next one)
+ * @param[in] phase new phase
+ * @param[in] now millis()
+ ************************************************************/
+void netEnter(NetPhase phase, uint32_t now) {
+  if (phase != NET_ONLINE) {
+    g_RxGate.disarm();
+  }
+  g_Net.phase = phase;
+  g_Net.phaseSince = now;
 }
 
 
 /************************************************************
- * MQTT Init
- * - Set LastWill to 
- *   - topic:   TOPIC_STATUS 
- *   - message: STATUS_MSG_OFF
- *   - retain:  yes
- * - subscribe to MQTT_PREFIX "/" T_CMD
- * - publish 
- *   - topic:   TOPIC_STATUS 
- *   - message: STATUS_MSG_ON
- *   - retain:  yes
- ************************************************************/ 
-void setupMQTT(void) {    
-  String myClientID;
-  myClientID = composeClientID();
-  DBG_SETUP.println("Connecting to MQTT-Server ... ");
-  DBG_SETUP.print("  - ClientID: ");
-  DBG_SETUP.println(myClientID);  
-  if (mqtt.connect(myClientID.c_str(), MQTT_USER, MQTT_PASS, MQTT_PREFIX "/" T_STATUS, 1, true, STATUS_MSG_OFF, true))  { 
-    DBG_SETUP.println("  - Register Callback");
-    mqtt.setCallback(mqttCallback);
-    mqtt.setBufferSize(MQTT_BUFSIZE);
-    DBG_SETUP.println("  - Publish State ONLINE");
-    mqtt.publish(MQTT_PREFIX "/" T_STATUS, STATUS_MSG_ON, true);
-    DBG_SETUP.print("  - Subscribe to ");
-    DBG_SETUP.println(MQTT_PREFIX "/" T_CMD);
-    mqtt.subscribe(MQTT_PREFIX "/" T_CMD);
-    DBG_SETUP.println("  connected.");
-  } else {      
-      DBG_SETUP.println("Connection failed - trying later...");
-  }   
-  mqtt.loop();
+ * Network State Machine
+ * - never blocks (except DNS once per T_DNS_TTL and CONNACK)
+ * - WIFI_CONNECTING: wait for the IP, restart the association
+ *   after T_WIFI_CONNECT_TIMEOUT
+ * - MQTT_CONNECTING: see netStepMqtt()
+ * - ONLINE: fall back if WiFi or MQTT is lost
+ ************************************************************/
+void netStep(void) {
+  uint32_t now = millis();
+  boolean  wifiUp = (WiFi.status() == WL_CONNECTED) && (WiFi.localIP()[0] != 0);
+  switch (g_Net.phase) {
+    case NET_WIFI_CONNECTING:
+      if (wifiUp) {
+        if (!g_Net.timeToIp) {
+          g_Net.timeToIp = now;
+        }
+        g_Net.connectMs = now - g_Net.phaseSince;
+        if (!g_Net.fast) {
+          netSaveCache();
+        }
+        IPAddress ip = WiFi.localIP();
+        LOGI(NET, "WiFi connected, IP address: %u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+        // first connect right away, after an outage with jitter
+        netMqttBegin(now, g_Net.timeToOnline ? netLostWait((uint32_t)random(0x7fffffff)) : 0);
+        netStep();                         // connect MQTT in the same pass
+      } else if (g_Net.fast && ((now - g_Net.phaseSince) >= T_WIFI_FAST_TIMEOUT)) {
+        LOGE(NET, "WiFi: cached BSSID failed, scanning");
+        netFastMiss();
+      } else if ((now - g_Net.phaseSince) >= T_WIFI_CONNECT_TIMEOUT) {
+        LOGE(NET, "WiFi: no IP, restarting association");
+        WiFi.disconnect();
+        netBegin();
+      }
+      break;
+    case NET_MQTT_CONNECTING:
+      if (!wifiUp) {
+        LOGE(NET, "WiFi CONNECTION LOST");
+        netMqttAbort();
+        netEnter(NET_WIFI_CONNECTING, now);
+      } else {
+        netStepMqtt(now);
+      }
+      break;
+    case NET_ONLINE:
+      if (!wifiUp) {
+        LOGE(NET, "WiFi CONNECTION LOST");
+        g_Net.lostAt = now;
+        netEnter(NET_WIFI_CONNECTING, now);
+      } else if (!mqtt.connected()) {
+        LOGE(NET, "MQTT CONNECTION LOST");
+        g_Net.lostAt = now;
+        netMqttBegin(now, netLostWait((uint32_t)random(0x7fffffff)));
+      }
+      break;
+  }
 }
 
 
 /************************************************************
- * Init Over-The-Air Update Handler
- * - set OTA-Password with ArduinoOTA.setPasswordHash("[MD5(Pass)]");
- * MD5 ("mysecretOtaPassword") = 5386fe58bd9627e6a22aee5f1726c868 
- * ATTENTION: setPasswordHash MUST NOT CONTAIN CAPS Letters A-F
- *   NO:  5386FE58BD9627E6A22AEE5F1726C868
- *   YES: 5386fe58bd9627e6a22aee5f1726c868
- ************************************************************/ 
-void setupOTA(void) {  
-  DBG_SETUP.print("- Init OTA... ");
-  // Set Port 3232
-  ArduinoOTA.setPort(3232);
-  
-  // Hostname defaults to esp8266-[ChipID]
-  ArduinoOTA.setHostname("homectrl32");
-  
-  // authenticate using password      
-  // ArduinoOTA.setPasswordHash("45159b2115f99bf96aa00fa2b9da0cb9");
-  ArduinoOTA.setPasswordHash(g_otahash);
+ * MQTT Connect Step (NET_MQTT_CONNECTING)
+ * - NET_MQTT_WAIT: at nextAttempt resolve the broker (cached)
+ *   and start the TCP connect
+ * - NET_MQTT_TCP: poll the TCP connect; once up, hand the
+ *   socket to the WiFiClient and send CONNECT (connectMQTT)
+ * @param[in] now millis()
+ ************************************************************/
+void netStepMqtt(uint32_t now) {
+  IPAddress ip;
+  int       res;
+  switch (g_Net.mqttStage) {
+    case NET_MQTT_WAIT:
+      if ((int32_t)(now - g_Net.nextAttempt) < 0) {
+        return;
+      }
+      g_Net.attempts++;
+      if (!netResolve(g_Net.broker, ip)) {
+        netMqttFailed();
+        return;
+      }
+      mqtt.setServer(ip, MQTT_PORT);
+      g_Net.sock = tcpConnectStart(ip, MQTT_PORT);
+      if (g_Net.sock == TCP_FAILED) {
+        netMqttFailed();
+        return;
+      }
+      g_Net.tcpSince = now;
+      g_Net.mqttStage = NET_MQTT_TCP;
+      break;
+    case NET_MQTT_TCP:
+      res = tcpConnectPoll(g_Net.sock);
+      if ((res == TCP_PENDING) && ((now - g_Net.tcpSince) < T_MQTT_TCP_TIMEOUT)) {
+        return;
+      }
+      if (res != TCP_CONNECTED) {
+        netMqttAbort();
+        netMqttFailed();
+        return;
+      }
+      myWiFiClient = WiFiClient(g_Net.sock);
+      g_Net.sock = TCP_FAILED;
+      g_Net.mqttStage = NET_MQTT_WAIT;
+      if (connectMQTT()) {
+        netOnline(millis());
+      } else {
+        netMqttFailed();
+      }
+      break;
+  }
+}
 
-  // OTA Callback: onStart
-  ArduinoOTA.onStart([]() {
-    String type;
-    if (ArduinoOTA.getCommand() == U_FLASH) {
-      type = "sketch";
-    } else { // U_FS
-      type = "filesystem";
-    }
-    // NOTE: if updating FS this would be the place to unmount FS using FS.end()
-    // DBG_SETUP.println("Start updating " + type);
-    dbgout("Update Started: " + type);
-  });  
 
-  // OTA Callback: onEnd
-  ArduinoOTA.onEnd([]() {
-    dbgout("Update finished");
-  });  
+/************************************************************
+ * Start a MQTT Connect Cycle
+ * - first broker, no backoff
+ * @param[in] now millis()
+ * @param[in] wait ms until the first attempt
+ ************************************************************/
+void netMqttBegin(uint32_t now, uint32_t wait) {
+  netEnter(NET_MQTT_CONNECTING, now);
+  g_Net.mqttStage = NET_MQTT_WAIT;
+  g_Net.broker = 0;
+  g_Net.backoffRound = 0;
+  g_Net.nextAttempt = now + wait;
+}
 
-  // OTA Callback: onProgress
-  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-    // Progress output disabled
-    // DBG_SETUP.printf("Progress: %u%%\r", (progress / (total / 100));
-  });  
 
-  // OTA Callback: onError
-  ArduinoOTA.onError([](ota_error_t error) {
-    DBG_SETUP.printf("Error[%u]: ", error);
-    if (error == OTA_AUTH_ERROR) {
-      DBG_SETUP.println("Auth Failed");
-    } else if (error == OTA_BEGIN_ERROR) {
-      DBG_SETUP.println("Begin Failed");
-    } else if (error == OTA_CONNECT_ERROR) {
-      DBG_SETUP.println("Connect Failed");
-    } else if (error == OTA_RECEIVE_ERROR) {
-      DBG_SETUP.println("Receive Failed");
-    } else if (error == OTA_END_ERROR) {
-      DBG_SETUP.println("End Failed");
+/************************************************************
+ * Abort a pending TCP Connect
+ ************************************************************/
+void netMqttAbort(void) {
+  if (g_Net.mqttStage == NET_MQTT_TCP) {
+    tcpConnectAbort(g_Net.sock);
+    g_Net.sock = TCP_FAILED;
+    g_Net.mqttStage = NET_MQTT_WAIT;
+  }
+}
+
+
+/************************************************************
+ * MQTT Connect Attempt failed
+ * - cached IP settings in use: they may be stale, scan + DHCP
+ * - next broker right away; after the last one start over
+ *   with the first after the backoff
+ ************************************************************/
+void netMqttFailed(void) {
+  LOGE(NET, "MQTT CONNECT to %s FAILED [%lu]", g_MqttServers[g_Net.broker], (unsigned long)g_Net.attempts);
+  g_Net.mqttStage = NET_MQTT_WAIT;
+  if (g_Net.fast) {
+    LOGE(NET, "MQTT: cached IP settings failed, using DHCP");
+    netFastMiss();
+    return;
+  }
+  if (g_Net.broker + 1u < countof(g_MqttServers)) {
+    g_Net.broker++;
+    g_Net.nextAttempt = millis();
+    return;
+  }
+  g_Net.broker = 0;
+  g_Net.nextAttempt = millis() + netRetryWait(g_Net.backoffRound, (uint32_t)random(0x7fffffff));
+}
+
+
+/************************************************************
+ * Resolve a Broker
+ * - cached for T_DNS_TTL
+ * - the last address is kept if the lookup fails
+ * @param[in] index into g_MqttServers
+ * @param[out] ip address of the broker
+ * @return true if an address is known
+ ************************************************************/
+boolean netResolve(uint8_t index, IPAddress& ip) {
+  NetDnsEntry& entry = g_Net.dns[index];
+  uint32_t     now = millis();
+  if (!entry.valid || ((now - entry.resolvedAt) >= T_DNS_TTL)) {
+    IPAddress resolved;
+    g_Net.dnsLookups++;
+    if (WiFi.hostByName(g_MqttServers[index], resolved)) {
+      entry.ip = (uint32_t)resolved;
+      entry.resolvedAt = now;
+      entry.valid = true;
     }
-  });  
+  }
+  ip = IPAddress(entry.ip);
+  return entry.valid;
+}
 
-  // OTA Init
-  ArduinoOTA.begin();
 
-  DBG_SETUP.println("done.");
-  delay(DEBUG_SETUP_DELAY);  
+/************************************************************
+ * MQTT is ONLINE
+ * - statistics of this (re)connect, published with the
+ *   network state
+ * - the receive task takes over the socket (MQTT_RX_TASK),
+ *   QoS 1 packets without PUBACK are sent again (mqttQos.h)
+ * @param[in] now millis()
+ ************************************************************/
+void netOnline(uint32_t now) {
+  netEnter(NET_ONLINE, now);
+  if (g_RxTask) {
+    mqttRxArm();
+    mqttQosResend();
+  }
+  if (g_Net.fast) {
+    g_Net.fastHits++;
+    g_Net.fast = false;
+  }
+  g_Net.lastAttempts = g_Net.attempts;
+  g_Net.lastReconnectMs = now - g_Net.lostAt;
+  g_Net.lastBroker = g_Net.broker;
+  g_Net.attempts = 0;
+  if (!g_Net.timeToOnline) {
+    g_Net.timeToOnline = now;
+    LOGI(MAIN, "ONLINE after %lu ms (IP after %lu ms)", (unsigned long)g_Net.timeToOnline, (unsigned long)g_Net.timeToIp);
+  } else {
+    g_Net.mqttReconnects++;
+    LOGI(MAIN, "RECONNECTED to %s after %lu ms, %lu attempts", g_MqttServers[g_Net.broker],
+         (unsigned long)g_Net.lastReconnectMs, (unsigned long)g_Net.lastAttempts);
+  }
+  sendNetworkState(false);
 }
 
 
 /************************************************************
- * Init Wifi 
- * - SSID: WIFI_SSID 
- * - PSK:  WIFI_PSK
- ************************************************************/ 
-void setupWIFI(void) {      
-  int cnt = 0;  
-  DBG_SETUP.println("- Init WiFi... ");
-  DBG_SETUP.print("  - connecting to '");    
-  DBG_SETUP.print(g_wifissid);    
-  DBG_SETUP.println("'");    
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(g_wifissid, g_wifipass);
-  delay(5000);
-  while ((WiFi.status() != WL_CONNECTED) && (cnt < T_WIFI_MAX_TRIES)){
-    cnt++;
-    DBG_SETUP.print("  - Connection failed! - Retrying [");      
-    DBG_SETUP.print(cnt);      
-    DBG_SETUP.println("]...");
-    delay(2000);
-  }
-  if (WiFi.status() != WL_CONNECTED) {
-    g_wificonnected = false;
-    DBG_SETUP.println("  - Connection failed! - trying later...");        
+ * Start WiFi Association
+ * - with a valid g_NetCache: static IP, channel and BSSID,
+ *   no scan, no DHCP
+ * - else: scan + DHCP
+ ************************************************************/
+void netBegin(void) {
+  g_Net.fast = netCacheValid(g_NetCache);
+  if (g_Net.fast) {
+    WiFi.config(IPAddress(g_NetCache.ip), IPAddress(g_NetCache.gateway), IPAddress(g_NetCache.subnet),
+                IPAddress(g_NetCache.dns));
+    WiFi.begin(g_wifissid, g_wifipass, g_NetCache.channel, g_NetCache.bssid);
   } else {
-    g_wificonnected = true;
-    DBG_SETUP.println("  - Successfully connected");    
-    DBG_SETUP.print("  IP address: ");
-    DBG_SETUP.println(WiFi.localIP());
-  }  
-  delay(DEBUG_SETUP_DELAY);
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());   // DHCP
+    WiFi.begin(g_wifissid, g_wifipass);
+  }
+  g_Net.wifiAttempts++;
+  netEnter(NET_WIFI_CONNECTING, millis());
 }
 
 
 /************************************************************
- * Main Setup
- * - setupGPIO
- * - setupWIFI
- * - setupOTA
- * - setupGlobalVars 
- ************************************************************/ 
-void setup(void) {  
-  // Serial Port
-  Serial.begin(115200);  
-  DBG.println("");
-  DBG.println("################################");
-  DBG.println("### Darios ESP32 Hello-World ###");
-  DBG.println("################################");  
-  DBG.println("Version: " + String(VERSION));
-  DBG.println("Target: " + String(TARGET));
-  DBG.println("Build timestamp: " + String(BUILD_TIMESTAMP));
-
-  DBG_SETUP.println("\nInit ...");
-  delay(DEBUG_SETUP_DELAY);  
+ * Fast Association failed
+ * - drop the cache, associate again with scan + DHCP
+ ************************************************************/
+void netFastMiss(void) {
+  g_Net.fastMisses++;
+  g_NetCache.magic = 0;
+  WiFi.disconnect();
+  netBegin();
+}
 
-  // Global Vars
-  setupGlobalVars();  
 
-  // GPIO-Ports
-  setupGPIO(); 
+/************************************************************
+ * Save BSSID, channel and DHCP lease to g_NetCache
+ ************************************************************/
+void netSaveCache(void) {
+  memcpy(g_NetCache.bssid, WiFi.BSSID(), sizeof(g_NetCache.bssid));
+  g_NetCache.channel = (uint8_t)WiFi.channel();
+  g_NetCache.reserved = 0;
+  g_NetCache.ip = (uint32_t)WiFi.localIP();
+  g_NetCache.gateway = (uint32_t)WiFi.gatewayIP();
+  g_NetCache.subnet = (uint32_t)WiFi.subnetMask();
+  g_NetCache.dns = (uint32_t)WiFi.dnsIP();
+  g_NetCache.magic = NET_CACHE_MAGIC;
+  g_NetCache.check = netCacheCheck(g_NetCache);
+}
 
-  // WiFi
-  setupWIFI();
 
-  // OTA-Update-Handler  
-  setupOTA();    
+/************************************************************
+ * Connect MQTT
+ * - TCP is up already (netStepMqtt), only CONNECT / CONNACK
+ * - LastWill: STATUS_MSG_OFF on TOPIC_STATUS, retained
+ * - publish STATUS_MSG_ON on TOPIC_STATUS, retained
+ * - subscribe to TOPIC_CMD and TOPIC_OTA
+ * @return true if connected
+ ************************************************************/
+boolean connectMQTT(void) {
+  LOGI(NET, "MQTT connecting [%lu]... ", (unsigned long)g_Net.attempts);
+  if (!mqtt.connect(g_DeviceFacts.clientId, MQTT_USER, MQTT_PASS, TOPIC_STATUS, 1, true, STATUS_MSG_OFF, true)) {
+    LOGE(NET, "MQTT CONNECTION FAILED - state: %d", mqtt.state());
+    return false;
+  }
+  mqtt.publish(TOPIC_STATUS, STATUS_MSG_ON, true);
+  mqtt.subscribe(TOPIC_CMD);
+  mqtt.subscribe(TOPIC_OTA);
+  LOGI(NET, "MQTT CONNECTED");
+  return true;
+}
 
-  // MQTT
-  setupMQTT();
 
-  // IRQ 
-  // setupIRQ();    
+/************************************************************
+ * MQTT Message Received
+ * - Callback function started when MQTT Message received
+ * - the message may carry a batch of commands, separated by
+ *   newline or ';' plus an optional correlation id "#ID"
+ *   (see commandBatch.h); a batch is answered with one
+ *   JSON result document
+ * - the commands are parsed in place, inside the receive 
+ *   buffer of PubSubClient (no copy, no heap allocation):
+ *   - PubSubClient puts the payload directly behind the 
+ *     '\0' terminating the topic
+ *   - the payload is moved one byte to the front (onto this 
+ *     '\0')
+ *   - the byte freed at the end takes the terminating '\0'
+ *   - topic is not usable afterwards
+ *   - cmd is only valid until the next publish, so all 
+ *     commands of a batch run before anything is published
+ * - dual-core: the payload is copied to g_CmdQueue, the
+ *   application runs it (appLoop)
+ * - TOPIC_OTA: patch chunk, stays on the network side
+ *   (otaDeltaReceive)
+ * - micros() at arrival goes with the command (g_Probe.rx,
+ *   dual-core: in front of the queue record)
+ * @param[in] topic Topic received
+ * @param[in] topic Message received
+ * @param[in] length Length of the Message received
+ ************************************************************/ 
+void mqttCallback(char* topic, byte* payload, unsigned int length) {  
+  char* cmd = (char*)payload - 1;
+  if (!strcmp(topic, TOPIC_OTA)) {
+    otaDeltaReceive(payload, length);
+    return;
+  }
+  uint32_t rx = micros();
+  // dual-core: copy to the application (appLoop)
+  if (g_NetTask) {
+    uint8_t* rec = g_CmdQueue.reserve(sizeof(rx) + length + 1);
+    if (!rec) {
+      g_TaskStats.cmdDropped++;
+      LOGE(MQTT, "ERROR: command queue full, command ignored");
+      return;
+    }
+    memcpy(rec, &rx, sizeof(rx));
+    memcpy(rec + sizeof(rx), payload, length);
+    rec[sizeof(rx) + length] = '\0';
+    g_CmdQueue.commit();
+    g_TaskStats.cmdQueued++;
+    idleWake(IDLE_EV_CMD);
+    return;
+  }
+  // check buffer layout, before touching the topic
+  if (topic + strlen(topic) != cmd) {
+    LOGE(MQTT, "ERROR: unexpected MQTT buffer layout, command ignored");
+    return;
+  }
+  // shift to front
+  memmove(cmd, payload, length);
+  cmd[length] = '\0';
+  g_Probe.rx = rx;
+  runCommands(cmd);
+}
+
+
+/************************************************************
+ * Run Commands and publish the Result
+ * - cmd is parsed in place (cut into tokens)
+ * - a probe sent alone is answered with its cycle stamps
+ *   (g_Probe.rx set by the caller, see cmdProbe.h)
+ * @param[in] cmd command batch, '\0' terminated
+ ************************************************************/ 
+void runCommands(char* cmd) {
+  static char result[CMD_BATCH_RESULT_SIZE];
+  size_t      probe = 0;
+  cmdProbeStart(g_Probe, micros(), STAMP_NOW(), STAMP_PER_US(ESP.getCpuFreqMHz()));
+  // Echo Command (copied now, the parser cuts cmd)
+  LOGI(MQTT, "received MQTT-Message: \"%s\"", cmd);
+  // Execute Commands (before publishing anything: a publish 
+  // reuses the PubSubClient buffer and overwrites cmd)
+  execCommands(cmd, result);
+  if (g_Probe.pending && (result[0] != '{')) {
+    probe = cmdProbeResult(result, sizeof(result), g_Probe, STAMP_NOW(), STAMP_PER_US(ESP.getCpuFreqMHz()));
+  }
+  if (probe) {
+    cmdProbeStamp(result, probe, g_Probe, STAMP_NOW());
+  }
+  // Publish Result;
+  mqttPub(TOPIC_RESULT, result, false);
+}
+
+
+/************************************************************
+ * Execute Commands
+ * - command table g_CommandDefs, no publish (the native
+ *   fleet runs it for its virtual nodes, native/fleet)
+ * @param[in] cmd command batch, '\0' terminated, cut into tokens
+ * @param[out] result CMD_BATCH_RESULT_SIZE bytes, see cmdRunBatch
+ * @return number of commands executed
+ ************************************************************/ 
+size_t execCommands(char* cmd, char* result) {
+  return cmdRunBatch(g_Commands, cmd, result);
+}
+
+
+/************************************************************
+ * Publish & Print Message
+ * - to Serial Console
+ *   - if mqttOnly is false
+ * - Publish MQTT-Message to topic (use the full TOPIC_* defines)
+ *   - the payload is streamed to the client, no heap allocation
+ * @param[in] topic MQTT-Topic (including MQTT_PREFIX)
+ * @param[in] msg Message to be send
+ * @param[in] mqttOnly if false, then also Serial Output is generated
+ * @return true if the message was handed to the client
+ ************************************************************/ 
+boolean mqttPub(const char* topic, const char* msg, boolean mqttOnly){  
+  return mqttPub(topic, msg, strlen(msg), mqttOnly, false);
+}
+
+
+/************************************************************
+ * Publish & Print Message with known length
+ * - connected: sent at once (mqttSend); a KEEP_ALL topic
+ *   (results) only once no older KEEP_ALL message is queued,
+ *   it sends OUTBOX_CATCH_UP of the queue first, so the
+ *   queue shrinks under any load; a KEEP_LATEST topic drops
+ *   its older, queued state (see outbox.h)
+ * - offline, or results still queued: into the outbox 
+ *   (policy of the topic: g_OutboxRules), jobOutbox() sends
+ *   them once ONLINE again
+ * - QoS 1 topic and its window full (see mqttQos.h): into
+ *   the outbox as well, sent as PUBACKs free the window
+ * - dual-core, called by the application: passed to the 
+ *   network task (g_PubQueue), which publishes it
+ * @param[in] topic MQTT-Topic (including MQTT_PREFIX)
+ * @param[in] msg Message to be send (need not be terminated)
+ * @param[in] len Length of msg
+ * @param[in] mqttOnly if false, then also Serial Output is generated
+ * @param[in] retained publish as retained message
+ * @return true if the message was handed to the client 
+ *         (false if it was queued in the outbox: offline or
+ *         back-pressure; application side: true if passed to
+ *         the network task)
+ ************************************************************/ 
+boolean mqttPub(const char* topic, const char* msg, size_t len, boolean mqttOnly, boolean retained){  
+  // Log
+  if (!mqttOnly) {
+    LOGI(MQTT, "%s: %s", topic, (LogStr{msg, len}));
+  }  
+  // Application side (dual-core)
+  if (g_NetTask && (xTaskGetCurrentTaskHandle() != g_NetTask)) {
+    return taskPubPush(topic, msg, len, retained);
+  }
+  // MQTT
+  OutboxPolicy policy = outboxPolicy(g_OutboxRules, topic);
+  if (mqtt.connected()) {
+    if ((policy == OUTBOX_KEEP_ALL) && g_Outbox.keepAll()) {
+      outboxDrain(OUTBOX_CATCH_UP);
+    }
+    if ((policy != OUTBOX_KEEP_ALL) || !g_Outbox.keepAll()) {
+      if (mqttQosRoom(topic, len)) {
+        boolean sent = mqttSend(topic, msg, len, retained);
+        if (sent && (policy == OUTBOX_KEEP_LATEST)) {
+          g_Outbox.discard(topic);
+        }
+        return sent;
+      }
+      g_QosStats.blocked++;
+    }
+  }
+  if (policy == OUTBOX_NONE) {
+    if (mqtt.connected()) {
+      return mqttSend(topic, msg, len, retained);
+    }
+    LOGE(MQTT, "ERROR: MQTT-Connection lost");
+  } else if (!g_Outbox.push(topic, msg, len, retained, policy)) {
+    LOGE(MQTT, "ERROR: MQTT-Outbox full, message dropped");
+  }
+  return false;
+}
+
+
+/************************************************************
+ * Pass a Message to the Network Task (dual-core)
+ * - record: flags, topic + '\0', payload (see taskSplit.h)
+ * - queue full: wait up to T_PUB_QUEUE_WAIT for the network
+ *   task, then drop
+ * @return true if queued
+ ************************************************************/ 
+boolean taskPubPush(const char* topic, const char* msg, size_t len, boolean retained){  
+  size_t   tl = strlen(topic) + 1;
+  uint32_t start = millis();
+  uint8_t* rec;
+  while (!(rec = g_PubQueue.reserve(1 + tl + len))) {
+    if (millis() - start >= T_PUB_QUEUE_WAIT) {
+      g_TaskStats.pubDropped++;
+      LOGE(MQTT, "ERROR: publish queue full, message dropped");
+      return false;
+    }
+    vTaskDelay(1);
+  }
+  rec[0] = retained ? PUB_F_RETAINED : 0;
+  memcpy(rec + 1, topic, tl);
+  memcpy(rec + 1 + tl, msg, len);
+  g_PubQueue.commit();
+  g_TaskStats.pubQueued++;
+  idleWake(IDLE_EV_PUB);
+  return true;
+}
+
+
+/************************************************************
+ * Publish the Messages of the Application (dual-core)
+ * - network task, from netLoop()
+ * - into mqttPub, so the outbox takes them while offline
+ ************************************************************/ 
+void taskPubDrain(void) {
+  size_t   n;
+  uint8_t* rec;
+  while ((rec = g_PubQueue.peek(n))) {
+    const char* topic = (const char*)rec + 1;
+    size_t      tl = strlen(topic) + 1;
+    mqttPub(topic, topic + tl, n - 1 - tl, true, rec[0] & PUB_F_RETAINED);
+    g_PubQueue.release();
+  }
+}
+
+
+/************************************************************
+ * Run the Commands received by the Network Task (dual-core)
+ * - application task, from appLoop()
+ ************************************************************/ 
+void taskCmdDrain(void) {
+  size_t   n;
+  uint8_t* rec;
+  while ((rec = g_CmdQueue.peek(n))) {
+    memcpy(&g_Probe.rx, rec, sizeof(g_Probe.rx));
+    runCommands((char*)rec + sizeof(g_Probe.rx));
+    g_CmdQueue.release();
+  }
+}
+
+
+/************************************************************
+ * Send Message to the Broker
+ * - beginPublish/write/endPublish hands topic and payload 
+ *   to the client as they are: no String, no malloc, no copy
+ * - QoS 1 topics: mqttSendQos1()
+ * @param[in] topic MQTT-Topic (including MQTT_PREFIX)
+ * @param[in] msg Message to be send (need not be terminated)
+ * @param[in] len Length of msg
+ * @param[in] retained publish as retained message
+ * @return true if the message was handed to the client
+ ************************************************************/ 
+boolean mqttSend(const char* topic, const char* msg, size_t len, boolean retained){  
+  if (mqttQosTopic(topic)) {
+    return mqttSendQos1(topic, msg, len, retained);
+  }
+  if (!mqtt.beginPublish(topic, len, retained) || 
+      (mqtt.write((const uint8_t*)msg, len) != len) || 
+      !mqtt.endPublish()) {
+    LOGE(MQTT, "ERROR: MQTT-Publish failed");
+    return false;
+  }
+  return true;
+}
+
+
+/************************************************************
+ * Topic published with QoS 1
+ * - listed in g_Qos1Topics, and the receive task runs (it
+ *   reads the PUBACKs, PubSubClient would drop them)
+ ************************************************************/ 
+boolean mqttQosTopic(const char* topic) {
+  if (!g_QosOn || !g_RxTask) {
+    return false;
+  }
+  for (size_t i = 0; i < countof(g_Qos1Topics); i++) {
+    if (!strcmp(g_Qos1Topics[i], topic)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/************************************************************
+ * Room for a Message (back-pressure)
+ * - QoS 1 topic: the window takes one more packet of this
+ *   size (or it is too large for the window: QoS 0)
+ * - other topics: always
+ * @param[in] topic MQTT-Topic (including MQTT_PREFIX)
+ * @param[in] len Length of the payload
+ * @return false if the sender should wait (mqttPub queues
+ *         the message in the outbox)
+ ************************************************************/ 
+boolean mqttQosRoom(const char* topic, size_t len) {
+  if (!mqttQosTopic(topic)) {
+    return true;
+  }
+  size_t n = mqttPublishSize(strlen(topic), len, true);
+  return (n > MQTT_QOS_BUFFER) || g_QosWindow.room(n);
+}
+
+
+/************************************************************
+ * Send Message with QoS 1 (see mqttQos.h)
+ * - PUBLISH with packet id into the window, then to the 
+ *   socket (mqttRxSend); the PUBACK is read by the receive
+ *   task, mqttQosReap() frees the packet
+ * - a failed send stays in the window: the connection is
+ *   dropped and the packet sent again after the reconnect
+ * - larger than the window: QoS 0 (PubSubClient)
+ * @return true if the packet is in flight, false if the
+ *         window is full
+ ************************************************************/ 
+boolean mqttSendQos1(const char* topic, const char* msg, size_t len, boolean retained){  
+  size_t   tl = strlen(topic);
+  size_t   n = mqttPublishSize(tl, len, true);
+  uint16_t id;
+  uint8_t* packet;
+  if (n > MQTT_QOS_BUFFER) {
+    g_QosStats.oversize++;
+    return mqtt.beginPublish(topic, len, retained) && 
+           (mqtt.write((const uint8_t*)msg, len) == len) && 
+           mqtt.endPublish();
+  }
+  if (!(packet = g_QosWindow.reserve(n, id))) {
+    g_QosStats.blocked++;
+    return false;
+  }
+  mqttPublishEncode(packet, topic, tl, (const uint8_t*)msg, len, retained, id);
+  g_QosWindow.commit(micros());
+  g_QosStats.sent++;
+  if (!mqttRxSend(g_RxGate.armed(), packet, n)) {
+    LOGE(MQTT, "ERROR: MQTT-Publish failed, sent again after reconnect");
+    g_RxLost = true;
+  }
+  return true;
+}
+
+
+/************************************************************
+ * cronjob
+ * - run the Timer Jobs that are due (see setupTimers)
+ ************************************************************/ 
+void cronjob(void) {
+  g_Timers.run(millis());
+}
+
+
+#if LOOP_STATS
+/************************************************************
+ * Timer Runner: calls the Timer Jobs, one histogram per job
+ * (see setupTimers, loopStats.h)
+ ************************************************************/ 
+void cronRunner(TimerCallback fn) {
+  uint32_t c0 = LOOP_CYCLES();
+  fn();
+  g_LoopStats.addJob(fn, LOOP_CYCLES() - c0);
+}
+#endif
+
+
+/************************************************************
+ * Job: drain the Outbox (every T_OUTBOX_DRAIN)
+ * - max. OUTBOX_DRAIN_BURST messages, so a long backlog does
+ *   not flood the broker or stall loop() after a reconnect
+ ************************************************************/
+void jobOutbox(void) {
+  outboxDrain(OUTBOX_DRAIN_BURST);
+}
+
+
+/************************************************************
+ * Send queued Messages
+ * - only while ONLINE, oldest first; a failed send stays
+ *   queued, a full QoS 1 window ends it (mqttRxLoop
+ *   continues)
+ * @param[in] max messages at most
+ ************************************************************/
+void outboxDrain(uint8_t max) {
+  OutboxMessage msg;
+  for (uint8_t i = 0; (i < max) && (g_Net.phase == NET_ONLINE) && mqtt.connected(); i++) {
+    if (!g_Outbox.front(msg) || !mqttQosRoom(msg.topic, msg.len) ||
+        !mqttSend(msg.topic, msg.payload, msg.len, msg.retained)) {
+      return;
+    }
+    g_Outbox.pop();
+  }
+}
+
+
+/************************************************************
+ * Job: publish the Log (every T_LOG_FLUSH)
+ * - all frames drained since the last run in one message
+ *   (binary, see binLog.h)
+ * - offline: the frames stay in g_LogBatch, not in the
+ *   outbox, where a batch per second would hold back the
+ *   results after the reconnect; logDrain() drops what does
+ *   not fit, the count is logged once ONLINE again
+ ************************************************************/ 
+void jobLogFlush(void) {
+  if (!g_LogBatchLen || (g_Net.phase != NET_ONLINE) || !mqtt.connected()) {
+    return;
+  }
+  mqttPub(TOPIC_LOG, (const char*)g_LogBatch, g_LogBatchLen, true, false);
+  g_LogBatchLen = 0;
+  if (g_LogBatchDropped) {
+    LOGE(MAIN, "ERROR: %u log frames dropped while offline", (unsigned)g_LogBatchDropped);
+    g_LogBatchDropped = 0;
+  }
+}
+
+
+/************************************************************
+ * Job: send CPU State (every T_CPU_STATE)
+ ************************************************************/ 
+void jobCPUState(void) {
+  sendCPUState(true);
+}
+
+
+/************************************************************
+ * Job: send Loop Metrics (every T_METRICS_STATE)
+ * - closes the interval, sent once the application left it
+ *   (jobLoopStatsSend, see loopStats.h)
+ ************************************************************/ 
+void jobLoopStats(void) {
+#if LOOP_STATS
+  g_LoopStats.newInterval(millis());
+  jobLoopStatsSend();
+#endif
+}
+
+
+/************************************************************
+ * Job: send the closed Interval of the Loop Metrics
+ * - not settled yet (loop() running or asleep): again after
+ *   T_METRICS_SETTLE
+ ************************************************************/ 
+void jobLoopStatsSend(void) {
+#if LOOP_STATS
+  if (!g_LoopStats.settled()) {
+    g_Timers.after(T_METRICS_SETTLE, jobLoopStatsSend);
+    return;
+  }
+  sendLoopStats(true);
+#endif
+}
+
+
+/************************************************************
+ * Job: send Network State (every T_NETWORK_STATE)
+ ************************************************************/ 
+void jobNetworkState(void) {
+  sendNetworkState(true);
+}
+
+
+/************************************************************
+ * Job: send IRQ State (every T_IRQ_STATE)
+ ************************************************************/ 
+void jobIrqState(void) {
+  sendIrqState(true);
+}
+
+
+/************************************************************
+ * Job: publish Sketch State (every T_SKETCH_PUBLISH)
+ * - only if it changed and was not published yet
+ ************************************************************/ 
+void jobSketchState(void) {
+  if (g_DeviceFacts.sketchStatePending && mqtt.connected()) {
+    sendSketchState(true);
+  }
+}
+
+
+/************************************************************
+ * Reset Handler
+ * - one-shot Timer Job, started by command "reset" 
+ *   (T_REBOOT_TIMEOUT ms later)
+ ************************************************************/ 
+void resetHandler() {  
+  g_rebootJob = TIMER_NONE;
+  delay(1000);      
+  ESP.restart();    
+}
+
+
+/************************************************************
+ * Send Telemetry Document
+ * - encoded by TelemetryWriter (JSON, CBOR or MessagePack, 
+ *   see TELEMETRY_FORMAT)
+ * - binary documents are not printed, only their size
+ * @param[in] topic MQTT-Topic (including MQTT_PREFIX)
+ * @param[in] doc encoded telemetry document
+ * @param[in] len length of doc, 0 if it did not fit
+ * @param[in] mqttOnly if false, then also Serial Output is generated
+ * @param[in] retained publish as retained message
+ * @return true if the message was handed to the client
+ ************************************************************/ 
+boolean sendTelemetry(const char* topic, const char* doc, size_t len, boolean mqttOnly, boolean retained) {
+  if (!len) {
+    LOGE(MQTT, "ERROR: telemetry for %s exceeds %u bytes", topic, (unsigned)TELEMETRY_BUFSIZE);
+    return false;
+  }
+  if (TelemetryWriter::BINARY && !mqttOnly) {
+    LOGI(MQTT, "%s: %u bytes", topic, (unsigned)len);
+    mqttOnly = true;
+  }
+  return mqttPub(topic, doc, len, mqttOnly, retained);
+}
+
+
+/************************************************************
+ * Send CPU State
+ * this will send Status of CPU (fields: CPU_STATE_FIELDS):
+ ************************************************************
+ * {"Heap Size":349264,"FreeHeap":260632,"Minimum Free Heap":253140,
+ *  "Max Free Heap":113792,"Chip Model":"ESP32-D0WDQ5",
+ *  "Chip Revision":1,"Millis":5220121,"Cycle Count":3019255534,
+ *  "Idle %":[97,0],"Wakes":[8810,52,431,12,0],"Busy Passes":166
+ * }
+ ************************************************************
+ * - "Idle %": time asleep since the last CPU state, loop()
+ *   and network task (dual-core)
+ * - "Wakes": timer, bound, socket, irq, queue (see IdleWake)
+ ************************************************************
+ * @param[in] mqttOnly if false, then also Serial Output is generated
+ ************************************************************/ 
+void sendCPUState(boolean mqttOnly) {    
+  TelemetryWriter tlm(g_TelemetryBuf, sizeof(g_TelemetryBuf));
+  uint32_t        now = micros();
+  g_IdlePercent[0] = g_IdleLoop.percent(now);
+  g_IdlePercent[1] = g_IdleNet.percent(now);
+  for (uint8_t i = 0; i < IDLE_WAKE_COUNT; i++) {
+    g_IdleWakes[i] = g_IdleLoop.wakes(i) + g_IdleNet.wakes(i);
+  }
+  TELEMETRY_WRITE(tlm, CPU_STATE_FIELDS);
+  sendTelemetry(TOPIC_CPU, tlm.data(), tlm.length(), mqttOnly, false);
+}
+
+
+/************************************************************
+ * Send Network State
+ * this will send State of Network (fields: NETWORK_STATE_FIELDS):
+ ************************************************************
+ * {"IP-Address":"192.168.1.42",
+ *  "MQTT-ClientID":"esp32_00_00_00",
+ *  "Time to IP":1500,"Time to Online":1520,"WiFi Attempts":1,
+ *  "Connect ms":1500,"Fast Hits":0,"Fast Misses":0,
+ *  "MQTT Reconnects":0,"Reconnect Attempts":1,"Reconnect ms":1522,
+ *  "DNS Lookups":1,"Broker":0,
+ *  "Outbox Depth":0,"Outbox Max Depth":12,"Outbox Queued":31,
+ *  "Outbox Sent":31,"Outbox Replaced":18,"Outbox Dropped":0,
+ *  "Outbox Spilled":0,"Rx Packets":412,"Rx Commands":57,
+ *  "Rx Dropped":0,"Rx Pings":98,"Rx Lost":0,"Qos In Flight":0,
+ *  "Qos Sent":57,"Qos Acked":57,"Qos Retransmits":0,
+ *  "Qos Blocked":0,"Qos Timeouts":0,"Qos Ack p50 us":4095,
+ *  "Qos Ack p99 us":8191
+ * }
+ ************************************************************
+ * @param[in] mqttOnly if false, then also Serial Output is generated
+ ************************************************************/ 
+void sendNetworkState(boolean mqttOnly) {    
+  TelemetryWriter tlm(g_TelemetryBuf, sizeof(g_TelemetryBuf));
+  TELEMETRY_WRITE(tlm, NETWORK_STATE_FIELDS);
+  sendTelemetry(TOPIC_NETWORK, tlm.data(), tlm.length(), mqttOnly, false);
+}
+
+
+/************************************************************
+ * Send IRQ State
+ * this will send the IRQ statistics (fields: IRQ_STATE_FIELDS):
+ ************************************************************
+ * {"Events":412,"Accepted":80,"Bounced":332,"Overflows":0,
+ *  "Max Rate":96,"Rate Histogram":[0,0,0,0,2,3,1,1],
+ *  "Latency p50 us":63,"Latency p99 us":1023,
+ *  "Latency max us":812,
+ *  "Latency Histogram":[0,0,3,10,41,97,180,64,12,5,0]
+ * }
+ ************************************************************
+ * @param[in] mqttOnly if false, then also Serial Output is generated
+ ************************************************************/ 
+void sendIrqState(boolean mqttOnly) {    
+  TelemetryWriter tlm(g_TelemetryBuf, sizeof(g_TelemetryBuf));
+  g_IrqSnapshot.read(g_IrqReport);
+  TELEMETRY_WRITE(tlm, IRQ_STATE_FIELDS);
+  sendTelemetry(TOPIC_IRQ, tlm.data(), tlm.length(), mqttOnly, false);
+}
+
+
+/************************************************************
+ * Send Roller State
+ * this will send the roller positions (fields: ROLLER_STATE_FIELDS):
+ ************************************************************
+ * {"Position":[0,40,100,100],"Busy":2,"Moves":12,
+ *  "Reversals":1,"End Syncs":5
+ * }
+ ************************************************************
+ * - application side (rollerLoop): its own buffer, the
+ *   network task renders the others into g_TelemetryBuf
+ ************************************************************
+ * @param[in] mqttOnly if false, then also Serial Output is generated
+ * @return true if the message was handed to the client
+ ************************************************************/ 
+boolean sendRollerState(boolean mqttOnly) {    
+  static char buf[TELEMETRY_BUFSIZE];
+  TelemetryWriter tlm(buf, sizeof(buf));
+  for (size_t i = 0; i < NUM_ROLLERS; i++) {
+    g_RollerPercent[i] = g_Rollers.percent(i);
+  }
+  TELEMETRY_WRITE(tlm, ROLLER_STATE_FIELDS);
+  return sendTelemetry(TOPIC_ROLLER, tlm.data(), tlm.length(), mqttOnly, false);
+}
+
+
+/************************************************************
+ * Send Loop Metrics
+ * this will send [p50, p99, max] in us of every loop() stage
+ * and timer job that ran in the closed interval (see
+ * loopStats.h, jobLoopStats):
+ ************************************************************
+ * {"Loop Rate":688230,"loop":[2,2,1653],"mqtt":[0,0,413],
+ *  "ota":[0,0,371],"pub":[0,0,59],"cron":[0,0,378],
+ *  "log":[0,0,33],"cmd":[0,0,113],"irq":[0,0,33],
+ *  "roller":[0,0,82],"sketchpub":[0,0,0],"outbox":[0,0,0],
+ *  "logflush":[2,2,2]
+ * }
+ * (native benchmark, benchLoopStats)
+ ************************************************************
+ * - "Loop Rate": loop() passes per second
+ * - "other": timer jobs without a name (e.g. reboot)
+ ************************************************************
+ * @param[in] mqttOnly if false, then also Serial Output is generated
+ * @return true if the message was handed to the client
+ ************************************************************/ 
+boolean sendLoopStats(boolean mqttOnly) {
+#if LOOP_STATS
+  TelemetryWriter tlm(g_TelemetryBuf, sizeof(g_TelemetryBuf));
+  writeLoopStats(tlm);
+  return sendTelemetry(TOPIC_METRICS, tlm.data(), tlm.length(), mqttOnly, false);
+#else
+  (void)mqttOnly;
+  return false;
+#endif
+}
+
+
+/************************************************************
+ * Write the Loop Metrics of the closed interval
+ * - document of sendLoopStats(), the native fleet sends it
+ *   for its nodes as well
+ ************************************************************
+ * @param[out] tlm writer
+ ************************************************************/ 
+void writeLoopStats(TelemetryWriter& tlm) {
+#if LOOP_STATS
+  static const char* const stageNames[LOOP_STAGE_COUNT] = {
+    "loop", "mqtt", "net", "ota", "pub", "cron", "log", "cmd", "irq", "roller"
+  };
+  const LogHistogram<LOOP_HIST_BUCKETS>* h;
+  uint32_t summary[3];
+  uint32_t mhz = STAMP_PER_US(g_DeviceFacts.cpuFreqMHz ? g_DeviceFacts.cpuFreqMHz : 240);
+  uint32_t ms = g_LoopStats.closedMs();
+  size_t   fields = 1;
+  for (size_t i = 0; i < LOOP_STAGE_COUNT; i++) {
+    fields += (g_LoopStats.stage(i) != nullptr);
+  }
+  for (size_t j = 0; j < LOOP_STATS_JOBS; j++) {
+    fields += (g_LoopStats.job(j) && g_LoopStats.jobName(j));
+  }
+  h = g_LoopStats.stage(LOOP_STAGE_LOOP);
+  tlm.begin(fields);
+  tlm.field("Loop Rate", (uint32_t)(h && ms ? (uint64_t)h->count() * 1000 / ms : 0));
+  for (size_t i = 0; i < LOOP_STAGE_COUNT + LOOP_STATS_JOBS; i++) {
+    bool        stage = (i < LOOP_STAGE_COUNT);
+    const char* name = stage ? stageNames[i] : g_LoopStats.jobName(i - LOOP_STAGE_COUNT);
+    h = stage ? g_LoopStats.stage(i) : g_LoopStats.job(i - LOOP_STAGE_COUNT);
+    if (h && name) {
+      summary[0] = h->percentile(50) / mhz;
+      summary[1] = h->percentile(99) / mhz;
+      summary[2] = h->max() / mhz;
+      tlm.field(name, TelemetryList{summary, 3});
+    }
+  }
+  tlm.end();
+#else
+  tlm.begin(0);
+  tlm.end();
+#endif
+}
+
+
+/************************************************************
+ * Send Sketch State
+ * this will send Status of Sketch (fields: SKETCH_STATE_FIELDS)
+ * as retained message, pre-rendered in g_DeviceFacts:
+ ************************************************************
+ * {"Project version":"1.0.6","Target":"Serial",
+ *  "Build timestamp":"2022-12-14 00:48:05.288080",
+ *  "Sdk Version":"v3.3.5-1-g85c43024c","CpuFreq":240,
+ *  "SketchSize":790608,"Free SketchSpace":1310720,
+ *  "Sketch MD5":"fc84355a94fd722e55310621cf3645da",
+ *  "Flash ChipSize":4194304,"Flash Chip Speed":40000000
+ * }
+ ************************************************************
+ * @param[in] mqttOnly if false, then also Serial Output is generated
+ ************************************************************/ 
+void sendSketchState(boolean mqttOnly) {    
+  if (sendTelemetry(TOPIC_SKETCH, g_DeviceFacts.sketchState, g_DeviceFacts.sketchStateLen, mqttOnly, true)) {
+    g_DeviceFacts.sketchStatePending = false;
+  }
+}
+
+
+/************************************************************
+ * Update Sketch State
+ * - re-render the sketch state document if a value changed
+ *   (only the CPU frequency can change without a reboot)
+ * - it is published by jobSketchState() while MQTT is up
+ ************************************************************/ 
+void updateSketchState(void) {
+  if (ESP.getCpuFreqMHz() != g_DeviceFacts.cpuFreqMHz) {
+    g_DeviceFacts.cpuFreqMHz = ESP.getCpuFreqMHz();
+    renderSketchState();
+  }
+}
+
+
+/************************************************************
+ * Render Sketch State
+ * - encode SKETCH_STATE_FIELDS into g_DeviceFacts.sketchState
+ * - mark it for publishing
+ ************************************************************/ 
+void renderSketchState(void) {
+  TelemetryWriter tlm(g_DeviceFacts.sketchState, sizeof(g_DeviceFacts.sketchState));
+  TELEMETRY_WRITE(tlm, SKETCH_STATE_FIELDS);
+  g_DeviceFacts.sketchStateLen = tlm.length();
+  g_DeviceFacts.sketchStatePending = true;
+}
+                  
+
+/************************************************************
+ * Init Global Vars
+ ************************************************************/ 
+void setupGlobalVars(void){
+  g_Firstrun = true;
+  g_LedState = 0;    
+  g_rebootJob = TIMER_NONE;                // no reboot pending
+  g_rebootRequest = false;
+  g_NetTask = nullptr;                     // single loop() until startNetTask()
+  LOGI(SETUP, "- Global Vars ... done.");
+  delay(DEBUG_SETUP_DELAY);  
+}
+
+
+/************************************************************
+ * Init Device Facts
+ * - read everything that does not change until reboot, once
+ *   (getSketchMD5() reads the whole app partition)
+ * - needs WiFi initialized (MAC for the ClientID)
+ ************************************************************/ 
+void setupDeviceFacts(void) {
+  composeClientID(g_DeviceFacts.clientId, sizeof(g_DeviceFacts.clientId));
+  snprintf(g_DeviceFacts.sketchMD5, sizeof(g_DeviceFacts.sketchMD5), "%s", ESP.getSketchMD5().c_str());
+  g_DeviceFacts.sdkVersion = ESP.getSdkVersion();
+  g_DeviceFacts.cpuFreqMHz = ESP.getCpuFreqMHz();
+  g_DeviceFacts.sketchSize = ESP.getSketchSize();
+  g_DeviceFacts.freeSketchSpace = ESP.getFreeSketchSpace();
+  g_DeviceFacts.flashChipSize = ESP.getFlashChipSize();
+  g_DeviceFacts.flashChipSpeed = ESP.getFlashChipSpeed();
+  renderSketchState();
+  LOGI(SETUP, "- Device Facts ... done.");
+  delay(DEBUG_SETUP_DELAY);
+}
+
+
+/************************************************************
+ * Init GPIO-Ports
+ ************************************************************/ 
+void setupGPIO(void) {  
+  pinMode(DBG_LED, OUTPUT);
+  pinMode(INT_PIN, INPUT_PULLUP);
+  LOGI(SETUP, "- Init GPIO-Port... done.");
+  delay(DEBUG_SETUP_DELAY);  
+}
+
+
+/************************************************************
+ * Init I2C
+ * - I2C bus, configure the MCP 23017 (MCP_COUNT chips)
+ * - a chip that does not answer is skipped
+ ************************************************************/ 
+void setupI2C(void) {  
+  Wire.begin(I2C_SDA, I2C_CLK, I2CSPEED);
+  for (uint8_t i = 0; i < MCP_COUNT; i++) {
+    if (!g_Mcp[i].begin(Wire, MCP_ADDR + i, MCP_INPUTS)) {
+      LOGE(SETUP, "MCP 23017 at 0x%02x not found", MCP_ADDR + i);
+    }
+  }
+  LOGI(SETUP, "- Init I2C... done.");
+  delay(DEBUG_SETUP_DELAY);
+}
+
+
+/************************************************************
+ * Init Rollers
+ * - calibrated travel times, all relays off
+ ************************************************************/ 
+void setupRollers(void) {  
+  g_Rollers.begin(g_RollerUpMs, g_RollerDownMs, micros());
+  g_RollerRelays = 0;
+  g_RollerBusy = 0;
+  g_RollerStatePending = true;
+  g_RollerPublishedAt = millis();
+  LOGI(SETUP, "- Init Rollers... %u configured.", NUM_ROLLERS);
+  delay(DEBUG_SETUP_DELAY);
+}
+
+
+/************************************************************
+ * Init IRQ
+ * IRQ is triggered from MCP 23017
+ * - both edges, debounced by irqDrain()
+ ************************************************************/ 
+void setupIRQ(void) {  
+  g_Irq.stable = digitalRead(INT_PIN);
+  attachInterrupt(INT_PIN, irqHandler, CHANGE);
+  LOGI(SETUP, "- Init IRQ... done.");
+  delay(DEBUG_SETUP_DELAY);
+}
+
+
+/************************************************************
+ * MQTT Init
+ * - register the callback, set the buffer size
+ * - the connection is made by netStep() as soon as WiFi has
+ *   an IP (see connectMQTT)
+ ************************************************************/
+void setupMQTT(void) {
+  LOGI(SETUP, "- Init MQTT... ClientID: %s", g_DeviceFacts.clientId);
+  mqtt.setCallback(mqttCallback);
+  mqtt.setBufferSize(MQTT_BUFSIZE);
+  mqtt.setSocketTimeout(T_MQTT_SOCKET_TIMEOUT);
+#ifdef OUTBOX_SPILL_PARTITION
+  if (g_OutboxSpill.begin(OUTBOX_SPILL_PARTITION)) {
+    g_Outbox.setSpill(&g_OutboxSpill);
+  } else {
+    LOGE(SETUP, "ERROR: Outbox spill partition " OUTBOX_SPILL_PARTITION " not found");
+  }
+#endif
+  delay(DEBUG_SETUP_DELAY);
+}
+
+
+/************************************************************
+ * Init Timer Jobs
+ * - periodic jobs run on fixed deadlines, no drift
+ * - applications add their own jobs with g_Timers.every()
+ *   and g_Timers.after() (max. TIMER_JOBS in total)
+ ************************************************************/ 
+void setupTimers(void) {
+  g_Timers.begin(millis());
+  g_Timers.every(T_NET_MONITORING, monitorConnections);
+  g_Timers.every(T_CPU_STATE,      jobCPUState);
+  g_Timers.every(T_NETWORK_STATE,  jobNetworkState);
+  g_Timers.every(T_IRQ_STATE,      jobIrqState);
+  g_Timers.every(T_SKETCH_STATE,   updateSketchState);
+  g_Timers.every(T_SKETCH_PUBLISH, jobSketchState);
+  g_Timers.every(T_OUTBOX_DRAIN,   jobOutbox);
+  g_Timers.every(T_LOG_FLUSH,      jobLogFlush);
+#if LOOP_STATS
+  g_Timers.every(T_METRICS_STATE,  jobLoopStats);
+  g_Timers.runner(cronRunner);
+  g_LoopStats.nameJob(monitorConnections, "monitor");
+  g_LoopStats.nameJob(jobCPUState,        "cpu");
+  g_LoopStats.nameJob(jobNetworkState,    "network");
+  g_LoopStats.nameJob(jobIrqState,        "irqstate");
+  g_LoopStats.nameJob(updateSketchState,  "sketch");
+  g_LoopStats.nameJob(jobSketchState,     "sketchpub");
+  g_LoopStats.nameJob(jobOutbox,          "outbox");
+  g_LoopStats.nameJob(jobLoopStats,       "metrics");
+  g_LoopStats.nameJob(jobLogFlush,        "logflush");
+  g_LoopStats.newInterval(millis());
+#endif
+  LOGI(SETUP, "- Init Timer Jobs... %u registered.", (unsigned)g_Timers.count());
+  delay(DEBUG_SETUP_DELAY);
+}
+
+
+/************************************************************
+ * Init Tickless Idle (see idleWait.h)
+ * - IDLE_WAIT: loop() sleeps between the passes
+ * - IDLE_LIGHT_SLEEP: automatic light sleep, if the SDK
+ *   supports it
+ ************************************************************/
+void setupIdle(void) {
+#if IDLE_WAIT
+  g_IdleOn = idleBegin();
+  if (!g_IdleOn) {
+    LOGE(SETUP, "ERROR: idle wait not available, loop() spins");
+  }
+#else
+  g_IdleOn = false;
+#endif
+#if IDLE_LIGHT_SLEEP
+  if (!idleLightSleep()) {
+    LOGE(SETUP, "ERROR: light sleep not supported by the SDK");
+  }
+#endif
+  LOGI(SETUP, "- Init Idle... %s, max. %u ms per sleep", g_IdleOn ? "tickless" : "spinning", (unsigned)IDLE_LATENCY_MS);
+  delay(DEBUG_SETUP_DELAY);
+}
+
+
+/************************************************************
+ * Init Over-The-Air Update Handler
+ * - set OTA-Password with ArduinoOTA.setPasswordHash("[MD5(Pass)]");
+ * MD5 ("mysecretOtaPassword") = 5386fe58bd9627e6a22aee5f1726c868 
+ * ATTENTION: setPasswordHash MUST NOT CONTAIN CAPS Letters A-F
+ *   NO:  5386FE58BD9627E6A22AEE5F1726C868
+ *   YES: 5386fe58bd9627e6a22aee5f1726c868
+ ************************************************************/ 
+void setupOTA(void) {  
+  // Set Port 3232
+  ArduinoOTA.setPort(3232);
+  
+  // Hostname defaults to esp8266-[ChipID]
+  ArduinoOTA.setHostname("homectrl32");
   
-  // MQTT Command Parser
-  // "command", Params, Callback-Function 
-  // s: String, d:Double, u:Unsigned Int , i:Signed Integer  
-  parser.registerCommand("hello",  "", &cmd_hello);                // hello
-  parser.registerCommand("helloadd", "uu", &cmd_helloadd);          // helloadd [SUM1] [SUM2]
-  parser.registerCommand("helloecho", "s", &cmd_helloecho);         // helloecho [STRING]
-  parser.registerCommand("reset", "", &cmd_reset);                  // reset
+  // authenticate using password      
+  // ArduinoOTA.setPasswordHash("45159b2115f99bf96aa00fa2b9da0cb9");
+  ArduinoOTA.setPasswordHash(g_otahash);
+
+  // OTA Callback: onStart
+  ArduinoOTA.onStart([]() {
+    g_OtaStartMs = millis();
+    g_OtaTotal = 0;
+    // NOTE: if updating FS this would be the place to unmount FS using FS.end()
+    if (ArduinoOTA.getCommand() == U_FLASH) {
+      LOGI(MAIN, "Update Started: sketch");
+    } else { // U_FS
+      LOGI(MAIN, "Update Started: filesystem");
+    }
+  });  
+
+  // OTA Callback: onEnd
+  ArduinoOTA.onEnd([]() {
+    otaProgress(g_OtaStartMs, g_OtaTotal, g_OtaTotal, g_OtaTotal, true);
+    LOGI(MAIN, "Update finished");
+  });  
+
+  // OTA Callback: onProgress (bounded rate, see otaProgress)
+  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
+    g_OtaTotal = total;
+    otaProgress(g_OtaStartMs, progress, total, progress, false);
+  });  
+
+  // OTA Callback: onError
+  ArduinoOTA.onError([](ota_error_t error) {
+    const char* reason = (error == OTA_AUTH_ERROR)    ? "Auth Failed" :
+                         (error == OTA_BEGIN_ERROR)   ? "Begin Failed" :
+                         (error == OTA_CONNECT_ERROR) ? "Connect Failed" :
+                         (error == OTA_RECEIVE_ERROR) ? "Receive Failed" :
+                         (error == OTA_END_ERROR)     ? "End Failed" : "";
+    LOGE(MAIN, "OTA Error[%u]: %s", (unsigned)error, reason);
+  });  
+
+  // OTA Init
+  ArduinoOTA.begin();
+
+  LOGI(SETUP, "- Init OTA... done.");
+  delay(DEBUG_SETUP_DELAY);  
+}
+
+
+/************************************************************
+ * Delta OTA: chunk received on TOPIC_OTA
+ * - u32 offset (little endian) + patch bytes, see otaDelta.h
+ * - queued (up to OTA_DELTA_WINDOW chunks), answered by
+ *   otaDeltaStep() once the chunk is used up
+ * - answered now: start, refused (out of order, window
+ *   full), error
+ * @param[in] payload Message received
+ * @param[in] length Length of the Message received
+ ************************************************************/ 
+void otaDeltaReceive(const byte* payload, unsigned int length) {
+  OtaDeltaState was = g_OtaDelta.state();
+  uint32_t offset;
+  if (length < sizeof(offset)) {
+    LOGE(MAIN, "OTA delta: message of %u bytes ignored", length);
+    return;
+  }
+  memcpy(&offset, payload, sizeof(offset));
+  if (g_OtaDelta.receive(offset, payload + sizeof(offset), length - sizeof(offset), g_DeviceFacts.sketchMD5,
+                         millis())) {
+    otaDeltaAnswer(was);
+  }
+}
+
+
+/************************************************************
+ * Delta OTA: apply the queued chunks (netLoop)
+ * - at most one sector to flash per pass
+ * - progress to the log (otaProgress)
+ ************************************************************/ 
+void otaDeltaStep(void) {
+  OtaDeltaState        was = g_OtaDelta.state();
+  const OtaDeltaStats& s = g_OtaDelta.stats();
+  if (g_OtaDelta.step(millis())) {
+    otaDeltaAnswer(was);
+  }
+  if (g_OtaDelta.state() == OTA_DELTA_RUNNING) {
+    otaProgress(s.startMs, s.newBytes, g_OtaDelta.newSize(), s.patchBytes, false);
+  }
+}
+
+
+/************************************************************
+ * Delta OTA: answer on TOPIC_OTA_ACK
+ * - "ack N", "done MD5" or "error REASON"
+ * - done: boot partition switched, reboot after 
+ *   T_REBOOT_TIMEOUT (as the command "reset")
+ * @param[in] was state before the message / step
+ ************************************************************/ 
+void otaDeltaAnswer(OtaDeltaState was) {
+  const OtaDeltaStats& s = g_OtaDelta.stats();
+  char   msg[48];
+  size_t len = g_OtaDelta.answer(msg, sizeof(msg));
+  mqttPub(TOPIC_OTA_ACK, msg, len, true, false);
+  if (g_OtaDelta.state() == was) {
+    return;
+  }
+  switch (g_OtaDelta.state()) {
+    case OTA_DELTA_RUNNING:
+      LOGI(MAIN, "OTA delta: started, image of %u bytes (flags %u)", (unsigned)g_OtaDelta.newSize(),
+           (unsigned)g_OtaDelta.flags());
+      break;
+    case OTA_DELTA_DONE:
+      otaProgress(s.startMs, s.newBytes, g_OtaDelta.newSize(), s.patchBytes, true);
+      LOGI(MAIN, "OTA delta: MD5 %s, rebooting", g_OtaDelta.newMD5());
+      g_rebootRequest = true;
+      break;
+    case OTA_DELTA_ERROR:
+      LOGE(MAIN, "OTA delta: %s (patch byte %u)", g_OtaDelta.error(), (unsigned)s.patchBytes);
+      break;
+    default:
+      break;
+  }
+}
+
+
+/************************************************************
+ * OTA Progress to the log (TOPIC_LOG)
+ * - at most once per T_OTA_PROGRESS, the last one always
+ * - bytes per second: received over the air (patch or
+ *   image), since the start of the update
+ * @param[in] startMs millis() of the start
+ * @param[in] done image bytes written
+ * @param[in] total image bytes
+ * @param[in] received bytes received
+ * @param[in] last true at the end: total time
+ ************************************************************/ 
+void otaProgress(uint32_t startMs, uint32_t done, uint32_t total, uint32_t received, boolean last) {
+  uint32_t now = millis(), ms = now - startMs;
+  uint32_t rate = ms ? (uint32_t)((uint64_t)received * 1000 / ms) : 0;
+  if (!last && (now - g_OtaProgressMs < T_OTA_PROGRESS)) {
+    return;
+  }
+  g_OtaProgressMs = now;
+  if (last) {
+    LOGI(MAIN, "OTA: %u bytes in %u ms, %u bytes received (%u B/s)", (unsigned)done, (unsigned)ms,
+         (unsigned)received, (unsigned)rate);
+  } else {
+    LOGI(MAIN, "OTA: %u/%u bytes (%u %%), %u bytes received (%u B/s)", (unsigned)done, (unsigned)total,
+         (unsigned)(total ? (uint64_t)done * 100 / total : 0), (unsigned)received, (unsigned)rate);
+  }
+}
+
+
+/************************************************************
+ * Init Wifi
+ * - SSID: WIFI_SSID
+ * - PSK:  WIFI_PSK
+ * - only starts the association, netStep() takes it from
+ *   there (no waiting in setup)
+ * - uses the cached BSSID and lease if valid (see netBegin)
+ ************************************************************/
+void setupWIFI(void) {
+  WiFi.mode(WIFI_STA);
+  netBegin();
+  LOGI(SETUP, "- Init WiFi... connecting to '%s' (%s)", g_wifissid, g_Net.fast ? "cached BSSID and lease" : "scan + DHCP");
+  delay(DEBUG_SETUP_DELAY);
+}
+
+
+/************************************************************
+ * Main Setup
+ * - setupGPIO
+ * - setupWIFI
+ * - setupOTA
+ * - setupGlobalVars 
+ ************************************************************/ 
+void setup(void) {  
+  // Serial Port
+  Serial.begin(115200);  
+  LOGI(MAIN, "### Darios ESP32 Hello-World ###");
+  LOGI(MAIN, "Version: %s, Target: %s, Build timestamp: %s", VERSION, TARGET, BUILD_TIMESTAMP);
+  LOGI(SETUP, "Init ...");
+  delay(DEBUG_SETUP_DELAY);  
+
+  // Global Vars
+  setupGlobalVars();  
+
+  // GPIO-Ports
+  setupGPIO(); 
+
+  // WiFi
+  setupWIFI();
+
+  // Device Facts (ClientID needs the MAC)
+  setupDeviceFacts();
+
+  // OTA-Update-Handler  
+  setupOTA();    
+
+  // MQTT
+  setupMQTT();
+
+  // I2C, MCP 23017
+  setupI2C();
+
+  // Rollers (relays on the MCP 23017)
+  setupRollers();
+
+  // IRQ 
+  setupIRQ();    
   
+  // Timer Jobs
+  setupTimers();
+
+  // Tickless Idle
+  setupIdle();
+
+  // MQTT Commands: see Command Table g_CommandDefs
+  LOGI(SETUP, "- %u MQTT-Commands registered", (unsigned)g_Commands.count());
+
   // Setup finished  
-  dbgout("Init complete, starting Main-Loop");
-  DBG_SETUP.println("##########################################");
+  LOGI(MAIN, "Init complete, starting Main-Loop");
   delay(DEBUG_SETUP_DELAY);
+
+  // MQTT Receive Task
+#if MQTT_RX_TASK
+  if (!startRxTask()) {
+    LOGE(MAIN, "ERROR: MQTT receive task not started, mqtt.loop()");
+  }
+#endif
+#if MQTT_QOS1
+  g_QosOn = true;                  // QoS 0 while the receive task does not run
+#endif
+
+  // Network Task on its own core
+#if DUAL_CORE
+  if (!startNetTask()) {
+    LOGE(MAIN, "ERROR: network task not started, single loop()");
+  }
+#endif
+}
+
+
+/************************************************************
+ * Start the Network Task (dual-core, see taskSplit.h)
+ * - netLoop() runs on NET_TASK_CORE from now on, loop() 
+ *   only runs appLoop()
+ * @return true if the task was created
+ ************************************************************/ 
+boolean startNetTask(void) {
+  TaskHandle_t task = nullptr;
+  g_NetTaskStop = false;
+  if (xTaskCreatePinnedToCore(netTask, "net", NET_TASK_STACK, nullptr, NET_TASK_PRIO, &task, 
+                              NET_TASK_CORE) != pdPASS) {
+    return false;
+  }
+  g_NetTask = task;
+  return true;
+}
+
+
+/************************************************************
+ * Stop the Network Task
+ * - back to the single loop(), returns when the task ended
+ ************************************************************/ 
+void stopNetTask(void) {
+  g_NetTaskStop = true;
+  while (g_NetTask) {
+    vTaskDelay(1);
+  }
+}
+
+
+/************************************************************
+ * Network Task
+ * - netLoop(), then sleep until the network side has work
+ *   (idleNet), else one tick per pass
+ ************************************************************/ 
+void netTask(void* param) {
+  (void)param;
+  while (!g_NetTaskStop) {
+    netLoop();
+    int      readSock, writeSock;
+    uint32_t budget = idleNetBudget(readSock, writeSock);
+    if (!g_IdleOn || !idleSleep(g_IdleNet, IDLE_EV_NET, budget, readSock, writeSock)) {
+      vTaskDelay(1);
+    }
+  }
+  g_NetTask = nullptr;
+  vTaskDelete(nullptr);
+}
+
+
+/************************************************************
+ * Start the MQTT Receive Task (see mqttRx.h)
+ * - from the network side, or while the network task is
+ *   stopped (mqtt.loop() must not run at the same time)
+ * - ONLINE already: the task takes the socket right away
+ * @return true if the task was created
+ ************************************************************/ 
+boolean startRxTask(void) {
+  TaskHandle_t task = nullptr;
+  g_RxTaskStop = false;
+  if (xTaskCreatePinnedToCore(rxTask, "mqttRx", MQTT_RX_TASK_STACK, nullptr, MQTT_RX_TASK_PRIO, &task,
+                              MQTT_RX_TASK_CORE) != pdPASS) {
+    return false;
+  }
+  g_RxTask = task;
+  if (g_Net.phase == NET_ONLINE) {
+    mqttRxArm();
+  }
+  return true;
+}
+
+
+/************************************************************
+ * Stop the MQTT Receive Task
+ * - back to mqtt.loop(), returns when the task ended
+ * - QoS 1 packets in flight are given up (mqtt.loop() drops
+ *   their PUBACK)
+ ************************************************************/ 
+void stopRxTask(void) {
+  g_RxGate.disarm();
+  g_RxTaskStop = true;
+  while (g_RxTask) {
+    vTaskDelay(1);
+  }
+  mqttQosReap();
+  g_QosStats.abandoned += g_QosWindow.clear();
+}
+
+
+/************************************************************
+ * MQTT Receive Task
+ * - blocks on the socket while armed (MQTT_RX_POLL_MS per
+ *   call, so a disarm never waits longer), else sleeps
+ * - a closed socket or a protocol error sets g_RxLost, the
+ *   network side drops the connection (mqttRxLoop)
+ ************************************************************/ 
+void rxTask(void* param) {
+  static uint8_t segment[MQTT_RX_SEGMENT];
+  (void)param;
+  while (!g_RxTaskStop) {
+    int sock = g_RxLost ? -1 : g_RxGate.take();
+    if (sock < 0) {
+      g_RxGate.release();
+      vTaskDelay(MQTT_RX_POLL_MS / portTICK_PERIOD_MS);
+      continue;
+    }
+    int n = mqttRxRecv(sock, segment, sizeof(segment), MQTT_RX_POLL_MS);
+    if (n > 0) {
+      rxFeed(segment, (size_t)n);
+    } else if (n < 0) {
+      g_RxLost = true;
+    }
+    g_RxGate.release();
+  }
+  g_RxTask = nullptr;
+  vTaskDelete(nullptr);
+}
+
+
+/************************************************************
+ * Decode received Bytes (receive task)
+ * - packet by packet, each one complete is dispatched
+ * @param[in] data bytes from the socket
+ * @param[in] n number of bytes
+ ************************************************************/ 
+void rxFeed(const uint8_t* data, size_t n) {
+  g_RxLastIn = millis();
+  while (n) {
+    size_t used = g_RxDecoder.feed(data, n);
+    data += used;
+    n -= used;
+    if (g_RxDecoder.error()) {
+      g_RxLost = true;
+      return;
+    }
+    if (g_RxDecoder.complete()) {
+      rxDispatch();
+      g_RxDecoder.next();
+    }
+  }
+  g_RxStats.oversize = g_RxDecoder.oversize();
+}
+
+
+/************************************************************
+ * Dispatch a complete Packet (receive task)
+ * - TOPIC_CMD: to the application (g_CmdQueue, as the
+ *   network task does it in dual-core), micros() at
+ *   arrival in front (cmdProbe.h)
+ * - other PUBLISH (TOPIC_OTA): to the network side,
+ *   topic + '\0' + payload in g_RxNetQueue
+ * - PUBACK: the QoS 1 window (mqttQos.h), mqttQosReap()
+ *   frees the packet on the network side
+ * - PINGRESP, SUBACK: only count as inbound traffic
+ ************************************************************/ 
+void rxDispatch(void) {
+  const char* topic;
+  size_t      topicLen, len;
+  uint8_t*    payload;
+  uint8_t*    rec;
+  uint32_t    rx = micros();
+  g_RxStats.packets++;
+  if (g_RxDecoder.type() == MQTT_PKT_PUBACK) {
+    payload = g_RxDecoder.body();
+    if ((g_RxDecoder.length() >= 2) && g_QosWindow.ack(((uint16_t)payload[0] << 8) | payload[1], micros())) {
+      idleWake(IDLE_EV_RX);
+    }
+    return;
+  }
+  if (!g_RxDecoder.publish(topic, topicLen, payload, len)) {
+    return;
+  }
+  if ((topicLen == sizeof(TOPIC_CMD) - 1) && !memcmp(topic, TOPIC_CMD, topicLen)) {
+    if (!(rec = g_CmdQueue.reserve(sizeof(rx) + len + 1))) {
+      g_RxStats.dropped++;
+      return;
+    }
+    memcpy(rec, &rx, sizeof(rx));
+    memcpy(rec + sizeof(rx), payload, len);
+    rec[sizeof(rx) + len] = '\0';
+    g_CmdQueue.commit();
+    g_RxStats.commands++;
+    idleWake(IDLE_EV_CMD);
+    return;
+  }
+  if (!(rec = g_RxNetQueue.reserve(topicLen + 1 + len))) {
+    g_RxStats.dropped++;
+    return;
+  }
+  memcpy(rec, topic, topicLen);
+  rec[topicLen] = '\0';
+  memcpy(rec + topicLen + 1, payload, len);
+  g_RxNetQueue.commit();
+  idleWake(IDLE_EV_RX);
+}
+
+
+/************************************************************
+ * Hand the MQTT Socket to the Receive Task (netOnline)
+ * - PubSubClient is done with it (CONNACK read)
+ ************************************************************/ 
+void mqttRxArm(void) {
+  g_RxDecoder.next();                      // the task has let go (disarm), no partial packet
+  g_RxLost = false;
+  g_RxLastIn = millis();
+  g_RxPingAt = 0;
+  g_RxGate.arm(myWiFiClient.fd());
+}
+
+
+/************************************************************
+ * MQTT on the Network Side with the Receive Task
+ * - instead of mqtt.loop(): publishes from g_RxNetQueue
+ *   (delta OTA chunks), keepalive
+ * - QoS 1: frees the acknowledged packets, the outbox goes
+ *   on where the full window stopped it
+ * - PINGREQ after MQTT_KEEPALIVE s without inbound bytes;
+ *   no byte within MQTT_KEEPALIVE s after it, no PUBACK
+ *   within MQTT_QOS_ACK_TIMEOUT, a closed socket or a
+ *   protocol error: the connection is dropped
+ * @return false if not (or no longer) connected
+ ************************************************************/ 
+boolean mqttRxLoop(void) {
+  static const uint8_t pingReq[2] = {MQTT_PKT_PINGREQ << 4, 0};
+  size_t   n;
+  uint8_t* rec;
+  while ((rec = g_RxNetQueue.peek(n))) {
+    size_t topicLen = strlen((char*)rec);
+    if (!strcmp((char*)rec, TOPIC_OTA)) {
+      otaDeltaReceive(rec + topicLen + 1, (unsigned int)(n - topicLen - 1));
+    }
+    g_RxNetQueue.release();
+  }
+  if (mqttQosReap() && !g_Outbox.empty()) {
+    jobOutbox();
+  }
+  int sock = g_RxGate.armed();
+  if (sock < 0) {
+    return false;
+  }
+  uint32_t now = millis();
+  uint32_t lastIn = g_RxLastIn;
+  boolean  lost = g_RxLost;
+  if (g_RxPingAt && ((int32_t)(lastIn - g_RxPingAt) >= 0)) {
+    g_RxPingAt = 0;
+  } else if (g_RxPingAt) {
+    lost = lost || ((now - g_RxPingAt) >= MQTT_KEEPALIVE * 1000u);
+  } else if ((now - lastIn) >= MQTT_KEEPALIVE * 1000u) {
+    lost = lost || !mqttRxSend(sock, pingReq, sizeof(pingReq));
+    g_RxPingAt = now ? now : 1;
+    g_RxStats.pings++;
+  }
+  if (g_QosWindow.oldest(micros()) >= MQTT_QOS_ACK_TIMEOUT * 1000u) {
+    LOGE(MQTT, "ERROR: no PUBACK within %u ms", (unsigned)MQTT_QOS_ACK_TIMEOUT);
+    g_QosStats.timeouts++;
+    lost = true;
+  }
+  if (lost) {
+    LOGE(NET, "MQTT receive: connection lost");
+    g_RxStats.lost++;
+    g_RxGate.disarm();
+    myWiFiClient.stop();
+    return false;
+  }
+  return mqtt.connected();
+}
+
+
+/************************************************************
+ * Free the acknowledged QoS 1 Packets (network side)
+ * - ack latency into g_QosStats.ackUs
+ * @return packets freed
+ ************************************************************/
+uint32_t mqttQosReap(void) {
+  uint32_t n = g_QosWindow.reap([](uint32_t us) { g_QosStats.ackUs.add(us); });
+  g_QosStats.acked += n;
+  return n;
+}
+
+
+/************************************************************
+ * Send the unacknowledged QoS 1 Packets again (netOnline)
+ * - DUP set, in the order of the first send, before the
+ *   outbox is drained
+ ************************************************************/
+void mqttQosResend(void) {
+  int sock = g_RxGate.armed();
+  mqttQosReap();
+  uint32_t n = g_QosWindow.resend([sock](const uint8_t* packet, size_t len) {
+    return mqttRxSend(sock, packet, len);
+  }, micros());
+  if (n) {
+    g_QosStats.retransmits += n;
+    LOGI(MQTT, "QoS 1: %u publishes sent again", (unsigned)n);
+  }
 }
 
 
 /************************************************************
  * Main Loop
- * - OTA handler
- * - HeartBeat handler
+ * - single loop(): network and application
+ * - dual-core: only the application, the network task runs
+ *   netLoop()
  ************************************************************/ 
 void loop(void) {
-  // Main Handler
-  resetHandler();                 // reset ESP if triggered  
-  monitorConnections();            // Monitor (and restore) Wifi & MQTT Connection
-  mqtt.loop();                     // handle MQTT Messaging  
-  ArduinoOTA.handle();             // handle OTA  
-  cronjob();                       // Cronjob-Handler  
-  // APP Handler
-  
+  LOOP_STAGE(LOOP_STAGE_LOOP, {
+    if (!g_NetTask) {
+      netLoop();
+    }
+    appLoop();
+  });
   // First Loop completed
   g_Firstrun = false;              
+  // sleep until something is due (see idleWait.h)
+  if (g_IdleOn) {
+    idleLoop();
+  }
+}
+
+
+/************************************************************
+ * Idle after a loop() Pass
+ * - single loop(): until the earlier of both sides has work,
+ *   on the MQTT socket, INT_PIN
+ * - dual-core: only the application side (INT_PIN, commands
+ *   from the network task)
+ ************************************************************/ 
+void idleLoop(void) {
+  int      readSock = -1, writeSock = -1;
+  uint32_t events = IDLE_EV_APP;
+  uint32_t budget = idleAppBudget();
+  if (!g_NetTask && budget) {
+    uint32_t net = idleNetBudget(readSock, writeSock);
+    budget = (net < budget) ? net : budget;
+    events |= IDLE_EV_NET;
+  }
+  idleSleep(g_IdleLoop, events, budget, readSock, writeSock);
+}
+
+
+/************************************************************
+ * Idle Budget of the Network Side
+ * - 0 while publishes, received OTA chunks, log entries or
+ *   a delta OTA are pending, or the client holds received
+ *   bytes
+ * - else the next timer job and, depending on the phase:
+ *   - WIFI_CONNECTING: poll every T_IDLE_WIFI_POLL
+ *   - MQTT_CONNECTING: next attempt, or the TCP connect
+ *     (writeSock) until its timeout
+ *   - ONLINE: data on the MQTT socket (readSock); with the
+ *     receive task only its events (IDLE_EV_RX)
+ * @param[out] readSock socket to wake on when readable
+ * @param[out] writeSock socket to wake on when writable
+ * @return us, IDLE_NONE if nothing is due
+ ************************************************************/ 
+uint32_t idleNetBudget(int& readSock, int& writeSock) {
+  uint32_t now = millis();
+  uint32_t ms = g_Timers.nextDeadline(now);
+  readSock = -1;
+  writeSock = -1;
+  if (!g_PubQueue.empty() || !g_RxNetQueue.empty() || !g_Log.empty() || g_LogWaiting ||
+      (g_OtaDelta.state() == OTA_DELTA_RUNNING)) {
+    return 0;
+  }
+  switch (g_Net.phase) {
+    case NET_WIFI_CONNECTING:
+      ms = (ms < T_IDLE_WIFI_POLL) ? ms : T_IDLE_WIFI_POLL;
+      break;
+    case NET_MQTT_CONNECTING:
+      if (g_Net.mqttStage == NET_MQTT_TCP) {
+        int32_t left = (int32_t)(g_Net.tcpSince + T_MQTT_TCP_TIMEOUT - now);
+        writeSock = g_Net.sock;
+        ms = (left <= 0) ? 0 : ((uint32_t)left < ms) ? (uint32_t)left : ms;
+      } else {
+        int32_t left = (int32_t)(g_Net.nextAttempt - now);
+        ms = (left <= 0) ? 0 : ((uint32_t)left < ms) ? (uint32_t)left : ms;
+      }
+      break;
+    case NET_ONLINE:
+      if (g_RxTask) {
+        break;                             // the receive task reads the socket
+      }
+      if (myWiFiClient.available()) {
+        return 0;
+      }
+      readSock = myWiFiClient.fd();
+      break;
+  }
+  return (ms < IDLE_NONE / 1000) ? ms * 1000 : IDLE_NONE;
+}
+
+
+/************************************************************
+ * Idle Budget of the Application Side
+ * - 0 while commands or IRQ events are queued, or a relay
+ *   write has to be retried
+ * - else the end of the IRQ debounce, the next start or
+ *   stop of a roller and a pending roller state
+ * @return us, IDLE_NONE if nothing is due
+ ************************************************************/ 
+uint32_t idleAppBudget(void) {
+  if (!g_CmdQueue.empty() || !g_IrqRing.empty() || (g_Rollers.relays() != g_RollerRelays)) {
+    return 0;
+  }
+  uint32_t us = g_Rollers.nextEvent(micros());
+  if (g_RollerStatePending) {
+    uint32_t since = millis() - g_RollerPublishedAt;
+    uint32_t left = (since < T_ROLLER_PUBLISH) ? (T_ROLLER_PUBLISH - since) * 1000 : 0;
+    us = (left < us) ? left : us;
+  }
+  if (g_Irq.pending) {
+    uint32_t cyclesPerUs = STAMP_PER_US(g_DeviceFacts.cpuFreqMHz);
+    uint32_t quiet = (IRQ_CYCLES() - g_Irq.lastAt) / cyclesPerUs;
+    uint32_t left = (quiet < IRQ_DEBOUNCE_US) ? IRQ_DEBOUNCE_US - quiet : 0;
+    us = (left < us) ? left : us;
+  }
+  return us;
+}
+
+
+/************************************************************
+ * Sleep for an Idle Budget (see idleWait.h)
+ * - at most IDLE_LATENCY_MS, earlier on the sockets or the
+ *   events
+ * - the time asleep and the wake-up reason go to stats
+ * @param[in,out] stats statistics of the calling task
+ * @param[in] events IDLE_EV_... to wake for
+ * @param[in] budget us until something is due, 0: no sleep
+ * @param[in] readSock wake if readable (-1: none)
+ * @param[in] writeSock wake if writable (-1: none)
+ * @return true if it slept
+ ************************************************************/ 
+boolean idleSleep(IdleStats& stats, uint32_t events, uint32_t budget, int readSock, int writeSock) {
+  if (!budget) {
+    stats.busyPass();
+    return false;
+  }
+  uint32_t us = (budget < IDLE_LATENCY_MS * 1000u) ? budget : IDLE_LATENCY_MS * 1000u;
+  uint32_t t0 = micros();
+  uint8_t  reason = idleWait(events, readSock, writeSock, us);
+  if ((reason == IDLE_WAKE_TIMER) && (us < budget)) {
+    reason = IDLE_WAKE_BOUND;
+  }
+  stats.add(reason, micros() - t0);
+  return true;
+}
+
+
+/************************************************************
+ * Network Loop
+ * - MQTT, WiFi / MQTT state machine, OTA handler, delta OTA
+ * - Timer Jobs (system jobs, reboot)
+ ************************************************************/ 
+void netLoop(void) {
+  boolean alive;
+  LOOP_STAGE(LOOP_STAGE_MQTT, alive = g_RxTask ? mqttRxLoop() : mqtt.loop());   // handle MQTT Messaging
+  if (!alive || (g_Net.phase != NET_ONLINE)) {
+    LOOP_STAGE(LOOP_STAGE_NET, netStep());             // not ONLINE: bring up WiFi / MQTT
+  }
+  LOOP_STAGE(LOOP_STAGE_OTA, (ArduinoOTA.handle(), otaDeltaStep()));   // handle OTA, apply delta OTA chunk
+  LOOP_STAGE(LOOP_STAGE_PUB, taskPubDrain());          // publishes of the application (dual-core)
+  if (g_rebootRequest.exchange(false) && (g_rebootJob == TIMER_NONE)) {   // taken and cleared in one step
+    g_rebootJob = g_Timers.after(T_REBOOT_TIMEOUT, resetHandler);
+  }
+  LOOP_STAGE(LOOP_STAGE_CRON, cronjob());              // Timer Jobs (incl. Wifi & MQTT Monitoring, reboot)
+  LOOP_STAGE(LOOP_STAGE_LOG, g_LogWaiting = logDrain());   // Log entries to UART and TOPIC_LOG batch
+}
+
+
+/************************************************************
+ * Application Loop
+ * - commands received by the network task (dual-core)
+ * - IRQ events (debounced edges of INT_PIN)
+ * - rollers
+ * - application handlers
+ ************************************************************/ 
+void appLoop(void) {
+  LOOP_STAGE(LOOP_STAGE_CMD, taskCmdDrain());
+  LOOP_STAGE(LOOP_STAGE_IRQ, irqDrain());
+  LOOP_STAGE(LOOP_STAGE_ROLLER, rollerLoop());
+  // APP Handler
+  
 }
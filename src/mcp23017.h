@@ -0,0 +1,214 @@
+/*!
+ * @file mcp23017.h
+ */
+/************************************************************
+ * MCP23017 I/O Expander
+ ************************************************************
+ * 16 bit I2C port expander, port A = bits 0..7, port B =
+ * bits 8..15 of every uint16_t below. Several chips share
+ * one bus (addresses 0x20..0x27) and one interrupt line:
+ *
+ *   IOCON: BANK=0 (A/B registers interleaved), SEQOP=0
+ *          (address pointer increments), MIRROR=1 (INTA =
+ *          INTB), ODR=1 (open drain: INT of all chips wired
+ *          to INT_PIN with its pull-up)
+ *
+ * Interrupt path, one I2C transaction per chip:
+ *
+ *   S addr+W 0x0E Sr addr+R INTFA INTFB INTCAPA INTCAPB
+ *                           GPIOA GPIOB P
+ *
+ *   the read of INTCAP/GPIO clears the interrupt of the chip
+ *
+ * - register shadows (IODIR, GPPU, GPINTEN, OLAT): writes only
+ *   go out for the ports whose bits change, both ports of a
+ *   register pair in one transaction
+ * - inputs: pull-up and interrupt on change enabled, outputs
+ *   start low (OLAT is written before IODIR)
+ * - no heap, no String; a failed transaction returns false
+ *   and counts an error
+ ************************************************************/
+#ifndef _MCP23017_H_
+#define _MCP23017_H_
+
+#include <Arduino.h>
+#include <Wire.h>
+
+// registers (IOCON.BANK = 0)
+#define MCP_IODIRA        0x00
+#define MCP_IPOLA         0x02
+#define MCP_GPINTENA      0x04
+#define MCP_DEFVALA       0x06
+#define MCP_INTCONA       0x08
+#define MCP_IOCON         0x0A
+#define MCP_GPPUA         0x0C
+#define MCP_INTFA         0x0E
+#define MCP_INTCAPA       0x10
+#define MCP_GPIOA         0x12
+#define MCP_OLATA         0x14
+// IOCON bits
+#define MCP_IOCON_MIRROR  0x40
+#define MCP_IOCON_SEQOP   0x20
+#define MCP_IOCON_ODR     0x04
+
+struct McpInterrupt {
+  uint16_t    flags;                       // INTF: pins that caused the interrupt
+  uint16_t    captured;                    // INTCAP: inputs at the time of the interrupt
+  uint16_t    gpio;                        // GPIO: inputs now
+};
+
+struct McpStats {
+  uint32_t    transactions;                // I2C transactions (START .. STOP)
+  uint32_t    bytesOut;                    // register address + data written
+  uint32_t    bytesIn;                     // data read
+  uint32_t    writesSkipped;               // writes saved by the shadows
+  uint32_t    errors;                      // NACK / bus errors
+};
+
+class Mcp23017 {
+  public:
+    /************************************************************
+     * Configure the chip
+     * @param[in] wire    I2C bus (begin() done)
+     * @param[in] address 0x20..0x27
+     * @param[in] inputs  bit set: input with pull-up and
+     *                    interrupt on change, else output (low)
+     * @return false if the chip does not answer
+     ************************************************************/
+    bool begin(TwoWire& wire, uint8_t address, uint16_t inputs) {
+      McpInterrupt  irq;
+      const uint8_t iocon = MCP_IOCON_MIRROR | MCP_IOCON_ODR;
+      const uint8_t low[2] = {0, 0};
+      uint8_t cfg[6] = {(uint8_t)inputs, (uint8_t)(inputs >> 8), 0, 0,
+                        (uint8_t)inputs, (uint8_t)(inputs >> 8)};   // IODIR, IPOL, GPINTEN
+      _wire = &wire;
+      _address = address;
+      _olat = 0;
+      _iodir = _gppu = _gpinten = inputs;
+      _present = writeRegs(MCP_IOCON, &iocon, 1) &&
+                 writeRegs(MCP_OLATA, low, sizeof(low)) &&
+                 writeRegs(MCP_IODIRA, cfg, sizeof(cfg)) &&
+                 writeRegs(MCP_GPPUA, cfg, 2) &&
+                 readInterrupt(irq);          // clear a stale interrupt, read the inputs
+      return _present;
+    }
+
+    /************************************************************
+     * Read INTF, INTCAP and GPIO of both ports (one transaction)
+     * - clears the interrupt of the chip
+     * @param[out] irq registers read
+     * @return false on a bus error
+     ************************************************************/
+    bool readInterrupt(McpInterrupt& irq) {
+      uint8_t r[6];
+      if (!readRegs(MCP_INTFA, r, sizeof(r))) {
+        return false;
+      }
+      irq.flags = r[0] | (r[1] << 8);
+      irq.captured = r[2] | (r[3] << 8);
+      irq.gpio = r[4] | (r[5] << 8);
+      _inputs = irq.gpio & _iodir;
+      return true;
+    }
+
+    /************************************************************
+     * Set outputs
+     * - only ports whose bits change are written
+     * @param[in] mask  bits to change
+     * @param[in] value new levels of these bits
+     * @return false on a bus error
+     ************************************************************/
+    bool write(uint16_t mask, uint16_t value) {
+      return writePair(MCP_OLATA, (_olat & ~mask) | (value & mask), _olat);
+    }
+
+    bool digitalWrite(uint8_t pin, uint8_t level) {
+      return write(1u << pin, level ? 1u << pin : 0);
+    }
+
+    /************************************************************
+     * Change pin directions (see begin())
+     * @param[in] inputs bit set: input, else output
+     * @return false on a bus error
+     ************************************************************/
+    bool setInputs(uint16_t inputs) {
+      return writePair(MCP_GPINTENA, inputs, _gpinten) &&
+             writePair(MCP_GPPUA, inputs, _gppu) &&
+             writePair(MCP_IODIRA, inputs, _iodir);
+    }
+
+    bool            present(void) const     { return _present; }
+    uint8_t         address(void) const     { return _address; }
+    uint16_t        inputs(void) const      { return _inputs; }   // GPIO of the last readInterrupt()
+    uint16_t        outputs(void) const     { return _olat; }
+    const McpStats& stats(void) const       { return _stats; }
+
+  private:
+    TwoWire*  _wire = nullptr;
+    uint8_t   _address = 0;
+    bool      _present = false;
+    // shadows of the chip registers, port A in the low byte
+    uint16_t  _iodir = 0xffff;
+    uint16_t  _gppu = 0;
+    uint16_t  _gpinten = 0;
+    uint16_t  _olat = 0;
+    uint16_t  _inputs = 0;
+    McpStats  _stats = {};
+
+    // write the changed bytes of a register pair, update the shadow
+    bool writePair(uint8_t regA, uint16_t value, uint16_t& shadow) {
+      uint16_t diff = value ^ shadow;
+      uint8_t  data[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+      bool     ok;
+      if (!diff) {
+        _stats.writesSkipped++;
+        return true;
+      }
+      if (!(diff & 0xff00)) {
+        ok = writeRegs(regA, data, 1);
+      } else if (!(diff & 0x00ff)) {
+        ok = writeRegs(regA + 1, data + 1, 1);
+      } else {
+        ok = writeRegs(regA, data, 2);
+      }
+      if (ok) {
+        shadow = value;
+      }
+      return ok;
+    }
+
+    bool writeRegs(uint8_t reg, const uint8_t* data, size_t n) {
+      _wire->beginTransmission(_address);
+      _wire->write(reg);
+      _wire->write(data, n);
+      _stats.transactions++;
+      _stats.bytesOut += 1 + n;
+      if (_wire->endTransmission() != 0) {
+        _stats.errors++;
+        return false;
+      }
+      return true;
+    }
+
+    // register address, repeated start, sequential read
+    bool readRegs(uint8_t reg, uint8_t* data, size_t n) {
+      _wire->beginTransmission(_address);
+      _wire->write(reg);
+      _stats.transactions++;
+      _stats.bytesOut++;
+      if ((_wire->endTransmission(false) != 0) ||
+          (_wire->requestFrom(_address, (uint8_t)n, (uint8_t)true) != n)) {
+        _stats.errors++;
+        return false;
+      }
+      for (size_t i = 0; i < n; i++) {
+        data[i] = (uint8_t)_wire->read();
+      }
+      _stats.bytesIn += n;
+      return true;
+    }
+};
+
+extern Mcp23017 g_Mcp[];
+
+#endif // _MCP23017_H_
@@ -0,0 +1,317 @@
+/*!
+ * @file mqttQos.h
+ */
+/************************************************************
+ * MQTT QoS 1 Publishing
+ ************************************************************
+ * PubSubClient publishes QoS 0 only: a result on TOPIC_RESULT
+ * the TCP connection loses on its way is gone, and a slow
+ * link is not noticed until its send buffer is full.
+ *
+ * MQTT_QOS1 1 (needs MQTT_RX_TASK): the topics of
+ * g_Qos1Topics go out as QoS 1, pipelined:
+ *
+ *   mqttSend: reserve() -> PUBLISH (QoS 1, packet id) into
+ *             the window -> mqttRxSend()
+ *   rxTask:   PUBACK -> ack(id)
+ *   network:  mqttRxLoop(): reap() the acknowledged ones,
+ *             the outbox takes over what the window refused
+ *   netOnline: resend() what was not acknowledged, DUP set
+ *
+ * - fixed memory: SLOTS packet ids and one byte ring of
+ *   BYTES for the packets as sent (for the retransmission);
+ *   a packet is never split at the end of the ring
+ * - the window is full when limit() packets or BYTES bytes
+ *   are in flight: reserve() fails, mqttPub() queues the
+ *   message in the outbox instead of sending it (returns
+ *   false), jobOutbox() waits for room: back-pressure
+ * - FIFO: the ring is reclaimed from the oldest packet, a
+ *   PUBACK out of order frees its slot once the older ones
+ *   are acknowledged as well (brokers acknowledge in order)
+ * - packet id = sequence number modulo a multiple of SLOTS,
+ *   so the slot of a PUBACK is (id - 1) % SLOTS and no id is
+ *   in flight twice
+ * - ack() is the only call of the receive task: it sets the
+ *   acknowledgement of a slot if the slot still holds the id
+ *   (atomics), everything else is the network side
+ * - retransmission only after a reconnect (MQTT 3.1.1); no
+ *   PUBACK within MQTT_QOS_ACK_TIMEOUT drops the connection
+ *   (mqttRxLoop), so the link gets a new one
+ * - a packet larger than BYTES goes out as QoS 0 (counted)
+ ************************************************************/
+#ifndef _MQTTQOS_H_
+#define _MQTTQOS_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include "logHistogram.h"
+#include "mqttRx.h"
+
+#ifndef MQTT_QOS1
+  #define MQTT_QOS1              0         // 1: g_Qos1Topics as QoS 1 (MQTT_RX_TASK)
+#endif
+#ifndef MQTT_QOS_WINDOW
+  #define MQTT_QOS_WINDOW        8         // packets in flight (limit(), at most MQTT_QOS_SLOTS)
+#endif
+
+#define MQTT_QOS_SLOTS           16        // packet id table
+#define MQTT_QOS_BUFFER          4096      // bytes of the packets in flight
+#define MQTT_QOS_ACK_TIMEOUT     (MQTT_KEEPALIVE * 1000u)   // ms without PUBACK: connection dropped
+#define QOS_HIST_BUCKETS         20        // ack latency up to 512 ms
+
+#define MQTT_PUB_F_DUP           0x08      // fixed header of a PUBLISH
+#define MQTT_PUB_F_QOS1          0x02
+#define MQTT_PUB_F_RETAIN        0x01
+
+struct MqttQosStats {
+  uint32_t    sent;                        // QoS 1 publishes (first send)
+  uint32_t    acked;                       // PUBACK received
+  uint32_t    retransmits;                 // sent again after a reconnect (DUP)
+  uint32_t    blocked;                     // window full: to the outbox
+  uint32_t    oversize;                    // larger than the ring: sent as QoS 0
+  uint32_t    timeouts;                    // no PUBACK within MQTT_QOS_ACK_TIMEOUT
+  uint32_t    abandoned;                   // in flight when the receive task stopped
+  LogHistogram<QOS_HIST_BUCKETS> ackUs;    // us from send to PUBACK (receive task)
+};
+
+/************************************************************
+ * Bytes of a PUBLISH Packet
+ * - fixed header (1 + remaining length), topic, packet id
+ *   (QoS 1), payload
+ ************************************************************/
+inline size_t mqttPublishSize(size_t topicLen, size_t len, bool qos1) {
+  size_t remaining = 2 + topicLen + (qos1 ? 2 : 0) + len;
+  size_t header = 2;
+  for (size_t r = remaining >> 7; r; r >>= 7) {
+    header++;
+  }
+  return header + remaining;
+}
+
+/************************************************************
+ * Encode a PUBLISH Packet
+ * @param[out] out mqttPublishSize() bytes
+ * @param[in] id packet id (QoS 1), 0: QoS 0
+ * @return bytes written
+ ************************************************************/
+inline size_t mqttPublishEncode(uint8_t* out, const char* topic, size_t topicLen, const uint8_t* msg, size_t len,
+                                bool retained, uint16_t id) {
+  size_t   remaining = 2 + topicLen + (id ? 2 : 0) + len;
+  uint8_t* p = out;
+  *p++ = (MQTT_PKT_PUBLISH << 4) | (id ? MQTT_PUB_F_QOS1 : 0) | (retained ? MQTT_PUB_F_RETAIN : 0);
+  do {
+    uint8_t digit = remaining & 0x7f;
+    remaining >>= 7;
+    *p++ = digit | (remaining ? 0x80 : 0);
+  } while (remaining);
+  *p++ = (uint8_t)(topicLen >> 8);
+  *p++ = (uint8_t)topicLen;
+  memcpy(p, topic, topicLen);
+  p += topicLen;
+  if (id) {
+    *p++ = (uint8_t)(id >> 8);
+    *p++ = (uint8_t)id;
+  }
+  memcpy(p, msg, len);
+  return (size_t)(p - out) + len;
+}
+
+/************************************************************
+ * In-flight Window (see above)
+ * - network side: room(), reserve(), commit(), reap(),
+ *   resend(), oldest(), clear(), limit()
+ * - receive task: ack()
+ ************************************************************/
+template <size_t SLOTS, size_t BYTES>
+class MqttQosWindow {
+  static_assert((SLOTS >= 1) && (SLOTS <= 256), "1..256 slots");
+  static_assert(BYTES <= 65535, "offsets are 16 bit");
+
+  public:
+    /************************************************************
+     * Room for a Packet
+     * - the next slot is free (below limit()) and n bytes fit
+     * @param[in] n packet bytes
+     * @param[out] id packet id of the packet
+     * @return where the packet goes, nullptr if the window is
+     *         full (commit() must follow a success)
+     ************************************************************/
+    uint8_t* reserve(size_t n, uint16_t& id) {
+      if (!room(n)) {
+        return nullptr;
+      }
+      size_t at = _wr;
+      size_t waste = 0;
+      if (at + n > BYTES) {
+        waste = BYTES - at;
+        at = 0;
+      }
+      Slot& s = _slots[_tail % SLOTS];
+      s.at = (uint16_t)at;
+      s.len = (uint16_t)n;
+      s.span = (uint16_t)(waste + n);
+      id = (uint16_t)(_tail % ID_SPAN) + 1;
+      return _buf + at;
+    }
+
+    /************************************************************
+     * reserve() would succeed
+     ************************************************************/
+    bool room(size_t n) const {
+      if ((n > BYTES) || ((_tail - _head) >= _limit)) {
+        return false;
+      }
+      size_t waste = (_wr + n > BYTES) ? BYTES - _wr : 0;
+      return _used + waste + n <= BYTES;
+    }
+
+    /************************************************************
+     * Packet of reserve() is in Flight
+     * @param[in] now micros() of the send
+     ************************************************************/
+    void commit(uint32_t now) {
+      Slot& s = _slots[_tail % SLOTS];
+      s.sentAt = now;
+      s.ackedAt = 0;
+      s.acked.store(false);
+      s.id.store((uint16_t)(_tail % ID_SPAN) + 1);
+      _wr = (s.at + s.len) % BYTES;
+      _used += s.span;
+      _tail++;
+    }
+
+    /************************************************************
+     * PUBACK (receive task)
+     * @param[in] id packet id of the PUBACK
+     * @param[in] now micros()
+     * @return false if not in flight (late, duplicate)
+     ************************************************************/
+    bool ack(uint16_t id, uint32_t now) {
+      if (!id) {
+        return false;
+      }
+      Slot& s = _slots[(id - 1) % SLOTS];
+      if ((s.id.load() != id) || s.acked.load()) {
+        return false;
+      }
+      s.ackedAt = now;
+      s.acked.store(true);
+      return true;
+    }
+
+    /************************************************************
+     * Free the acknowledged Packets (oldest first)
+     * @param[in] fn called with the ack latency in us of each
+     * @return packets freed
+     ************************************************************/
+    template <typename F>
+    uint32_t reap(F fn) {
+      uint32_t n = 0;
+      while (_head != _tail) {
+        Slot& s = _slots[_head % SLOTS];
+        if (!s.acked.load()) {
+          break;
+        }
+        fn(s.ackedAt - s.sentAt);
+        release(s);
+        n++;
+      }
+      return n;
+    }
+
+    /************************************************************
+     * Send the unacknowledged Packets again (after a reconnect)
+     * - in the order of the first send, DUP flag set
+     * @param[in] fn fn(packet, bytes), false stops
+     * @param[in] now micros() of the send
+     * @return packets sent
+     ************************************************************/
+    template <typename F>
+    uint32_t resend(F fn, uint32_t now) {
+      uint32_t n = 0;
+      for (uint32_t seq = _head; seq != _tail; seq++) {
+        Slot& s = _slots[seq % SLOTS];
+        if (s.acked.load()) {
+          continue;
+        }
+        _buf[s.at] |= MQTT_PUB_F_DUP;
+        s.sentAt = now;
+        if (!fn(_buf + s.at, (size_t)s.len)) {
+          break;
+        }
+        n++;
+      }
+      return n;
+    }
+
+    /************************************************************
+     * Age of the oldest unacknowledged Packet
+     * @param[in] now micros()
+     * @return us, 0 if none
+     ************************************************************/
+    uint32_t oldest(uint32_t now) const {
+      for (uint32_t seq = _head; seq != _tail; seq++) {
+        const Slot& s = _slots[seq % SLOTS];
+        if (!s.acked.load()) {
+          return now - s.sentAt;
+        }
+      }
+      return 0;
+    }
+
+    /************************************************************
+     * Forget all Packets
+     * @return packets that were in flight
+     ************************************************************/
+    uint32_t clear(void) {
+      uint32_t n = _tail - _head;
+      while (_head != _tail) {
+        release(_slots[_head % SLOTS]);
+      }
+      return n;
+    }
+
+    // packets in flight at most (1..SLOTS)
+    void     limit(uint32_t n)            { _limit = !n ? 1 : (n > SLOTS) ? SLOTS : n; }
+    uint32_t limit(void) const            { return _limit; }
+    uint32_t inFlight(void) const         { return _tail - _head; }
+    size_t   bytes(void) const            { return _used; }
+
+  private:
+    static const uint32_t ID_SPAN = (65535 / SLOTS) * SLOTS;
+
+    struct Slot {
+      std::atomic<uint16_t> id{0};         // 0: free
+      std::atomic<bool>     acked{false};
+      uint32_t              ackedAt = 0;   // micros(), written before acked
+      uint32_t              sentAt = 0;    // micros()
+      uint16_t              at = 0;        // packet in _buf
+      uint16_t              len = 0;
+      uint16_t              span = 0;      // len + bytes skipped at the end of _buf
+    };
+
+    void release(Slot& s) {
+      s.id.store(0);
+      s.acked.store(false);
+      _used -= s.span;
+      _head++;
+      if (_head == _tail) {
+        _wr = 0;
+        _used = 0;
+      }
+    }
+
+    Slot     _slots[SLOTS];
+    uint8_t  _buf[BYTES];
+    uint32_t _head = 0;                    // oldest packet in flight (sequence number)
+    uint32_t _tail = 0;                    // next packet
+    size_t   _wr = 0;                      // next byte of _buf
+    size_t   _used = 0;                    // bytes in flight incl. skipped ones
+    uint32_t _limit = (MQTT_QOS_WINDOW < SLOTS) ? MQTT_QOS_WINDOW : SLOTS;
+};
+
+extern boolean                                        g_QosOn;       // MQTT_QOS1, or set by the native bench
+extern MqttQosWindow<MQTT_QOS_SLOTS, MQTT_QOS_BUFFER> g_QosWindow;
+extern MqttQosStats                                   g_QosStats;
+
+#endif // _MQTTQOS_H_
@@ -0,0 +1,55 @@
+/*!
+ * @file mqttRx.cpp
+ */
+/************************************************************
+ * MQTT Receive Task: Socket (ESP32, lwIP)
+ * - the native target uses native/shim/mqttRx.cpp
+ ************************************************************/
+#ifdef ARDUINO_ARCH_ESP32
+
+#include <mqttRx.h>
+#include <lwip/sockets.h>
+#include <errno.h>
+
+/************************************************************
+ * Receive
+ * - select() until the socket is readable, then whatever
+ *   lwIP holds (MSG_DONTWAIT: the socket stays in blocking
+ *   mode for PubSubClient)
+ * @param[in] sock MQTT socket (WiFiClient::fd)
+ * @param[out] buf received bytes
+ * @param[in] n size of buf
+ * @param[in] waitMs longest wait for the first byte
+ * @return bytes, 0 if nothing arrived, -1 if closed or failed
+ ************************************************************/
+int mqttRxRecv(int sock, uint8_t* buf, size_t n, uint32_t waitMs) {
+  fd_set         rfds;
+  struct timeval tv = {(time_t)(waitMs / 1000), (suseconds_t)((waitMs % 1000) * 1000)};
+  FD_ZERO(&rfds);
+  FD_SET(sock, &rfds);
+  int res = lwip_select(sock + 1, &rfds, nullptr, nullptr, &tv);
+  if (res == 0) {
+    return 0;
+  }
+  if (res < 0) {
+    return (errno == EINTR) ? 0 : -1;
+  }
+  res = lwip_recv(sock, buf, n, MSG_DONTWAIT);
+  if (res > 0) {
+    return res;
+  }
+  return ((res < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) ? 0 : -1;
+}
+
+
+/************************************************************
+ * Send a Packet
+ * - from the network side only (same task as the publishes
+ *   of PubSubClient, so packets never interleave)
+ * @return true if all bytes went out
+ ************************************************************/
+boolean mqttRxSend(int sock, const uint8_t* buf, size_t n) {
+  return lwip_send(sock, buf, n, 0) == (int)n;
+}
+
+#endif // ARDUINO_ARCH_ESP32
@@ -0,0 +1,239 @@
+/*!
+ * @file mqttRx.h
+ */
+/************************************************************
+ * MQTT Receive Task
+ ************************************************************
+ * MQTT_RX_TASK 0 (default): inbound messages are read by
+ * mqtt.loop() once per netLoop() pass, after whatever the
+ * pass cost before (netStep, ArduinoOTA, timer jobs)
+ *
+ * MQTT_RX_TASK 1: setup() starts a receive task which owns
+ * the read side of the MQTT socket once ONLINE
+ *
+ *   rxTask: mqttRxRecv (blocks on the socket)
+ *           -> MqttRxDecoder (packet by packet, as the
+ *              bytes arrive, into a preallocated buffer)
+ *           -> TOPIC_CMD: g_CmdQueue -> appLoop (commands)
+ *              TOPIC_OTA: g_RxNetQueue -> network side
+ *              PINGRESP:  keepalive
+ *              PUBACK:    QoS 1 window (mqttQos.h)
+ *   network side: mqttRxLoop() instead of mqtt.loop():
+ *           delta OTA chunks, PINGREQ, connection lost
+ *
+ * - PubSubClient still connects (CONNECT / CONNACK, LastWill
+ *   on TOPIC_STATUS), publishes and subscribes; the task is
+ *   armed after CONNACK (netOnline) and disarmed before the
+ *   network leaves NET_ONLINE (netEnter), so it never reads
+ *   a byte meant for PubSubClient
+ * - arm / disarm: MqttRxGate, the network side waits until
+ *   the task let go of the socket (MQTT_RX_POLL_MS at most)
+ * - keepalive: PubSubClient's loop() no longer runs, so the
+ *   network side sends PINGREQ after MQTT_KEEPALIVE s without
+ *   inbound traffic and drops the connection when no byte
+ *   came back within another MQTT_KEEPALIVE s
+ * - the task does not log (BinLog has one ring per producer:
+ *   loop() and the network task), it counts (MqttRxStats,
+ *   NETWORK_STATE_FIELDS)
+ * - subscriptions are QoS 0: a QoS 1 PUBLISH is delivered
+ *   but not acknowledged
+ * - ESP32: lwIP select() / recv() (mqttRx.cpp)
+ * - native: the LocalBroker session of the socket as MQTT
+ *   bytes, in TCP segments (native/shim/mqttRx.cpp)
+ ************************************************************/
+#ifndef _MQTTRX_H_
+#define _MQTTRX_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include "spscRing.h"
+
+#ifndef MQTT_RX_TASK
+  #define MQTT_RX_TASK           0         // 1: receive task instead of mqtt.loop()
+#endif
+
+#define MQTT_RX_TASK_CORE        0         // with the network stack
+#define MQTT_RX_TASK_STACK       4096
+#define MQTT_RX_TASK_PRIO        2         // above the network task and loopTask
+#define MQTT_RX_POLL_MS          20        // longest block in mqttRxRecv (disarm latency)
+#define MQTT_RX_SEGMENT          512       // bytes per mqttRxRecv
+#define RX_NET_QUEUE_SIZE        4096      // bytes, publishes for the network side (delta OTA chunks)
+
+// MQTT control packet types (fixed header >> 4)
+#define MQTT_PKT_PUBLISH         3
+#define MQTT_PKT_PUBACK          4
+#define MQTT_PKT_SUBACK          9
+#define MQTT_PKT_PINGREQ         12
+#define MQTT_PKT_PINGRESP        13
+
+struct MqttRxStats {
+  uint32_t    packets;                     // complete packets
+  uint32_t    commands;                    // TOPIC_CMD to g_CmdQueue
+  uint32_t    dropped;                     // queue full
+  uint32_t    oversize;                    // larger than the buffer, skipped (decoder)
+  uint32_t    pings;                       // PINGREQ sent
+  uint32_t    lost;                        // connection closed, error, no PINGRESP
+};
+
+/************************************************************
+ * Incremental Packet Decoder
+ * - bytes in any pieces, one packet at a time:
+ *
+ *     while (n) {
+ *       size_t used = dec.feed(p, n);
+ *       p += used; n -= used;
+ *       if (dec.complete()) { ... dec.body() ...; dec.next(); }
+ *       if (dec.error()) -> close the connection
+ *     }
+ *
+ * - fixed header, remaining length (1..4 bytes), body into
+ *   the SIZE byte buffer; a larger body is skipped
+ * - the body of a complete packet may be changed in place
+ ************************************************************/
+template <size_t SIZE>
+class MqttRxDecoder {
+  public:
+    /************************************************************
+     * Take Bytes
+     * - stops after the last byte of a packet
+     * @return bytes used
+     ************************************************************/
+    size_t feed(const uint8_t* data, size_t n) {
+      size_t used = 0;
+      while ((used < n) && (_state != RX_DONE) && (_state != RX_ERROR)) {
+        uint8_t b = data[used];
+        switch (_state) {
+          case RX_HEADER:
+            _header = b;
+            _length = 0;
+            _shift = 0;
+            _state = RX_LENGTH;
+            used++;
+            break;
+          case RX_LENGTH:
+            _length |= (uint32_t)(b & 0x7f) << _shift;
+            _shift += 7;
+            used++;
+            if (b & 0x80) {
+              if (_shift >= 28) {
+                _state = RX_ERROR;
+              }
+              break;
+            }
+            _at = 0;
+            _state = !_length ? RX_DONE : (_length <= SIZE) ? RX_BODY : RX_SKIP;
+            break;
+          case RX_BODY:
+          case RX_SKIP: {
+            size_t take = ((n - used) < (_length - _at)) ? n - used : _length - _at;
+            if (_state == RX_BODY) {
+              memcpy(_buf + _at, data + used, take);
+            }
+            _at += take;
+            used += take;
+            if (_at == _length) {
+              if (_state == RX_SKIP) {
+                _oversize++;
+                _state = RX_HEADER;
+              } else {
+                _state = RX_DONE;
+              }
+            }
+            break;
+          }
+          default:
+            break;
+        }
+      }
+      return used;
+    }
+
+    bool     complete(void) const         { return _state == RX_DONE; }
+    bool     error(void) const            { return _state == RX_ERROR; }
+    void     next(void)                   { _state = RX_HEADER; }
+    uint8_t  type(void) const             { return _header >> 4; }
+    uint8_t  flags(void) const            { return _header & 0x0f; }
+    uint8_t* body(void)                   { return _buf; }
+    uint32_t length(void) const           { return _length; }
+    uint32_t oversize(void) const         { return _oversize; }
+
+    /************************************************************
+     * PUBLISH of a complete Packet
+     * - topic is not terminated; QoS 1/2 packet id skipped
+     * @param[out] topic, topicLen, payload, payloadLen
+     * @return false if not a PUBLISH or malformed
+     ************************************************************/
+    bool publish(const char*& topic, size_t& topicLen, uint8_t*& payload, size_t& payloadLen) {
+      if ((type() != MQTT_PKT_PUBLISH) || (_length < 2)) {
+        return false;
+      }
+      size_t tl = ((size_t)_buf[0] << 8) | _buf[1];
+      size_t at = 2 + tl + ((flags() & 0x06) ? 2 : 0);
+      if (at > _length) {
+        return false;
+      }
+      topic = (const char*)_buf + 2;
+      topicLen = tl;
+      payload = _buf + at;
+      payloadLen = _length - at;
+      return true;
+    }
+
+  private:
+    enum : uint8_t { RX_HEADER, RX_LENGTH, RX_BODY, RX_SKIP, RX_DONE, RX_ERROR };
+    uint8_t  _buf[SIZE];
+    uint8_t  _state = RX_HEADER;
+    uint8_t  _header = 0;
+    uint8_t  _shift = 0;
+    uint32_t _length = 0;
+    uint32_t _at = 0;
+    uint32_t _oversize = 0;
+};
+
+/************************************************************
+ * Socket Handover between Network Side and Receive Task
+ * - network side: arm(sock) once ONLINE, disarm() before the
+ *   socket is closed or PubSubClient reads again (waits until
+ *   the task let go)
+ * - task: take() before each receive, the socket or -1;
+ *   release() when it does not read any more
+ * - seq_cst on both sides: after disarm() returned, take()
+ *   never hands out the old socket
+ ************************************************************/
+class MqttRxGate {
+  public:
+    void arm(int sock)                    { _want.store(sock); }
+    void disarm(void) {
+      _want.store(-1);
+      while (_using.load() >= 0) {
+        vTaskDelay(1);
+      }
+    }
+    int  take(void) {
+      int sock = _want.load();
+      _using.store(sock);
+      if (_want.load() != sock) {
+        _using.store(-1);
+        return -1;
+      }
+      return sock;
+    }
+    void release(void)                    { _using.store(-1); }
+    int  armed(void) const                { return _want.load(); }
+
+  private:
+    std::atomic<int> _want{-1};
+    std::atomic<int> _using{-1};
+};
+
+/************************************************************
+ * Platform (mqttRx.cpp, native/shim/mqttRx.cpp)
+ ************************************************************/
+int     mqttRxRecv(int sock, uint8_t* buf, size_t n, uint32_t waitMs);   // bytes, 0: none yet, -1: closed
+boolean mqttRxSend(int sock, const uint8_t* buf, size_t n);              // a whole packet (PINGREQ, QoS 1 PUBLISH)
+
+extern SpscRing<RX_NET_QUEUE_SIZE> g_RxNetQueue;   // receive task -> network side
+extern MqttRxStats                 g_RxStats;
+extern TaskHandle_t volatile       g_RxTask;       // nullptr: mqtt.loop()
+
+#endif // _MQTTRX_H_
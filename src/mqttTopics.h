@@ -0,0 +1,49 @@
+/*!
+ * @file mqttTopics.h
+ */
+#ifndef _MQTTTOPICS_H_
+#define _MQTTTOPICS_H_
+
+/************************************************************
+ * MQTT Topics
+ * - Prefix for MQTT Topics should be defined in plattformio.ini
+ *   e.g.: build_flags = '-DMQTT_PREFIX="homectrl/tisch"'
+ * - Full Topics (TOPIC_*) are joined to MQTT_PREFIX at
+ *   compile time, use them for publish/subscribe
+ ************************************************************/
+#ifndef MQTT_PREFIX
+  #define MQTT_PREFIX "esp32/default"
+#endif
+
+// Topic used to subscribe, MQTT_PREFIX will be added
+#define T_CMD          "cmd"                      // Topic for Commands (subscribe)
+#define T_OTA          "ota"                      // Topic for Delta OTA Patch Chunks (subscribe)
+// Topics used to publish, MQTT_PREFIX will be added
+#define T_CPU          "cpu"                      // Topic for CPU Status
+#define T_IRQ          "irq"                      // Topic for IRQ Statistics
+#define T_LOG          "log"                      // Topic for Logging
+#define T_METRICS      "metrics"                  // Topic for Loop Stage Metrics
+#define T_NETWORK      "network"                  // Topic for Network Status
+#define T_OTA_ACK      "otaack"                   // Topic for Delta OTA Answers
+#define T_RESULT       "result"                   // Topic for Commands Responses
+#define T_ROLLER       "roller"                   // Topic for Roller Positions
+#define T_SKETCH       "sketch"                   // Topic for Sketch Status
+#define T_STATUS       "status"                   // Topic for Online-Status 'ONLINE/OFFLINE' (published at birth and lastwill)
+#define STATUS_MSG_ON  "ONLINE"                   // Online Message
+#define STATUS_MSG_OFF "OFFLINE"                  // Last Will Message
+
+// Full Topics
+#define TOPIC_CMD      MQTT_PREFIX "/" T_CMD
+#define TOPIC_CPU      MQTT_PREFIX "/" T_CPU
+#define TOPIC_IRQ      MQTT_PREFIX "/" T_IRQ
+#define TOPIC_LOG      MQTT_PREFIX "/" T_LOG
+#define TOPIC_METRICS  MQTT_PREFIX "/" T_METRICS
+#define TOPIC_NETWORK  MQTT_PREFIX "/" T_NETWORK
+#define TOPIC_OTA      MQTT_PREFIX "/" T_OTA
+#define TOPIC_OTA_ACK  MQTT_PREFIX "/" T_OTA_ACK
+#define TOPIC_RESULT   MQTT_PREFIX "/" T_RESULT
+#define TOPIC_ROLLER   MQTT_PREFIX "/" T_ROLLER
+#define TOPIC_SKETCH   MQTT_PREFIX "/" T_SKETCH
+#define TOPIC_STATUS   MQTT_PREFIX "/" T_STATUS
+
+#endif // _MQTTTOPICS_H_
@@ -3,6 +3,7 @@
  * Hardware Design is defined
  * - I2C Interface
  * - Interupt Pin
+ * - MCP 23017 I/O Expanders
  ************************************************************/ 
 #ifndef _MYHWCONFIG_H_
 #define _MYHWCONFIG_H_
@@ -21,4 +22,14 @@
  ************************************************************/ 
 #define INT_PIN            19                          // Attach Interuptto this PIN
 
+/************************************************************
+ * MCP 23017 
+ * - MCP_COUNT chips at MCP_ADDR, MCP_ADDR+1, ...
+ * - INT of all chips (open drain) wired to INT_PIN
+ * - pins: bit 0..7 = port A, bit 8..15 = port B
+ ************************************************************/ 
+#define MCP_COUNT           1                          // No of MCP 23017 on the I2C bus
+#define MCP_ADDR         0x20                          // I2C address of the first chip (A2..A0 = 0)
+#define MCP_INPUTS     0xff00                          // Port B: inputs (pull-up, IRQ), Port A: outputs
+
 #endif // _MYHWCONFIG_H_
@@ -0,0 +1,173 @@
+/*!
+ * @file netState.h
+ */
+/************************************************************
+ * Network State Machine
+ ************************************************************
+ * WiFi and MQTT are brought up by netStep() without blocking
+ * (setup() only starts the association):
+ *
+ *   NET_WIFI_CONNECTING --IP--> NET_MQTT_CONNECTING --> NET_ONLINE
+ *          ^                            |                   |
+ *          +------- WiFi lost ----------+-------------------+
+ *
+ * - netStep() runs from loop() while not ONLINE and from
+ *   monitorConnections() (every T_NET_MONITORING)
+ * - MQTT connects in the first loop() after the IP arrives
+ * - boot latency: ms from boot to the first IP and to the
+ *   first ONLINE, published with the network state
+ *
+ * Fast Reconnect
+ * - BSSID, channel and the IP settings of the last DHCP lease
+ *   are kept in RTC memory (survive ESP.restart() and the
+ *   reboot after OTA, not a power cycle)
+ * - with a valid cache the association skips the scan
+ *   (channel + BSSID) and DHCP (static config), a few 100 ms
+ *   instead of seconds
+ * - no IP within T_WIFI_FAST_TIMEOUT or no MQTT connect with
+ *   the cached IP: cache dropped, normal scan + DHCP
+ *
+ * MQTT Connect (NET_MQTT_CONNECTING)
+ *
+ *   NET_MQTT_WAIT --due--> NET_MQTT_TCP --TCP up--> CONNECT/CONNACK --> NET_ONLINE
+ *        ^                      | failed / T_MQTT_TCP_TIMEOUT
+ *        +-- next broker / backoff --+
+ *
+ * - the TCP connect is polled (tcpConnect.h), loop(), OTA
+ *   and the timer jobs keep running while the broker is down
+ * - brokers: MQTT_SERVER, then MQTT_SERVER_2, MQTT_SERVER_3
+ *   (optional) in this order; each cycle starts with the first
+ * - after a failed round: capped exponential backoff with
+ *   jitter (netRetryWait), a lost connection waits a random
+ *   0..T_MQTT_BACKOFF_MIN first (netLostWait), so a fleet does not
+ *   reconnect in lockstep when the broker comes back
+ * - resolved broker addresses are cached for T_DNS_TTL
+ * - attempts and duration of the last reconnect are
+ *   published with the network state once ONLINE again
+ ************************************************************/
+#ifndef _NETSTATE_H_
+#define _NETSTATE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "settings.h"           // T_MQTT_BACKOFF_MIN, T_MQTT_BACKOFF_MAX
+
+enum NetPhase : uint8_t {
+  NET_WIFI_CONNECTING = 0,                 // association / DHCP in progress
+  NET_MQTT_CONNECTING,                     // IP assigned, waiting for the broker
+  NET_ONLINE                               // ONLINE published, TOPIC_CMD subscribed
+};
+
+enum NetMqttStage : uint8_t {
+  NET_MQTT_WAIT = 0,                       // waiting for nextAttempt
+  NET_MQTT_TCP                             // TCP connect in progress (sock)
+};
+
+#define NET_MAX_BROKERS  3                 // MQTT_SERVER, MQTT_SERVER_2, MQTT_SERVER_3
+
+struct NetDnsEntry {
+  uint32_t    ip;
+  uint32_t    resolvedAt;                  // millis()
+  bool        valid;
+};
+
+struct NetState {
+  NetPhase    phase;
+  uint32_t    phaseSince;                  // millis() when the phase was entered
+  uint32_t    nextAttempt;                 // millis() of the next MQTT connect attempt
+  uint32_t    wifiAttempts;                // associations started (incl. the first one)
+  uint32_t    timeToIp;                    // ms from boot to the first IP (0: not yet)
+  uint32_t    timeToOnline;                // ms from boot to the first ONLINE (0: not yet)
+  uint32_t    connectMs;                   // last association: WiFi.begin() until IP
+  bool        fast;                        // current association uses the NetCache
+  uint32_t    fastHits;                    // fast associations that reached ONLINE
+  uint32_t    fastMisses;                  // fast associations that fell back to scan + DHCP
+  // MQTT connect
+  NetMqttStage mqttStage;
+  uint8_t     broker;                      // index into the broker list
+  uint8_t     backoffRound;                // failed rounds over all brokers
+  int         sock;                        // pending TCP connect (NET_MQTT_TCP)
+  uint32_t    tcpSince;                    // millis() the TCP connect was started
+  uint32_t    lostAt;                      // millis() ONLINE was lost (0: boot)
+  uint32_t    attempts;                    // connect attempts since lostAt
+  NetDnsEntry dns[NET_MAX_BROKERS];
+  // statistics, published with the network state
+  uint32_t    mqttReconnects;              // successful connects after the first one
+  uint32_t    lastAttempts;                // attempts of the last (re)connect
+  uint32_t    lastReconnectMs;             // lostAt until ONLINE of the last (re)connect
+  uint8_t     lastBroker;                  // broker of the current connection
+  uint32_t    dnsLookups;
+};
+
+/************************************************************
+ * Backoff after a failed round (equal jitter)
+ * - base = min * 2^round, capped at max
+ * - result in [base / 2, base]
+ * @param[in] round failed rounds so far (0: first)
+ * @param[in] rnd random number
+ ************************************************************/
+inline uint32_t netBackoff(uint8_t round, uint32_t min, uint32_t max, uint32_t rnd) {
+  uint32_t base = (round < 16) ? (min << round) : max;
+  if ((base > max) || (base < min)) {
+    base = max;
+  }
+  return base / 2 + rnd % (base / 2 + 1);
+}
+
+/************************************************************
+ * Wait after a failed round (netBackoff between
+ * T_MQTT_BACKOFF_MIN and T_MQTT_BACKOFF_MAX)
+ * @param[in,out] round failed rounds so far, counted up
+ * @param[in] rnd random number
+ ************************************************************/
+inline uint32_t netRetryWait(uint8_t& round, uint32_t rnd) {
+  uint32_t wait = netBackoff(round, T_MQTT_BACKOFF_MIN, T_MQTT_BACKOFF_MAX, rnd);
+  round += (round < 0xff) ? 1 : 0;
+  return wait;
+}
+
+/************************************************************
+ * Wait before the first attempt after a lost connection
+ * - random 0..T_MQTT_BACKOFF_MIN, so a fleet does not
+ *   reconnect in lockstep
+ * @param[in] rnd random number
+ ************************************************************/
+inline uint32_t netLostWait(uint32_t rnd) {
+  return rnd % T_MQTT_BACKOFF_MIN;
+}
+
+#define NET_CACHE_MAGIC  0x4e455431u       // "NET1"
+
+struct NetCache {
+  uint32_t    magic;
+  uint8_t     bssid[6];
+  uint8_t     channel;
+  uint8_t     reserved;
+  uint32_t    ip;
+  uint32_t    gateway;
+  uint32_t    subnet;
+  uint32_t    dns;
+  uint32_t    check;                       // netCacheCheck() of the fields above
+};
+
+/************************************************************
+ * Checksum of a NetCache (FNV-1a), RTC memory is not
+ * cleared on a power cycle
+ ************************************************************/
+inline uint32_t netCacheCheck(const NetCache& cache) {
+  const uint8_t* p = (const uint8_t*)&cache;
+  uint32_t       h = 2166136261u;
+  for (size_t i = 0; i < offsetof(NetCache, check); i++) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+inline bool netCacheValid(const NetCache& cache) {
+  return (cache.magic == NET_CACHE_MAGIC) && (cache.check == netCacheCheck(cache));
+}
+
+extern NetState g_Net;
+extern NetCache g_NetCache;
+
+#endif // _NETSTATE_H_
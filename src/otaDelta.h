@@ -0,0 +1,616 @@
+/*!
+ * @file otaDelta.h
+ */
+/************************************************************
+ * Delta OTA
+ ************************************************************
+ * Rebuilds the new image from the running one and a patch of
+ * tools/otadelta.py while the patch streams in over MQTT:
+ *
+ *   host -> TOPIC_OTA       u32 offset + patch bytes (offset 0
+ *                           starts an update)
+ *   receive()               queues the chunk (OTA_DELTA_WINDOW
+ *                           chunks, in order)
+ *   step() (netLoop)        applies them: heatshrink (if
+ *                           compressed), base bytes from the
+ *                           running partition, the new image
+ *                           sector by sector into the next OTA
+ *                           partition, MD5 over all of it
+ *   device -> TOPIC_OTA_ACK "ack N F" (patch bytes taken, the
+ *                           next offset; F chunks free),
+ *                           "done MD5", "error REASON"
+ *   MD5 == header           esp_ota_set_boot_partition(), reboot
+ *
+ * Patch (little endian, numbers are LEB128 varints):
+ *   header  "HDLT" version flags, heatshrink W << 4 | L, 0,
+ *           base size, new size (u32), base MD5, new MD5
+ *           (16 bytes each)
+ *   COPY    0x01 len seek: base cursor += seek (zigzag), then
+ *           pairs until len bytes are out: same (copied from
+ *           the base), n > 0 diffs (new = base + diff, mod 256)
+ *   DATA    0x02 len bytes
+ *   END     0x00
+ *   flags   OTA_FLAG_FULL: no base, only DATA (full image)
+ *           OTA_FLAG_HEATSHRINK: the ops behind the header are
+ *           heatshrink compressed (window 2^W, lookahead 2^L)
+ *
+ * - the base MD5 has to be the one of the running sketch
+ *   (ESP.getSketchMD5()), else the update is refused
+ * - windowed: the host keeps up to F chunks in flight beyond
+ *   N; an answer goes out whenever a chunk is used up, or
+ *   one is refused (out of order, window full)
+ * - at most one sector erase + write per step(); RAM: one
+ *   sector, OTA_DELTA_WINDOW chunks, the heatshrink window
+ * - the boot partition only changes once the MD5 matched (and
+ *   the bootloader checks the image); an error leaves the
+ *   running sketch untouched, the host starts again at 0
+ ************************************************************/
+#ifndef _OTADELTA_H_
+#define _OTADELTA_H_
+
+#include <Arduino.h>
+#include <MD5Builder.h>
+#include <esp_partition.h>
+#include <esp_ota_ops.h>
+
+#define OTA_DELTA_MAGIC     "HDLT"
+#define OTA_DELTA_VERSION   1
+#define OTA_DELTA_HEADER    48             // bytes of the patch header
+#define OTA_DELTA_SECTOR    4096           // flash erase unit
+#ifndef OTA_DELTA_CHUNK
+  #define OTA_DELTA_CHUNK   1536           // max. patch bytes per message (MQTT_BUFSIZE)
+#endif
+#ifndef OTA_DELTA_WINDOW
+  #define OTA_DELTA_WINDOW  4              // chunks queued (in flight for the host)
+#endif
+#ifndef OTA_HS_WINDOW_MAX
+  #define OTA_HS_WINDOW_MAX 11             // largest heatshrink window W (2^W bytes of RAM)
+#endif
+#define OTA_DELTA_PLAIN     256            // bytes decompressed at a time
+#define OTA_DELTA_ABORT     0xffffffff     // offset of a message that cancels the update
+
+// header flags
+#define OTA_FLAG_FULL       0x01
+#define OTA_FLAG_HEATSHRINK 0x02
+
+// patch ops
+#define OTA_OP_END          0x00
+#define OTA_OP_COPY         0x01
+#define OTA_OP_DATA         0x02
+
+enum OtaDeltaState {
+  OTA_DELTA_IDLE,
+  OTA_DELTA_RUNNING,                       // patch streaming in
+  OTA_DELTA_DONE,                          // boot partition switched, reboot pending
+  OTA_DELTA_ERROR
+};
+
+struct OtaDeltaStats {
+  uint32_t    patchBytes;                  // patch bytes taken (in order)
+  uint32_t    chunks;                      // messages taken
+  uint32_t    repeats;                     // messages out of order (refused)
+  uint32_t    full;                        // messages refused, window full
+  uint32_t    plainBytes;                  // patch bytes after heatshrink
+  uint32_t    baseBytes;                   // read from the running partition
+  uint32_t    newBytes;                    // written to the next partition
+  uint32_t    startMs;                     // millis() of offset 0
+  uint32_t    endMs;                       // millis() of done / error
+};
+
+class OtaDelta {
+  public:
+    /************************************************************
+     * Chunk received on TOPIC_OTA
+     * - offset 0 starts an update (one running is dropped)
+     * - out of order or window full: refused, the answer has
+     *   the offset the host has to go on with
+     * @param[in] offset    position of data in the patch
+     * @param[in] data      patch bytes
+     * @param[in] len       <= OTA_DELTA_CHUNK (+ header)
+     * @param[in] sketchMD5 MD5 of the running sketch (hex)
+     * @param[in] nowMs     millis()
+     * @return true if the host gets an answer now, false if it
+     *         comes from step() once the chunk is used up
+     ************************************************************/
+    bool receive(uint32_t offset, const uint8_t* data, size_t len, const char* sketchMD5, uint32_t nowMs) {
+      if (offset == OTA_DELTA_ABORT) {
+        if (_state == OTA_DELTA_RUNNING) {
+          fail("aborted", nowMs);
+        }
+        return true;
+      }
+      if (offset == 0) {
+        if (start(data, len, sketchMD5, nowMs)) {
+          push(data + OTA_DELTA_HEADER, len - OTA_DELTA_HEADER, len, nowMs);
+        }
+        return true;
+      }
+      if (_state != OTA_DELTA_RUNNING) {
+        return true;
+      }
+      if (offset != _stats.patchBytes) {
+        _stats.repeats++;
+        return true;
+      }
+      if (_count == OTA_DELTA_WINDOW) {
+        _stats.full++;
+        return true;
+      }
+      return !push(data, len, len, nowMs);
+    }
+
+    /************************************************************
+     * Apply the queued chunks (netLoop)
+     * - returns after one sector went to flash or when the
+     *   queue is used up
+     * @param[in] nowMs millis()
+     * @return true if a chunk was used up (or the update
+     *         ended): answer
+     ************************************************************/
+    bool step(uint32_t nowMs) {
+      uint32_t n;
+      if (_state != OTA_DELTA_RUNNING) {
+        return false;
+      }
+      _freed = false;
+      while ((_fill < OTA_DELTA_SECTOR) && ((_st == ST_SAME) || input(n))) {
+        if (!decode()) {
+          fail(_error, nowMs);
+          return true;
+        }
+        if (_st == ST_END) {
+          finish(nowMs);
+          return true;
+        }
+      }
+      if ((_fill == OTA_DELTA_SECTOR) && !flush()) {
+        fail("flash write", nowMs);
+        return true;
+      }
+      return _freed;
+    }
+
+    // answer for TOPIC_OTA_ACK
+    size_t answer(char* buf, size_t size) const {
+      switch (_state) {
+        case OTA_DELTA_RUNNING:
+          return snprintf(buf, size, "ack %u %u", (unsigned)_stats.patchBytes, (unsigned)(OTA_DELTA_WINDOW - _count));
+        case OTA_DELTA_DONE:    return snprintf(buf, size, "done %s", _newMD5);
+        case OTA_DELTA_ERROR:   return snprintf(buf, size, "error %s", _error);
+        default:                return snprintf(buf, size, "idle");
+      }
+    }
+
+    OtaDeltaState        state(void) const   { return _state; }
+    const char*          error(void) const   { return _error; }
+    const char*          newMD5(void) const  { return _newMD5; }
+    uint32_t             newSize(void) const { return _newSize; }
+    uint8_t              flags(void) const   { return _flags; }
+    const OtaDeltaStats& stats(void) const   { return _stats; }
+
+  private:
+    // decoder: op, numbers, runs
+    enum DecodeState { ST_OP, ST_LEN, ST_SEEK, ST_SAMEN, ST_SAME, ST_DIFFN, ST_DIFF, ST_DATA, ST_END };
+    // heatshrink: tag bit, literal, backref index / count, backref
+    enum HsState { HS_TAG, HS_LITERAL, HS_INDEX, HS_COUNT, HS_COPY };
+
+    OtaDeltaState          _state = OTA_DELTA_IDLE;
+    const char*            _error = "";
+    OtaDeltaStats          _stats = {};
+    const esp_partition_t* _base = nullptr;  // running
+    const esp_partition_t* _next = nullptr;  // written
+    uint8_t                _flags = 0;
+    uint32_t               _baseSize = 0;
+    uint32_t               _newSize = 0;
+    uint8_t                _md5[16];         // of the new image (header)
+    char                   _newMD5[33] = "";
+    MD5Builder             _hash;
+    // decoder
+    DecodeState            _st = ST_OP;
+    uint8_t                _op = 0;
+    uint32_t               _num = 0;         // number being read
+    uint8_t                _shift = 0;
+    uint32_t               _len = 0;         // bytes of the op still to come
+    uint32_t               _run = 0;         // bytes of the same / diff run still to come
+    uint32_t               _cursor = 0;      // base position
+    uint32_t               _out = 0;         // new image bytes of all ops so far
+    uint32_t               _written = 0;     // new image bytes in flash
+    // chunk queue
+    uint8_t                _queue[OTA_DELTA_WINDOW][OTA_DELTA_CHUNK];
+    uint16_t               _queueLen[OTA_DELTA_WINDOW];
+    uint8_t                _head = 0;        // chunk being used
+    uint8_t                _count = 0;
+    size_t                 _at = 0;          // bytes of the head chunk used
+    bool                   _freed = false;   // a chunk was used up in this step()
+    // heatshrink
+    HsState                _hs = HS_TAG;
+    uint8_t                _hsW = 0;
+    uint8_t                _hsL = 0;
+    uint16_t               _hsIndex = 0;
+    uint16_t               _hsCount = 0;
+    uint16_t               _hsPos = 0;       // next byte in _hsWindow
+    uint32_t               _bits = 0;        // bit buffer, MSB first
+    uint8_t                _bitCount = 0;
+    uint8_t                _hsWindow[1 << OTA_HS_WINDOW_MAX];
+    uint8_t                _plain[OTA_DELTA_PLAIN];
+    size_t                 _plainLen = 0;
+    size_t                 _plainAt = 0;
+    // output
+    uint8_t                _sector[OTA_DELTA_SECTOR];
+    size_t                 _fill = 0;
+
+    static uint32_t le32(const uint8_t* p) {
+      return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    static void hex(char* out, const uint8_t* md5) {
+      for (int i = 0; i < 16; i++) {
+        snprintf(out + 2 * i, 3, "%02x", md5[i]);
+      }
+    }
+
+    bool start(const uint8_t* h, size_t len, const char* sketchMD5, uint32_t nowMs) {
+      char baseMD5[33];
+      _stats = {};
+      _stats.startMs = nowMs;
+      _head = _count = 0;
+      _at = _fill = 0;
+      _st = ST_OP;
+      _num = _shift = 0;
+      _len = _run = _cursor = _out = _written = 0;
+      if ((len < OTA_DELTA_HEADER) || memcmp(h, OTA_DELTA_MAGIC, 4) || (h[4] != OTA_DELTA_VERSION) ||
+          (h[5] & ~(OTA_FLAG_FULL | OTA_FLAG_HEATSHRINK))) {
+        return fail("no delta patch", nowMs);
+      }
+      _flags = h[5];
+      _hsW = h[6] >> 4;
+      _hsL = h[6] & 0x0f;
+      if ((_flags & OTA_FLAG_HEATSHRINK) && ((_hsW < 4) || (_hsW > OTA_HS_WINDOW_MAX) || (_hsL < 3) || (_hsL >= _hsW))) {
+        return fail("heatshrink window too large", nowMs);
+      }
+      _hs = HS_TAG;
+      _hsPos = 0;
+      _bits = _bitCount = 0;
+      _plainLen = _plainAt = 0;
+      memset(_hsWindow, 0, sizeof(_hsWindow));
+      _baseSize = le32(h + 8);
+      _newSize = le32(h + 12);
+      hex(baseMD5, h + 16);
+      memcpy(_md5, h + 32, sizeof(_md5));
+      hex(_newMD5, _md5);
+      _base = esp_ota_get_running_partition();
+      _next = esp_ota_get_next_update_partition(nullptr);
+      if (_flags & OTA_FLAG_FULL) {
+        _baseSize = 0;                     // a COPY fails: base out of range
+      } else if (strcmp(baseMD5, sketchMD5)) {
+        return fail("base is not the running sketch", nowMs);
+      }
+      if (!_base || !_next || (_baseSize > _base->size) || !_newSize || (_newSize > _next->size)) {
+        return fail("no partition for the image", nowMs);
+      }
+      _hash.begin();
+      _state = OTA_DELTA_RUNNING;
+      return true;
+    }
+
+    // queue a chunk in order; total: bytes of the message (offset 0: with the header)
+    bool push(const uint8_t* data, size_t len, size_t total, uint32_t nowMs) {
+      if (len > OTA_DELTA_CHUNK) {
+        return fail("chunk too long", nowMs);
+      }
+      _stats.patchBytes += (uint32_t)total;
+      _stats.chunks++;
+      if (len) {
+        uint8_t slot = (uint8_t)((_head + _count) % OTA_DELTA_WINDOW);
+        memcpy(_queue[slot], data, len);
+        _queueLen[slot] = (uint16_t)len;
+        _count++;
+      }
+      return true;
+    }
+
+    bool fail(const char* error, uint32_t nowMs) {
+      _error = error;
+      _state = OTA_DELTA_ERROR;
+      _head = _count = 0;
+      _at = 0;
+      _st = ST_OP;
+      _stats.endMs = nowMs;
+      return false;
+    }
+
+    /************************************************************
+     * Input of the decoder: the head chunk, or what heatshrink
+     * made of the queue
+     * @param[out] n bytes at the returned pointer
+     * @return nullptr if there is nothing (yet)
+     ************************************************************/
+    const uint8_t* input(uint32_t& n) {
+      if (_flags & OTA_FLAG_HEATSHRINK) {
+        if (_plainAt == _plainLen) {
+          inflate();
+        }
+        n = (uint32_t)(_plainLen - _plainAt);
+        return n ? _plain + _plainAt : nullptr;
+      }
+      n = _count ? (uint32_t)(_queueLen[_head] - _at) : 0;
+      return n ? _queue[_head] + _at : nullptr;
+    }
+
+    void consume(uint32_t n) {
+      if (_flags & OTA_FLAG_HEATSHRINK) {
+        _plainAt += n;
+        return;
+      }
+      _at += n;
+      if (_at == _queueLen[_head]) {
+        pop();
+      }
+    }
+
+    void pop(void) {
+      _head = (uint8_t)((_head + 1) % OTA_DELTA_WINDOW);
+      _count--;
+      _at = 0;
+      _freed = true;
+    }
+
+    // n bits of the queue (MSB first), false if not there yet
+    bool bits(uint8_t n, uint16_t& v) {
+      while (_bitCount < n) {
+        if (!_count) {
+          return false;
+        }
+        _bits = (_bits << 8) | _queue[_head][_at++];
+        _bitCount += 8;
+        if (_at == _queueLen[_head]) {
+          pop();
+        }
+      }
+      _bitCount -= n;
+      v = (uint16_t)((_bits >> _bitCount) & ((1u << n) - 1));
+      _bits &= (1u << _bitCount) - 1;
+      return true;
+    }
+
+    void emit(uint8_t b) {
+      _plain[_plainLen++] = b;
+      _hsWindow[_hsPos] = b;
+      _hsPos = (uint16_t)((_hsPos + 1) & ((1u << _hsW) - 1));
+    }
+
+    // one heatshrink step, false if the bits are not there yet
+    bool unshrink(void) {
+      uint16_t v;
+      switch (_hs) {
+        case HS_TAG:
+          if (!bits(1, v)) {
+            return false;
+          }
+          _hs = v ? HS_LITERAL : HS_INDEX;
+          return true;
+        case HS_LITERAL:
+          if (!bits(8, v)) {
+            return false;
+          }
+          emit((uint8_t)v);
+          _hs = HS_TAG;
+          return true;
+        case HS_INDEX:
+          if (!bits(_hsW, v)) {
+            return false;
+          }
+          _hsIndex = v + 1;
+          _hs = HS_COUNT;
+          return true;
+        case HS_COUNT:
+          if (!bits(_hsL, v)) {
+            return false;
+          }
+          _hsCount = v + 1;
+          _hs = HS_COPY;
+          return true;
+        default:                           // HS_COPY
+          while (_hsCount && (_plainLen < sizeof(_plain))) {
+            emit(_hsWindow[(_hsPos - _hsIndex) & ((1u << _hsW) - 1)]);
+            _hsCount--;
+          }
+          if (!_hsCount) {
+            _hs = HS_TAG;
+          }
+          return true;
+      }
+    }
+
+    // refill _plain from the queue
+    void inflate(void) {
+      _plainLen = _plainAt = 0;
+      while ((_plainLen < sizeof(_plain)) && unshrink()) {
+      }
+      _stats.plainBytes += (uint32_t)_plainLen;
+    }
+
+    // END: last sector, MD5, boot partition
+    void finish(uint32_t nowMs) {
+      uint8_t  md5[16];
+      uint32_t n;
+      if (input(n) || _count) {
+        fail("data after the end", nowMs);
+        return;
+      }
+      if ((_out != _newSize) || (_fill && !flush())) {
+        fail((_out != _newSize) ? "image size" : "flash write", nowMs);
+        return;
+      }
+      _hash.calculate();
+      _hash.getBytes(md5);
+      if (memcmp(md5, _md5, sizeof(md5))) {
+        fail("MD5 mismatch", nowMs);
+        return;
+      }
+      if (esp_ota_set_boot_partition(_next) != ESP_OK) {
+        fail("image rejected", nowMs);
+        return;
+      }
+      _state = OTA_DELTA_DONE;
+      _stats.endMs = nowMs;
+    }
+
+    // sector to flash (the last one may be short)
+    bool flush(void) {
+      if ((esp_partition_erase_range(_next, _written, OTA_DELTA_SECTOR) != ESP_OK) ||
+          (esp_partition_write(_next, _written, _sector, _fill) != ESP_OK)) {
+        return false;
+      }
+      _hash.add(_sector, (uint16_t)_fill);
+      _written += _fill;
+      _stats.newBytes = _written;
+      _fill = 0;
+      return true;
+    }
+
+    bool baseRead(uint8_t* dst, uint32_t n) {
+      if ((_cursor > _baseSize) || (n > _baseSize - _cursor) ||
+          (esp_partition_read(_base, _cursor, dst, n) != ESP_OK)) {
+        return false;
+      }
+      _cursor += n;
+      _stats.baseBytes += n;
+      return true;
+    }
+
+    // a number is complete (_num): next state
+    bool number(void) {
+      uint32_t n = _num;
+      _num = 0;
+      switch (_st) {
+        case ST_LEN:
+          if (n > _newSize - _out) {
+            _error = "image too long";
+            return false;
+          }
+          _len = n;
+          _out += n;
+          _st = (_op == OTA_OP_COPY) ? ST_SEEK : (_len ? ST_DATA : ST_OP);
+          return true;
+        case ST_SEEK:
+          _cursor += (n >> 1) ^ (0 - (n & 1));   // zigzag
+          _st = _len ? ST_SAMEN : ST_OP;
+          return true;
+        case ST_SAMEN:
+          if (n > _len) {
+            _error = "bad run";
+            return false;
+          }
+          _run = n;
+          _st = ST_SAME;
+          return true;
+        default:                           // ST_DIFFN
+          if (!n || (n > _len)) {
+            _error = "bad run";
+            return false;
+          }
+          _run = n;
+          _st = ST_DIFF;
+          return true;
+      }
+    }
+
+    /************************************************************
+     * One decoder step: an op byte, a byte of a number, or a
+     * run into the sector (never beyond it)
+     * - called with input there (or in ST_SAME)
+     * @return false on a malformed patch (_error)
+     ************************************************************/
+    bool decode(void) {
+      uint32_t       room = (uint32_t)(OTA_DELTA_SECTOR - _fill);
+      uint32_t       avail = 0, n;
+      const uint8_t* in = (_st == ST_SAME) ? nullptr : input(avail);
+      uint8_t        b;
+      switch (_st) {
+        case ST_OP:
+          _op = *in;
+          consume(1);
+          if (_op == OTA_OP_END) {
+            _st = ST_END;
+            return true;
+          }
+          if ((_op != OTA_OP_COPY) && (_op != OTA_OP_DATA)) {
+            _error = "bad op";
+            return false;
+          }
+          _st = ST_LEN;
+          return true;
+
+        case ST_LEN:
+        case ST_SEEK:
+        case ST_SAMEN:
+        case ST_DIFFN:
+          b = *in;
+          consume(1);
+          if (_shift > 28) {
+            _error = "bad number";
+            return false;
+          }
+          _num |= (uint32_t)(b & 0x7f) << _shift;
+          _shift += 7;
+          if (b & 0x80) {
+            return true;
+          }
+          _shift = 0;
+          return number();
+
+        case ST_SAME:
+          n = (_run < room) ? _run : room;
+          if (!baseRead(_sector + _fill, n)) {
+            _error = "base out of range";
+            return false;
+          }
+          _fill += n;
+          _run -= n;
+          _len -= n;
+          if (!_run) {
+            _st = _len ? ST_DIFFN : ST_OP;
+          }
+          return true;
+
+        case ST_DIFF:
+          n = (_run < room) ? _run : room;
+          n = (n < avail) ? n : avail;
+          if (!baseRead(_sector + _fill, n)) {
+            _error = "base out of range";
+            return false;
+          }
+          for (uint32_t i = 0; i < n; i++) {
+            _sector[_fill + i] += in[i];
+          }
+          consume(n);
+          _fill += n;
+          _run -= n;
+          _len -= n;
+          if (!_run) {
+            _st = _len ? ST_SAMEN : ST_OP;
+          }
+          return true;
+
+        case ST_DATA:
+          n = (_len < room) ? _len : room;
+          n = (n < avail) ? n : avail;
+          memcpy(_sector + _fill, in, n);
+          consume(n);
+          _fill += n;
+          _len -= n;
+          if (!_len) {
+            _st = ST_OP;
+          }
+          return true;
+
+        default:                           // ST_END
+          return true;
+      }
+    }
+};
+
+extern OtaDelta g_OtaDelta;
+
+#endif // _OTADELTA_H_
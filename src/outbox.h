@@ -0,0 +1,366 @@
+/*!
+ * @file outbox.h
+ */
+/************************************************************
+ * Offline Outbox (store and forward)
+ ************************************************************
+ * Holds the messages mqttPub() could not hand to the client
+ * and drains them once ONLINE again:
+ *
+ *   offline:  mqttPub() -> g_Outbox.push(topic, msg, policy)
+ *   online:   jobOutbox(): front() -> mqttSend() -> pop(),
+ *             OUTBOX_DRAIN_BURST messages every T_OUTBOX_DRAIN
+ *             mqttPub(): sends queued ones first, then its
+ *             own message directly unless it must wait for
+ *             them (keepAll(), discard())
+ *
+ * - fixed memory: one ring of SIZE bytes, no heap; a record
+ *   is header + topic ('\0' terminated) + payload, padded to
+ *   8 bytes and never split at the end of the ring
+ * - policy per topic (OutboxRule table):
+ *   OUTBOX_KEEP_LATEST  a new message replaces the queued one
+ *                       of its topic (telemetry: only the
+ *                       current state is of interest); in
+ *                       place if it fits, else the old one is
+ *                       marked dead and skipped
+ *   OUTBOX_KEEP_ALL     every message is queued (results, log)
+ *   OUTBOX_NONE         not queued, the caller retries itself
+ * - ring full: the oldest records are evicted; KEEP_ALL
+ *   records go to the spill (OutboxSpill, e.g. a flash
+ *   partition, outboxSpill.h) if there is one, else they
+ *   are dropped
+ * - spilled records are older than everything in the ring,
+ *   front() serves them first, so the order is kept
+ * - order matters among the KEEP_ALL records only: a newer
+ *   KEEP_ALL message waits while keepAll() is not 0, a
+ *   KEEP_LATEST one is sent past the queue and discard()s
+ *   the queued, older state of its topic
+ ************************************************************/
+#ifndef _OUTBOX_H_
+#define _OUTBOX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef OUTBOX_SIZE
+  #define OUTBOX_SIZE  8192                // bytes of the outbox ring (RAM)
+#endif
+
+enum OutboxPolicy : uint8_t {
+  OUTBOX_NONE = 0,                         // not queued
+  OUTBOX_KEEP_LATEST,                      // only the newest message of the topic
+  OUTBOX_KEEP_ALL                          // every message, in order
+};
+
+struct OutboxRule {
+  const char*  topic;
+  OutboxPolicy policy;
+};
+
+#define OUTBOX_F_RETAINED  0x01
+#define OUTBOX_F_DEAD      0x02            // replaced by a newer message (KEEP_LATEST)
+#define OUTBOX_F_KEEP_ALL  0x04            // spill instead of drop when evicted
+
+// record header, followed by topic and payload
+struct OutboxRecord {
+  uint16_t    size;                        // header + topic + payload, padded (0: wrap to the start)
+  uint16_t    len;                         // payload
+  uint8_t     topicLen;                    // incl. '\0'
+  uint8_t     flags;                       // OUTBOX_F_*
+  uint16_t    reserved;
+};
+
+#define OUTBOX_ALIGN  8
+static_assert(sizeof(OutboxRecord) == OUTBOX_ALIGN, "record header must fill one alignment unit");
+
+// one message as returned by front()
+struct OutboxMessage {
+  const char* topic;
+  const char* payload;
+  size_t      len;
+  bool        retained;
+};
+
+struct OutboxStats {
+  uint32_t    queued;                      // messages accepted by push()
+  uint32_t    sent;                        // messages removed by pop()
+  uint32_t    replaced;                    // KEEP_LATEST messages replaced by a newer one
+  uint32_t    dropped;                     // lost: ring (and spill) full or too large
+  uint32_t    spilled;                     // evicted to the spill
+  uint32_t    maxDepth;                    // high water mark of depth()
+};
+
+/************************************************************
+ * Spill Storage (optional)
+ * - keeps whole records (OutboxRecord + topic + payload) in
+ *   the order they were written
+ ************************************************************/
+class OutboxSpill {
+  public:
+    virtual bool           write(const uint8_t* rec, size_t len) = 0;  // false: full
+    virtual const uint8_t* peek(size_t& len) = 0;                      // oldest record, nullptr: empty
+    virtual void           drop(void) = 0;                             // remove the oldest record
+    virtual uint32_t       count(void) const = 0;
+};
+
+/************************************************************
+ * Topic Policy
+ * - topics not in the table are kept (OUTBOX_KEEP_ALL)
+ ************************************************************/
+template <size_t N>
+OutboxPolicy outboxPolicy(const OutboxRule (&rules)[N], const char* topic) {
+  for (size_t i = 0; i < N; i++) {
+    if (!strcmp(rules[i].topic, topic)) {
+      return rules[i].policy;
+    }
+  }
+  return OUTBOX_KEEP_ALL;
+}
+
+
+/************************************************************
+ * Outbox
+ * @tparam SIZE bytes of the ring (multiple of OUTBOX_ALIGN)
+ ************************************************************/
+template <size_t SIZE>
+class Outbox {
+  static_assert((SIZE % OUTBOX_ALIGN == 0) && (SIZE <= 0xfff8), "outbox size");
+
+  public:
+    void setSpill(OutboxSpill* spill)   { _spill = spill; }
+    bool     empty(void) const          { return !_live && !spilled(); }
+    uint32_t depth(void) const          { return _live + spilled(); }   // messages waiting
+    uint32_t keepAll(void) const        { return _keepAll + spilled(); } // KEEP_ALL messages waiting
+    size_t   bytes(void) const          { return _bytes; }              // ring bytes in use
+    const OutboxStats& stats(void) const { return _stats; }
+
+    /************************************************************
+     * Queue a Message
+     * @param[in] topic full topic
+     * @param[in] msg payload (need not be terminated)
+     * @param[in] len length of msg
+     * @param[in] retained publish as retained message
+     * @param[in] policy OUTBOX_KEEP_LATEST or OUTBOX_KEEP_ALL
+     * @return false if the message was dropped
+     ************************************************************/
+    bool push(const char* topic, const char* msg, size_t len, bool retained, OutboxPolicy policy) {
+      size_t tl = strlen(topic) + 1;
+      size_t n = align(sizeof(OutboxRecord) + tl + len);
+      if ((policy == OUTBOX_NONE) || (tl > 0xff) || (n > SIZE)) {
+        _stats.dropped++;
+        return false;
+      }
+      if ((policy == OUTBOX_KEEP_LATEST) && supersede(topic, msg, len, retained)) {
+        _stats.queued++;
+        return true;
+      }
+      size_t at;
+      while (!place(n, at)) {
+        evict();
+      }
+      OutboxRecord rec = {(uint16_t)n, (uint16_t)len, (uint8_t)tl,
+                          (uint8_t)((retained ? OUTBOX_F_RETAINED : 0) |
+                                    ((policy == OUTBOX_KEEP_ALL) ? OUTBOX_F_KEEP_ALL : 0)), 0};
+      memcpy(_buf + at, &rec, sizeof(rec));
+      memcpy(_buf + at + sizeof(rec), topic, tl);
+      memcpy(_buf + at + sizeof(rec) + tl, msg, len);
+      _tail = at + n;
+      _count++;
+      _live++;
+      _keepAll += (policy == OUTBOX_KEEP_ALL);
+      _bytes += n;
+      _stats.queued++;
+      _stats.maxDepth = (depth() > _stats.maxDepth) ? depth() : _stats.maxDepth;
+      return true;
+    }
+
+    /************************************************************
+     * Oldest Message
+     * - spilled messages first, then the ring
+     * - valid until the next push() or pop()
+     * @param[out] m message
+     * @return false if empty
+     ************************************************************/
+    bool front(OutboxMessage& m) {
+      size_t         len;
+      const uint8_t* rec = spilled() ? _spill->peek(len) : nullptr;
+      _fromSpill = (rec != nullptr);
+      if (!_fromSpill) {
+        while (_count && (header(_head).flags & OUTBOX_F_DEAD)) {
+          dropHead();
+        }
+        if (!_count) {
+          return false;
+        }
+        rec = _buf + _head;
+      }
+      OutboxRecord h;
+      memcpy(&h, rec, sizeof(h));
+      m.topic = (const char*)rec + sizeof(h);
+      m.payload = m.topic + h.topicLen;
+      m.len = h.len;
+      m.retained = h.flags & OUTBOX_F_RETAINED;
+      return true;
+    }
+
+    /************************************************************
+     * Remove the Message returned by front() (it was sent)
+     ************************************************************/
+    void pop(void) {
+      if (_fromSpill) {
+        _spill->drop();
+      } else if (_count) {
+        dropHead();
+      }
+      _stats.sent++;
+    }
+
+    /************************************************************
+     * Drop the queued Message of a Topic (KEEP_LATEST)
+     * - a newer message of the topic was sent past the queue
+     * @return false if none was queued
+     ************************************************************/
+    bool discard(const char* topic) {
+      size_t at;
+      if (!find(topic, at)) {
+        return false;
+      }
+      kill(at);
+      _stats.replaced++;
+      return true;
+    }
+
+  private:
+    alignas(OUTBOX_ALIGN) uint8_t _buf[SIZE];
+    size_t       _head = 0;                // oldest record (or wrap marker)
+    size_t       _tail = 0;                // next free byte
+    uint32_t     _count = 0;               // records in the ring, incl. dead ones
+    uint32_t     _live = 0;                // records not replaced
+    uint32_t     _keepAll = 0;             // KEEP_ALL records in the ring
+    size_t       _bytes = 0;
+    bool         _fromSpill = false;       // front() returned a spilled record
+    OutboxSpill* _spill = nullptr;
+    OutboxStats  _stats = {};
+
+    static size_t align(size_t n)       { return (n + OUTBOX_ALIGN - 1) & ~(size_t)(OUTBOX_ALIGN - 1); }
+    uint32_t spilled(void) const        { return _spill ? _spill->count() : 0; }
+
+    OutboxRecord header(size_t at) const {
+      OutboxRecord h;
+      memcpy(&h, _buf + at, sizeof(h));
+      return h;
+    }
+
+    // skip the wrap marker (or the exact end of the ring)
+    void normalizeHead(void) {
+      if ((_head == SIZE) || !header(_head).size) {
+        _head = 0;
+      }
+    }
+
+    // find room for n bytes at the tail, wrap if needed
+    bool place(size_t n, size_t& at) {
+      if (!_count) {
+        _head = _tail = 0;
+      }
+      if (_count && (_tail <= _head)) {    // wrapped: free space is _tail.._head
+        at = _tail;
+        return _tail + n <= _head;
+      }
+      if (_tail + n <= SIZE) {
+        at = _tail;
+        return true;
+      }
+      if (n <= _head) {
+        if (_tail < SIZE) {
+          OutboxRecord wrap = {};
+          memcpy(_buf + _tail, &wrap, sizeof(wrap));
+        }
+        at = 0;
+        return true;
+      }
+      return false;
+    }
+
+    // remove the oldest record from the ring
+    void dropHead(void) {
+      normalizeHead();
+      OutboxRecord h = header(_head);
+      _head += h.size;
+      _count--;
+      _bytes -= h.size;
+      if (!(h.flags & OUTBOX_F_DEAD)) {
+        _live--;
+        _keepAll -= ((h.flags & OUTBOX_F_KEEP_ALL) != 0);
+      }
+      if (!_count) {
+        _head = _tail = 0;
+      } else {
+        normalizeHead();
+      }
+    }
+
+    // ring full: oldest record to the spill or lost
+    void evict(void) {
+      normalizeHead();
+      OutboxRecord h = header(_head);
+      if (!(h.flags & OUTBOX_F_DEAD)) {
+        if ((h.flags & OUTBOX_F_KEEP_ALL) && _spill && _spill->write(_buf + _head, h.size)) {
+          _stats.spilled++;
+        } else {
+          _stats.dropped++;
+        }
+      }
+      dropHead();
+    }
+
+    // live record of topic
+    bool find(const char* topic, size_t& at) const {
+      at = _head;
+      for (uint32_t i = 0; i < _count; i++) {
+        if ((at == SIZE) || !header(at).size) {
+          at = 0;
+        }
+        OutboxRecord h = header(at);
+        if (!(h.flags & OUTBOX_F_DEAD) && !strcmp((const char*)_buf + at + sizeof(h), topic)) {
+          return true;
+        }
+        at += h.size;
+      }
+      return false;
+    }
+
+    // mark the record at at dead, front() skips it
+    void kill(size_t at) {
+      OutboxRecord h = header(at);
+      h.flags |= OUTBOX_F_DEAD;
+      memcpy(_buf + at, &h, sizeof(h));
+      _live--;
+      _keepAll -= ((h.flags & OUTBOX_F_KEEP_ALL) != 0);
+    }
+
+    // KEEP_LATEST: replace the queued message of topic, in
+    // place if the new one fits (true), else mark it dead
+    bool supersede(const char* topic, const char* msg, size_t len, bool retained) {
+      size_t at;
+      if (!find(topic, at)) {
+        return false;
+      }
+      _stats.replaced++;
+      OutboxRecord h = header(at);
+      if (sizeof(h) + h.topicLen + len > h.size) {
+        kill(at);
+        return false;
+      }
+      h.len = (uint16_t)len;
+      h.flags = (uint8_t)((h.flags & ~OUTBOX_F_RETAINED) | (retained ? OUTBOX_F_RETAINED : 0));
+      memcpy(_buf + at, &h, sizeof(h));
+      memcpy(_buf + at + sizeof(h) + h.topicLen, msg, len);
+      return true;
+    }
+};
+
+extern Outbox<OUTBOX_SIZE> g_Outbox;
+
+#endif // _OUTBOX_H_
@@ -0,0 +1,127 @@
+/*!
+ * @file outboxSpill.h
+ */
+/************************************************************
+ * Outbox Spill to a Flash Partition
+ ************************************************************
+ * Records evicted from the RAM outbox (KEEP_ALL only) are
+ * appended to a data partition, used as a ring of sectors:
+ *
+ *   sector:  | rec rec rec .. (erased) | rec rec .. | ...
+ *              ^_read                      ^_write
+ *
+ * - a record never spans two sectors, the rest of a sector
+ *   stays erased (0xff) and is skipped by the reader
+ * - a sector is erased when the writer enters it; if it
+ *   still holds unread records the spill is full and
+ *   write() fails (the newest evicted record is dropped)
+ * - read and write position are kept in RAM: the spill
+ *   bridges a long outage, it does not survive a reboot
+ * - erasing blocks for some 10 ms per sector (while offline)
+ * - partition table entry, e.g. 64 KB:
+ *     outbox, data, 0x99, , 0x10000
+ ************************************************************/
+#ifndef _OUTBOXSPILL_H_
+#define _OUTBOXSPILL_H_
+
+#include <esp_partition.h>
+#include "outbox.h"
+
+#define OUTBOX_SPILL_SECTOR   4096
+#ifndef OUTBOX_SPILL_RECORD
+  #define OUTBOX_SPILL_RECORD 1024         // larger records are not spilled
+#endif
+
+class PartitionSpill : public OutboxSpill {
+  public:
+    /************************************************************
+     * Find and erase the first sector of the partition
+     * @param[in] label partition name
+     * @return false if there is no such partition
+     ************************************************************/
+    bool begin(const char* label) {
+      _part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+      if (!_part || (_part->size < 2 * OUTBOX_SPILL_SECTOR)) {
+        _part = nullptr;
+        return false;
+      }
+      _size = _part->size - _part->size % OUTBOX_SPILL_SECTOR;
+      _read = _write = 0;
+      _count = 0;
+      return esp_partition_erase_range(_part, 0, OUTBOX_SPILL_SECTOR) == ESP_OK;
+    }
+
+    bool write(const uint8_t* rec, size_t len) override {
+      if (!_part || (len > OUTBOX_SPILL_RECORD)) {
+        return false;
+      }
+      if (!_count) {
+        _read = _write;                    // everything read, the sector may be reused
+      }
+      if ((_write % OUTBOX_SPILL_SECTOR) + len > OUTBOX_SPILL_SECTOR) {
+        size_t next = nextSector(_write);
+        if (_count && (next / OUTBOX_SPILL_SECTOR == _read / OUTBOX_SPILL_SECTOR)) {
+          return false;                    // next sector not read yet
+        }
+        if (esp_partition_erase_range(_part, next, OUTBOX_SPILL_SECTOR) != ESP_OK) {
+          return false;
+        }
+        if (!_count) {
+          _read = next;
+        }
+        _write = next;
+      }
+      if (esp_partition_write(_part, _write, rec, len) != ESP_OK) {
+        return false;
+      }
+      _write += len;
+      _count++;
+      return true;
+    }
+
+    const uint8_t* peek(size_t& len) override {
+      if (!_count) {
+        return nullptr;
+      }
+      OutboxRecord h;
+      for (;;) {
+        size_t off = _read % OUTBOX_SPILL_SECTOR;
+        if ((off + sizeof(h) <= OUTBOX_SPILL_SECTOR) &&
+            (esp_partition_read(_part, _read, &h, sizeof(h)) == ESP_OK) &&
+            (h.size >= sizeof(h)) && (h.size <= OUTBOX_SPILL_RECORD) && (off + h.size <= OUTBOX_SPILL_SECTOR)) {
+          break;
+        }
+        _read = nextSector(_read);         // erased rest of the sector
+      }
+      if (esp_partition_read(_part, _read, _rec, h.size) != ESP_OK) {
+        return nullptr;
+      }
+      len = h.size;
+      return _rec;
+    }
+
+    void drop(void) override {
+      size_t len;
+      if (peek(len)) {
+        _read += len;
+        _count--;
+      }
+    }
+
+    uint32_t count(void) const override { return _count; }
+
+  private:
+    const esp_partition_t* _part = nullptr;
+    size_t   _size = 0;                    // whole sectors
+    size_t   _read = 0;                    // oldest record
+    size_t   _write = 0;                   // next free byte
+    uint32_t _count = 0;
+    alignas(OUTBOX_ALIGN) uint8_t _rec[OUTBOX_SPILL_RECORD];   // record returned by peek()
+
+    size_t nextSector(size_t pos) const {
+      size_t next = (pos / OUTBOX_SPILL_SECTOR + 1) * OUTBOX_SPILL_SECTOR;
+      return (next >= _size) ? 0 : next;
+    }
+};
+
+#endif // _OUTBOXSPILL_H_
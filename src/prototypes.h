@@ -5,31 +5,109 @@
 #ifndef _prototypes_H_
 #define _prototypes_H_
 
+#include "netState.h"           // NetPhase
+#include "otaDelta.h"           // OtaDeltaState
+#include "timerWheel.h"         // TimerCallback
+#include "idleWait.h"           // IdleStats
+#include "mqttRx.h"             // MqttRxStats, g_RxTask
+#include "mqttQos.h"            // MqttQosStats, g_QosWindow
+#include "telemetry.h"          // TelemetryWriter
+
 /************************************************************
  * Prototypes 
  ************************************************************/ 
-String composeClientID(void);
-void   cronjob(void);
-void   dbgout(String);
-void   loop(void);
-String macToStr(const uint8_t*);
-void   monitorConnections(void);
-void   mqttCallback(char*, byte* , unsigned int);
-void   mqttPub(String, String, boolean);
-void   oncePerMinute(void);
-void   oncePerSecond(void);
-void   oncePerTenSeconds(void);
-void   oncePerThirtySeconds(void);
-void   resetHandler(void);
-void   sendCPUState(boolean);
-void   sendNetworkState(boolean);
-void   sendSketchState(boolean);
-void   setup(void);
-void   setupGlobalVars(void);
-void   setupGPIO(void);
-void   setupIRQ(void);
-void   setupMQTT(void);
-void   setupOTA(void);
-void   setupWIFI(void);
+void    appLoop(void);
+void    composeClientID(char*, size_t);
+boolean connectMQTT(void);
+void    cronjob(void);
+void    cronRunner(TimerCallback);
+size_t  execCommands(char*, char*);
+uint32_t idleAppBudget(void);
+void    idleLoop(void);
+uint32_t idleNetBudget(int&, int&);
+boolean idleSleep(IdleStats&, uint32_t, uint32_t, int, int);
+void    irqDrain(void);
+void    irqEdge(uint8_t, uint32_t);
+void    irqHandler(void);
+void    irqReport(void);
+void    jobCPUState(void);
+void    jobIrqState(void);
+void    jobLogFlush(void);
+void    jobLoopStats(void);
+void    jobLoopStatsSend(void);
+void    jobNetworkState(void);
+void    jobOutbox(void);
+void    jobSketchState(void);
+boolean logDrain(void);
+void    loop(void);
+String  macToStr(const uint8_t*);
+void    mcpInputs(uint8_t, uint16_t, uint16_t);
+void    mcpService(void);
+void    monitorConnections(void);
+void    mqttCallback(char*, byte* , unsigned int);
+boolean mqttPub(const char*, const char*, boolean);
+boolean mqttPub(const char*, const char*, size_t, boolean, boolean);
+void    mqttQosResend(void);
+uint32_t mqttQosReap(void);
+boolean mqttQosRoom(const char*, size_t);
+boolean mqttQosTopic(const char*);
+void    mqttRxArm(void);
+boolean mqttRxLoop(void);
+boolean mqttSend(const char*, const char*, size_t, boolean);
+boolean mqttSendQos1(const char*, const char*, size_t, boolean);
+void    netBegin(void);
+void    netEnter(NetPhase, uint32_t);
+void    netFastMiss(void);
+void    netLoop(void);
+void    netMqttAbort(void);
+void    netMqttBegin(uint32_t, uint32_t);
+void    netMqttFailed(void);
+void    netOnline(uint32_t);
+boolean netResolve(uint8_t, IPAddress&);
+void    netSaveCache(void);
+void    netStep(void);
+void    netStepMqtt(uint32_t);
+void    netTask(void*);
+void    otaDeltaAnswer(OtaDeltaState);
+void    otaDeltaReceive(const byte*, unsigned int);
+void    otaDeltaStep(void);
+void    otaProgress(uint32_t, uint32_t, uint32_t, uint32_t, boolean);
+void    outboxDrain(uint8_t);
+void    renderSketchState(void);
+void    resetHandler(void);
+void    rollerButton(uint8_t, uint8_t);
+void    rollerLoop(void);
+void    runCommands(char*);
+void    rxDispatch(void);
+void    rxFeed(const uint8_t*, size_t);
+void    rxTask(void*);
+void    sendCPUState(boolean);
+void    sendIrqState(boolean);
+boolean sendLoopStats(boolean);
+void    sendNetworkState(boolean);
+boolean sendRollerState(boolean);
+void    sendSketchState(boolean);
+boolean sendTelemetry(const char*, const char*, size_t, boolean, boolean);
+void    setup(void);
+void    setupGlobalVars(void);
+void    setupDeviceFacts(void);
+void    setupGPIO(void);
+void    setupI2C(void);
+void    setupIdle(void);
+void    setupIRQ(void);
+void    setupMQTT(void);
+void    setupRollers(void);
+void    setupOTA(void);
+void    setupTimers(void);
+void    setupWIFI(void);
+boolean startNetTask(void);
+boolean startRxTask(void);
+void    stopNetTask(void);
+void    stopRxTask(void);
+void    taskCmdDrain(void);
+void    taskPubDrain(void);
+boolean taskPubPush(const char*, const char*, size_t, boolean);
+void    updateSketchState(void);
+void    writeLoopStats(TelemetryWriter&);
 
 #endif
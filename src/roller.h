@@ -0,0 +1,254 @@
+/*!
+ * @file roller.h
+ */
+/************************************************************
+ * Roller Shutter Engine
+ ************************************************************
+ * Position of N rollers from their calibrated travel times,
+ * no end switches; the motor of roller i has two relays:
+ *
+ *   bit 2*i:   up   (towards 0 %, open)
+ *   bit 2*i+1: down (towards 100 %, closed)
+ *
+ *   moveTo / moveGroup / stop     (commands, buttons)
+ *   tick(micros())                (every loop pass)
+ *     -> relays()                 (one MCP write per change)
+ *
+ * - position: fixed point, ROLLER_FULL units = 100 %; speed
+ *   in units per us as Q16 per direction; the fraction left
+ *   by each tick is carried (frac), so no drift with the tick
+ *   rate
+ * - time: 32 bit micros(), differences only (wraps after 71
+ *   minutes)
+ * - moves to 0 % or 100 % run ROLLER_OVERRUN_PCT further into
+ *   the end stop, the position is set to the end then (drift
+ *   of the travel times is corrected on every full move)
+ * - commands only set targets, tick() stops and starts the
+ *   motors; after any stop a motor rests ROLLER_DEAD_US
+ *   (reversal: stop, rest, other direction)
+ * - group: all rollers of the mask that have to start, start
+ *   in the same tick, when the last of them is rested;
+ *   rollers already running that way keep running
+ * - struct of arrays, tick() is a loop over small arrays
+ *   without branches on the moving path but for the arrival
+ ************************************************************/
+#ifndef _ROLLER_H_
+#define _ROLLER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef NUM_ROLLERS
+  #define NUM_ROLLERS         4            // No of Rollers to be configured
+#endif
+#define ROLLER_FULL           (1L << 24)   // position units of 100 %
+#ifndef ROLLER_DEAD_US
+  #define ROLLER_DEAD_US      500000       // motor rest before (re)starting
+#endif
+#ifndef ROLLER_OVERRUN_PCT
+  #define ROLLER_OVERRUN_PCT  5            // extra travel into the end stop
+#endif
+#define ROLLER_OVERRUN        (ROLLER_FULL / 100 * ROLLER_OVERRUN_PCT)
+#define ROLLER_NO_EVENT       0xffffffffu  // nextEvent(): all rollers rest
+
+struct RollerStats {
+  uint32_t    moves;                       // moveTo / moveGroup per roller
+  uint32_t    reversals;                   // stopped for a change of direction
+  uint32_t    arrivals;                    // target reached
+  uint32_t    endSyncs;                    // position set at an end stop
+};
+
+template <size_t N>
+class RollerBank {
+  static_assert(N <= 16, "2 relay bits per roller in 32 bit");
+
+  public:
+    /************************************************************
+     * Calibrate and stop all rollers
+     * - positions are assumed at 0 % (open) until the first
+     *   move to an end
+     * @param[in] upMs   travel time 100 % -> 0 % per roller
+     * @param[in] downMs travel time 0 % -> 100 % per roller
+     * @param[in] nowUs  micros()
+     ************************************************************/
+    void begin(const uint32_t* upMs, const uint32_t* downMs, uint32_t nowUs) {
+      for (size_t i = 0; i < N; i++) {
+        calibrate(i, upMs[i], downMs[i]);
+        _pos[i] = _target[i] = 0;
+        _frac[i] = 0;
+        _dir[i] = _want[i] = 0;
+        _last[i] = nowUs;
+        _restUntil[i] = nowUs;
+      }
+      _group = _relays = 0;
+    }
+
+    void calibrate(size_t i, uint32_t upMs, uint32_t downMs) {
+      _speed[i][0] = (uint32_t)(((uint64_t)ROLLER_FULL << 16) / ((uint64_t)upMs * 1000));
+      _speed[i][1] = (uint32_t)(((uint64_t)ROLLER_FULL << 16) / ((uint64_t)downMs * 1000));
+    }
+
+    /************************************************************
+     * Move one roller
+     * - takes effect in the next tick(): a roller running the
+     *   other way stops there and waits for its dead time
+     * @param[in] i       roller
+     * @param[in] percent 0 (open) .. 100 (closed)
+     ************************************************************/
+    void moveTo(size_t i, uint32_t percent) {
+      _stats.moves++;
+      _group &= ~(1u << i);
+      _target[i] = (percent >= 100) ? ROLLER_FULL + ROLLER_OVERRUN :
+                   (percent == 0)   ? -ROLLER_OVERRUN :
+                                      (int32_t)((int64_t)ROLLER_FULL * percent / 100);
+      _want[i] = (_target[i] > _pos[i]) - (_target[i] < _pos[i]);
+    }
+
+    /************************************************************
+     * Move several rollers, they start in the same tick (once
+     * the last of them is past its dead time)
+     * - one group at a time, the members of an older group
+     *   start on their own then
+     * @param[in] mask    bit i: roller i
+     * @param[in] percent 0 (open) .. 100 (closed)
+     ************************************************************/
+    void moveGroup(uint32_t mask, uint32_t percent) {
+      for (size_t i = 0; i < N; i++) {
+        if ((mask >> i) & 1) {
+          moveTo(i, percent);
+        }
+      }
+      _group = mask & ((N < 32) ? (1u << N) - 1 : ~0u);
+    }
+
+    // stops in the next tick()
+    void stop(size_t i) {
+      _group &= ~(1u << i);
+      _target[i] = _pos[i];
+      _want[i] = 0;
+    }
+
+    /************************************************************
+     * Advance all rollers to nowUs
+     * - the only place where motors stop and start, so the
+     *   dead time runs from the relay write that stopped them
+     * @param[in] nowUs micros()
+     * @return relay bits (see relays())
+     ************************************************************/
+    uint32_t tick(uint32_t nowUs) {
+      uint32_t relays = 0, waiting = 0, ready = 0;
+      for (size_t i = 0; i < N; i++) {
+        int32_t  dir = _dir[i];
+        uint64_t acc = (uint64_t)(nowUs - _last[i]) * _speed[i][dir > 0] + _frac[i];
+        _last[i] = nowUs;
+        _pos[i] += dir * (int32_t)(acc >> 16);
+        _frac[i] = (uint16_t)(dir ? acc : 0);
+        // passed the target, unless a new one lies behind (reversal)
+        if (dir && (_want[i] != -dir) && ((_pos[i] - _target[i]) * dir >= 0)) {
+          arrive(i);
+        }
+        int8_t want = (_target[i] > _pos[i]) - (_target[i] < _pos[i]);
+        if (dir && (want != dir)) {
+          _stats.reversals += (want != 0);
+          _dir[i] = 0;
+          _frac[i] = 0;
+          _restUntil[i] = nowUs + ROLLER_DEAD_US;
+        }
+        _want[i] = _dir[i] ? 0 : want;
+        waiting |= (uint32_t)(_want[i] != 0) << i;
+        ready |= (uint32_t)(_want[i] && ((int32_t)(nowUs - _restUntil[i]) >= 0)) << i;
+      }
+      // a group starts when all of its waiting members are ready
+      _group &= waiting;
+      uint32_t start = (ready & ~_group) | ((_group & ~ready) ? 0 : _group);
+      _group &= ~start;
+      for (size_t i = 0; i < N; i++) {
+        if ((start >> i) & 1) {
+          _dir[i] = _want[i];
+          _want[i] = 0;
+        }
+        relays |= (uint32_t)((_dir[i] < 0) | ((_dir[i] > 0) << 1)) << (2 * i);
+      }
+      _relays = relays;
+      return relays;
+    }
+
+    // position 0 .. 100 %
+    uint32_t percent(size_t i) const {
+      int32_t p = (_pos[i] < 0) ? 0 : (_pos[i] > ROLLER_FULL) ? ROLLER_FULL : _pos[i];
+      return (uint32_t)(((int64_t)p * 100 + ROLLER_FULL / 2) / ROLLER_FULL);
+    }
+
+    int32_t  position(size_t i) const   { return _pos[i]; }           // ROLLER_FULL = 100 %
+    int8_t   direction(size_t i) const  { return _dir[i]; }
+    uint32_t relays(void) const         { return _relays; }           // of the last tick()
+
+    // rollers running or waiting for their dead time
+    uint32_t busy(void) const {
+      uint32_t mask = 0;
+      for (size_t i = 0; i < N; i++) {
+        mask |= (uint32_t)((_dir[i] | _want[i]) != 0) << i;
+      }
+      return mask;
+    }
+
+    /************************************************************
+     * us from nowUs until tick() has to stop or start a motor
+     * - arrival at the target (rounded up), end of a dead time;
+     *   a member of a group waits for the others
+     * - lets loop() sleep while the rollers move (idleWait.h)
+     * @param[in] nowUs micros()
+     * @return us, ROLLER_NO_EVENT if all rollers rest
+     ************************************************************/
+    uint32_t nextEvent(uint32_t nowUs) const {
+      uint32_t next = ROLLER_NO_EVENT;
+      for (size_t i = 0; i < N; i++) {
+        uint32_t us = ROLLER_NO_EVENT;
+        if (_dir[i]) {
+          int64_t  left = (int64_t)(_target[i] - _pos[i]) * _dir[i];
+          uint32_t speed = _speed[i][_dir[i] > 0];
+          int64_t  at = (left <= 0) ? 0 : speed ? ((left << 16) - _frac[i] + speed - 1) / speed : ROLLER_NO_EVENT;
+          int64_t  rem = at - (int64_t)(uint32_t)(nowUs - _last[i]);
+          us = (rem <= 0) ? 0 : (rem < ROLLER_NO_EVENT) ? (uint32_t)rem : ROLLER_NO_EVENT - 1;
+        } else if (_want[i]) {
+          int32_t rest = (int32_t)(_restUntil[i] - nowUs);
+          us = (rest > 0) ? (uint32_t)rest : ((_group >> i) & 1) ? ROLLER_NO_EVENT : 0;
+        }
+        next = (us < next) ? us : next;
+      }
+      return next;
+    }
+
+    const RollerStats& stats(void) const { return _stats; }
+
+  private:
+    // per roller (struct of arrays)
+    int32_t     _pos[N];                   // units, may run beyond 0 / ROLLER_FULL into the end stop
+    int32_t     _target[N];
+    uint32_t    _speed[N][2];              // Q16 units/us: [0] up, [1] down
+    uint32_t    _last[N];                  // us of the last tick
+    uint32_t    _restUntil[N];             // us: no start before
+    uint16_t    _frac[N];                  // Q16 fraction carried between ticks
+    int8_t      _dir[N];                   // -1 up, 0 stopped, +1 down
+    int8_t      _want[N];                  // direction to start (dead time, group)
+    uint32_t    _group = 0;                // rollers of the last moveGroup() not started yet
+    uint32_t    _relays = 0;
+    RollerStats _stats = {};
+
+    // target reached: stop there, or at the end (travel times synced)
+    void arrive(size_t i) {
+      _stats.arrivals++;
+      if ((_target[i] < 0) || (_target[i] > ROLLER_FULL)) {
+        _stats.endSyncs++;
+        _pos[i] = (_target[i] < 0) ? 0 : ROLLER_FULL;
+      }
+      _target[i] = _pos[i];
+    }
+};
+
+extern RollerBank<NUM_ROLLERS> g_Rollers;
+extern const uint32_t g_RollerUpMs[NUM_ROLLERS];     // calibrated travel times (main.cpp)
+extern const uint32_t g_RollerDownMs[NUM_ROLLERS];
+extern uint32_t       g_RollerPercent[NUM_ROLLERS];    // ROLLER_STATE_FIELDS (sendRollerState)
+
+#endif // _ROLLER_H_
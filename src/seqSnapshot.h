@@ -0,0 +1,71 @@
+/*!
+ * @file seqSnapshot.h
+ */
+/************************************************************
+ * Snapshot for another Task (Sequence Counter)
+ ************************************************************
+ * A value written by one task, read as a whole by others
+ * (e.g. statistics of the application core published by
+ * the network task), no lock, no heap:
+ *
+ *   writer:  snap.publish(value);    // copy of the value
+ *   reader:  T copy;
+ *            snap.read(copy);        // consistent copy
+ *
+ * - sequence lock over a double buffer: the counter is odd
+ *   while publish() writes, even when it is done, and
+ *   counter / 2 selects the published slot; publish() fills
+ *   the other one
+ * - publish(): counter odd, release fence, slot, counter
+ *   even (release); the fence keeps the slot writes from
+ *   getting visible before the odd counter
+ * - read() copies the published slot, acquire fence, and
+ *   tries again if the writer meanwhile started the publish()
+ *   after next (that one writes the slot it copied); a copy
+ *   is short against the time between two publish(), so
+ *   retries are rare
+ * - T: trivially copyable; one writer task only
+ ************************************************************/
+#ifndef _SEQSNAPSHOT_H_
+#define _SEQSNAPSHOT_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
+
+template <typename T>
+class SeqSnapshot {
+  static_assert(std::is_trivially_copyable<T>::value, "plain data only");
+
+  public:
+    /************************************************************
+     * Writer: publish a Copy of value
+     ************************************************************/
+    void publish(const T& value) {
+      uint32_t seq = _seq.load(std::memory_order_relaxed);
+      _seq.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      _slot[((seq >> 1) + 1) & 1] = value;
+      _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    /************************************************************
+     * Reader: the last published Value
+     * @param[out] out consistent copy (T() before the first
+     *             publish())
+     ************************************************************/
+    void read(T& out) const {
+      uint32_t seq;
+      do {
+        seq = _seq.load(std::memory_order_acquire);
+        out = _slot[(seq >> 1) & 1];
+        std::atomic_thread_fence(std::memory_order_acquire);
+      } while (_seq.load(std::memory_order_relaxed) - (seq & ~1u) > 2);
+    }
+
+  private:
+    T                     _slot[2] = {};
+    std::atomic<uint32_t> _seq{0};         // 2 x publish() count, odd while writing
+};
+
+#endif // _SEQSNAPSHOT_H_
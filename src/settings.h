@@ -0,0 +1,53 @@
+/*!
+ * @file settings.h
+ */
+/************************************************************
+ * Buffers and Timings
+ ************************************************************
+ * MQTT buffer, batch sizes and the T_* periods and timeouts
+ * of main.cpp; the native fleet (native/fleet) runs its
+ * node model on the same values, so both change together
+ ************************************************************/
+#ifndef _SETTINGS_H_
+#define _SETTINGS_H_
+
+/************************************************************
+ * MQTT-Connection Settings
+ ************************************************************/ 
+#define MQTT_BUFSIZE   2048                       // MQTT-Buffersize (may be augmented, when Scan returns many BLE-Devices
+#define LOG_BATCH_SIZE 1024                       // Log frames per TOPIC_LOG publish (see binLog.h)
+#define OUTBOX_DRAIN_BURST 5                      // max. queued messages sent per T_OUTBOX_DRAIN
+#define OUTBOX_CATCH_UP    2                      // queued messages sent ahead of a new one that waits for them
+#define MCP_SERVICE_PASSES 3                      // read all MCP 23017 again while INT_PIN stays low
+// Outbox: size of the ring in RAM: OUTBOX_SIZE (outbox.h)
+// optional spill of the outbox to a flash partition (needs a partition table entry, see outboxSpill.h)
+// e.g.: build_flags = '-DOUTBOX_SPILL_PARTITION="outbox"'
+
+/************************************************************
+ * Timings
+ ************************************************************/ 
+#define T_CPU_STATE           10000  // send CPU State every 10 seconds
+#define T_METRICS_STATE       10000  // send Loop Metrics every 10 seconds (LOOP_STATS)
+#define T_METRICS_SETTLE         10  // check every 10 ms whether loop() left the closed interval (max. IDLE_LATENCY_MS)
+#define T_NETWORK_STATE       30000  // send Network State every 30 seconds
+#define T_IRQ_STATE           60000  // send IRQ State every 60 seconds
+#define T_ROLLER_PUBLISH        1000  // publish changed Roller positions at most every second (rollerLoop)
+#define T_SKETCH_STATE        60000  // check Sketch State for changes every minute
+#define T_SKETCH_PUBLISH       1000  // retry publishing a changed Sketch State every second
+#define T_NET_MONITORING      10000  // How often check Wifi & MQTT: 10 seconds 
+#define T_WIFI_CONNECT_TIMEOUT 15000  // restart the WiFi association if no IP after 15 seconds
+#define T_MQTT_BACKOFF_MIN     1000  // MQTT reconnect backoff: 1 second after the first failed round ...
+#define T_MQTT_BACKOFF_MAX    60000  // ... doubled each round up to 60 seconds (plus jitter)
+#define T_MQTT_TCP_TIMEOUT     5000  // give up a TCP connect to the broker after 5 seconds
+#define T_MQTT_SOCKET_TIMEOUT     2  // seconds to wait for CONNACK once TCP is up
+#define T_DNS_TTL            300000  // resolve the broker names again after 5 minutes
+#define T_WIFI_FAST_TIMEOUT    2000  // fall back to scan + DHCP if the cached BSSID gives no IP within 2 seconds
+#define T_REBOOT_TIMEOUT       5000  // ms from command "reset" until Reboot
+#define T_LOG_FLUSH            1000  // publish the log frames of the last second on TOPIC_LOG
+#define T_OUTBOX_DRAIN          100  // send queued messages every 100 ms once ONLINE (OUTBOX_DRAIN_BURST each)
+#define T_OTA_PROGRESS         1000  // at most one OTA progress entry per second in the log
+#define T_IDLE_WIFI_POLL         10  // idle loop: check the WiFi association every 10 ms until it has an IP
+// longest sleep of an idle pass: IDLE_LATENCY_MS (idleWait.h)
+// max. Timer Jobs (system and application): TIMER_JOBS (timerWheel.h)
+
+#endif // _SETTINGS_H_
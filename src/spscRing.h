@@ -0,0 +1,134 @@
+/*!
+ * @file spscRing.h
+ */
+/************************************************************
+ * Lock-free Single Producer / Single Consumer Ring
+ ************************************************************
+ * Variable length records between exactly one producer and
+ * one consumer task (e.g. one per core), no lock, no heap:
+ *
+ *   producer:  uint8_t* p = ring.reserve(n);  // nullptr: full
+ *              memcpy(p, data, n);
+ *              ring.commit();                 // visible now
+ *   consumer:  size_t n;
+ *              uint8_t* p = ring.peek(n);     // nullptr: empty
+ *              ... use p[0..n-1] (may be modified in place)
+ *              ring.release();                // space reusable
+ *
+ * - a record is a 4 byte length + data, padded to 4 bytes;
+ *   it is never split at the end of the ring (a wrap marker
+ *   sends the consumer back to the start)
+ * - only _tail is written by the producer, only _head by the
+ *   consumer; release/acquire on them orders the data
+ * - one byte is kept free, so _head == _tail means empty
+ ************************************************************/
+#ifndef _SPSCRING_H_
+#define _SPSCRING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+#define SPSC_WRAP  0xffffffffu             // length of the wrap marker
+
+template <size_t SIZE>
+class SpscRing {
+  static_assert((SIZE % 4 == 0) && (SIZE >= 16) && (SIZE < SPSC_WRAP), "ring size");
+
+  public:
+    /************************************************************
+     * Producer: reserve n bytes
+     * @return pointer to the record data, nullptr if full
+     ************************************************************/
+    uint8_t* reserve(size_t n) {
+      size_t   need = align(sizeof(uint32_t) + n);
+      uint32_t tail = _tail.load(std::memory_order_relaxed);
+      uint32_t head = _head.load(std::memory_order_acquire);
+      uint32_t at;
+      if (tail >= head) {
+        if ((tail + need < SIZE) || ((tail + need == SIZE) && head)) {
+          at = tail;
+        } else if (need < head) {
+          uint32_t wrap = SPSC_WRAP;
+          memcpy(_buf + tail, &wrap, sizeof(wrap));
+          at = 0;
+        } else {
+          _full++;
+          return nullptr;
+        }
+      } else if (tail + need < head) {
+        at = tail;
+      } else {
+        _full++;
+        return nullptr;
+      }
+      uint32_t len = (uint32_t)n;
+      memcpy(_buf + at, &len, sizeof(len));
+      _next = (at + need == SIZE) ? 0 : (uint32_t)(at + need);
+      return _buf + at + sizeof(len);
+    }
+
+    // Producer: publish the reserved record
+    void commit(void) {
+      _tail.store(_next, std::memory_order_release);
+    }
+
+    // Producer: reserve, copy, commit
+    bool push(const void* data, size_t n) {
+      uint8_t* p = reserve(n);
+      if (!p) {
+        return false;
+      }
+      memcpy(p, data, n);
+      commit();
+      return true;
+    }
+
+    /************************************************************
+     * Consumer: oldest record
+     * @param[out] n length of the record
+     * @return pointer to the record data, nullptr if empty
+     ************************************************************/
+    uint8_t* peek(size_t& n) {
+      uint32_t head = _head.load(std::memory_order_relaxed);
+      if (head == _tail.load(std::memory_order_acquire)) {
+        return nullptr;
+      }
+      uint32_t len;
+      memcpy(&len, _buf + head, sizeof(len));
+      if (len == SPSC_WRAP) {
+        head = 0;
+        memcpy(&len, _buf, sizeof(len));
+      }
+      _peekAt = head;
+      _peekLen = len;
+      n = len;
+      return _buf + head + sizeof(len);
+    }
+
+    // Consumer: free the record returned by peek()
+    void release(void) {
+      uint32_t next = _peekAt + (uint32_t)align(sizeof(uint32_t) + _peekLen);
+      _head.store((next == SIZE) ? 0 : next, std::memory_order_release);
+    }
+
+    bool     empty(void) const          { return _head.load(std::memory_order_acquire) ==
+                                                 _tail.load(std::memory_order_acquire); }
+    uint32_t full(void) const           { return _full; }   // failed reserve() calls (producer side)
+
+  private:
+    alignas(4) uint8_t    _buf[SIZE];
+    std::atomic<uint32_t> _head{0};        // written by the consumer only
+    std::atomic<uint32_t> _tail{0};        // written by the producer only
+    // producer side
+    uint32_t              _next = 0;       // _tail after commit()
+    uint32_t              _full = 0;
+    // consumer side
+    uint32_t              _peekAt = 0;
+    uint32_t              _peekLen = 0;
+
+    static size_t align(size_t n)       { return (n + 3) & ~(size_t)3; }
+};
+
+#endif // _SPSCRING_H_
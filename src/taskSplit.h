@@ -0,0 +1,66 @@
+/*!
+ * @file taskSplit.h
+ */
+/************************************************************
+ * Dual-Core Task Split
+ ************************************************************
+ * DUAL_CORE 0 (default): everything runs in loop(), as before
+ *
+ * DUAL_CORE 1: setup() starts the network task on core 0,
+ * loop() (Arduino loopTask, core 1) only runs the application
+ *
+ *   core 0: netTask()                 core 1: loop()
+ *   netLoop(): mqtt.loop / netStep    appLoop(): commands,
+ *              ArduinoOTA.handle                 application
+ *              cronjob (system jobs)             handlers
+ *              publish g_PubQueue
+ *
+ *   mqttCallback --g_CmdQueue--> appLoop: cmdRunBatch
+ *   (MQTT_RX_TASK: rxTask is the producer, see mqttRx.h)
+ *   netLoop <--g_PubQueue-- mqttPub (called on core 1)
+ *
+ * - both queues are lock-free SPSC rings (spscRing.h), one
+ *   producer and one consumer task each
+ * - g_CmdQueue record: micros() at arrival (u32, cmdProbe.h),
+ *   command payload + '\0'
+ * - g_PubQueue record: flags, topic + '\0', payload
+ * - mqttPub() on the network task (timer jobs, log batches)
+ *   publishes directly, on any other task it queues; a
+ *   full queue blocks the application for up to
+ *   T_PUB_QUEUE_WAIT, never the network task
+ * - the network task sleeps one tick per pass (feeds the
+ *   idle task / watchdog of core 0)
+ * - native: tasks are std::threads (native/shim), start it
+ *   with "program --dual-core"
+ ************************************************************/
+#ifndef _TASKSPLIT_H_
+#define _TASKSPLIT_H_
+
+#include <Arduino.h>
+#include "spscRing.h"
+
+#ifndef DUAL_CORE
+  #define DUAL_CORE  0                     // 1: network task on NET_TASK_CORE
+#endif
+
+#define NET_TASK_CORE     0                // core 1 runs the Arduino loopTask
+#define NET_TASK_STACK    8192
+#define NET_TASK_PRIO     1                // same as the loopTask
+#define CMD_QUEUE_SIZE    4096             // bytes, inbound commands
+#define PUB_QUEUE_SIZE    8192             // bytes, outbound publishes
+#define PUB_F_RETAINED    0x01
+#define T_PUB_QUEUE_WAIT  100              // ms the application waits for room in g_PubQueue
+
+struct TaskSplitStats {
+  uint32_t    cmdQueued;                   // commands passed to the application
+  uint32_t    cmdDropped;                  // g_CmdQueue full
+  uint32_t    pubQueued;                   // publishes passed to the network task
+  uint32_t    pubDropped;                  // g_PubQueue full for T_PUB_QUEUE_WAIT
+};
+
+extern SpscRing<CMD_QUEUE_SIZE> g_CmdQueue;
+extern SpscRing<PUB_QUEUE_SIZE> g_PubQueue;
+extern TaskSplitStats           g_TaskStats;
+extern TaskHandle_t volatile    g_NetTask;  // nullptr: single loop()
+
+#endif // _TASKSPLIT_H_
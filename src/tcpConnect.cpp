@@ -0,0 +1,80 @@
+/*!
+ * @file tcpConnect.cpp
+ */
+/************************************************************
+ * Non-blocking TCP Connect (ESP32, lwIP)
+ * - the native target uses native/shim/tcpConnect.cpp
+ ************************************************************/
+#ifdef ARDUINO_ARCH_ESP32
+
+#include <tcpConnect.h>
+#include <lwip/sockets.h>
+#include <errno.h>
+
+/************************************************************
+ * Start Connect
+ * - socket in O_NONBLOCK mode, connect() returns EINPROGRESS
+ * @param[in] ip broker address
+ * @param[in] port broker port
+ * @return socket or TCP_FAILED
+ ************************************************************/
+int tcpConnectStart(IPAddress ip, uint16_t port) {
+  int sock = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (sock < 0) {
+    return TCP_FAILED;
+  }
+  lwip_fcntl(sock, F_SETFL, lwip_fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+  if ((lwip_connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) && (errno != EINPROGRESS)) {
+    lwip_close(sock);
+    return TCP_FAILED;
+  }
+  return sock;
+}
+
+
+/************************************************************
+ * Poll Connect
+ * - select() without timeout, the socket is writable once
+ *   the handshake is done (SO_ERROR tells if it failed)
+ * - connected: back to blocking mode, options as set by
+ *   WiFiClient::connect()
+ * @param[in] sock socket from tcpConnectStart()
+ * @return TCP_CONNECTED, TCP_PENDING or TCP_FAILED
+ ************************************************************/
+int tcpConnectPoll(int sock) {
+  fd_set         wfds;
+  struct timeval tv = {0, 0};
+  FD_ZERO(&wfds);
+  FD_SET(sock, &wfds);
+  int res = lwip_select(sock + 1, nullptr, &wfds, nullptr, &tv);
+  if (res == 0) {
+    return TCP_PENDING;
+  }
+  int       err = 0;
+  socklen_t len = sizeof(err);
+  if ((res < 0) || (lwip_getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) < 0) || err) {
+    return TCP_FAILED;
+  }
+  int one = 1;
+  lwip_fcntl(sock, F_SETFL, lwip_fcntl(sock, F_GETFL, 0) & ~O_NONBLOCK);
+  lwip_setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  lwip_setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+  return TCP_CONNECTED;
+}
+
+
+/************************************************************
+ * Abort Connect
+ ************************************************************/
+void tcpConnectAbort(int sock) {
+  if (sock >= 0) {
+    lwip_close(sock);
+  }
+}
+
+#endif // ARDUINO_ARCH_ESP32
@@ -0,0 +1,35 @@
+/*!
+ * @file tcpConnect.h
+ */
+/************************************************************
+ * Non-blocking TCP Connect
+ ************************************************************
+ * Opens the TCP connection to the broker without blocking
+ * loop():
+ *
+ *   int sock = tcpConnectStart(ip, MQTT_PORT);
+ *   loop(): switch (tcpConnectPoll(sock)) ...
+ *   TCP_CONNECTED: myWiFiClient = WiFiClient(sock);
+ *                  mqtt.connect(...)   // uses the open socket
+ *
+ * PubSubClient::connect() skips DNS and the TCP connect when
+ * its client is already connected, it only sends CONNECT and
+ * waits for CONNACK.
+ * - ESP32: lwIP socket in O_NONBLOCK mode (tcpConnect.cpp)
+ * - native: simulated against the LocalBroker (native/shim)
+ ************************************************************/
+#ifndef _TCPCONNECT_H_
+#define _TCPCONNECT_H_
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#define TCP_FAILED      -1
+#define TCP_PENDING      0
+#define TCP_CONNECTED    1
+
+int     tcpConnectStart(IPAddress ip, uint16_t port);   // socket, TCP_FAILED on error
+int     tcpConnectPoll(int sock);                       // TCP_CONNECTED, TCP_PENDING or TCP_FAILED
+void    tcpConnectAbort(int sock);                      // close a pending or failed socket
+
+#endif // _TCPCONNECT_H_
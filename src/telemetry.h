@@ -0,0 +1,325 @@
+/*!
+ * @file telemetry.h
+ */
+/************************************************************
+ * Telemetry Encoder
+ ************************************************************
+ * Writes one flat key/value document into a fixed buffer,
+ * no String, no heap allocation.
+ * Encodings (select per env with -DTELEMETRY_FORMAT=...):
+ * - TELEMETRY_JSON     {"key":value,...}  (default)
+ * - TELEMETRY_CBOR     RFC 8949 map, text keys
+ * - TELEMETRY_MSGPACK  MessagePack map, str keys
+ * Keys are the same in all encodings, a consumer only needs
+ * a different decoder.
+ *
+ * Documents are defined as field lists (see telemetryFields.h):
+ *
+ *   #define CPU_STATE_FIELDS(FIELD)              \
+ *     FIELD("FreeHeap", ESP.getFreeHeap())       \
+ *     FIELD("Chip Model", ESP.getChipModel())
+ *
+ *   TelemetryWriter tlm(buf, sizeof(buf));
+ *   TELEMETRY_WRITE(tlm, CPU_STATE_FIELDS);
+ *   mqttPub(TOPIC_CPU, tlm.data(), tlm.length(), ...);
+ *
+ * The value type is taken from the expression: integers,
+ * bool, const char*, String, IPAddress, TelemetryList (array
+ * of unsigned values, e.g. histogram buckets).
+ ************************************************************/
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <Arduino.h>
+#include <type_traits>
+
+#define TELEMETRY_JSON     0
+#define TELEMETRY_CBOR     1
+#define TELEMETRY_MSGPACK  2
+
+#ifndef TELEMETRY_FORMAT
+  #define TELEMETRY_FORMAT  TELEMETRY_JSON
+#endif
+
+#ifndef TELEMETRY_BUFSIZE
+  #define TELEMETRY_BUFSIZE  1024          // max size of one telemetry document (TOPIC_NETWORK: up to 858 bytes of JSON, benchTelemetry)
+#endif
+
+// X-macro helpers: count the fields, write one field
+#define TELEMETRY_COUNT(key, value)   +1
+#define TELEMETRY_FIELD(key, value)   _tlm.field(key, value);
+#define TELEMETRY_WRITE(writer, FIELDS)           \
+  do {                                            \
+    auto& _tlm = (writer);                        \
+    _tlm.begin(0 FIELDS(TELEMETRY_COUNT));        \
+    FIELDS(TELEMETRY_FIELD)                       \
+    _tlm.end();                                   \
+  } while (0)
+
+// array of unsigned values
+struct TelemetryList {
+  const uint32_t* values;
+  size_t          count;
+};
+
+template <int FORMAT>
+class TelemetryEncoder {
+  public:
+    static constexpr bool BINARY = (FORMAT != TELEMETRY_JSON);
+
+    TelemetryEncoder(char* buf, size_t size) : _buf((uint8_t*)buf), _size(size), _len(0), _count(0), _overflow(false) {}
+
+    /************************************************************
+     * Start a document with the given number of fields
+     ************************************************************/
+    void begin(size_t fields) {
+      _len = 0;
+      _count = 0;
+      _overflow = false;
+      if (FORMAT == TELEMETRY_JSON) {
+        put('{');
+      } else if (FORMAT == TELEMETRY_CBOR) {
+        cborHead(5, fields);
+      } else if (fields < 16) {
+        put((uint8_t)(0x80 | fields));
+      } else {
+        put(0xde);
+        putBE(fields, 2);
+      }
+    }
+
+    /************************************************************
+     * Finish the document
+     * - JSON is '\0' terminated (not counted in length())
+     * - returns the length, 0 if the buffer was too small
+     ************************************************************/
+    size_t end(void) {
+      if (FORMAT == TELEMETRY_JSON) {
+        put('}');
+        if (_len < _size) {
+          _buf[_len] = '\0';
+        } else {
+          _overflow = true;
+        }
+      }
+      return length();
+    }
+
+    /************************************************************
+     * Fields
+     ************************************************************/
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type field(const char* key, T value) {
+      this->key(key);
+      if (std::is_same<T, bool>::value) {
+        boolValue((bool)value);
+      } else if (std::is_signed<T>::value && (value < 0)) {
+        negative((int64_t)value);
+      } else {
+        unsignedInt((uint64_t)value);
+      }
+    }
+
+    void field(const char* key, const char* value) {
+      this->key(key);
+      str(value, strlen(value));
+    }
+
+    void field(const char* key, const String& value) {
+      field(key, value.c_str());
+    }
+
+    void field(const char* key, const IPAddress& value) {
+      char ip[16];
+      int  n = snprintf(ip, sizeof(ip), "%u.%u.%u.%u", value[0], value[1], value[2], value[3]);
+      this->key(key);
+      str(ip, (size_t)n);
+    }
+
+    void field(const char* key, const TelemetryList& list) {
+      this->key(key);
+      if (FORMAT == TELEMETRY_JSON) {
+        put('[');
+      } else if (FORMAT == TELEMETRY_CBOR) {
+        cborHead(4, list.count);
+      } else if (list.count < 16) {
+        put((uint8_t)(0x90 | list.count));
+      } else {
+        put(0xdc);
+        putBE(list.count, 2);
+      }
+      for (size_t i = 0; i < list.count; i++) {
+        if ((FORMAT == TELEMETRY_JSON) && i) {
+          put(',');
+        }
+        unsignedInt(list.values[i]);
+      }
+      if (FORMAT == TELEMETRY_JSON) {
+        put(']');
+      }
+    }
+
+    const char* data(void) const      { return (const char*)_buf; }
+    size_t      length(void) const    { return _overflow ? 0 : _len; }
+    bool        overflow(void) const  { return _overflow; }
+
+  private:
+    void put(uint8_t c) {
+      if (_len < _size) {
+        _buf[_len++] = c;
+      } else {
+        _overflow = true;
+      }
+    }
+
+    void putBytes(const char* s, size_t n) {
+      if (n <= _size - _len) {
+        memcpy(_buf + _len, s, n);
+        _len += n;
+      } else {
+        _overflow = true;
+      }
+    }
+
+    void putBE(uint64_t v, int bytes) {
+      while (bytes--) {
+        put((uint8_t)(v >> (8 * bytes)));
+      }
+    }
+
+    void putDec(uint64_t v) {
+      char tmp[20];
+      int  n = 0;
+      do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+      } while (v);
+      while (n) {
+        put(tmp[--n]);
+      }
+    }
+
+    // CBOR: major type and argument
+    void cborHead(uint8_t major, uint64_t v) {
+      major <<= 5;
+      if (v < 24) {
+        put((uint8_t)(major | v));
+      } else if (v <= 0xff) {
+        put(major | 24);
+        put((uint8_t)v);
+      } else if (v <= 0xffff) {
+        put(major | 25);
+        putBE(v, 2);
+      } else if (v <= 0xffffffffULL) {
+        put(major | 26);
+        putBE(v, 4);
+      } else {
+        put(major | 27);
+        putBE(v, 8);
+      }
+    }
+
+    void key(const char* name) {
+      if (FORMAT == TELEMETRY_JSON) {
+        if (_count) {
+          put(',');
+        }
+      }
+      _count++;
+      str(name, strlen(name));
+      if (FORMAT == TELEMETRY_JSON) {
+        put(':');
+      }
+    }
+
+    void str(const char* s, size_t n) {
+      if (FORMAT == TELEMETRY_JSON) {
+        put('"');
+        for (size_t i = 0; i < n; i++) {
+          if ((s[i] == '"') || (s[i] == '\\')) {
+            put('\\');
+          }
+          put((uint8_t)s[i] < 0x20 ? ' ' : s[i]);
+        }
+        put('"');
+        return;
+      }
+      if (FORMAT == TELEMETRY_CBOR) {
+        cborHead(3, n);
+      } else if (n < 32) {
+        put((uint8_t)(0xa0 | n));
+      } else if (n <= 0xff) {
+        put(0xd9);
+        put((uint8_t)n);
+      } else {
+        put(0xda);
+        putBE(n, 2);
+      }
+      putBytes(s, n);
+    }
+
+    void unsignedInt(uint64_t v) {
+      if (FORMAT == TELEMETRY_JSON) {
+        putDec(v);
+      } else if (FORMAT == TELEMETRY_CBOR) {
+        cborHead(0, v);
+      } else if (v < 0x80) {
+        put((uint8_t)v);
+      } else if (v <= 0xff) {
+        put(0xcc);
+        put((uint8_t)v);
+      } else if (v <= 0xffff) {
+        put(0xcd);
+        putBE(v, 2);
+      } else if (v <= 0xffffffffULL) {
+        put(0xce);
+        putBE(v, 4);
+      } else {
+        put(0xcf);
+        putBE(v, 8);
+      }
+    }
+
+    void negative(int64_t v) {
+      if (FORMAT == TELEMETRY_JSON) {
+        put('-');
+        putDec((uint64_t)(-(v + 1)) + 1);
+      } else if (FORMAT == TELEMETRY_CBOR) {
+        cborHead(1, (uint64_t)(-(v + 1)));
+      } else if (v >= -32) {
+        put((uint8_t)v);
+      } else if (v >= INT8_MIN) {
+        put(0xd0);
+        putBE((uint64_t)v, 1);
+      } else if (v >= INT16_MIN) {
+        put(0xd1);
+        putBE((uint64_t)v, 2);
+      } else if (v >= INT32_MIN) {
+        put(0xd2);
+        putBE((uint64_t)v, 4);
+      } else {
+        put(0xd3);
+        putBE((uint64_t)v, 8);
+      }
+    }
+
+    void boolValue(bool v) {
+      if (FORMAT == TELEMETRY_JSON) {
+        v ? putBytes("true", 4) : putBytes("false", 5);
+      } else if (FORMAT == TELEMETRY_CBOR) {
+        put(v ? 0xf5 : 0xf4);
+      } else {
+        put(v ? 0xc3 : 0xc2);
+      }
+    }
+
+    uint8_t* _buf;
+    size_t   _size;
+    size_t   _len;
+    size_t   _count;
+    bool     _overflow;
+};
+
+typedef TelemetryEncoder<TELEMETRY_FORMAT> TelemetryWriter;
+
+#endif // _TELEMETRY_H_
@@ -0,0 +1,129 @@
+/*!
+ * @file telemetryFields.h
+ */
+/************************************************************
+ * Telemetry Field Lists
+ ************************************************************
+ * One line per field: FIELD("Key", expression)
+ * - the encoding is taken from the type of the expression
+ * - written with TELEMETRY_WRITE (see telemetry.h)
+ * - expressions are evaluated where the list is written
+ ************************************************************/
+#ifndef _TELEMETRYFIELDS_H_
+#define _TELEMETRYFIELDS_H_
+
+#include "telemetry.h"
+#include "deviceFacts.h"
+#include "netState.h"
+#include "outbox.h"
+#include "irqEvents.h"
+#include "roller.h"
+#include "idleWait.h"
+#include "mqttRx.h"
+#include "mqttQos.h"
+
+/************************************************************
+ * CPU State -> TOPIC_CPU
+ * - g_IdlePercent and g_IdleWakes are filled by
+ *   sendCPUState() (see idleWait.h)
+ ************************************************************/
+#define CPU_STATE_FIELDS(FIELD)                                \
+  FIELD("Heap Size",          ESP.getHeapSize())               \
+  FIELD("FreeHeap",           ESP.getFreeHeap())               \
+  FIELD("Minimum Free Heap",  ESP.getMinFreeHeap())            \
+  FIELD("Max Free Heap",      ESP.getMaxAllocHeap())           \
+  FIELD("Chip Model",         ESP.getChipModel())              \
+  FIELD("Chip Revision",      ESP.getChipRevision())           \
+  FIELD("Millis",             millis())                        \
+  FIELD("Cycle Count",        ESP.getCycleCount())             \
+  FIELD("Idle %",             (TelemetryList{g_IdlePercent, 2})) \
+  FIELD("Wakes",              (TelemetryList{g_IdleWakes, IDLE_WAKE_COUNT})) \
+  FIELD("Busy Passes",        g_IdleLoop.busy() + g_IdleNet.busy())
+
+/************************************************************
+ * Network State -> TOPIC_NETWORK
+ * - "Rx ...": receive task (MQTT_RX_TASK, see mqttRx.h)
+ * - "Qos ...": QoS 1 publishing (MQTT_QOS1, see mqttQos.h)
+ ************************************************************/
+#define NETWORK_STATE_FIELDS(FIELD)                            \
+  FIELD("IP-Address",         WiFi.localIP())                  \
+  FIELD("MQTT-ClientID",      g_DeviceFacts.clientId)          \
+  FIELD("Time to IP",         g_Net.timeToIp)                  \
+  FIELD("Time to Online",     g_Net.timeToOnline)              \
+  FIELD("WiFi Attempts",      g_Net.wifiAttempts)              \
+  FIELD("Connect ms",         g_Net.connectMs)                 \
+  FIELD("Fast Hits",          g_Net.fastHits)                  \
+  FIELD("Fast Misses",        g_Net.fastMisses)                \
+  FIELD("MQTT Reconnects",    g_Net.mqttReconnects)            \
+  FIELD("Reconnect Attempts", g_Net.lastAttempts)              \
+  FIELD("Reconnect ms",       g_Net.lastReconnectMs)           \
+  FIELD("DNS Lookups",        g_Net.dnsLookups)                \
+  FIELD("Broker",             g_Net.lastBroker)                \
+  FIELD("Outbox Depth",       g_Outbox.depth())                \
+  FIELD("Outbox Max Depth",   g_Outbox.stats().maxDepth)       \
+  FIELD("Outbox Queued",      g_Outbox.stats().queued)         \
+  FIELD("Outbox Sent",        g_Outbox.stats().sent)           \
+  FIELD("Outbox Replaced",    g_Outbox.stats().replaced)       \
+  FIELD("Outbox Dropped",     g_Outbox.stats().dropped)        \
+  FIELD("Outbox Spilled",     g_Outbox.stats().spilled)        \
+  FIELD("Rx Packets",         g_RxStats.packets)               \
+  FIELD("Rx Commands",        g_RxStats.commands)              \
+  FIELD("Rx Dropped",         g_RxStats.dropped + g_RxStats.oversize) \
+  FIELD("Rx Pings",           g_RxStats.pings)                 \
+  FIELD("Rx Lost",            g_RxStats.lost)                  \
+  FIELD("Qos In Flight",      g_QosWindow.inFlight())          \
+  FIELD("Qos Sent",           g_QosStats.sent)                 \
+  FIELD("Qos Acked",          g_QosStats.acked)                \
+  FIELD("Qos Retransmits",    g_QosStats.retransmits)          \
+  FIELD("Qos Blocked",        g_QosStats.blocked)              \
+  FIELD("Qos Timeouts",       g_QosStats.timeouts)             \
+  FIELD("Qos Ack p50 us",     g_QosStats.ackUs.percentile(50)) \
+  FIELD("Qos Ack p99 us",     g_QosStats.ackUs.percentile(99))
+
+/************************************************************
+ * IRQ State -> TOPIC_IRQ (see irqEvents.h)
+ * - counters and histograms since boot
+ * - g_IrqReport is filled by sendIrqState() (snapshot of
+ *   irqDrain, the application side)
+ ************************************************************/
+#define IRQ_STATE_FIELDS(FIELD)                                \
+  FIELD("Events",             g_IrqReport.events)              \
+  FIELD("Accepted",           g_IrqReport.accepted)            \
+  FIELD("Bounced",            g_IrqReport.bounced)             \
+  FIELD("Overflows",          g_IrqReport.overflows)           \
+  FIELD("Max Rate",           g_IrqReport.maxRate)             \
+  FIELD("Rate Histogram",     g_IrqReport.rate.buckets())      \
+  FIELD("Latency p50 us",     g_IrqReport.latency.percentile(50)) \
+  FIELD("Latency p99 us",     g_IrqReport.latency.percentile(99)) \
+  FIELD("Latency max us",     g_IrqReport.latency.max())       \
+  FIELD("Latency Histogram",  g_IrqReport.latency.buckets())
+
+/************************************************************
+ * Roller State -> TOPIC_ROLLER (see roller.h)
+ * - g_RollerPercent is filled by sendRollerState()
+ *   (application side, as tick() updates g_Rollers)
+ ************************************************************/
+#define ROLLER_STATE_FIELDS(FIELD)                             \
+  FIELD("Position",           (TelemetryList{g_RollerPercent, NUM_ROLLERS})) \
+  FIELD("Busy",               g_Rollers.busy())                \
+  FIELD("Moves",              g_Rollers.stats().moves)         \
+  FIELD("Reversals",          g_Rollers.stats().reversals)     \
+  FIELD("End Syncs",          g_Rollers.stats().endSyncs)
+
+/************************************************************
+ * Sketch State -> TOPIC_SKETCH (retained)
+ * - rendered once from g_DeviceFacts (deviceFacts.h)
+ ************************************************************/
+#define SKETCH_STATE_FIELDS(FIELD)                             \
+  FIELD("Project version",    VERSION)                         \
+  FIELD("Target",             TARGET)                          \
+  FIELD("Build timestamp",    BUILD_TIMESTAMP)                 \
+  FIELD("Sdk Version",        g_DeviceFacts.sdkVersion)        \
+  FIELD("CpuFreq",            g_DeviceFacts.cpuFreqMHz)        \
+  FIELD("SketchSize",         g_DeviceFacts.sketchSize)        \
+  FIELD("Free SketchSpace",   g_DeviceFacts.freeSketchSpace)   \
+  FIELD("Sketch MD5",         g_DeviceFacts.sketchMD5)         \
+  FIELD("Flash ChipSize",     g_DeviceFacts.flashChipSize)     \
+  FIELD("Flash Chip Speed",   g_DeviceFacts.flashChipSpeed)
+
+#endif // _TELEMETRYFIELDS_H_
@@ -0,0 +1,342 @@
+/*!
+ * @file timerWheel.h
+ */
+/************************************************************
+ * Timer Wheel
+ ************************************************************
+ * Hierarchical timer wheel for periodic and one-shot jobs,
+ * resolution 1 ms (millis()):
+ *
+ *   TimerWheel<16> g_Timers;
+ *   g_Timers.begin(millis());
+ *   g_Timers.every(10000, sendCPUState10s);       // periodic
+ *   int id = g_Timers.after(5000, resetHandler);  // one-shot
+ *   g_Timers.cancel(id);
+ *   loop(): g_Timers.run(millis());
+ *
+ * - 4 levels of 64 slots (64^4 ms = 4.6 h), longer delays
+ *   are re-cascaded; insert, cancel and expiry are O(1)
+ * - periodic jobs run on fixed deadlines (start + k * period):
+ *   loop latency delays a run but does not shift the next
+ *   one; periods missed completely are skipped (missed())
+ * - run() skips empty ticks using per level occupancy bits
+ * - nextDeadline(): ms until the next job may be due, so the
+ *   idle loop can sleep instead of spinning
+ * - jobs live in a fixed pool of N entries, no heap
+ * - runner(): optional function that calls the callbacks
+ *   (e.g. to time them, see loopStats.h)
+ ************************************************************/
+#ifndef _TIMERWHEEL_H_
+#define _TIMERWHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TIMER_NONE           -1            // returned if the pool is exhausted
+#define TIMER_NO_DEADLINE    0xffffffffu   // nextDeadline(): no job registered
+
+#ifndef TIMER_JOBS
+  #define TIMER_JOBS         16            // max. jobs of g_Timers (system and application)
+#endif
+
+#define TIMER_WHEEL_BITS     6
+#define TIMER_WHEEL_SLOTS    (1u << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS   4
+#define TIMER_WHEEL_SPAN     (1u << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+typedef void (*TimerCallback)(void);
+typedef void (*TimerRunner)(TimerCallback fn);
+
+template <size_t N>
+class TimerWheel {
+  public:
+    static_assert(N < 255, "too many timer jobs");
+
+    TimerWheel() : _runner(nullptr), _now(0), _target(0), _count(0), _missed(0) {
+      for (size_t l = 0; l < TIMER_WHEEL_LEVELS; l++) {
+        _occupied[l] = 0;
+        for (size_t s = 0; s < TIMER_WHEEL_SLOTS; s++) {
+          _slots[l][s] = NIL;
+        }
+      }
+      for (size_t i = 0; i < N; i++) {
+        _jobs[i].next = (uint8_t)((i + 1 < N) ? i + 1 : NIL);
+        _jobs[i].armed = false;
+        _jobs[i].generation = 0;
+      }
+      _free = N ? 0 : NIL;
+    }
+
+    /************************************************************
+     * Set the current time (call once before adding jobs)
+     ************************************************************/
+    void begin(uint32_t now) {
+      _now = now;
+      _target = now;
+    }
+
+    /************************************************************
+     * Periodic job, first run after firstDelay ms
+     * - returns the job id or TIMER_NONE
+     ************************************************************/
+    int every(uint32_t period, TimerCallback fn, uint32_t firstDelay) {
+      return add(firstDelay, period ? period : 1, fn);
+    }
+
+    int every(uint32_t period, TimerCallback fn) {
+      return every(period, fn, period);
+    }
+
+    /************************************************************
+     * One-shot job, runs once after delay ms
+     ************************************************************/
+    int after(uint32_t delay, TimerCallback fn) {
+      return add(delay, 0, fn);
+    }
+
+    /************************************************************
+     * Cancel a job, false if it already ran or is unknown
+     ************************************************************/
+    bool cancel(int id) {
+      Job* job = lookup(id);
+      if (!job) {
+        return false;
+      }
+      unlink(job);
+      release(job);
+      return true;
+    }
+
+    /************************************************************
+     * Run all jobs due up to now
+     * - callbacks may add and cancel jobs (also themselves)
+     ************************************************************/
+    void run(uint32_t now) {
+      _target = now;
+      while ((int32_t)(now - _now) > 0) {
+        uint32_t todo = now - _now;
+        uint32_t step = ticksToNextEvent();
+        if (step > todo) {
+          _now = now;                      // nothing due and no cascade in between
+          break;
+        }
+        _now += step - 1;
+        tick();
+      }
+    }
+
+    /************************************************************
+     * ms from now until the next job may be due
+     * - 0 if a job is due, TIMER_NO_DEADLINE if there is none
+     * - jobs beyond the first level report the time of their
+     *   cascade (early, never late)
+     ************************************************************/
+    uint32_t nextDeadline(uint32_t now) const {
+      if (!_count) {
+        return TIMER_NO_DEADLINE;
+      }
+      uint32_t earliest = _now + TIMER_WHEEL_SPAN;
+      if (_occupied[0]) {
+        earliest = _now + nearest(0, _now);
+      }
+      for (size_t l = 1; l < TIMER_WHEEL_LEVELS; l++) {
+        if (_occupied[l]) {
+          uint32_t shift = TIMER_WHEEL_BITS * l;
+          uint32_t start = ((_now >> shift) + nearest(l, _now >> shift)) << shift;
+          if ((int32_t)(start - earliest) < 0) {
+            earliest = start;
+          }
+        }
+      }
+      return ((int32_t)(earliest - now) <= 0) ? 0 : earliest - now;
+    }
+
+    /************************************************************
+     * Call the callbacks through fn (nullptr: directly)
+     ************************************************************/
+    void runner(TimerRunner fn) {
+      _runner = fn;
+    }
+
+    size_t   count(void) const   { return _count; }       // jobs registered
+    uint32_t missed(void) const  { return _missed; }      // periods skipped (loop blocked > period)
+
+  private:
+    static const uint8_t NIL = 0xff;
+
+    struct Job {
+      uint32_t      expires;               // absolute deadline [ms]
+      uint32_t      period;                // 0: one-shot
+      TimerCallback fn;
+      uint8_t       next;
+      uint8_t       prev;
+      uint8_t       level;
+      uint8_t       slot;
+      uint8_t       generation;            // part of the id, detects stale ids
+      bool          armed;
+    };
+
+    int add(uint32_t delay, uint32_t period, TimerCallback fn) {
+      if ((_free == NIL) || !fn) {
+        return TIMER_NONE;
+      }
+      uint8_t idx = _free;
+      Job*    job = &_jobs[idx];
+      _free = job->next;
+      job->generation++;
+      job->armed = true;
+      job->expires = _now + (delay ? delay : 1);
+      job->period = period;
+      job->fn = fn;
+      _count++;
+      insert(job);
+      return (int)(((uint32_t)job->generation << 8) | idx);
+    }
+
+    Job* lookup(int id) {
+      if (id < 0) {
+        return nullptr;
+      }
+      uint32_t idx = (uint32_t)id & 0xff;
+      if (idx >= N) {
+        return nullptr;
+      }
+      Job* job = &_jobs[idx];
+      return (job->armed && (job->generation == (uint8_t)((uint32_t)id >> 8))) ? job : nullptr;
+    }
+
+    void release(Job* job) {
+      job->armed = false;
+      job->next = _free;
+      _free = (uint8_t)(job - _jobs);
+      _count--;
+    }
+
+    // put a job into the level/slot matching its distance
+    void insert(Job* job) {
+      uint32_t pos = job->expires;
+      if ((int32_t)(pos - _now) < 0) {
+        pos = _now;                        // overdue: slot of the current tick
+      } else if (pos - _now >= TIMER_WHEEL_SPAN) {
+        pos = _now + TIMER_WHEEL_SPAN - 1; // too far: re-cascaded later
+      }
+      uint32_t delta = pos - _now;
+      uint8_t  level = 0;
+      while ((level < TIMER_WHEEL_LEVELS - 1) && (delta >> (TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
+      }
+      uint8_t slot = (uint8_t)((pos >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+      uint8_t idx = (uint8_t)(job - _jobs);
+      job->level = level;
+      job->slot = slot;
+      job->prev = NIL;
+      job->next = _slots[level][slot];
+      if (job->next != NIL) {
+        _jobs[job->next].prev = idx;
+      }
+      _slots[level][slot] = idx;
+      _occupied[level] |= (1ULL << slot);
+    }
+
+    void unlink(Job* job) {
+      if (job->prev != NIL) {
+        _jobs[job->prev].next = job->next;
+      } else {
+        _slots[job->level][job->slot] = job->next;
+      }
+      if (job->next != NIL) {
+        _jobs[job->next].prev = job->prev;
+      }
+      if (_slots[job->level][job->slot] == NIL) {
+        _occupied[job->level] &= ~(1ULL << job->slot);
+      }
+    }
+
+    // distance (1..64) from index to the next occupied slot of a level
+    uint32_t nearest(size_t level, uint32_t index) const {
+      uint32_t start = (index + 1) & (TIMER_WHEEL_SLOTS - 1);
+      uint64_t bits = _occupied[level];
+      uint64_t rotated = (bits >> start) | (bits << ((TIMER_WHEEL_SLOTS - start) & (TIMER_WHEEL_SLOTS - 1)));
+      return (uint32_t)__builtin_ctzll(rotated) + 1;
+    }
+
+    // ticks to the next occupied first level slot or cascade
+    uint32_t ticksToNextEvent(void) const {
+      uint32_t step = TIMER_WHEEL_SLOTS - (_now & (TIMER_WHEEL_SLOTS - 1));
+      if (_occupied[0]) {
+        uint32_t next = nearest(0, _now);
+        step = (next < step) ? next : step;
+      }
+      return step;
+    }
+
+    // advance one tick: cascade upper levels, run the jobs due
+    void tick(void) {
+      _now++;
+      for (size_t l = 1; l < TIMER_WHEEL_LEVELS; l++) {
+        if (_now & ((1u << (TIMER_WHEEL_BITS * l)) - 1)) {
+          break;
+        }
+        cascade(l, (_now >> (TIMER_WHEEL_BITS * l)) & (TIMER_WHEEL_SLOTS - 1));
+      }
+      uint8_t slot = _now & (TIMER_WHEEL_SLOTS - 1);
+      uint8_t idx;
+      while ((idx = _slots[0][slot]) != NIL) {
+        Job* job = &_jobs[idx];
+        unlink(job);
+        if ((int32_t)(job->expires - _now) > 0) {
+          insert(job);
+          continue;
+        }
+        fire(job);
+      }
+    }
+
+    void cascade(size_t level, uint32_t slot) {
+      uint8_t idx = _slots[level][slot];
+      _slots[level][slot] = NIL;
+      _occupied[level] &= ~(1ULL << slot);
+      while (idx != NIL) {
+        Job* job = &_jobs[idx];
+        idx = job->next;
+        insert(job);
+      }
+    }
+
+    void fire(Job* job) {
+      TimerCallback fn = job->fn;
+      if (job->period) {
+        // fixed deadlines: next = last deadline + period, skip
+        // the periods that passed while the loop was blocked
+        uint32_t next = job->expires + job->period;
+        if ((int32_t)(next - _target) <= 0) {
+          uint32_t skip = (_target - next) / job->period + 1;
+          _missed += skip;
+          next += skip * job->period;
+        }
+        job->expires = next;
+        insert(job);
+      } else {
+        release(job);
+      }
+      if (_runner) {
+        _runner(fn);
+      } else {
+        fn();
+      }
+    }
+
+    Job      _jobs[N];
+    uint8_t  _slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t _occupied[TIMER_WHEEL_LEVELS];
+    uint8_t  _free;
+    TimerRunner _runner;
+    uint32_t _now;                         // time of the last tick processed
+    uint32_t _target;                      // time run() was called with
+    size_t   _count;
+    uint32_t _missed;
+};
+
+extern TimerWheel<TIMER_JOBS> g_Timers;
+
+#endif // _TIMERWHEEL_H_
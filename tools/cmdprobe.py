@@ -0,0 +1,148 @@
+""" Command latency probe: where the time of a command goes """
+##############################################################
+# Command Latency Probe (see src/cmdProbe.h)
+#
+# Sends "probe SEQ" to [PREFIX]/cmd at a fixed rate and reads
+# the answers on [PREFIX]/result:
+#
+#   probe SEQ mhz=240 start=C end=C pub=C
+#
+# C: CPU cycles since the message arrived in mqttCallback()
+# (arrival -> start measured with micros(), 1 us resolution:
+# the message may arrive on the other core).
+# The round trip (host clock) is split into
+#   network  round trip - pub: broker, wire both ways, the wait
+#            for mqtt.loop(), the way out through mqttPub
+#   queue    arrival -> the batch starts (dual-core: g_CmdQueue)
+#   handler  the batch runs
+#   format   the probe result is written
+#
+# The native target runs the same split without a broker
+# (program --bench, section "command latency probe").
+#
+# Usage:
+#   python tools/cmdprobe.py --broker mqtt.example.de --prefix esp32/hello-ota
+#   python tools/cmdprobe.py --broker localhost --prefix esp32/hello-ota --rate 50 --count 5000 --csv probe.csv
+#
+# Needs paho-mqtt.
+#
+##############################################################
+# Copyright (C) 2022  Dario Carluccio
+##############################################################
+
+import argparse
+import re
+import sys
+import threading
+import time
+
+RESULT = re.compile(r'probe (\d+) mhz=(\d+) start=(\d+) end=(\d+) pub=(\d+)')
+PARTS = ['rtt', 'network', 'queue', 'handler', 'format']
+TIMEOUT = 5.0               # seconds before a probe counts as lost
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100.0 * (len(values) - 1) + 0.5))]
+
+
+class Probe:
+    """ probes in flight and the split of the answered ones [us] """
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.sent = {}
+        self.samples = []
+        self.other = 0
+
+    def send(self, seq):
+        with self.lock:
+            self.sent[seq] = time.perf_counter()
+
+    def answer(self, text):
+        now = time.perf_counter()
+        m = RESULT.match(text)
+        with self.lock:
+            if not m or int(m.group(1)) not in self.sent:
+                self.other += 1
+                return
+            seq, mhz, start, end, pub = (int(v) for v in m.groups())
+            rtt = (now - self.sent.pop(seq)) * 1e6
+            self.samples.append((seq, rtt, max(rtt - pub / mhz, 0.0), start / mhz, (end - start) / mhz,
+                                 (pub - end) / mhz))
+
+    def lost(self, older_than):
+        with self.lock:
+            return sum(1 for t in self.sent.values() if t < older_than)
+
+
+def report(probe, count, seconds):
+    print('{} probes in {:.1f} s: {} answered, {} lost, {} other results'.format(
+        count, seconds, len(probe.samples), len(probe.sent), probe.other))
+    print('{:<10} {:>10} {:>10} {:>10} {:>10} {:>10}'.format('[us]', 'mean', 'p50', 'p90', 'p99', 'max'))
+    for i, name in enumerate(PARTS):
+        v = [s[i + 1] for s in probe.samples]
+        if v:
+            print('{:<10} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.1f}'.format(
+                name, sum(v) / len(v), percentile(v, 50), percentile(v, 90), percentile(v, 99), max(v)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Command latency probe')
+    parser.add_argument('--broker', required=True)
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('--prefix', required=True, help='MQTT_PREFIX of the device')
+    parser.add_argument('--user')
+    parser.add_argument('--password')
+    parser.add_argument('--rate', type=float, default=10.0, help='probes per second')
+    parser.add_argument('--count', type=int, default=1000, help='probes to send')
+    parser.add_argument('--csv', help='write every sample (us) to this file')
+    args = parser.parse_args()
+
+    import paho.mqtt.client as mqtt
+    probe = Probe()
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_message = lambda c, u, m: probe.answer(m.payload.decode('ascii', 'replace'))
+    try:
+        client.connect(args.broker, args.port)
+    except OSError as e:
+        sys.exit('cmdprobe: {}'.format(e))
+    client.subscribe(args.prefix + '/result')
+    client.loop_start()
+    time.sleep(0.5)             # SUBACK before the first probe
+    start = time.perf_counter()
+    seq = 0
+    try:
+        while seq < args.count:
+            due = start + seq / args.rate
+            now = time.perf_counter()
+            if now < due:
+                time.sleep(min(due - now, 0.01))
+                continue
+            probe.send(seq)
+            client.publish(args.prefix + '/cmd', 'probe {}'.format(seq))
+            seq += 1
+            if seq % max(int(args.rate), 1) == 0:
+                print('\r{} / {} sent, {} answered'.format(seq, args.count, len(probe.samples)), end='', flush=True)
+        deadline = time.perf_counter() + TIMEOUT
+        while probe.lost(time.perf_counter() + 1) and time.perf_counter() < deadline:
+            time.sleep(0.05)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        client.loop_stop()
+    print()
+    report(probe, seq, time.perf_counter() - start)
+    if args.csv:
+        with open(args.csv, 'w') as f:
+            f.write('seq,' + ','.join(PARTS) + '\n')
+            for s in probe.samples:
+                f.write('{},{}\n'.format(s[0], ','.join('{:.1f}'.format(v) for v in s[1:])))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,274 @@
+""" Decode the binary log of the firmware """
+##############################################################
+# Binary Log Decoder (see src/binLog.h)
+#
+# The firmware sends log entries as frames, the format strings
+# stay in the image: the format id of an entry is the offset of
+# its format string from the symbol g_LogAnchor, the text is
+# read from the ELF of the same build.
+#
+#   frame: A5 5A len entry xor(entry)
+#   entry: u32 us, i32 format id, u8 category << 4 | level,
+#          arguments: tag + data
+#            1: int32, 2: int64, 3: double, 4: len + bytes
+#
+# Bytes outside of frames (boot messages, crash dumps) are
+# passed through as text.
+#
+# Usage:
+#   python tools/logdecode.py .pio/build/<env>/firmware.elf log.bin
+#   mosquitto_sub -t <PREFIX>/log -N | python tools/logdecode.py firmware.elf
+#   python tools/logdecode.py firmware.elf --serial /dev/ttyUSB0
+#
+# No dependencies (pyserial for --serial only).
+#
+##############################################################
+# Copyright (C) 2022  Dario Carluccio
+##############################################################
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+ANCHOR = 'g_LogAnchor'
+SYNC = b'\xa5\x5a'
+HEADER = struct.Struct('<IiB')
+CATEGORIES = ['MAIN', 'SETUP', 'NET', 'MQTT', 'IRQ', 'PARSER']
+LEVELS = ['-', 'E', 'I', 'D']
+
+SHT_SYMTAB = 2
+SHT_NOBITS = 8
+SHF_ALLOC = 2
+
+# printf conversion: flags, width, precision, length, type
+SPEC = re.compile(r'%([-+ #0]*)(\d*)(\.\d+)?(?:hh|h|ll|l|z|j|t|L)?([diouxXeEfgGcsp%])')
+
+
+class Elf:
+    """ Allocated sections and the symbol table of an ELF32 / ELF64 (little endian) """
+
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+        d = self.data
+        if d[:4] != b'\x7fELF' or d[5] != 1:
+            raise ValueError('{}: no little endian ELF'.format(path))
+        is64 = (d[4] == 2)
+        if is64:
+            shoff, = struct.unpack_from('<Q', d, 0x28)
+            shentsize, shnum, shstrndx = struct.unpack_from('<HHH', d, 0x3a)
+            shdr = struct.Struct('<IIQQQQIIQQ')
+            sym = struct.Struct('<IBBHQQ')
+        else:
+            shoff, = struct.unpack_from('<I', d, 0x20)
+            shentsize, shnum, shstrndx = struct.unpack_from('<HHH', d, 0x2e)
+            shdr = struct.Struct('<IIIIIIIIII')
+            sym = struct.Struct('<IIIBBH')
+        self.sections = []
+        for i in range(shnum):
+            name, typ, flags, addr, offset, size, link, _, _, entsize = shdr.unpack_from(d, shoff + i * shentsize)
+            self.sections.append((typ, flags, addr, offset, size, link, entsize))
+        self.symbols = {}
+        for typ, _, _, offset, size, link, entsize in self.sections:
+            if typ != SHT_SYMTAB:
+                continue
+            stroff = self.sections[link][3]
+            for at in range(offset, offset + size, entsize):
+                if is64:
+                    name, _, _, _, value, _ = sym.unpack_from(d, at)
+                else:
+                    name, value, _, _, _, _ = sym.unpack_from(d, at)
+                end = d.index(b'\0', stroff + name)
+                self.symbols[d[stroff + name:end].decode('ascii', 'replace')] = value
+
+    def string(self, addr):
+        """ C string at a virtual address, None if no section holds it """
+        for typ, flags, start, offset, size, _, _ in self.sections:
+            if (flags & SHF_ALLOC) and typ != SHT_NOBITS and start <= addr < start + size:
+                at = offset + addr - start
+                end = self.data.find(b'\0', at, offset + size)
+                return self.data[at:end if end >= 0 else offset + size].decode('utf-8', 'replace')
+        return None
+
+
+def unpack_args(entry):
+    """ arguments of an entry, None if malformed """
+    args = []
+    at = HEADER.size
+    while at < len(entry):
+        tag = entry[at]
+        at += 1
+        if tag == 1 and at + 4 <= len(entry):
+            args.append(struct.unpack_from('<i', entry, at)[0])
+            at += 4
+        elif tag == 2 and at + 8 <= len(entry):
+            args.append(struct.unpack_from('<q', entry, at)[0])
+            at += 8
+        elif tag == 3 and at + 8 <= len(entry):
+            args.append(struct.unpack_from('<d', entry, at)[0])
+            at += 8
+        elif tag == 4 and at < len(entry):
+            n = entry[at]
+            args.append(entry[at + 1:at + 1 + n].decode('utf-8', 'replace'))
+            at += 1 + n
+        else:
+            return None
+    return args
+
+
+def format_c(fmt, args):
+    """ printf of the firmware in Python (length modifiers dropped) """
+    out = []
+    pos = 0
+    rest = list(args)
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, prec, conv = m.groups()
+        if conv == '%':
+            out.append('%')
+            continue
+        if not rest:
+            out.append(m.group(0))
+            continue
+        v = rest.pop(0)
+        spec = '%' + flags + width + (prec or '')
+        if conv == 'p':
+            out.append('0x%x' % (v & 0xffffffffffffffff))
+        elif conv == 's':
+            out.append((spec + 's') % (v,))
+        elif conv == 'c':
+            out.append((spec + 'c') % (chr(v & 0xff),))
+        elif conv in 'uoxX':
+            bits = 64 if (isinstance(v, int) and (v < -0x80000000 or v > 0xffffffff)) else 32
+            out.append((spec + ('d' if conv == 'u' else conv)) % (int(v) & ((1 << bits) - 1),))
+        elif conv in 'di':
+            out.append((spec + 'd') % (int(v),))
+        else:
+            out.append((spec + conv) % (float(v),))
+    out.append(fmt[pos:])
+    if rest:
+        out.append(' [+{}]'.format(rest))
+    return ''.join(out)
+
+
+class Decoder:
+    """ frames to text lines, other bytes passed through """
+
+    def __init__(self, elf):
+        self.elf = elf
+        self.anchor = elf.symbols.get(ANCHOR)
+        if self.anchor is None:
+            raise ValueError('symbol {} not found (ELF of another build?)'.format(ANCHOR))
+        self.buf = bytearray()
+        self.text = bytearray()
+        self.frames = 0
+        self.errors = 0
+
+    def entry(self, entry):
+        us, fmt_id, cat_level = HEADER.unpack_from(entry)
+        cat = cat_level >> 4
+        level = cat_level & 0x0f
+        fmt = self.elf.string(self.anchor + fmt_id)
+        args = unpack_args(entry)
+        if fmt is None or args is None:
+            text = '?? format id {} args {}'.format(fmt_id, entry[HEADER.size:].hex())
+        else:
+            text = format_c(fmt, args)
+        return '{:12.6f} {:<6} {} {}'.format(us / 1e6, CATEGORIES[cat] if cat < len(CATEGORIES) else cat,
+                                              LEVELS[level] if level < len(LEVELS) else level, text)
+
+    def passthrough(self, data):
+        lines = []
+        self.text += data
+        while b'\n' in self.text:
+            line, _, rest = self.text.partition(b'\n')
+            self.text = bytearray(rest)
+            lines.append(line.decode('utf-8', 'replace').rstrip('\r'))
+        return lines
+
+    def feed(self, data):
+        """ new bytes, returns the complete lines """
+        lines = []
+        self.buf += data
+        while True:
+            at = self.buf.find(SYNC)
+            if at < 0:
+                # keep a trailing A5, it may be the start of a frame
+                keep = 1 if self.buf.endswith(SYNC[:1]) else 0
+                lines += self.passthrough(self.buf[:len(self.buf) - keep])
+                del self.buf[:len(self.buf) - keep]
+                return lines
+            lines += self.passthrough(self.buf[:at])
+            del self.buf[:at]
+            if len(self.buf) < 3 or len(self.buf) < 4 + self.buf[2]:
+                return lines
+            n = self.buf[2]
+            entry = bytes(self.buf[3:3 + n])
+            x = 0
+            for b in entry:
+                x ^= b
+            if n < HEADER.size or x != self.buf[3 + n]:
+                # noise: the sync bytes are text, look for the next one
+                self.errors += 1
+                lines += self.passthrough(self.buf[:1])
+                del self.buf[:1]
+                continue
+            if self.text:
+                lines.append(self.text.decode('utf-8', 'replace'))
+                self.text = bytearray()
+            lines.append(self.entry(entry))
+            self.frames += 1
+            del self.buf[:4 + n]
+
+    def close(self):
+        rest = bytes(self.buf + self.text)
+        self.buf = bytearray()
+        self.text = bytearray()
+        return [rest.decode('utf-8', 'replace')] if rest else []
+
+
+def chunks(args):
+    if args.serial:
+        import serial
+        port = serial.Serial(args.serial, args.baud, timeout=0.1)
+        while True:
+            data = port.read(4096)
+            if data:
+                yield data
+    else:
+        fd = os.open(args.input, os.O_RDONLY) if args.input != '-' else sys.stdin.fileno()
+        while True:
+            data = os.read(fd, 65536)
+            if not data:
+                return
+            yield data
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode the binary log of the firmware')
+    parser.add_argument('elf', help='firmware.elf of the running build')
+    parser.add_argument('input', nargs='?', default='-', help='capture (UART or TOPIC_LOG), default stdin')
+    parser.add_argument('--serial', metavar='PORT', help='read a serial port (pyserial)')
+    parser.add_argument('--baud', type=int, default=115200)
+    args = parser.parse_args()
+    try:
+        decoder = Decoder(Elf(args.elf))
+    except (OSError, ValueError) as e:
+        sys.exit('logdecode: {}'.format(e))
+    try:
+        for data in chunks(args):
+            for line in decoder.feed(data):
+                print(line, flush=True)
+    except KeyboardInterrupt:
+        pass
+    for line in decoder.close():
+        print(line)
+    if decoder.errors:
+        print('logdecode: {} frames, {} bad frames'.format(decoder.frames, decoder.errors), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,492 @@
+""" Delta OTA: patch between two firmware images, send it over MQTT """
+##############################################################
+# Delta OTA (see src/otaDelta.h)
+#
+# The device rebuilds the new image from the running one, so
+# only what changed goes over the air. Releases are kept in
+# releases/<version>_<target>/firmware.bin (copy_bin_2_release.py),
+# the patch goes next to the new one:
+#
+#   releases/1.0.7_OTA-Prod/firmware-from-1.0.6_OTA-Prod.delta
+#
+# Patch (little endian, numbers are LEB128 varints):
+#   header  "HDLT" version flags, heatshrink W << 4 | L, 0,
+#           base size, new size (u32), base MD5, new MD5
+#   COPY    0x01 len seek: base cursor += seek (zigzag), then
+#           pairs until len bytes are out: same (copied), n > 0
+#           diffs (new = base + diff, mod 256)
+#   DATA    0x02 len bytes
+#   END     0x00
+#   flags   1: full image (no base), 2: ops heatshrink compressed
+#
+# Matches are found with an index of 16 byte windows of the
+# old image and extended with mismatches (bsdiff style), so
+# code that only moved (new addresses in the instructions)
+# costs a few diff bytes instead of a full copy. The ops are
+# heatshrink compressed (LZSS, window 2^W, lookahead 2^L; the
+# device decompresses with a 2^W byte window), --raw turns it
+# off, ops it does not make smaller stay raw. "full" packs a
+# whole image the same way, for a device whose running
+# release is not known.
+#
+# "send" keeps as many chunks in flight as the device has
+# room for (F of "ack N F"), a chunk not answered within 5 s
+# is sent again from N.
+#
+# Usage:
+#   python tools/otadelta.py make releases/1.0.6_OTA-Prod releases/1.0.7_OTA-Prod
+#   python tools/otadelta.py full releases/1.0.7_OTA-Prod
+#   python tools/otadelta.py apply releases/1.0.6_OTA-Prod patch.delta new.bin
+#   python tools/otadelta.py send patch.delta --broker mqtt.example.de --prefix esp32/hello-ota
+#
+# No dependencies (paho-mqtt for send only).
+#
+##############################################################
+# Copyright (C) 2022  Dario Carluccio
+##############################################################
+
+import argparse
+import hashlib
+import os
+import struct
+import sys
+import time
+
+MAGIC = b'HDLT'
+VERSION = 1
+HEADER = struct.Struct('<4sBBBxII16s16s')
+FLAG_FULL = 0x01
+FLAG_HEATSHRINK = 0x02
+OP_END = 0x00
+OP_COPY = 0x01
+OP_DATA = 0x02
+
+WINDOW = 16                 # bytes of an index key
+STEP = 4                    # old image positions indexed
+MIN_MATCH = 24              # shorter exact matches go as DATA
+SLACK = 64                  # bytes past the best score before the extension stops
+MIN_SAME = 4                # shorter runs of equal bytes stay in the diff
+HS_WINDOW = 11              # heatshrink W (<= OTA_HS_WINDOW_MAX of the device)
+HS_LOOKAHEAD = 4            # heatshrink L
+HS_CHAIN = 8                # match candidates tried per position
+CHUNK = 1536                # OTA_DELTA_CHUNK
+ACK_TIMEOUT = 5.0           # seconds before a chunk is sent again
+
+
+def image(path):
+    """ firmware.bin of a release directory, or the file itself """
+    if os.path.isdir(path):
+        path = os.path.join(path, 'firmware.bin')
+    with open(path, 'rb') as f:
+        return f.read()
+
+
+def varint(n):
+    out = bytearray()
+    while True:
+        b = n & 0x7f
+        n >>= 7
+        if n:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def zigzag(v):
+    return ((v << 1) ^ (v >> 31)) & 0xffffffff
+
+
+def read_varint(data, at):
+    n = shift = 0
+    while True:
+        b = data[at]
+        at += 1
+        n |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            return n, at
+
+
+class Delta:
+    """ greedy matcher: exact seed, extended forward with mismatches """
+
+    def __init__(self, old, new):
+        self.old = old
+        self.new = new
+        self.index = {}
+        for i in range(0, len(old) - WINDOW + 1, STEP):
+            self.index.setdefault(old[i:i + WINDOW], i)
+        self.ops = []       # (OP_COPY, new start, old start, len) / (OP_DATA, new start, len)
+
+    def seed(self, i, last):
+        """ old position of an exact match at new[i], the last offset first """
+        old, new = self.old, self.new
+        if last is not None and 0 <= i + last <= len(old) - WINDOW and old[i + last:i + last + WINDOW] == new[i:i + WINDOW]:
+            return i + last
+        for k in range(STEP):
+            j = self.index.get(new[i - k:i - k + WINDOW]) if i >= k else None
+            if j is not None and new[i - k:i - k + WINDOW] == old[j:j + WINDOW]:
+                return j + k
+        return None
+
+    def extend(self, i, j):
+        """ length of the copy new[i:] from old[j:]: exact, then with mismatches """
+        old, new = self.old, self.new
+        n = 0
+        limit = min(len(new) - i, len(old) - j)
+        while n < limit and old[j + n] == new[i + n]:
+            n += 1
+        if n < MIN_MATCH:
+            return n
+        best, score, best_score = n, 0, 0
+        k = n
+        while k < limit and k - best <= SLACK:
+            score += 1 if old[j + k] == new[i + k] else -1
+            k += 1
+            if score > best_score:
+                best, best_score = k, score
+        return best
+
+    def run(self):
+        new = self.new
+        i = data = 0
+        last = None
+        while i <= len(new) - WINDOW:
+            j = self.seed(i, last)
+            n = self.extend(i, j) if j is not None else 0
+            if n < MIN_MATCH:
+                i += 1
+                continue
+            # grow the match backwards into the pending data
+            while i > data and j > 0 and self.old[j - 1] == new[i - 1]:
+                i -= 1
+                j -= 1
+                n += 1
+            if i > data:
+                self.ops.append((OP_DATA, data, i - data))
+            self.ops.append((OP_COPY, i, j, n))
+            last = j - i
+            i += n
+            data = i
+        if data < len(new):
+            self.ops.append((OP_DATA, data, len(new) - data))
+        return self
+
+    def pairs(self, i, j, n):
+        """ same / diff runs of a copy """
+        d = bytes((self.new[i + k] - self.old[j + k]) & 0xff for k in range(n))
+        out = bytearray()
+        k = 0
+        while k < n:
+            same = k
+            while k < n and d[k] == 0:
+                k += 1
+            out += varint(k - same)
+            if k == n:
+                break
+            start = k
+            while k < n:
+                if d[k] == 0:
+                    run = k
+                    while run < n and d[run] == 0 and run - k < MIN_SAME:
+                        run += 1
+                    if run - k >= MIN_SAME or run == n:
+                        break
+                    k = run
+                else:
+                    k += 1
+            out += varint(k - start) + d[start:k]
+        return bytes(out)
+
+    def ops_bytes(self):
+        new = self.new
+        out = bytearray()
+        cursor = 0
+        for op in self.ops:
+            if op[0] == OP_COPY:
+                _, i, j, n = op
+                out += bytes([OP_COPY]) + varint(n) + varint(zigzag(j - cursor)) + self.pairs(i, j, n)
+                cursor = j + n
+            else:
+                _, i, n = op
+                out += bytes([OP_DATA]) + varint(n) + new[i:i + n]
+        out.append(OP_END)
+        return bytes(out)
+
+
+def full_ops(new):
+    """ a whole image: one DATA op """
+    return bytes([OP_DATA]) + varint(len(new)) + new + bytes([OP_END])
+
+
+class BitWriter:
+    def __init__(self):
+        self.out = bytearray()
+        self.acc = 0
+        self.n = 0
+
+    def put(self, value, bits):
+        self.acc = (self.acc << bits) | value
+        self.n += bits
+        while self.n >= 8:
+            self.n -= 8
+            self.out.append((self.acc >> self.n) & 0xff)
+        self.acc &= (1 << self.n) - 1
+
+    def bytes(self):
+        return bytes(self.out + (bytes([(self.acc << (8 - self.n)) & 0xff]) if self.n else b''))
+
+
+def heatshrink(data, w=HS_WINDOW, l=HS_LOOKAHEAD):
+    """ heatshrink (LZSS) encoder: tag 1 + literal, tag 0 + index (w bits) + count (l bits) """
+    window, longest = 1 << w, 1 << l
+    shortest = max(3, (1 + w + l) // 9 + 1)   # a backref has to be shorter than the literals
+    bits = BitWriter()
+    heads = {}
+    i, n = 0, len(data)
+    while i < n:
+        best, dist = 0, 0
+        chain = heads.get(data[i:i + 3]) if i + 3 <= n else None
+        if chain:
+            limit = min(longest, n - i)
+            for j in reversed(chain[-HS_CHAIN:]):
+                if i - j > window:
+                    break
+                k = 3
+                while k < limit and data[j + k] == data[i + k]:
+                    k += 1
+                if k > best:
+                    best, dist = k, i - j
+                    if k == limit:
+                        break
+        step = best if best >= shortest else 1
+        if step > 1:
+            bits.put(0, 1)
+            bits.put(dist - 1, w)
+            bits.put(best - 1, l)
+        else:
+            bits.put(0x100 | data[i], 9)
+        for k in range(i, min(i + step, n - 2)):
+            chain = heads.setdefault(data[k:k + 3], [])
+            chain.append(k)
+            if len(chain) > 4 * HS_CHAIN:
+                del chain[:-HS_CHAIN]
+        i += step
+    return bits.bytes()
+
+
+def unshrink(data, w, l):
+    """ heatshrink decoder (reference) """
+    out = bytearray()
+    acc = nbits = at = 0
+
+    def get(count):
+        nonlocal acc, nbits, at
+        while nbits < count:
+            if at == len(data):
+                return None
+            acc = (acc << 8) | data[at]
+            at += 1
+            nbits += 8
+        nbits -= count
+        v = (acc >> nbits) & ((1 << count) - 1)
+        acc &= (1 << nbits) - 1
+        return v
+
+    while True:
+        tag = get(1)
+        if tag is None:
+            return bytes(out)
+        if tag:
+            v = get(8)
+            if v is None:
+                return bytes(out)
+            out.append(v)
+            continue
+        index, count = get(w), get(l)
+        if index is None or count is None:
+            return bytes(out)
+        for _ in range(count + 1):
+            out.append(out[len(out) - index - 1] if len(out) > index else 0)
+
+
+def pack(old, new, ops, compress, full):
+    """ header + ops (raw if heatshrink does not make them smaller) """
+    if compress:
+        shrunk = heatshrink(ops)
+        compress = len(shrunk) < len(ops)
+        ops = shrunk if compress else ops
+    flags = (FLAG_FULL if full else 0) | (FLAG_HEATSHRINK if compress else 0)
+    hs = (HS_WINDOW << 4 | HS_LOOKAHEAD) if compress else 0
+    header = HEADER.pack(MAGIC, VERSION, flags, hs, len(old), len(new), hashlib.md5(old).digest(),
+                         hashlib.md5(new).digest())
+    return header + ops
+
+
+def apply(old, patch):
+    """ reference decoder (same checks as the device) """
+    magic, version, flags, hs, base_size, new_size, base_md5, new_md5 = HEADER.unpack_from(patch)
+    if magic != MAGIC or version != VERSION or flags & ~(FLAG_FULL | FLAG_HEATSHRINK):
+        raise ValueError('no delta patch')
+    if flags & FLAG_FULL:
+        old = b''
+    elif len(old) != base_size or hashlib.md5(old).digest() != base_md5:
+        raise ValueError('patch is for another base image')
+    if flags & FLAG_HEATSHRINK:
+        patch = patch[:HEADER.size] + unshrink(patch[HEADER.size:], hs >> 4, hs & 0x0f)
+    out = bytearray()
+    at = HEADER.size
+    cursor = 0
+    while True:
+        op = patch[at]
+        at += 1
+        if op == OP_END:
+            break
+        n, at = read_varint(patch, at)
+        if op == OP_DATA:
+            out += patch[at:at + n]
+            at += n
+            continue
+        if op != OP_COPY:
+            raise ValueError('bad op {} at {}'.format(op, at - 1))
+        seek, at = read_varint(patch, at)
+        cursor = (cursor + ((seek >> 1) ^ -(seek & 1))) & 0xffffffff
+        while n:
+            same, at = read_varint(patch, at)
+            out += old[cursor:cursor + same]
+            cursor += same
+            n -= same
+            if not n:
+                break
+            diff, at = read_varint(patch, at)
+            out += bytes((old[cursor + k] + patch[at + k]) & 0xff for k in range(diff))
+            cursor += diff
+            at += diff
+            n -= diff
+    if at != len(patch):
+        raise ValueError('data after the end')
+    if cursor > len(old):
+        raise ValueError('base out of range')
+    if len(out) != new_size or hashlib.md5(out).digest() != new_md5:
+        raise ValueError('MD5 mismatch')
+    return bytes(out)
+
+
+def send(args):
+    import paho.mqtt.client as mqtt
+    with open(args.patch, 'rb') as f:
+        patch = f.read()
+    answers = []
+    client = mqtt.Client()
+    if args.user:
+        client.username_pw_set(args.user, args.password)
+    client.on_message = lambda c, u, m: answers.append(m.payload.decode('ascii', 'replace'))
+    client.connect(args.broker, args.port)
+    client.subscribe(args.prefix + '/otaack')
+    client.loop_start()
+    start = time.time()
+    acked, free = 0, 1          # "ack N F" of the device (before the first one: the header chunk)
+    offset = resends = 0
+    answer = ''
+    try:
+        while True:
+            # fill the window
+            while offset < len(patch) and offset < acked + free * args.chunk + (HEADER.size if not acked else 0):
+                chunk = patch[offset:offset + args.chunk + (HEADER.size if offset == 0 else 0)]
+                client.publish(args.prefix + '/ota', struct.pack('<I', offset) + chunk)
+                offset += len(chunk)
+            deadline = time.time() + ACK_TIMEOUT
+            while not answers and time.time() < deadline:
+                time.sleep(0.002)
+            if not answers:
+                resends += 1
+                offset = acked
+                continue
+            answer = answers.pop(0)
+            if answer.startswith('error'):
+                sys.exit('otadelta: device: {}'.format(answer))
+            if answer.startswith('done'):
+                break
+            acked, free = (int(v) for v in answer.split()[1:3])
+            offset = max(offset, acked)
+            rate = acked / max(time.time() - start, 1e-3)
+            print('\r{:7d} / {} bytes, {:.0f} B/s'.format(acked, len(patch), rate), end='', flush=True)
+    finally:
+        client.loop_stop()
+    t = time.time() - start
+    print('\n{} ({} bytes in {:.1f} s, {:.0f} B/s, {} timeouts)'.format(answer, len(patch), t, len(patch) / t,
+                                                                      resends))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Delta OTA: make, check and send patches')
+    sub = parser.add_subparsers(dest='cmd', required=True)
+    p = sub.add_parser('make', help='patch OLD -> NEW (firmware.bin or release directory)')
+    p.add_argument('old')
+    p.add_argument('new')
+    p.add_argument('-o', '--output', help='default: NEW/firmware-from-<OLD>.delta')
+    p.add_argument('--raw', action='store_true', help='no heatshrink')
+    p = sub.add_parser('full', help='whole image NEW, compressed (firmware.bin or release directory)')
+    p.add_argument('new')
+    p.add_argument('-o', '--output', help='default: NEW/firmware.full')
+    p.add_argument('--raw', action='store_true', help='no heatshrink')
+    p = sub.add_parser('apply', help='rebuild NEW from OLD and PATCH (check)')
+    p.add_argument('old')
+    p.add_argument('patch')
+    p.add_argument('output', nargs='?')
+    p = sub.add_parser('send', help='stream PATCH to the device (paho-mqtt)')
+    p.add_argument('patch')
+    p.add_argument('--broker', required=True)
+    p.add_argument('--port', type=int, default=1883)
+    p.add_argument('--prefix', required=True, help='MQTT_PREFIX of the device')
+    p.add_argument('--user')
+    p.add_argument('--password')
+    p.add_argument('--chunk', type=int, default=CHUNK, help='OTA_DELTA_CHUNK of the device')
+    args = parser.parse_args()
+
+    try:
+        if args.cmd == 'make':
+            old, new = image(args.old), image(args.new)
+            t = time.time()
+            patch = pack(old, new, Delta(old, new).run().ops_bytes(), not args.raw, False)
+            if apply(old, patch) != new:
+                sys.exit('otadelta: patch check failed')
+            out = args.output
+            if not out:
+                name = os.path.basename(os.path.normpath(args.old))
+                if not os.path.isdir(args.old):
+                    name = os.path.splitext(name)[0]
+                base = args.new if os.path.isdir(args.new) else os.path.dirname(args.new)
+                out = os.path.join(base, 'firmware-from-{}.delta'.format(name))
+            with open(out, 'wb') as f:
+                f.write(patch)
+            print('{}: {} bytes ({:.1f} % of {}), {:.1f} s'.format(out, len(patch), 100.0 * len(patch) / len(new),
+                                                                    len(new), time.time() - t))
+        elif args.cmd == 'full':
+            new = image(args.new)
+            t = time.time()
+            patch = pack(b'', new, full_ops(new), not args.raw, True)
+            if apply(b'', patch) != new:
+                sys.exit('otadelta: patch check failed')
+            out = args.output or os.path.join(args.new if os.path.isdir(args.new) else os.path.dirname(args.new),
+                                              'firmware.full')
+            with open(out, 'wb') as f:
+                f.write(patch)
+            print('{}: {} bytes ({:.1f} % of {}), {:.1f} s'.format(out, len(patch), 100.0 * len(patch) / len(new),
+                                                                    len(new), time.time() - t))
+        elif args.cmd == 'apply':
+            with open(args.patch, 'rb') as f:
+                new = apply(image(args.old), f.read())
+            if args.output:
+                with open(args.output, 'wb') as f:
+                    f.write(new)
+            print('ok: {} bytes, MD5 {}'.format(len(new), hashlib.md5(new).hexdigest()))
+        else:
+            send(args)
+    except (OSError, ValueError) as e:
+        sys.exit('otadelta: {}'.format(e))
+
+
+if __name__ == '__main__':
+    main()